@@ -32,12 +32,16 @@
 namespace crnlib
 {
     crn_comp::crn_comp() :
-        m_pParams(nullptr)
+        m_pParams(nullptr),
+        m_slice_height(0),
+        m_total_blocks(0),
+        m_blocks(nullptr)
     {
     }
 
     crn_comp::~crn_comp()
     {
+        crnlib_free(m_blocks);
     }
 
     bool crn_comp::pack_color_endpoints(crnlib::vector<uint8>& packed_data, const crnlib::vector<uint16>& remapping)
@@ -292,8 +296,15 @@ namespace crnlib
         return true;
     }
 
+    uint crn_comp::get_num_slices(uint level) const
+    {
+        return m_slice_height ? m_pParams->m_faces * ((m_levels[level].block_height + m_slice_height - 1) / m_slice_height) : 1;
+    }
+
     bool crn_comp::pack_blocks(
         uint group,
+        uint first_row,
+        uint end_row,
         bool clear_histograms,
         symbol_codec* pCodec,
         const crnlib::vector<uint16>* pColor_endpoint_remap,
@@ -359,7 +370,7 @@ namespace crnlib
         }
 
         uint block_width = m_levels[group].block_width;
-        for (uint by = 0, b = m_levels[group].first_block, bEnd = b + m_levels[group].num_blocks; b < bEnd; by++)
+        for (uint by = first_row, b = m_levels[group].first_block + first_row * block_width, bEnd = m_levels[group].first_block + end_row * block_width; b < bEnd; by++)
         {
             for (uint bx = 0; bx < block_width; bx++, b++)
             {
@@ -457,6 +468,7 @@ namespace crnlib
         {
             uint blockHeight = ((math::maximum(1U, m_pParams->m_height >> level) + 7) & ~7) >> 2;
             m_levels[level].block_width = ((math::maximum(1U, m_pParams->m_width >> level) + 7) & ~7) >> (m_has_subblocks ? 1 : 2);
+            m_levels[level].block_height = blockHeight;
             m_levels[level].first_block = m_total_blocks;
             m_levels[level].num_blocks = m_pParams->m_faces * m_levels[level].block_width * blockHeight;
             m_total_blocks += m_levels[level].num_blocks;
@@ -465,9 +477,39 @@ namespace crnlib
         return true;
     }
 
+    void crn_comp::extract_blocks()
+    {
+        m_blocks = (color_quad_u8(*)[16])crnlib_malloc(m_total_blocks * 16 * sizeof(color_quad_u8));
+        for (uint b = 0, level = 0; level < m_pParams->m_levels; level++)
+        {
+            for (uint face = 0; face < m_pParams->m_faces; face++)
+            {
+                image_u8& image = m_images[face][level];
+                uint width = image.get_width();
+                uint height = image.get_height();
+                uint blockWidth = ((width + 7) & ~7) >> 2;
+                uint blockHeight = ((height + 7) & ~7) >> 2;
+                for (uint by = 0; by < blockHeight; by++)
+                {
+                    for (uint y0 = by << 2, bx = 0; bx < blockWidth; bx++, b++)
+                    {
+                        for (uint t = 0, x0 = bx << 2, dy = 0; dy < 4; dy++)
+                        {
+                            for (uint y = math::minimum<uint>(y0 + dy, height - 1), dx = 0; dx < 4; dx++, t++)
+                            {
+                                m_blocks[b][t] = image(math::minimum<uint>(x0 + dx, width - 1), y);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
     void crn_comp::clear()
     {
         m_pParams = nullptr;
+        m_task_pool.deinit();
 
         for (uint f = 0; f < cCRNMaxFaces; f++)
         {
@@ -477,13 +519,27 @@ namespace crnlib
             }
         }
 
-        utils::zero_object(m_has_comp);
         m_has_etc_color_blocks = false;
         m_has_subblocks = false;
 
         m_levels.clear();
+        m_slice_height = 0;
 
         m_total_blocks = 0;
+        crnlib_free(m_blocks);
+        m_blocks = nullptr;
+
+        m_hvq.clear();
+
+        clear_pass();
+    }
+
+    // Resets everything that depends on the quality level, keeping the aliased images, the extracted blocks
+    // and the tile analysis cached by m_hvq for the next trial of the bitrate search.
+    void crn_comp::clear_pass()
+    {
+        utils::zero_object(m_has_comp);
+
         m_color_endpoints.clear();
         m_alpha_endpoints.clear();
         m_color_selectors.clear();
@@ -495,8 +551,6 @@ namespace crnlib
 
         m_comp_data.clear();
 
-        m_hvq.clear();
-
         m_reference_hist.clear();
         m_reference_dm.clear();
         for (uint i = 0; i < 2; i++)
@@ -585,6 +639,7 @@ namespace crnlib
         }
 
         params.m_hierarchical = (m_pParams->m_flags & cCRNCompFlagHierarchical) != 0;
+        params.m_slice_height = m_slice_height;
         params.m_perceptual = (m_pParams->m_flags & cCRNCompFlagPerceptual) != 0;
 
         params.m_pProgress_func = m_pParams->m_pProgress_func;
@@ -702,7 +757,8 @@ namespace crnlib
         }
         }
         params.m_debugging = (m_pParams->m_flags & cCRNCompFlagDebugging) != 0;
-        params.m_pTask_pool = &m_task_pool;
+        params.m_pTask_pool = m_task_pool.get();
+        params.m_num_helper_threads = m_pParams->m_num_helper_threads;
 
         params.m_num_levels = m_pParams->m_levels;
         for (uint i = 0; i < m_pParams->m_levels; i++)
@@ -714,36 +770,83 @@ namespace crnlib
         }
         params.m_num_faces = m_pParams->m_faces;
         params.m_num_blocks = m_total_blocks;
-        color_quad_u8(*blocks)[16] = (color_quad_u8(*)[16])crnlib_malloc(params.m_num_blocks * 16 * sizeof(color_quad_u8));
-        for (uint b = 0, level = 0; level < m_pParams->m_levels; level++)
+        return m_hvq.compress(m_blocks, m_endpoint_indices, m_selector_indices, m_color_endpoints, m_alpha_endpoints, m_color_selectors, m_alpha_selectors, params);
+    }
+
+    // Symmetric co-occurrence counts of adjacent endpoint indices, stored as compressed sparse rows.
+    // Most endpoint pairs are never adjacent, so this replaces the n * n histogram used by the remapping heuristics.
+    class endpoint_adjacency
+    {
+    public:
+        // Each pair holds two endpoint indices packed as (i << 16) | j, and is counted in both rows.
+        void init(uint16 n, const crnlib::vector<uint32>& pairs)
         {
-            for (uint face = 0; face < m_pParams->m_faces; face++)
+            m_row_begin.resize(0);
+            m_row_begin.resize(n + 1);
+            for (uint p = 0; p < pairs.size(); p++)
             {
-                image_u8& image = m_images[face][level];
-                uint width = image.get_width();
-                uint height = image.get_height();
-                uint blockWidth = ((width + 7) & ~7) >> 2;
-                uint blockHeight = ((height + 7) & ~7) >> 2;
-                for (uint by = 0; by < blockHeight; by++)
+                m_row_begin[pairs[p] >> 16]++;
+                m_row_begin[pairs[p] & 0xFFFF]++;
+            }
+            for (uint total = 0, i = 0; i <= n; i++)
+            {
+                uint count = m_row_begin[i];
+                m_row_begin[i] = total;
+                total += count;
+            }
+
+            crnlib::vector<uint> fill(n);
+            crnlib::vector<uint16> neighbors(pairs.size() << 1);
+            for (uint p = 0; p < pairs.size(); p++)
+            {
+                uint i = pairs[p] >> 16, j = pairs[p] & 0xFFFF;
+                neighbors[m_row_begin[i] + fill[i]++] = j;
+                neighbors[m_row_begin[j] + fill[j]++] = i;
+            }
+
+            m_neighbors.resize(0);
+            m_frequencies.resize(0);
+            for (uint i = 0; i < n; i++)
+            {
+                uint16* pBegin = neighbors.get_ptr() + m_row_begin[i];
+                uint16* pEnd = neighbors.get_ptr() + m_row_begin[i + 1];
+                std::sort(pBegin, pEnd);
+                m_row_begin[i] = m_neighbors.size();
+                for (uint16* pNeighbor = pBegin; pNeighbor != pEnd; pNeighbor++)
                 {
-                    for (uint y0 = by << 2, bx = 0; bx < blockWidth; bx++, b++)
+                    if (pNeighbor == pBegin || *pNeighbor != pNeighbor[-1])
                     {
-                        for (uint t = 0, x0 = bx << 2, dy = 0; dy < 4; dy++)
-                        {
-                            for (uint y = math::minimum<uint>(y0 + dy, height - 1), dx = 0; dx < 4; dx++, t++)
-                            {
-                                blocks[b][t] = image(math::minimum<uint>(x0 + dx, width - 1), y);
-                            }
-                        }
+                        m_neighbors.push_back(*pNeighbor);
+                        m_frequencies.push_back(0);
                     }
+                    m_frequencies.back()++;
                 }
             }
+            m_row_begin[n] = m_neighbors.size();
         }
-        bool result = m_hvq.compress(blocks, m_endpoint_indices, m_selector_indices, m_color_endpoints, m_alpha_endpoints, m_color_selectors, m_alpha_selectors, params);
-        crnlib_free(blocks);
 
-        return result;
-    }
+        uint get_row_begin(uint i) const
+        {
+            return m_row_begin[i];
+        }
+        uint get_row_end(uint i) const
+        {
+            return m_row_begin[i + 1];
+        }
+        uint16 get_neighbor(uint r) const
+        {
+            return m_neighbors[r];
+        }
+        uint get_frequency(uint r) const
+        {
+            return m_frequencies[r];
+        }
+
+    private:
+        crnlib::vector<uint> m_row_begin;
+        crnlib::vector<uint16> m_neighbors;
+        crnlib::vector<uint> m_frequencies;
+    };
 
     struct optimize_color_params
     {
@@ -752,7 +855,7 @@ namespace crnlib
             color_quad_u8 low, high;
         };
         const unpacked_endpoint* unpacked_endpoints;
-        const uint* hist;
+        const endpoint_adjacency* pAdjacency;
         uint16 n;
         uint16 selected;
         float weight;
@@ -797,11 +900,11 @@ namespace crnlib
         }
     }
 
-    static void remap_color_endpoints(uint16* remapping, const optimize_color_params::unpacked_endpoint* unpacked_endpoints, const uint* hist, uint16 n, uint16 selected, float weight)
+    static void remap_color_endpoints(uint16* remapping, const optimize_color_params::unpacked_endpoint* unpacked_endpoints, const endpoint_adjacency& adjacency, uint16 n, uint16 selected, float weight)
     {
         struct Node
         {
-            uint index, frequency, front_similarity, back_similarity;
+            uint index, front_similarity, back_similarity;
             optimize_color_params::unpacked_endpoint e;
             Node()
             {
@@ -815,12 +918,18 @@ namespace crnlib
             remaining[i].e = unpacked_endpoints[i];
         }
         crnlib::vector<uint16> chosen(n << 1);
+        crnlib::vector<uint> position(n, cUINT32_MAX);
+        crnlib::vector<uint> frequency(n);
         uint remaining_count = n, chosen_front = n, chosen_back = chosen_front;
         chosen[chosen_front] = selected;
+        position[selected] = chosen_front;
         optimize_color_params::unpacked_endpoint front_e = remaining[selected].e, back_e = front_e;
         bool front_updated = true, back_updated = true;
         remaining[selected] = remaining[--remaining_count];
-        const uint* frequency = hist + selected * n;
+        for (uint r = adjacency.get_row_begin(selected), rEnd = adjacency.get_row_end(selected); r < rEnd; r++)
+        {
+            frequency[adjacency.get_neighbor(r)] += adjacency.get_frequency(r);
+        }
 
         for (uint similarity_base = (uint)(4000 * (1.0f + weight)), frequency_normalizer = 0; remaining_count;)
         {
@@ -829,7 +938,6 @@ namespace crnlib
             for (uint i = 0; i < remaining_count; i++)
             {
                 Node& node = remaining[i];
-                node.frequency += frequency[node.index];
                 if (front_updated)
                 {
                     node.front_similarity = similarity_base - math::minimum<uint>(4000, color::elucidian_distance(node.e.low, front_e.low, false) + color::elucidian_distance(node.e.high, front_e.high, false));
@@ -838,7 +946,7 @@ namespace crnlib
                 {
                     node.back_similarity = similarity_base - math::minimum<uint>(4000, color::elucidian_distance(node.e.low, back_e.low, false) + color::elucidian_distance(node.e.high, back_e.high, false));
                 }
-                uint64 value = math::maximum(node.front_similarity, node.back_similarity) * (node.frequency + frequency_normalizer) + 1;
+                uint64 value = math::maximum(node.front_similarity, node.back_similarity) * (frequency[node.index] + frequency_normalizer) + 1;
                 if (value > best_value || (value == best_value && node.index < selected))
                 {
                     best_value = value;
@@ -846,25 +954,35 @@ namespace crnlib
                     selected = node.index;
                 }
             }
-            frequency = hist + selected * n;
+            frequency_normalizer = frequency[selected] << 3;
+            // Chosen endpoints closer to an end of the chain weigh more towards that end. Only the adjacent endpoints contribute.
             uint frequency_front = 0, frequency_back = 0;
-            for (int front = chosen_front, back = chosen_back, scale = back - front; scale > 0; front++, back--, scale -= 2)
+            int chosen_span = chosen_back - chosen_front;
+            for (uint r = adjacency.get_row_begin(selected), rEnd = adjacency.get_row_end(selected); r < rEnd; r++)
             {
-                frequency_front += scale * frequency[chosen[front]];
-                frequency_back += scale * frequency[chosen[back]];
+                uint neighbor = adjacency.get_neighbor(r), neighbor_frequency = adjacency.get_frequency(r);
+                frequency[neighbor] += neighbor_frequency;
+                if (position[neighbor] != cUINT32_MAX)
+                {
+                    int front_scale = chosen_span - 2 * (int)(position[neighbor] - chosen_front);
+                    int back_scale = chosen_span - 2 * (int)(chosen_back - position[neighbor]);
+                    frequency_front += front_scale > 0 ? front_scale * neighbor_frequency : 0;
+                    frequency_back += back_scale > 0 ? back_scale * neighbor_frequency : 0;
+                }
             }
             front_updated = back_updated = false;
             Node& best_node = remaining[best_index];
-            frequency_normalizer = best_node.frequency << 3;
             if ((uint64)best_node.front_similarity * frequency_front > (uint64)best_node.back_similarity * frequency_back)
             {
                 chosen[--chosen_front] = selected;
+                position[selected] = chosen_front;
                 front_e = best_node.e;
                 front_updated = true;
             }
             else
             {
                 chosen[++chosen_back] = selected;
+                position[selected] = chosen_back;
                 back_e = best_node.e;
                 back_updated = true;
             }
@@ -886,7 +1004,7 @@ namespace crnlib
 
         if (data)
         {
-            remap_color_endpoints(remapping.get_ptr(), pParams->unpacked_endpoints, pParams->hist, n, pParams->selected, pParams->weight);
+            remap_color_endpoints(remapping.get_ptr(), pParams->unpacked_endpoints, *pParams->pAdjacency, n, pParams->selected, pParams->weight);
         }
         else
         {
@@ -932,6 +1050,145 @@ namespace crnlib
         crnlib_delete(pParams);
     }
 
+    // Orders selectors into a greedy chain, starting from the all-zero selector: each step appends the remaining selector
+    // with the lowest error against the last one, ties going to the lowest index. find_candidates() lists the closest
+    // selectors of every selector in parallel, so most steps only walk a short list instead of scanning every remaining
+    // selector; the list is exact, so the chain is the same with or without it.
+    template <typename selector_type, typename error_func>
+    class selector_chain
+    {
+    public:
+        enum
+        {
+            cMaxCandidates = 16
+        };
+
+        selector_chain(const selector_type* pSelectors, uint16 n, const error_func& error) :
+            m_pSelectors(pSelectors),
+            m_n(n),
+            m_error(error),
+            m_num_candidates(0),
+            m_num_tasks(1),
+            m_num_scans(0)
+        {
+        }
+
+        void find_candidates(task_pool* pTask_pool, uint num_tasks)
+        {
+            m_num_candidates = math::minimum<uint>(cMaxCandidates, m_n ? m_n - 1 : 0);
+            m_candidates.resize(m_n * m_num_candidates);
+            m_num_tasks = math::maximum(1U, num_tasks);
+            for (uint i = 0; i < m_num_tasks; i++)
+            {
+                pTask_pool->queue_object_task(this, &selector_chain::find_candidates_task, i);
+            }
+            pTask_pool->join();
+        }
+
+        void order(uint16* remapping)
+        {
+            crnlib::vector<uint16> remaining(m_n), position(m_n);
+            for (uint16 i = 0; i < m_n; i++)
+            {
+                remaining[i] = position[i] = i;
+            }
+            selector_type selected_selector = 0;
+            m_num_scans = 0;
+            for (uint16 selected = 0, left = m_n; left;)
+            {
+                uint16 next = m_n;
+                if (left != m_n)
+                {
+                    for (const uint16 *pCandidate = m_candidates.get_ptr() + selected * m_num_candidates, *pEnd = pCandidate + m_num_candidates; pCandidate != pEnd; pCandidate++)
+                    {
+                        if (position[*pCandidate] != cUINT16_MAX)
+                        {
+                            next = *pCandidate;
+                            break;
+                        }
+                    }
+                }
+                if (next == m_n)
+                {
+                    m_num_scans++;
+                    for (uint min_error = cUINT32_MAX, i = 0; i < left; i++)
+                    {
+                        uint error = m_error(m_pSelectors[remaining[i]], selected_selector);
+                        if (error < min_error || (error == min_error && remaining[i] < next))
+                        {
+                            min_error = error;
+                            next = remaining[i];
+                        }
+                    }
+                }
+                selected = next;
+                selected_selector = m_pSelectors[selected];
+                remapping[selected] = m_n - left;
+                left--;
+                uint16 p = position[selected];
+                remaining[p] = remaining[left];
+                position[remaining[p]] = p;
+                position[selected] = cUINT16_MAX;
+            }
+        }
+
+        uint get_num_scans() const
+        {
+            return m_num_scans;
+        }
+
+    private:
+        const selector_type* m_pSelectors;
+        uint16 m_n;
+        error_func m_error;
+        uint m_num_candidates;
+        uint m_num_tasks;
+        crnlib::vector<uint16> m_candidates;
+        uint m_num_scans;
+
+        void find_candidates_task(uint64 data, void*)
+        {
+            uint errors[cMaxCandidates];
+            for (uint i = (uint)(m_n * data / m_num_tasks), iEnd = (uint)(m_n * (data + 1) / m_num_tasks); i < iEnd; i++)
+            {
+                // Keeps the closest selectors sorted by error, then index; the list is filled with the first ones.
+                uint16* pCandidates = m_candidates.get_ptr() + i * m_num_candidates;
+                uint num_candidates = 0, max_error = cUINT32_MAX;
+                for (uint j = 0; j < m_n; j++)
+                {
+                    uint error = m_error(m_pSelectors[j], m_pSelectors[i]);
+                    if (error >= max_error || j == i)
+                    {
+                        continue;
+                    }
+                    uint k = num_candidates < m_num_candidates ? num_candidates++ : num_candidates - 1;
+                    for (; k && errors[k - 1] > error; k--)
+                    {
+                        errors[k] = errors[k - 1];
+                        pCandidates[k] = pCandidates[k - 1];
+                    }
+                    errors[k] = error;
+                    pCandidates[k] = j;
+                    if (num_candidates == m_num_candidates)
+                    {
+                        max_error = errors[num_candidates - 1];
+                    }
+                }
+            }
+        }
+    };
+
+    struct color_selector_error
+    {
+        const uint8* pD8;
+
+        uint operator()(uint32 a, uint32 b) const
+        {
+            uint32 delta = a ^ b;
+            return pD8[delta & 0xFFFF] + pD8[delta >> 16];
+        }
+    };
+
     void crn_comp::optimize_color_selectors()
     {
         crnlib::vector<uint16>& remapping = m_selector_remaping[cColor];
@@ -940,65 +1197,58 @@ namespace crnlib
 
         uint8 d[] = { 0, 5, 14, 10 };
 
+        // The error between two selectors only depends on their xor, so it takes two lookups of 8 pixels each.
         uint8 D4[0x100];
         for (uint16 i = 0; i < 0x100; i++)
         {
-            D4[i] = d[(i ^ i >> 4) & 3] + d[(i >> 2 ^ i >> 6) & 3];
+            D4[i] = d[i & 3] + d[i >> 2 & 3] + d[i >> 4 & 3] + d[i >> 6 & 3];
         }
         uint8 D8[0x10000];
         for (uint32 i = 0; i < 0x10000; i++)
         {
-            D8[i] = D4[(i >> 8 & 0xF0) | (i >> 4 & 0xF)] + D4[(i >> 4 & 0xF0) | (i & 0xF)];
+            D8[i] = D4[i & 0xFF] + D4[i >> 8];
         }
 
-        crnlib::vector<uint32> selectors(n);
-        crnlib::vector<uint16> indices(n);
-        for (uint16 i = 0; i < n; i++)
-        {
-            selectors[i] = m_color_selectors[i];
-            indices[i] = i;
-        }
-        uint32 selected_selector = 0;
-        for (uint16 left = n; left;)
+        timer t;
+        t.start();
+        color_selector_error error = { D8 };
+        selector_chain<uint32, color_selector_error> chain(m_color_selectors.get_ptr(), n, error);
+        // Finding the candidates costs about twice the scans it saves, so it only pays off split four or more ways.
+        if (m_pParams->m_num_helper_threads >= 3)
         {
-            uint16 selected_index = 0;
-            uint min_error = cUINT32_MAX;
-            for (uint16 i = 0; i < left; i++)
-            {
-                uint32 selector = selectors[i];
-                uint8 d0 = D8[(selector >> 16 & 0xFF00) | (selected_selector >> 24 & 0xFF)];
-                uint8 d1 = D8[(selector >> 8 & 0xFF00) | (selected_selector >> 16 & 0xFF)];
-                uint8 d2 = D8[(selector & 0xFF00) | (selected_selector >> 8 & 0xFF)];
-                uint8 d3 = D8[(selector << 8 & 0xFF00) | (selected_selector & 0xFF)];
-                uint error = d0 + d1 + d2 + d3;
-                if (error < min_error)
-                {
-                    min_error = error;
-                    selected_index = i;
-                }
-            }
-            selected_selector = selectors[selected_index];
-            remapping[indices[selected_index]] = n - left;
-            left--;
-            selectors[selected_index] = selectors[left];
-            indices[selected_index] = indices[left];
+            chain.find_candidates(m_task_pool.get(), m_pParams->m_num_helper_threads + 1);
         }
+        chain.order(remapping.get_ptr());
+        double ordering_time = t.get_elapsed_secs();
 
         pack_color_selectors(m_packed_color_selectors, remapping);
+
+        if (m_pParams->m_flags & cCRNCompFlagDebugging)
+        {
+            // Compare against scanning every remaining selector at each step.
+            t.start();
+            selector_chain<uint32, color_selector_error> reference(m_color_selectors.get_ptr(), n, error);
+            crnlib::vector<uint16> reference_remapping(n);
+            reference.order(reference_remapping.get_ptr());
+            double reference_time = t.get_elapsed_secs();
+            crnlib::vector<uint8> reference_packed;
+            pack_color_selectors(reference_packed, reference_remapping);
+            console::debug("Color selector ordering: %u selectors, %u packed bytes (%+i), %3.3fs (%+3.3fs) against a full scan per step, %u steps scanned",
+                n, m_packed_color_selectors.size(), (int)m_packed_color_selectors.size() - (int)reference_packed.size(), ordering_time, ordering_time - reference_time, chain.get_num_scans());
+        }
     }
 
     void crn_comp::optimize_color()
     {
         uint16 n = m_color_endpoints.size();
-        crnlib::vector<uint> hist(n * n);
+        crnlib::vector<uint32> pairs;
         crnlib::vector<uint> sum(n);
         for (uint i, i_prev = 0, b = 0; b < m_endpoint_indices.size(); b++, i_prev = i)
         {
             i = m_endpoint_indices[b].color;
             if ((m_has_subblocks && b & 1 ? m_endpoint_indices[b].reference : !m_endpoint_indices[b].reference) && i != i_prev)
             {
-                hist[i * n + i_prev]++;
-                hist[i_prev * n + i]++;
+                pairs.push_back(i << 16 | i_prev);
                 sum[i]++;
                 sum[i_prev]++;
             }
@@ -1013,6 +1263,9 @@ namespace crnlib
                 selected = i;
             }
         }
+        endpoint_adjacency adjacency;
+        adjacency.init(n, pairs);
+        pairs.clear();
         crnlib::vector<optimize_color_params::unpacked_endpoint> unpacked_endpoints(n);
         for (uint16 i = 0; i < n; i++)
         {
@@ -1026,14 +1279,14 @@ namespace crnlib
         {
             optimize_color_params* pParams = crnlib_new<optimize_color_params>();
             pParams->unpacked_endpoints = unpacked_endpoints.get_ptr();
-            pParams->hist = hist.get_ptr();
+            pParams->pAdjacency = &adjacency;
             pParams->n = n;
             pParams->selected = selected;
             pParams->weight = weights[i];
             pParams->pResult = remapping_trial + i;
-            m_task_pool.queue_object_task(this, &crn_comp::optimize_color_endpoints_task, i, pParams);
+            m_task_pool->queue_object_task(this, &crn_comp::optimize_color_endpoints_task, i, pParams);
         }
-        m_task_pool.join();
+        m_task_pool->join();
 
         for (uint best_bits = cUINT32_MAX, i = 0; i < 4; i++)
         {
@@ -1053,7 +1306,7 @@ namespace crnlib
             uint8 low, high;
         };
         const unpacked_endpoint* unpacked_endpoints;
-        const uint* hist;
+        const endpoint_adjacency* pAdjacency;
         uint16 n;
         uint16 selected;
         float weight;
@@ -1098,24 +1351,29 @@ namespace crnlib
         }
     }
 
-    static void remap_alpha_endpoints(uint16* remapping, const optimize_alpha_params::unpacked_endpoint* unpacked_endpoints, const uint* hist, uint16 n, uint16 selected, float weight)
+    static void remap_alpha_endpoints(uint16* remapping, const optimize_alpha_params::unpacked_endpoint* unpacked_endpoints, const endpoint_adjacency& adjacency, uint16 n, uint16 selected, float weight)
     {
-        const uint* frequency = hist + selected * n;
-        crnlib::vector<uint16> chosen, remaining;
+        crnlib::vector<uint16> chosen(n << 1), remaining;
+        crnlib::vector<uint> position(n, cUINT32_MAX);
         crnlib::vector<uint> total_frequency(n);
-        chosen.push_back(selected);
+        uint chosen_front = n, chosen_back = chosen_front;
+        chosen[chosen_front] = selected;
+        position[selected] = chosen_front;
         for (uint16 i = 0; i < n; i++)
         {
             if (i != selected)
             {
                 remaining.push_back(i);
-                total_frequency[i] = frequency[i];
             }
         }
+        for (uint r = adjacency.get_row_begin(selected), rEnd = adjacency.get_row_end(selected); r < rEnd; r++)
+        {
+            total_frequency[adjacency.get_neighbor(r)] += adjacency.get_frequency(r);
+        }
         for (uint similarity_base = (uint)(1000 * (1.0f + weight)), total_frequency_normalizer = 0; remaining.size();)
         {
-            const optimize_alpha_params::unpacked_endpoint& e_front = unpacked_endpoints[chosen.front()];
-            const optimize_alpha_params::unpacked_endpoint& e_back = unpacked_endpoints[chosen.back()];
+            const optimize_alpha_params::unpacked_endpoint& e_front = unpacked_endpoints[chosen[chosen_front]];
+            const optimize_alpha_params::unpacked_endpoint& e_back = unpacked_endpoints[chosen[chosen_back]];
             uint16 selected_index = 0;
             uint64 best_value = 0, selected_similarity_front = 0, selected_similarity_back = 0;
             for (uint16 i = 0; i < remaining.size(); i++)
@@ -1136,31 +1394,36 @@ namespace crnlib
                 }
             }
             selected = remaining[selected_index];
-            frequency = hist + selected * n;
             total_frequency_normalizer = total_frequency[selected];
             uint frequency_front = 0, frequency_back = 0;
-            for (int front = 0, back = chosen.size() - 1, scale = back; scale > 0; front++, back--, scale -= 2)
+            int chosen_span = chosen_back - chosen_front;
+            for (uint r = adjacency.get_row_begin(selected), rEnd = adjacency.get_row_end(selected); r < rEnd; r++)
             {
-                frequency_front += scale * frequency[chosen[front]];
-                frequency_back += scale * frequency[chosen[back]];
+                uint neighbor = adjacency.get_neighbor(r), neighbor_frequency = adjacency.get_frequency(r);
+                total_frequency[neighbor] += neighbor_frequency;
+                if (position[neighbor] != cUINT32_MAX)
+                {
+                    int front_scale = chosen_span - 2 * (int)(position[neighbor] - chosen_front);
+                    int back_scale = chosen_span - 2 * (int)(chosen_back - position[neighbor]);
+                    frequency_front += front_scale > 0 ? front_scale * neighbor_frequency : 0;
+                    frequency_back += back_scale > 0 ? back_scale * neighbor_frequency : 0;
+                }
             }
             if (selected_similarity_front * frequency_front > selected_similarity_back * frequency_back)
             {
-                chosen.push_front(selected);
+                chosen[--chosen_front] = selected;
+                position[selected] = chosen_front;
             }
             else
             {
-                chosen.push_back(selected);
+                chosen[++chosen_back] = selected;
+                position[selected] = chosen_back;
             }
             remaining.erase(remaining.begin() + selected_index);
-            for (uint16 i = 0; i < remaining.size(); i++)
-            {
-                total_frequency[remaining[i]] += frequency[remaining[i]];
-            }
         }
-        for (uint16 i = 0; i < n; i++)
+        for (uint16 i = chosen_front; i <= chosen_back; i++)
         {
-            remapping[chosen[i]] = i;
+            remapping[chosen[i]] = i - chosen_front;
         }
     }
 
@@ -1173,7 +1436,7 @@ namespace crnlib
 
         if (data)
         {
-            remap_alpha_endpoints(remapping.get_ptr(), pParams->unpacked_endpoints, pParams->hist, n, pParams->selected, pParams->weight);
+            remap_alpha_endpoints(remapping.get_ptr(), pParams->unpacked_endpoints, *pParams->pAdjacency, n, pParams->selected, pParams->weight);
         }
         else
         {
@@ -1233,6 +1496,17 @@ namespace crnlib
         crnlib_delete(pParams);
     }
 
+    struct alpha_selector_error
+    {
+        const uint8* pD12;
+
+        uint operator()(uint64 a, uint64 b) const
+        {
+            uint64 delta = a ^ b;
+            return pD12[delta & 0xFFF] + pD12[delta >> 12 & 0xFFF] + pD12[delta >> 24 & 0xFFF] + pD12[delta >> 36 & 0xFFF];
+        }
+    };
+
     void crn_comp::optimize_alpha_selectors()
     {
         crnlib::vector<uint16>& remapping = m_selector_remaping[cAlpha0];
@@ -1241,51 +1515,44 @@ namespace crnlib
 
         uint8 d[] = { 0, 2, 3, 3, 5, 5, 4, 4 };
 
-        uint8 D6[0x1000];
+        // As for the color selectors, the error only depends on the xor of the selectors, here 4 pixels per lookup.
+        uint8 D12[0x1000];
         for (uint16 i = 0; i < 0x1000; i++)
         {
-            D6[i] = d[(i ^ i >> 6) & 7] + d[(i >> 3 ^ i >> 9) & 7];
+            D12[i] = d[i & 7] + d[i >> 3 & 7] + d[i >> 6 & 7] + d[i >> 9 & 7];
         }
 
-        crnlib::vector<uint64> selectors(n);
-        crnlib::vector<uint16> indices(n);
-        for (uint16 i = 0; i < n; i++)
-        {
-            selectors[i] = m_alpha_selectors[i];
-            indices[i] = i;
-        }
-        uint64 selected_selector = 0;
-        for (uint16 left = n; left;)
+        timer t;
+        t.start();
+        alpha_selector_error error = { D12 };
+        selector_chain<uint64, alpha_selector_error> chain(m_alpha_selectors.get_ptr(), n, error);
+        if (m_pParams->m_num_helper_threads >= 3)
         {
-            uint16 selected_index = 0;
-            uint min_error = cUINT32_MAX;
-            for (uint16 i = 0; i < left; i++)
-            {
-                uint error = 0;
-                for (uint64 selector = selectors[i] << 6, delta_selector = selected_selector, j = 0; j < 8; j++, selector >>= 6, delta_selector >>= 6)
-                {
-                    error += D6[(selector & 0xFC0) | (delta_selector & 0x3F)];
-                }
-                if (error < min_error)
-                {
-                    min_error = error;
-                    selected_index = i;
-                }
-            }
-            selected_selector = selectors[selected_index];
-            remapping[indices[selected_index]] = n - left;
-            left--;
-            selectors[selected_index] = selectors[left];
-            indices[selected_index] = indices[left];
+            chain.find_candidates(m_task_pool.get(), m_pParams->m_num_helper_threads + 1);
         }
+        chain.order(remapping.get_ptr());
+        double ordering_time = t.get_elapsed_secs();
 
         pack_alpha_selectors(m_packed_alpha_selectors, remapping);
+
+        if (m_pParams->m_flags & cCRNCompFlagDebugging)
+        {
+            t.start();
+            selector_chain<uint64, alpha_selector_error> reference(m_alpha_selectors.get_ptr(), n, error);
+            crnlib::vector<uint16> reference_remapping(n);
+            reference.order(reference_remapping.get_ptr());
+            double reference_time = t.get_elapsed_secs();
+            crnlib::vector<uint8> reference_packed;
+            pack_alpha_selectors(reference_packed, reference_remapping);
+            console::debug("Alpha selector ordering: %u selectors, %u packed bytes (%+i), %3.3fs (%+3.3fs) against a full scan per step, %u steps scanned",
+                n, m_packed_alpha_selectors.size(), (int)m_packed_alpha_selectors.size() - (int)reference_packed.size(), ordering_time, ordering_time - reference_time, chain.get_num_scans());
+        }
     }
 
     void crn_comp::optimize_alpha()
     {
         uint16 n = m_alpha_endpoints.size();
-        crnlib::vector<uint> hist(n * n);
+        crnlib::vector<uint32> pairs;
         crnlib::vector<uint> sum(n);
         bool hasAlpha0 = m_has_comp[cAlpha0], hasAlpha1 = m_has_comp[cAlpha1];
         for (uint i0, i1, i0_prev = 0, i1_prev = 0, b = 0; b < m_endpoint_indices.size(); b++, i0_prev = i0, i1_prev = i1)
@@ -1296,15 +1563,13 @@ namespace crnlib
             {
                 if (hasAlpha0 && i0 != i0_prev)
                 {
-                    hist[i0 * n + i0_prev]++;
-                    hist[i0_prev * n + i0]++;
+                    pairs.push_back(i0 << 16 | i0_prev);
                     sum[i0]++;
                     sum[i0_prev]++;
                 }
                 if (hasAlpha1 && i1 != i1_prev)
                 {
-                    hist[i1 * n + i1_prev]++;
-                    hist[i1_prev * n + i1]++;
+                    pairs.push_back(i1 << 16 | i1_prev);
                     sum[i1]++;
                     sum[i1_prev]++;
                 }
@@ -1320,6 +1585,9 @@ namespace crnlib
                 selected = i;
             }
         }
+        endpoint_adjacency adjacency;
+        adjacency.init(n, pairs);
+        pairs.clear();
         crnlib::vector<optimize_alpha_params::unpacked_endpoint> unpacked_endpoints(n);
         for (uint16 i = 0; i < n; i++)
         {
@@ -1333,14 +1601,14 @@ namespace crnlib
         {
             optimize_alpha_params* pParams = crnlib_new<optimize_alpha_params>();
             pParams->unpacked_endpoints = unpacked_endpoints.get_ptr();
-            pParams->hist = hist.get_ptr();
+            pParams->pAdjacency = &adjacency;
             pParams->n = n;
             pParams->selected = selected;
             pParams->weight = weights[i];
             pParams->pResult = remapping_trial + i;
-            m_task_pool.queue_object_task(this, &crn_comp::optimize_alpha_endpoints_task, i, pParams);
+            m_task_pool->queue_object_task(this, &crn_comp::optimize_alpha_endpoints_task, i, pParams);
         }
-        m_task_pool.join();
+        m_task_pool->join();
 
         for (uint best_bits = cUINT32_MAX, i = 0; i < 4; i++)
         {
@@ -1420,6 +1688,11 @@ namespace crnlib
         m_crn_header.m_levels = static_cast<uint8>(m_pParams->m_levels);
         m_crn_header.m_faces = static_cast<uint8>(m_pParams->m_faces);
         m_crn_header.m_format = static_cast<uint8>(m_pParams->m_format);
+        m_crn_header.m_flags = m_slice_height ? crnd::cCRNHeaderFlagSliced : 0;
+        if (m_pParams->m_flags & cCRNCompFlagSmallestLevelsFirst)
+        {
+            m_crn_header.m_flags = m_crn_header.m_flags | crnd::cCRNHeaderFlagSmallestLevelsFirst;
+        }
         m_crn_header.m_userdata0 = m_pParams->m_userdata0;
         m_crn_header.m_userdata1 = m_pParams->m_userdata1;
 
@@ -1466,8 +1739,9 @@ namespace crnlib
         append_vec(m_comp_data, m_packed_data_models);
 
         uint level_ofs[cCRNMaxLevels];
-        for (uint i = 0; i < m_levels.size(); i++)
+        for (uint j = 0; j < m_levels.size(); j++)
         {
+            const uint i = (m_crn_header.m_flags & crnd::cCRNHeaderFlagSmallestLevelsFirst) ? m_levels.size() - 1 - j : j;
             level_ofs[i] = m_comp_data.size();
             append_vec(m_comp_data, m_packed_blocks[i]);
         }
@@ -1484,7 +1758,7 @@ namespace crnlib
 
         const uint actual_header_size = sizeof(crnd::crn_header) + sizeof(dst_header.m_level_ofs[0]) * (m_levels.size() - 1);
 
-        dst_header.m_sig = crnd::crn_header::cCRNSigValue;
+        dst_header.m_sig = (m_crn_header.m_flags & crnd::cCRNHeaderFlagsExtended) ? crnd::crn_header::cCRNSigValueExtended : crnd::crn_header::cCRNSigValue;
 
         dst_header.m_data_size = m_comp_data.size();
         dst_header.m_data_crc16 = crc16(&m_comp_data[actual_header_size], m_comp_data.size() - actual_header_size);
@@ -1514,10 +1788,6 @@ namespace crnlib
 
     bool crn_comp::compress_internal()
     {
-        if (!alias_images())
-        {
-            return false;
-        }
         if (!quantize_images())
         {
             return false;
@@ -1548,23 +1818,53 @@ namespace crnlib
         {
             for (uint level = 0; level < m_levels.size(); level++)
             {
-                symbol_codec codec;
-                codec.start_encoding(2 * 1024 * 1024);
-
-                if (!pack_blocks(
-                        level,
-                        !pass && !level, pass ? &codec : nullptr,
-                        m_has_comp[cColor] ? &m_endpoint_remaping[cColor] : nullptr, m_has_comp[cColor] ? &m_selector_remaping[cColor] : nullptr,
-                        m_has_comp[cAlpha0] ? &m_endpoint_remaping[cAlpha0] : nullptr, m_has_comp[cAlpha0] ? &m_selector_remaping[cAlpha0] : nullptr))
+                const uint num_slices = get_num_slices(level);
+                crnlib::vector<uint8>& packed_blocks = m_packed_blocks[level];
+                packed_blocks.clear();
+                if (m_slice_height && pass)
                 {
-                    return false;
+                    packed_blocks.resize(sizeof(crnd::crn_level_slices) + sizeof(crnd::crn_packed_uint<4>) * (num_slices - 1));
+                    crnd::crn_level_slices& slices = *(crnd::crn_level_slices*)packed_blocks.get_ptr();
+                    slices.m_slice_height = m_slice_height;
+                    slices.m_num_slices = num_slices;
                 }
 
-                codec.stop_encoding(false);
-
-                if (pass)
+                for (uint slice = 0; slice < num_slices; slice++)
                 {
-                    m_packed_blocks[level].swap(codec.get_encoding_buf());
+                    uint first_row = 0;
+                    uint end_row = m_pParams->m_faces * m_levels[level].block_height;
+                    if (m_slice_height)
+                    {
+                        const uint slices_per_face = num_slices / m_pParams->m_faces;
+                        const uint face_row = slice / slices_per_face * m_levels[level].block_height;
+                        first_row = face_row + slice % slices_per_face * m_slice_height;
+                        end_row = math::minimum(first_row + m_slice_height, face_row + m_levels[level].block_height);
+                    }
+
+                    symbol_codec codec;
+                    codec.start_encoding(2 * 1024 * 1024);
+
+                    if (!pack_blocks(
+                            level, first_row, end_row,
+                            !pass && !level && !slice, pass ? &codec : nullptr,
+                            m_has_comp[cColor] ? &m_endpoint_remaping[cColor] : nullptr, m_has_comp[cColor] ? &m_selector_remaping[cColor] : nullptr,
+                            m_has_comp[cAlpha0] ? &m_endpoint_remaping[cAlpha0] : nullptr, m_has_comp[cAlpha0] ? &m_selector_remaping[cAlpha0] : nullptr))
+                    {
+                        return false;
+                    }
+
+                    codec.stop_encoding(false);
+
+                    if (pass && m_slice_height)
+                    {
+                        // the offset table is rewritten through a fresh pointer since appending may move the buffer
+                        ((crnd::crn_level_slices*)packed_blocks.get_ptr())->m_slice_ofs[slice] = packed_blocks.size();
+                        append_vec(packed_blocks, codec.get_encoding_buf());
+                    }
+                    else if (pass)
+                    {
+                        packed_blocks.swap(codec.get_encoding_buf());
+                    }
                 }
             }
 
@@ -1610,32 +1910,52 @@ namespace crnlib
         return true;
     }
 
-    bool crn_comp::compress_pass(const crn_comp_params& params, float* pEffective_bitrate)
+    bool crn_comp::compress_init(const crn_comp_params& params)
     {
         clear();
 
-        if (pEffective_bitrate)
-        {
-            *pEffective_bitrate = 0.0f;
-        }
-
         m_pParams = &params;
         m_has_etc_color_blocks = params.m_format == cCRNFmtETC1 || params.m_format == cCRNFmtETC2 || params.m_format == cCRNFmtETC2A || params.m_format == cCRNFmtETC1S || params.m_format == cCRNFmtETC2AS;
         m_has_subblocks = params.m_format == cCRNFmtETC1 || params.m_format == cCRNFmtETC2 || params.m_format == cCRNFmtETC2A;
+        m_slice_height = (params.m_flags & cCRNCompFlagSlicedLevels) ? cCRNSliceHeight : 0;
 
         if ((math::minimum(m_pParams->m_width, m_pParams->m_height) < 1) || (math::maximum(m_pParams->m_width, m_pParams->m_height) > cCRNMaxLevelResolution))
         {
             return false;
         }
 
-        if (!m_task_pool.init(params.m_num_helper_threads))
+        if (!alias_images())
         {
             return false;
         }
 
-        bool status = compress_internal();
+        extract_blocks();
 
-        m_task_pool.deinit();
+        return true;
+    }
+
+    bool crn_comp::compress_pass(const crn_comp_params& params, float* pEffective_bitrate)
+    {
+        if (pEffective_bitrate)
+        {
+            *pEffective_bitrate = 0.0f;
+        }
+
+        if (!m_blocks)
+        {
+            return false;
+        }
+
+        clear_pass();
+        m_pParams = &params;
+
+        // A private pool is kept for the following passes, so a bitrate search doesn't restart its threads on every trial.
+        if (!m_task_pool.init(static_cast<task_pool*>(params.m_pTask_pool), params.m_num_helper_threads))
+        {
+            return false;
+        }
+
+        bool status = compress_internal();
 
         if ((status) && (pEffective_bitrate))
         {
@@ -1657,6 +1977,7 @@ namespace crnlib
 
     void crn_comp::compress_deinit()
     {
+        clear();
     }
 
 } // namespace crnlib
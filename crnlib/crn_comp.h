@@ -48,10 +48,7 @@ namespace crnlib
             return "CRN";
         }
 
-        virtual bool compress_init(const crn_comp_params&)
-        {
-            return true;
-        };
+        virtual bool compress_init(const crn_comp_params& params);
         virtual bool compress_pass(const crn_comp_params& params, float* pEffective_bitrate);
         virtual void compress_deinit();
 
@@ -74,7 +71,7 @@ namespace crnlib
         }
 
     private:
-        task_pool m_task_pool;
+        scoped_task_pool m_task_pool;
         const crn_comp_params* m_pParams;
 
         image_u8 m_images[cCRNMaxFaces][cCRNMaxLevels];
@@ -96,10 +93,14 @@ namespace crnlib
             uint first_block;
             uint num_blocks;
             uint block_width;
+            uint block_height;
         };
         crnlib::vector<level_details> m_levels;
+        uint m_slice_height;
 
         uint m_total_blocks;
+        color_quad_u8 (*m_blocks)[16];
+
         crnlib::vector<uint32> m_color_endpoints;
         crnlib::vector<uint32> m_alpha_endpoints;
         crnlib::vector<uint32> m_color_selectors;
@@ -135,8 +136,11 @@ namespace crnlib
         bool pack_color_selectors(crnlib::vector<uint8>& packed_data, const crnlib::vector<uint16>& remapping);
         bool pack_alpha_endpoints(crnlib::vector<uint8>& packed_data, const crnlib::vector<uint16>& remapping);
         bool pack_alpha_selectors(crnlib::vector<uint8>& packed_data, const crnlib::vector<uint16>& remapping);
+        uint get_num_slices(uint level) const;
         bool pack_blocks(
             uint group,
+            uint first_row,
+            uint end_row,
             bool clear_histograms,
             symbol_codec* pCodec,
             const crnlib::vector<uint16>* pColor_endpoint_remap,
@@ -145,7 +149,9 @@ namespace crnlib
             const crnlib::vector<uint16>* pAlpha_selector_remap);
 
         bool alias_images();
+        void extract_blocks();
         void clear();
+        void clear_pass();
         bool quantize_images();
 
         void optimize_color_endpoints_task(uint64 data, void* pData_ptr);
@@ -39,6 +39,8 @@ namespace crnlib
 
     const uint cConsoleBufSize = 4096;
 
+    static thread_local console_capture* g_pThread_capture;
+
     void console::init()
     {
         if (!m_pMutex)
@@ -60,6 +62,12 @@ namespace crnlib
     {
         init();
 
+        if (g_pThread_capture)
+        {
+            g_pThread_capture->m_crlf = false;
+            return;
+        }
+
         m_crlf = false;
     }
 
@@ -67,20 +75,80 @@ namespace crnlib
     {
         init();
 
+        if (g_pThread_capture)
+        {
+            g_pThread_capture->m_crlf = true;
+            return;
+        }
+
         m_crlf = true;
     }
 
+    void console::set_thread_capture(console_capture* pCapture)
+    {
+        init();
+
+        g_pThread_capture = pCapture;
+    }
+
+    console_capture* console::get_thread_capture()
+    {
+        return g_pThread_capture;
+    }
+
+    void console_capture::replay() const
+    {
+        const bool crlf = console::get_crlf();
+
+        for (uint i = 0; i < m_messages.size(); i++)
+        {
+            const message& msg = m_messages[i];
+
+            if (msg.m_crlf)
+            {
+                console::enable_crlf();
+            }
+            else
+            {
+                console::disable_crlf();
+            }
+
+            console::printf(msg.m_type, "%s", msg.m_text.get_ptr());
+        }
+
+        if (crlf)
+        {
+            console::enable_crlf();
+        }
+        else
+        {
+            console::disable_crlf();
+        }
+    }
+
     void console::vprintf(eConsoleMessageType type, const char* p, va_list args)
     {
         init();
 
         scoped_mutex lock(*m_pMutex);
 
-        m_num_messages[type]++;
-
         char buf[cConsoleBufSize];
         vsprintf_s(buf, cConsoleBufSize, p, args);
 
+        if (g_pThread_capture)
+        {
+            if (type != cProgressConsoleMessage)
+            {
+                console_capture::message* pMsg = g_pThread_capture->m_messages.enlarge(1);
+                pMsg->m_type = type;
+                pMsg->m_crlf = g_pThread_capture->m_crlf;
+                pMsg->m_text = buf;
+            }
+            return;
+        }
+
+        m_num_messages[type]++;
+
         bool handled = false;
 
         if (m_output_funcs.size())
@@ -58,6 +58,43 @@ namespace crnlib
 
     typedef bool (*console_output_func)(eConsoleMessageType type, const char* pMsg, void* pData);
 
+    // Holds the messages printed by a thread while console::set_thread_capture() is active on it.
+    // Progress messages are dropped. replay() prints the buffered messages from the calling thread.
+    class console_capture
+    {
+    public:
+        console_capture():
+            m_crlf(true)
+        {
+        }
+
+        void clear()
+        {
+            m_messages.clear();
+            m_crlf = true;
+        }
+
+        bool is_empty() const
+        {
+            return m_messages.empty();
+        }
+
+        CRN_EXPORT void replay() const;
+
+    private:
+        friend class console;
+
+        struct message
+        {
+            eConsoleMessageType m_type;
+            bool m_crlf;
+            dynamic_string m_text;
+        };
+
+        crnlib::vector<message> m_messages;
+        bool m_crlf;
+    };
+
     class console
     {
     public:
@@ -129,11 +166,17 @@ namespace crnlib
             return m_pLog_stream;
         }
 
+        // Counts the messages printed so far; a captured message is only counted once it is replayed.
         static uint get_num_messages(eConsoleMessageType type)
         {
             return m_num_messages[type];
         }
 
+        // Redirects all messages printed by the calling thread into pCapture, or restores normal output if nullptr.
+        // The crlf state is tracked per capture, so capturing threads don't disturb each other.
+        CRN_EXPORT static void set_thread_capture(console_capture* pCapture);
+        CRN_EXPORT static console_capture* get_thread_capture();
+
     private:
         static eConsoleMessageType m_default_category;
 
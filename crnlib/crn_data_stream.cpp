@@ -153,6 +153,32 @@ namespace crnlib
         return read(&buf[0], buf.size()) == buf.size();
     }
 
+    bool data_stream::read_remaining(vector<uint8>& buf, const uint8*& pData, uint& data_size)
+    {
+        const uint8* pBase = static_cast<const uint8*>(get_ptr());
+        if ((!pBase) || (!is_readable()))
+        {
+            if (!read_array(buf))
+            {
+                return false;
+            }
+
+            pData = buf.get_ptr();
+            data_size = buf.size();
+            return true;
+        }
+
+        const uint64 remaining = get_remaining();
+        if (remaining > 1024U * 1024U * 1024U)
+        {
+            return false;
+        }
+
+        pData = pBase + get_ofs();
+        data_size = static_cast<uint>(remaining);
+        return seek(static_cast<int64>(remaining), true);
+    }
+
     bool data_stream::write_array(const vector<uint8>& buf)
     {
         if (!buf.empty())
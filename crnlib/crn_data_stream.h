@@ -150,6 +150,9 @@ namespace crnlib
         bool read_array(vector<uint8>& buf);
         bool write_array(const vector<uint8>& buf);
 
+        // Consumes the rest of the stream. Memory backed streams (see get_ptr()) return a pointer into their data, others are read into buf.
+        bool read_remaining(vector<uint8>& buf, const uint8*& pData, uint& data_size);
+
     protected:
         dynamic_string m_name;
 
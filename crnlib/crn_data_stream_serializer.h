@@ -395,6 +395,12 @@ namespace crnlib
             return m_pStream->read_array(buf);
         }
 
+        // Like read_entire_file(), but doesn't copy the data of memory backed streams.
+        bool read_entire_file(crnlib::vector<uint8>& buf, const uint8*& pData, uint& data_size)
+        {
+            return m_pStream->read_remaining(buf, pData, data_size);
+        }
+
         bool write_entire_file(const crnlib::vector<uint8>& buf)
         {
             return m_pStream->write_array(buf);
@@ -167,7 +167,7 @@ namespace crnlib
 
             if (!m_pQDXT_state)
             {
-                m_pQDXT_state = crnlib_new<mipmapped_texture::qdxt_state>(m_task_pool);
+                m_pQDXT_state = crnlib_new<mipmapped_texture::qdxt_state>(*m_task_pool.get());
 
                 if (params.m_pProgress_func)
                 {
@@ -246,11 +246,11 @@ namespace crnlib
             m_pixel_fmt = PIXEL_FMT_DXT1A;
         }
 
-        if (!m_task_pool.init(m_pParams->m_num_helper_threads))
+        if (!m_task_pool.init(static_cast<task_pool*>(m_pParams->m_pTask_pool), m_pParams->m_num_helper_threads))
         {
             return false;
         }
-        m_pack_params.m_pTask_pool = &m_task_pool;
+        m_pack_params.m_pTask_pool = m_task_pool.get();
 
         const bool hierarchical = (params.m_flags & cCRNCompFlagHierarchical) != 0;
         m_q1_params.init(m_pack_params, params.m_quality_level, hierarchical);
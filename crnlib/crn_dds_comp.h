@@ -67,7 +67,7 @@ namespace crnlib
         pixel_format m_pixel_fmt;
         dxt_image::pack_params m_pack_params;
 
-        task_pool m_task_pool;
+        scoped_task_pool m_task_pool;
         qdxt1_params m_q1_params;
         qdxt5_params m_q5_params;
         mipmapped_texture::qdxt_state* m_pQDXT_state;
@@ -36,6 +36,10 @@
 #include "crn_intersect.h"
 #include "crn_vec_interval.h"
 
+#if CRNLIB_X86_SIMD
+#include <immintrin.h>
+#endif
+
 namespace crnlib
 {
     //-----------------------------------------------------------------------------------------------------------------------------------------
@@ -1367,6 +1371,176 @@ namespace crnlib
         }
     }
 
+#if CRNLIB_X86_SIMD
+    // SIMD versions of the trial loops of evaluate_solution_uber() and evaluate_solution_hc_*(). Each lane finds the nearest
+    // block color of one unique color, keeping the lowest selector on ties, and the weighted errors are summed as exact 64-bit
+    // integers. The early out is checked once per vector instead of once per color. That only changes how soon a losing trial
+    // is abandoned, so the selectors and errors are identical to the scalar loops.
+    CRNLIB_TARGET_SSE41 static inline __m128i dxt1_color_distances_sse41(__m128i lo, __m128i hi, __m128i block_color, __m128i channel_weights)
+    {
+        const __m128i dlo = _mm_sub_epi16(lo, block_color);
+        const __m128i dhi = _mm_sub_epi16(hi, block_color);
+        return _mm_hadd_epi32(_mm_madd_epi16(dlo, _mm_mullo_epi16(dlo, channel_weights)), _mm_madd_epi16(dhi, _mm_mullo_epi16(dhi, channel_weights)));
+    }
+
+    CRNLIB_TARGET_SSE41 static inline uint64 dxt1_evaluate_4_colors_sse41(const unique_color* pColors, const __m128i* pBlock_colors, uint num_block_colors, __m128i channel_weights, uint8* pSelectors)
+    {
+        const __m128 a = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pColors)));
+        const __m128 b = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pColors + 2)));
+        const __m128i colors = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i weights = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        const __m128i lo = _mm_cvtepu8_epi16(colors);
+        const __m128i hi = _mm_unpackhi_epi8(colors, _mm_setzero_si128());
+
+        __m128i best_error = dxt1_color_distances_sse41(lo, hi, pBlock_colors[0], channel_weights);
+        __m128i best_selector = _mm_setzero_si128();
+        for (uint s = 1; s < num_block_colors; s++)
+        {
+            const __m128i error = dxt1_color_distances_sse41(lo, hi, pBlock_colors[s], channel_weights);
+            best_selector = _mm_blendv_epi8(best_selector, _mm_set1_epi32(s), _mm_cmplt_epi32(error, best_error));
+            best_error = _mm_min_epi32(best_error, error);
+        }
+
+        if (pSelectors)
+        {
+            const __m128i selectors = _mm_packs_epi32(best_selector, best_selector);
+            const int packed = _mm_cvtsi128_si32(_mm_packus_epi16(selectors, selectors));
+            memcpy(pSelectors, &packed, 4);
+        }
+
+        const __m128i products = _mm_add_epi64(_mm_mul_epu32(best_error, weights), _mm_mul_epu32(_mm_srli_epi64(best_error, 32), _mm_srli_epi64(weights, 32)));
+        uint64 sums[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), products);
+        return sums[0] + sums[1];
+    }
+
+    // Evaluates the first (or with from_end the last) colors in groups of 4 and returns how many it covered. Stops early once error reaches max_error.
+    CRNLIB_TARGET_SSE41 static uint dxt1_evaluate_colors_sse41(const unique_color* pColors, uint num_colors, bool from_end, const color_quad_u8* pBlock_colors, uint num_block_colors,
+        bool perceptual, uint64 max_error, uint64& error, uint8* pSelectors)
+    {
+        const __m128i channel_weights = perceptual ? _mm_setr_epi16(color::cRWeight, color::cGWeight, color::cBWeight, 0, color::cRWeight, color::cGWeight, color::cBWeight, 0)
+                                                   : _mm_setr_epi16(1, 1, 1, 0, 1, 1, 1, 0);
+        __m128i block_colors[cDXT1SelectorValues];
+        for (uint s = 0; s < num_block_colors; s++)
+        {
+            const color_quad_u8& c = pBlock_colors[s];
+            block_colors[s] = _mm_setr_epi16(c.r, c.g, c.b, 0, c.r, c.g, c.b, 0);
+        }
+
+        const uint num_simd_colors = num_colors & ~3U;
+        for (uint i = 0; i < num_simd_colors; i += 4)
+        {
+            const uint ofs = from_end ? num_colors - 4 - i : i;
+            error += dxt1_evaluate_4_colors_sse41(pColors + ofs, block_colors, num_block_colors, channel_weights, pSelectors ? pSelectors + ofs : nullptr);
+            if (error >= max_error)
+            {
+                break;
+            }
+        }
+        return num_simd_colors;
+    }
+
+    CRNLIB_TARGET_AVX2 static inline __m256i dxt1_color_distances_avx2(__m256i lo, __m256i hi, __m256i block_color, __m256i channel_weights)
+    {
+        const __m256i dlo = _mm256_sub_epi16(lo, block_color);
+        const __m256i dhi = _mm256_sub_epi16(hi, block_color);
+        return _mm256_hadd_epi32(_mm256_madd_epi16(dlo, _mm256_mullo_epi16(dlo, channel_weights)), _mm256_madd_epi16(dhi, _mm256_mullo_epi16(dhi, channel_weights)));
+    }
+
+    // Eight colors per iteration. The lanes hold colors 0 1 4 5 | 2 3 6 7, which is the order the weights are loaded in,
+    // and the selectors are put back in order before they are stored.
+    CRNLIB_TARGET_AVX2 static inline uint64 dxt1_evaluate_8_colors_avx2(const unique_color* pColors, const __m256i* pBlock_colors, uint num_block_colors, __m256i channel_weights, uint8* pSelectors)
+    {
+        const __m256 a = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pColors)));
+        const __m256 b = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pColors + 4)));
+        const __m256i colors = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256i weights = _mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        const __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(colors));
+        const __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(colors, 1));
+
+        __m256i best_error = dxt1_color_distances_avx2(lo, hi, pBlock_colors[0], channel_weights);
+        __m256i best_selector = _mm256_setzero_si256();
+        for (uint s = 1; s < num_block_colors; s++)
+        {
+            const __m256i error = dxt1_color_distances_avx2(lo, hi, pBlock_colors[s], channel_weights);
+            best_selector = _mm256_blendv_epi8(best_selector, _mm256_set1_epi32(s), _mm256_cmpgt_epi32(best_error, error));
+            best_error = _mm256_min_epi32(best_error, error);
+        }
+
+        if (pSelectors)
+        {
+            const __m256i ordered = _mm256_permute4x64_epi64(best_selector, _MM_SHUFFLE(3, 1, 2, 0));
+            const __m128i selectors = _mm_packs_epi32(_mm256_castsi256_si128(ordered), _mm256_extracti128_si256(ordered, 1));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(pSelectors), _mm_packus_epi16(selectors, selectors));
+        }
+
+        const __m256i products = _mm256_add_epi64(_mm256_mul_epu32(best_error, weights), _mm256_mul_epu32(_mm256_srli_epi64(best_error, 32), _mm256_srli_epi64(weights, 32)));
+        const __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(products), _mm256_extracti128_si256(products, 1));
+        uint64 sums[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), sum);
+        return sums[0] + sums[1];
+    }
+
+    CRNLIB_TARGET_AVX2 static uint dxt1_evaluate_colors_avx2(const unique_color* pColors, uint num_colors, bool from_end, const color_quad_u8* pBlock_colors, uint num_block_colors,
+        bool perceptual, uint64 max_error, uint64& error, uint8* pSelectors)
+    {
+        const __m256i channel_weights = perceptual ? _mm256_setr_epi16(color::cRWeight, color::cGWeight, color::cBWeight, 0, color::cRWeight, color::cGWeight, color::cBWeight, 0,
+                                                         color::cRWeight, color::cGWeight, color::cBWeight, 0, color::cRWeight, color::cGWeight, color::cBWeight, 0)
+                                                   : _mm256_setr_epi16(1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0);
+        __m256i block_colors[cDXT1SelectorValues];
+        __m128i block_colors_128[cDXT1SelectorValues];
+        for (uint s = 0; s < num_block_colors; s++)
+        {
+            const color_quad_u8& c = pBlock_colors[s];
+            block_colors_128[s] = _mm_setr_epi16(c.r, c.g, c.b, 0, c.r, c.g, c.b, 0);
+            block_colors[s] = _mm256_broadcastsi128_si256(block_colors_128[s]);
+        }
+
+        const uint num_simd_colors = num_colors & ~3U;
+        for (uint i = 0; i < num_simd_colors;)
+        {
+            const uint n = (num_simd_colors - i >= 8) ? 8 : 4;
+            const uint ofs = from_end ? num_colors - n - i : i;
+            uint8* pDst = pSelectors ? pSelectors + ofs : nullptr;
+            if (n == 8)
+            {
+                error += dxt1_evaluate_8_colors_avx2(pColors + ofs, block_colors, num_block_colors, channel_weights, pDst);
+            }
+            else
+            {
+                error += dxt1_evaluate_4_colors_sse41(pColors + ofs, block_colors_128, num_block_colors, _mm256_castsi256_si128(channel_weights), pDst);
+            }
+            i += n;
+            if (error >= max_error)
+            {
+                break;
+            }
+        }
+        return num_simd_colors;
+    }
+
+    // Returns how many of the colors were evaluated with SIMD: the first ones, or the last ones with from_end.
+    // The caller evaluates the rest, unless error already reached max_error.
+    static uint dxt1_evaluate_colors_simd(const unique_color* pColors, uint num_colors, bool from_end, const color_quad_u8* pBlock_colors, uint num_block_colors,
+        bool perceptual, uint64 max_error, uint64& error, uint8* pSelectors)
+    {
+        if (crnlib_cpu_has_avx2())
+        {
+            return dxt1_evaluate_colors_avx2(pColors, num_colors, from_end, pBlock_colors, num_block_colors, perceptual, max_error, error, pSelectors);
+        }
+        if (crnlib_cpu_has_sse41())
+        {
+            return dxt1_evaluate_colors_sse41(pColors, num_colors, from_end, pBlock_colors, num_block_colors, perceptual, max_error, error, pSelectors);
+        }
+        return 0;
+    }
+#else
+    static uint dxt1_evaluate_colors_simd(const unique_color*, uint, bool, const color_quad_u8*, uint, bool, uint64, uint64&, uint8*)
+    {
+        return 0;
+    }
+#endif
+
     bool dxt1_endpoint_optimizer::evaluate_solution_uber(const dxt1_solution_coordinates& coords, bool alternate_rounding)
     {
         m_trial_solution.m_coords = coords;
@@ -1393,6 +1567,9 @@ namespace crnlib
         colors[0] = dxt1_block::unpack_color(coords.m_low_color, true);
         colors[1] = dxt1_block::unpack_color(coords.m_high_color, true);
 
+        // The grayscale sampling distance has no SIMD version.
+        const bool use_simd = m_perceptual || !m_pParams->m_grayscale_sampling;
+
         for (uint block_type = first_block_type; block_type <= last_block_type; block_type++)
         {
             uint64 trial_error = 0;
@@ -1402,9 +1579,11 @@ namespace crnlib
                 colors[2].set_noclamp_rgba((colors[0].r * 2 + colors[1].r + alternate_rounding) / 3, (colors[0].g * 2 + colors[1].g + alternate_rounding) / 3, (colors[0].b * 2 + colors[1].b + alternate_rounding) / 3, 0);
                 colors[3].set_noclamp_rgba((colors[1].r * 2 + colors[0].r + alternate_rounding) / 3, (colors[1].g * 2 + colors[0].g + alternate_rounding) / 3, (colors[1].b * 2 + colors[0].b + alternate_rounding) / 3, 0);
 
+                const int num_scalar_colors = (int)m_unique_colors.size() - (use_simd ? dxt1_evaluate_colors_simd(m_unique_colors.get_ptr(), m_unique_colors.size(), true, colors, 4, m_perceptual, m_trial_solution.m_error, trial_error, m_trial_selectors.get_ptr()) : 0);
+
                 if (m_perceptual)
                 {
-                    for (int unique_color_index = (int)m_unique_colors.size() - 1; unique_color_index >= 0; unique_color_index--)
+                    for (int unique_color_index = num_scalar_colors - 1; unique_color_index >= 0; unique_color_index--)
                     {
                         const color_quad_u8& c = m_unique_colors[unique_color_index].m_color;
 
@@ -1443,7 +1622,7 @@ namespace crnlib
                 }
                 else
                 {
-                    for (int unique_color_index = (int)m_unique_colors.size() - 1; unique_color_index >= 0; unique_color_index--)
+                    for (int unique_color_index = num_scalar_colors - 1; unique_color_index >= 0; unique_color_index--)
                     {
                         const color_quad_u8& c = m_unique_colors[unique_color_index].m_color;
 
@@ -1485,9 +1664,11 @@ namespace crnlib
             {
                 colors[2].set_noclamp_rgba((colors[0].r + colors[1].r + alternate_rounding) >> 1, (colors[0].g + colors[1].g + alternate_rounding) >> 1, (colors[0].b + colors[1].b + alternate_rounding) >> 1, 255U);
 
+                const int num_scalar_colors = (int)m_unique_colors.size() - (use_simd ? dxt1_evaluate_colors_simd(m_unique_colors.get_ptr(), m_unique_colors.size(), true, colors, 3, m_perceptual, m_trial_solution.m_error, trial_error, m_trial_selectors.get_ptr()) : 0);
+
                 if (m_perceptual)
                 {
-                    for (int unique_color_index = (int)m_unique_colors.size() - 1; unique_color_index >= 0; unique_color_index--)
+                    for (int unique_color_index = num_scalar_colors - 1; unique_color_index >= 0; unique_color_index--)
                     {
                         const color_quad_u8& c = m_unique_colors[unique_color_index].m_color;
 
@@ -1519,7 +1700,7 @@ namespace crnlib
                 }
                 else
                 {
-                    for (int unique_color_index = (int)m_unique_colors.size() - 1; unique_color_index >= 0; unique_color_index--)
+                    for (int unique_color_index = num_scalar_colors - 1; unique_color_index >= 0; unique_color_index--)
                     {
                         const color_quad_u8& c = m_unique_colors[unique_color_index].m_color;
 
@@ -1762,9 +1943,11 @@ namespace crnlib
         color_quad_u8 c1 = dxt1_block::unpack_color(coords.m_high_color, true);
         color_quad_u8 c2((c0.r * 2 + c1.r + alternate_rounding) / 3, (c0.g * 2 + c1.g + alternate_rounding) / 3, (c0.b * 2 + c1.b + alternate_rounding) / 3, 0);
         color_quad_u8 c3((c1.r * 2 + c0.r + alternate_rounding) / 3, (c1.g * 2 + c0.g + alternate_rounding) / 3, (c1.b * 2 + c0.b + alternate_rounding) / 3, 0);
+        const color_quad_u8 block_colors[cDXT1SelectorValues] = { c0, c1, c2, c3 };
         uint64 error = 0;
-        unique_color* color = m_evaluated_colors.get_ptr();
-        for (uint count = m_evaluated_colors.size(); count; color++, error < m_best_solution.m_error ? count-- : count = 0)
+        const uint num_simd_colors = dxt1_evaluate_colors_simd(m_evaluated_colors.get_ptr(), m_evaluated_colors.size(), false, block_colors, 4, true, m_best_solution.m_error, error, nullptr);
+        unique_color* color = m_evaluated_colors.get_ptr() + num_simd_colors;
+        for (uint count = error < m_best_solution.m_error ? m_evaluated_colors.size() - num_simd_colors : 0; count; color++, error < m_best_solution.m_error ? count-- : count = 0)
         {
             uint e01 = math::minimum(color::color_distance(true, color->m_color, c0, false), color::color_distance(true, color->m_color, c1, false));
             uint e23 = math::minimum(color::color_distance(true, color->m_color, c2, false), color::color_distance(true, color->m_color, c3, false));
@@ -1801,9 +1984,11 @@ namespace crnlib
         color_quad_u8 c1 = dxt1_block::unpack_color(coords.m_high_color, true);
         color_quad_u8 c2((c0.r * 2 + c1.r + alternate_rounding) / 3, (c0.g * 2 + c1.g + alternate_rounding) / 3, (c0.b * 2 + c1.b + alternate_rounding) / 3, 0);
         color_quad_u8 c3((c1.r * 2 + c0.r + alternate_rounding) / 3, (c1.g * 2 + c0.g + alternate_rounding) / 3, (c1.b * 2 + c0.b + alternate_rounding) / 3, 0);
+        const color_quad_u8 block_colors[cDXT1SelectorValues] = { c0, c1, c2, c3 };
         uint64 error = 0;
-        unique_color* color = m_evaluated_colors.get_ptr();
-        for (uint count = m_evaluated_colors.size(); count; color++, error < m_best_solution.m_error ? count-- : count = 0)
+        const uint num_simd_colors = dxt1_evaluate_colors_simd(m_evaluated_colors.get_ptr(), m_evaluated_colors.size(), false, block_colors, 4, false, m_best_solution.m_error, error, nullptr);
+        unique_color* color = m_evaluated_colors.get_ptr() + num_simd_colors;
+        for (uint count = error < m_best_solution.m_error ? m_evaluated_colors.size() - num_simd_colors : 0; count; color++, error < m_best_solution.m_error ? count-- : count = 0)
         {
             uint e01 = math::minimum(color::color_distance(false, color->m_color, c0, false), color::color_distance(false, color->m_color, c1, false));
             uint e23 = math::minimum(color::color_distance(false, color->m_color, c2, false), color::color_distance(false, color->m_color, c3, false));
@@ -222,6 +222,12 @@ namespace crnlib
 
         bool compute(const params& p, results& r);
 
+        // Forgets the winning endpoints of the previous blocks, which are tried first when endpoint caching is enabled.
+        void clear_prev_results()
+        {
+            m_num_prev_results = 0;
+        }
+
     private:
         const params* m_pParams;
         results* m_pResults;
@@ -27,6 +27,10 @@
 #include "crn_dxt_fast.h"
 #include "crn_ryg_dxt.hpp"
 
+#if CRNLIB_X86_SIMD
+#include <immintrin.h>
+#endif
+
 namespace crnlib
 {
     namespace dxt_fast
@@ -84,6 +88,203 @@ namespace crnlib
 #endif
         }
 
+#if CRNLIB_X86_SIMD
+        // SSE4.1 versions of the per-pixel loops below. They work on four pixels at a time in 32-bit integer lanes and
+        // produce exactly the scalar results, including the first-occurrence tie breaking. Callers only use them when
+        // n is a multiple of 4; lane sums are flushed every cSIMDChunkPixels pixels.
+        static const uint cSIMDChunkPixels = 4096;
+
+        CRNLIB_TARGET_SSE41 static inline void load_channels_sse41(const color_quad_u8* pBlock, __m128i& r, __m128i& g, __m128i& b)
+        {
+            const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBlock));
+            const __m128i mask = _mm_set1_epi32(0xFF);
+            r = _mm_and_si128(px, mask);
+            g = _mm_and_si128(_mm_srli_epi32(px, 8), mask);
+            b = _mm_and_si128(_mm_srli_epi32(px, 16), mask);
+        }
+
+        CRNLIB_TARGET_SSE41 static inline int64 horizontal_sum_sse41(__m128i v)
+        {
+            v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+            v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtsi128_si32(v);
+        }
+
+        CRNLIB_TARGET_SSE41 static inline __m128i dot_sse41(const color_quad_u8* pBlock, __m128i dir_r, __m128i dir_g, __m128i dir_b)
+        {
+            __m128i r, g, b;
+            load_channels_sse41(pBlock, r, g, b);
+            return _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(r, dir_r), _mm_mullo_epi32(g, dir_g)), _mm_mullo_epi32(b, dir_b));
+        }
+
+        CRNLIB_TARGET_SSE41 static void get_block_range_sse41(uint n, const color_quad_u8* block, int64 sum[3], int min[3], int max[3])
+        {
+            __m128i min_v[3], max_v[3];
+            load_channels_sse41(block, min_v[0], min_v[1], min_v[2]);
+            for (uint ch = 0; ch < 3; ch++)
+            {
+                max_v[ch] = min_v[ch];
+                sum[ch] = 0;
+            }
+
+            for (uint i = 0; i < n;)
+            {
+                const uint chunk_end = math::minimum(n, i + cSIMDChunkPixels);
+                __m128i sum_v[3] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+                for (; i < chunk_end; i += 4)
+                {
+                    __m128i v[3];
+                    load_channels_sse41(block + i, v[0], v[1], v[2]);
+                    for (uint ch = 0; ch < 3; ch++)
+                    {
+                        sum_v[ch] = _mm_add_epi32(sum_v[ch], v[ch]);
+                        min_v[ch] = _mm_min_epi32(min_v[ch], v[ch]);
+                        max_v[ch] = _mm_max_epi32(max_v[ch], v[ch]);
+                    }
+                }
+                for (uint ch = 0; ch < 3; ch++)
+                {
+                    sum[ch] += horizontal_sum_sse41(sum_v[ch]);
+                }
+            }
+
+            for (uint ch = 0; ch < 3; ch++)
+            {
+                __m128i lo = _mm_min_epi32(min_v[ch], _mm_shuffle_epi32(min_v[ch], _MM_SHUFFLE(1, 0, 3, 2)));
+                __m128i hi = _mm_max_epi32(max_v[ch], _mm_shuffle_epi32(max_v[ch], _MM_SHUFFLE(1, 0, 3, 2)));
+                lo = _mm_min_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+                hi = _mm_max_epi32(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+                min[ch] = _mm_cvtsi128_si32(lo);
+                max[ch] = _mm_cvtsi128_si32(hi);
+            }
+        }
+
+        // The covariance terms are sums of integer products, so the integer sums convert to exactly the doubles the
+        // scalar loop accumulates.
+        CRNLIB_TARGET_SSE41 static void get_block_covariance_sse41(uint n, const color_quad_u8* block, const uint ave_color[3], double cov[6])
+        {
+            const __m128i ave_r = _mm_set1_epi32(ave_color[0]);
+            const __m128i ave_g = _mm_set1_epi32(ave_color[1]);
+            const __m128i ave_b = _mm_set1_epi32(ave_color[2]);
+            int64 total[6] = { 0, 0, 0, 0, 0, 0 };
+
+            for (uint i = 0; i < n;)
+            {
+                const uint chunk_end = math::minimum(n, i + cSIMDChunkPixels);
+                __m128i sum[6];
+                for (uint j = 0; j < 6; j++)
+                {
+                    sum[j] = _mm_setzero_si128();
+                }
+                for (; i < chunk_end; i += 4)
+                {
+                    __m128i r, g, b;
+                    load_channels_sse41(block + i, r, g, b);
+                    r = _mm_sub_epi32(r, ave_r);
+                    g = _mm_sub_epi32(g, ave_g);
+                    b = _mm_sub_epi32(b, ave_b);
+                    sum[0] = _mm_add_epi32(sum[0], _mm_mullo_epi32(r, r));
+                    sum[1] = _mm_add_epi32(sum[1], _mm_mullo_epi32(r, g));
+                    sum[2] = _mm_add_epi32(sum[2], _mm_mullo_epi32(r, b));
+                    sum[3] = _mm_add_epi32(sum[3], _mm_mullo_epi32(g, g));
+                    sum[4] = _mm_add_epi32(sum[4], _mm_mullo_epi32(g, b));
+                    sum[5] = _mm_add_epi32(sum[5], _mm_mullo_epi32(b, b));
+                }
+                for (uint j = 0; j < 6; j++)
+                {
+                    total[j] += horizontal_sum_sse41(sum[j]);
+                }
+            }
+
+            for (uint j = 0; j < 6; j++)
+            {
+                cov[j] = static_cast<double>(total[j]);
+            }
+        }
+
+        // Finds the first pixels with the lowest and highest projection onto (v_r, v_g, v_b).
+        CRNLIB_TARGET_SSE41 static void find_block_extremes_sse41(uint n, const color_quad_u8* block, int v_r, int v_g, int v_b, uint& min_index, uint& max_index)
+        {
+            const __m128i dir_r = _mm_set1_epi32(v_r);
+            const __m128i dir_g = _mm_set1_epi32(v_g);
+            const __m128i dir_b = _mm_set1_epi32(v_b);
+            const __m128i step = _mm_set1_epi32(4);
+
+            __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+            __m128i min_dot = dot_sse41(block, dir_r, dir_g, dir_b);
+            __m128i max_dot = min_dot;
+            __m128i min_idx = index;
+            __m128i max_idx = index;
+            for (uint i = 4; i < n; i += 4)
+            {
+                index = _mm_add_epi32(index, step);
+                const __m128i dot = dot_sse41(block + i, dir_r, dir_g, dir_b);
+                const __m128i lower = _mm_cmplt_epi32(dot, min_dot);
+                const __m128i higher = _mm_cmpgt_epi32(dot, max_dot);
+                min_dot = _mm_min_epi32(min_dot, dot);
+                max_dot = _mm_max_epi32(max_dot, dot);
+                min_idx = _mm_blendv_epi8(min_idx, index, lower);
+                max_idx = _mm_blendv_epi8(max_idx, index, higher);
+            }
+
+            int min_dots[4], max_dots[4];
+            uint min_indices[4], max_indices[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(min_dots), min_dot);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(max_dots), max_dot);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(min_indices), min_idx);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(max_indices), max_idx);
+
+            uint min_lane = 0, max_lane = 0;
+            for (uint l = 1; l < 4; l++)
+            {
+                if ((min_dots[l] < min_dots[min_lane]) || ((min_dots[l] == min_dots[min_lane]) && (min_indices[l] < min_indices[min_lane])))
+                {
+                    min_lane = l;
+                }
+                if ((max_dots[l] > max_dots[max_lane]) || ((max_dots[l] == max_dots[max_lane]) && (max_indices[l] < max_indices[max_lane])))
+                {
+                    max_lane = l;
+                }
+            }
+            min_index = min_indices[min_lane];
+            max_index = max_indices[max_lane];
+        }
+
+        CRNLIB_TARGET_SSE41 static bool match_block_colors_sse41(uint n, const color_quad_u8* pBlock, int dirr, int dirg, int dirb, int c0Point, int halfPoint, int c3Point, uint8* pSelectors)
+        {
+            const __m128i dir_r = _mm_set1_epi32(dirr);
+            const __m128i dir_g = _mm_set1_epi32(dirg);
+            const __m128i dir_b = _mm_set1_epi32(dirb);
+            const __m128i c0 = _mm_set1_epi32(c0Point);
+            const __m128i half = _mm_set1_epi32(halfPoint);
+            const __m128i c3 = _mm_set1_epi32(c3Point);
+            const __m128i one = _mm_set1_epi32(1);
+            const __m128i two = _mm_set1_epi32(2);
+            const __m128i three = _mm_set1_epi32(3);
+
+            __m128i first = _mm_setzero_si128();
+            __m128i diff = _mm_setzero_si128();
+            for (uint i = 0; i < n; i += 4)
+            {
+                const __m128i dot = dot_sse41(pBlock + i, dir_r, dir_g, dir_b);
+                const __m128i low = _mm_blendv_epi8(three, one, _mm_cmplt_epi32(dot, c0));
+                const __m128i high = _mm_and_si128(_mm_cmplt_epi32(dot, c3), two);
+                const __m128i s = _mm_blendv_epi8(high, low, _mm_cmplt_epi32(dot, half));
+
+                if (!i)
+                {
+                    first = _mm_shuffle_epi32(s, _MM_SHUFFLE(0, 0, 0, 0));
+                }
+                diff = _mm_or_si128(diff, _mm_xor_si128(s, first));
+
+                const int packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(s, s), _mm_setzero_si128()));
+                memcpy(pSelectors + i, &packed, 4);
+            }
+
+            return !_mm_testz_si128(diff, diff);
+        }
+#endif
+
         // false if all selectors equal
         static bool match_block_colors(uint n, const color_quad_u8* pBlock, const color_quad_u8* pColors, uint8* pSelectors)
         {
@@ -109,6 +310,13 @@ namespace crnlib
             halfPoint >>= 1;
             c3Point >>= 1;
 
+#if CRNLIB_X86_SIMD
+            if (!(n & 3) && crnlib_cpu_has_sse41())
+            {
+                return match_block_colors_sse41(n, pBlock, dirr, dirg, dirb, c0Point, halfPoint, c3Point, pSelectors);
+            }
+#endif
+
             bool status = false;
             for (uint i = 0; i < n; i++)
             {
@@ -139,6 +347,19 @@ namespace crnlib
         {
             int min[3], max[3];
 
+#if CRNLIB_X86_SIMD
+            const bool use_sse41 = !(n & 3) && crnlib_cpu_has_sse41();
+            if (use_sse41)
+            {
+                int64 sum[3];
+                get_block_range_sse41(n, block, sum, min, max);
+                for (uint ch = 0; ch < 3; ch++)
+                {
+                    ave_color[ch] = static_cast<int>((sum[ch] + (n / 2)) / n);
+                }
+            }
+            else
+#endif
             for (uint ch = 0; ch < 3; ch++)
             {
                 const uint8* bp = ((const uint8*)block) + ch;
@@ -172,6 +393,13 @@ namespace crnlib
                 cov[i] = 0;
             }
 
+#if CRNLIB_X86_SIMD
+            if (use_sse41)
+            {
+                get_block_covariance_sse41(n, block, ave_color, cov);
+            }
+            else
+#endif
             for (uint i = 0; i < n; i++)
             {
                 double r = (int)block[i].r - (int)ave_color[0];
@@ -241,6 +469,16 @@ namespace crnlib
             color_quad_u8 minp(block[0]);
             color_quad_u8 maxp(block[0]);
 
+#if CRNLIB_X86_SIMD
+            if (use_sse41)
+            {
+                uint min_index, max_index;
+                find_block_extremes_sse41(n, block, v_r, v_g, v_b, min_index, max_index);
+                minp = block[min_index];
+                maxp = block[max_index];
+            }
+            else
+#endif
             for (uint i = 1; i < n; i++)
             {
                 int dot = block[i].r * v_r + block[i].g * v_g + block[i].b * v_b;
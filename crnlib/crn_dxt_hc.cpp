@@ -28,6 +28,10 @@
 #include "crn_dxt_fast.h"
 #include "crn_etc.h"
 
+#if CRNLIB_X86_SIMD
+#include <immintrin.h>
+#endif
+
 namespace crnlib
 {
     typedef vec<6, float> vec6F;
@@ -50,6 +54,7 @@ namespace crnlib
         m_has_etc_color_blocks(false),
         m_has_subblocks(false),
         m_num_alpha_blocks(0),
+        m_tiles_valid(false),
         m_main_thread_id(crn_get_current_thread_id()),
         m_canceled(false),
         m_pTask_pool(nullptr),
@@ -69,16 +74,45 @@ namespace crnlib
         m_num_alpha_blocks = 0;
         m_has_color_blocks = false;
 
+        clear_pass();
+
+        m_block_weights.clear();
+        m_block_encodings.clear();
+        m_tile_indices.clear();
+        m_endpoint_indices.clear();
+        m_tiles.clear();
+        m_tile_pixels.clear();
+        m_color_cluster_pixels.clear();
+        m_color_cluster_blocks.clear();
+        m_alpha_cluster_pixels.clear();
+        m_alpha_cluster_blocks.clear();
+        m_num_tiles = 0;
+
+        m_tiles_valid = false;
+        m_tile_blocks.clear();
+        m_tile_endpoint_indices.clear();
+        m_color_endpoint_vectors.clear();
+        m_color_endpoint_weights.clear();
+        m_color_endpoint_vector_indices.clear();
+        m_alpha_endpoint_vectors.clear();
+        m_alpha_endpoint_weights.clear();
+    }
+
+    void dxt_hc::clear_pass()
+    {
         m_color_clusters.clear();
         m_alpha_clusters.clear();
+        // The cluster storage keeps its capacity for the next pass.
+        m_color_cluster_pixels.resize(0);
+        m_color_cluster_blocks.resize(0);
+        m_alpha_cluster_pixels.resize(0);
+        m_alpha_cluster_blocks.resize(0);
 
         m_canceled = false;
 
         m_prev_phase_index = -1;
         m_prev_percentage_complete = -1;
 
-        m_block_weights.clear();
-        m_block_encodings.clear();
         for (uint c = 0; c < 3; c++)
         {
             m_block_selectors[c].clear();
@@ -87,42 +121,43 @@ namespace crnlib
         m_alpha_selectors.clear();
         m_color_selectors_used.clear();
         m_alpha_selectors_used.clear();
-        m_tile_indices.clear();
-        m_endpoint_indices.clear();
         m_selector_indices.clear();
-        m_tiles.clear();
-        m_num_tiles = 0;
     }
 
-    bool dxt_hc::compress(
-        color_quad_u8 (*blocks)[16],
-        crnlib::vector<endpoint_indices_details>& endpoint_indices,
-        crnlib::vector<selector_indices_details>& selector_indices,
-        crnlib::vector<uint32>& color_endpoints,
-        crnlib::vector<uint32>& alpha_endpoints,
-        crnlib::vector<uint32>& color_selectors,
-        crnlib::vector<uint64>& alpha_selectors,
-        const params& p)
+    bool dxt_hc::can_reuse_tiles(color_quad_u8 (*blocks)[16], const params& p) const
     {
-        clear();
-        m_has_etc_color_blocks = p.m_format == cETC1 || p.m_format == cETC2 || p.m_format == cETC2A || p.m_format == cETC1S || p.m_format == cETC2AS;
-        m_has_subblocks = p.m_format == cETC1 || p.m_format == cETC2 || p.m_format == cETC2A;
-        m_has_color_blocks = p.m_format == cDXT1 || p.m_format == cDXT5 || m_has_etc_color_blocks;
-        m_num_alpha_blocks = p.m_format == cDXT5 || p.m_format == cDXT5A || p.m_format == cETC2A || p.m_format == cETC2AS ? 1 : p.m_format == cDXN_XY || p.m_format == cDXN_YX ? 2
-                                                                                                                                                                               : 0;
-        if (!m_has_color_blocks && !m_num_alpha_blocks)
+        if (!m_tiles_valid || blocks != m_blocks)
         {
             return false;
         }
-        m_blocks = blocks;
-        m_main_thread_id = crn_get_current_thread_id();
-        m_pTask_pool = p.m_pTask_pool;
-        m_params = p;
+        if (p.m_num_blocks != m_params.m_num_blocks || p.m_num_levels != m_params.m_num_levels || p.m_num_faces != m_params.m_num_faces)
+        {
+            return false;
+        }
+        for (uint level = 0; level < p.m_num_levels; level++)
+        {
+            if (p.m_levels[level].m_first_block != m_params.m_levels[level].m_first_block ||
+                p.m_levels[level].m_num_blocks != m_params.m_levels[level].m_num_blocks ||
+                p.m_levels[level].m_block_width != m_params.m_levels[level].m_block_width ||
+                p.m_levels[level].m_weight != m_params.m_levels[level].m_weight)
+            {
+                return false;
+            }
+        }
+        return p.m_format == m_params.m_format && p.m_perceptual == m_params.m_perceptual &&
+            p.m_adaptive_tile_color_psnr_derating == m_params.m_adaptive_tile_color_psnr_derating &&
+            p.m_adaptive_tile_alpha_psnr_derating == m_params.m_adaptive_tile_alpha_psnr_derating &&
+            p.m_adaptive_tile_color_alpha_weighting_ratio == m_params.m_adaptive_tile_color_alpha_weighting_ratio &&
+            p.m_alpha_component_indices[0] == m_params.m_alpha_component_indices[0] &&
+            p.m_alpha_component_indices[1] == m_params.m_alpha_component_indices[1];
+    }
 
+    void dxt_hc::determine_tiles()
+    {
         uint tile_derating[8] = { 0, 1, 1, 2, 2, 2, 2, 3 };
-        for (uint level = 0; level < p.m_num_levels; level++)
+        for (uint level = 0; level < m_params.m_num_levels; level++)
         {
-            float adaptive_tile_color_psnr_derating = p.m_adaptive_tile_color_psnr_derating;
+            float adaptive_tile_color_psnr_derating = m_params.m_adaptive_tile_color_psnr_derating;
             if (level && adaptive_tile_color_psnr_derating > .25f)
             {
                 adaptive_tile_color_psnr_derating = math::maximum(.25f, adaptive_tile_color_psnr_derating / powf(3.0f, static_cast<float>(level)));
@@ -144,25 +179,22 @@ namespace crnlib
         m_num_blocks = m_params.m_num_blocks;
         m_block_weights.resize(m_num_blocks);
         m_block_encodings.resize(m_num_blocks);
-        for (uint c = 0; c < 3; c++)
-        {
-            m_block_selectors[c].resize(m_num_blocks);
-        }
         m_tile_indices.resize(m_num_blocks);
         m_endpoint_indices.resize(m_num_blocks);
-        m_selector_indices.resize(m_num_blocks);
         m_tiles.resize(m_num_blocks);
+        // The tiles of a group of blocks share the pixels of the group, so every block has room for its own pixels.
+        m_tile_pixels.resize(m_num_blocks * (m_has_subblocks ? 8 : 16));
 
-        for (uint level = 0; level < p.m_num_levels; level++)
+        for (uint level = 0; level < m_params.m_num_levels; level++)
         {
-            float weight = p.m_levels[level].m_weight;
-            for (uint b = p.m_levels[level].m_first_block, bEnd = b + p.m_levels[level].m_num_blocks; b < bEnd; b++)
+            float weight = m_params.m_levels[level].m_weight;
+            for (uint b = m_params.m_levels[level].m_first_block, bEnd = b + m_params.m_levels[level].m_num_blocks; b < bEnd; b++)
             {
                 m_block_weights[b] = weight;
             }
         }
 
-        for (uint i = 0; i <= m_pTask_pool->get_num_threads(); i++)
+        for (uint i = 0; i <= m_params.m_num_helper_threads; i++)
         {
             m_pTask_pool->queue_object_task(this, m_has_subblocks ? &dxt_hc::determine_tiles_task_etc : &dxt_hc::determine_tiles_task, i);
         }
@@ -171,12 +203,73 @@ namespace crnlib
         m_num_tiles = 0;
         for (uint t = 0; t < m_tiles.size(); t++)
         {
-            if (m_tiles[t].pixels.size())
+            if (m_tiles[t].num_pixels)
             {
                 m_num_tiles++;
             }
         }
 
+        // determine_color_endpoints() mirrors ETC blocks and resets their references, so keep the original state around.
+        if (m_has_subblocks)
+        {
+            m_tile_blocks.append(m_blocks[0], (m_num_blocks >> 1) * 16);
+        }
+        m_tile_endpoint_indices = m_endpoint_indices;
+        m_tiles_valid = true;
+    }
+
+    bool dxt_hc::compress(
+        color_quad_u8 (*blocks)[16],
+        crnlib::vector<endpoint_indices_details>& endpoint_indices,
+        crnlib::vector<selector_indices_details>& selector_indices,
+        crnlib::vector<uint32>& color_endpoints,
+        crnlib::vector<uint32>& alpha_endpoints,
+        crnlib::vector<uint32>& color_selectors,
+        crnlib::vector<uint64>& alpha_selectors,
+        const params& p)
+    {
+        const bool reuse_tiles = can_reuse_tiles(blocks, p);
+        if (reuse_tiles)
+        {
+            clear_pass();
+        }
+        else
+        {
+            clear();
+        }
+        m_has_etc_color_blocks = p.m_format == cETC1 || p.m_format == cETC2 || p.m_format == cETC2A || p.m_format == cETC1S || p.m_format == cETC2AS;
+        m_has_subblocks = p.m_format == cETC1 || p.m_format == cETC2 || p.m_format == cETC2A;
+        m_has_color_blocks = p.m_format == cDXT1 || p.m_format == cDXT5 || m_has_etc_color_blocks;
+        m_num_alpha_blocks = p.m_format == cDXT5 || p.m_format == cDXT5A || p.m_format == cETC2A || p.m_format == cETC2AS ? 1 : p.m_format == cDXN_XY || p.m_format == cDXN_YX ? 2
+                                                                                                                                                                               : 0;
+        if (!m_has_color_blocks && !m_num_alpha_blocks)
+        {
+            return false;
+        }
+        m_blocks = blocks;
+        m_main_thread_id = crn_get_current_thread_id();
+        m_pTask_pool = p.m_pTask_pool;
+        m_params = p;
+
+        if (reuse_tiles)
+        {
+            if (m_tile_blocks.size())
+            {
+                memcpy(m_blocks, m_tile_blocks.get_ptr(), m_tile_blocks.size_in_bytes());
+            }
+            m_endpoint_indices = m_tile_endpoint_indices;
+        }
+        else
+        {
+            determine_tiles();
+        }
+
+        for (uint c = 0; c < 3; c++)
+        {
+            m_block_selectors[c].resize(m_num_blocks);
+        }
+        m_selector_indices.resize(m_num_blocks);
+
         if (m_has_color_blocks)
         {
             determine_color_endpoints();
@@ -202,7 +295,7 @@ namespace crnlib
         hash_map<uint32, uint> color_endpoints_map;
         for (uint i = 0; i < m_color_clusters.size(); i++)
         {
-            if (m_color_clusters[i].pixels.size())
+            if (m_color_clusters[i].num_pixels)
             {
                 uint32 endpoint = m_has_etc_color_blocks ? m_color_clusters[i].first_endpoint : dxt1_block::pack_endpoints(m_color_clusters[i].first_endpoint, m_color_clusters[i].second_endpoint);
                 hash_map<uint32, uint>::insert_result insert_result = color_endpoints_map.insert(endpoint, color_endpoints.size());
@@ -223,7 +316,7 @@ namespace crnlib
         hash_map<uint32, uint> alpha_endpoints_map;
         for (uint i = 0; i < m_alpha_clusters.size(); i++)
         {
-            if (m_alpha_clusters[i].pixels.size())
+            if (m_alpha_clusters[i].num_pixels)
             {
                 uint32 endpoint = dxt5_block::pack_endpoints(m_alpha_clusters[i].first_endpoint, m_alpha_clusters[i].second_endpoint);
                 hash_map<uint32, uint>::insert_result insert_result = alpha_endpoints_map.insert(endpoint, alpha_endpoints.size());
@@ -286,11 +379,13 @@ namespace crnlib
             uint first_block = p.m_levels[level].m_first_block;
             uint end_block = first_block + p.m_levels[level].m_num_blocks;
             uint block_width = p.m_levels[level].m_block_width;
+            uint face_height = p.m_levels[level].m_num_blocks / block_width / p.m_num_faces;
             for (uint by = 0, b = first_block; b < end_block; by++)
             {
+                uint slice_row = p.m_slice_height ? by % face_height % p.m_slice_height : by;
                 for (uint bx = 0; bx < block_width; bx++, b++)
                 {
-                    bool top_match = by != 0;
+                    bool top_match = slice_row != 0;
                     bool left_match = top_match || bx;
                     bool diag_match = m_has_subblocks && top_match && bx;
                     for (uint c = m_has_color_blocks ? 0 : cAlpha0; c < cAlpha0 + m_num_alpha_blocks; c++)
@@ -383,9 +478,57 @@ namespace crnlib
         return *(vec2F*)result;
     }
 
+#if CRNLIB_X86_SIMD
+    // Four pixels per iteration: the selectors are turned into pshufb indices that gather the block colors.
+    CRNLIB_TARGET_SSE41 static uint get_tile_error_sse41(uint n, const color_quad_u8* pPixels, const color_quad_u8* pBlock_colors, const uint8* pSelectors)
+    {
+        const __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i palette = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pBlock_colors)), rgb_mask);
+        const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+        const __m128i channels = _mm_setr_epi8(0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3);
+
+        __m128i sum = zero;
+        for (uint p = 0; p < n; p += 4)
+        {
+            int selectors;
+            memcpy(&selectors, pSelectors + p, 4);
+            const __m128i index = _mm_add_epi8(_mm_slli_epi16(_mm_shuffle_epi8(_mm_cvtsi32_si128(selectors), spread), 2), channels);
+            const __m128i colors = _mm_shuffle_epi8(palette, index);
+            const __m128i px = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pPixels + p)), rgb_mask);
+            const __m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(px, zero), _mm_unpacklo_epi8(colors, zero));
+            const __m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(px, zero), _mm_unpackhi_epi8(colors, zero));
+            sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_madd_epi16(dlo, dlo), _mm_madd_epi16(dhi, dhi)));
+        }
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(sum);
+    }
+#endif
+
+    static uint get_tile_error(uint n, const color_quad_u8* pPixels, const color_quad_u8* pBlock_colors, const uint8* pSelectors)
+    {
+#if CRNLIB_X86_SIMD
+        if (crnlib_cpu_has_sse41())
+        {
+            return get_tile_error_sse41(n, pPixels, pBlock_colors, pSelectors);
+        }
+#endif
+        uint error = 0;
+        for (uint p = 0; p < n; p++)
+        {
+            for (uint8 c = 0; c < 3; c++)
+            {
+                uint delta = pPixels[p][c] - pBlock_colors[pSelectors[p]][c];
+                error += delta * delta;
+            }
+        }
+        return error;
+    }
+
     void dxt_hc::determine_tiles_task(uint64 data, void*)
     {
-        uint num_tasks = m_pTask_pool->get_num_threads() + 1;
+        uint num_tasks = m_params.m_num_helper_threads + 1;
         uint offsets[9] = { 0, 16, 32, 48, 0, 32, 64, 96, 64 };
         uint8 tiles[8][4] = { { 8 }, { 6, 7 }, { 4, 5 }, { 6, 1, 3 }, { 7, 0, 2 }, { 4, 2, 3 }, { 5, 0, 1 }, { 0, 2, 1, 3 } };
         color_quad_u8 tilePixels[128];
@@ -463,16 +606,7 @@ namespace crnlib
                             dxt_fast::compress_color_block(size, pixels, low16, high16, selectors);
                             color_quad_u8 block_colors[4];
                             dxt1_block::get_block_colors4(block_colors, low16, high16);
-                            uint error = 0;
-                            for (uint p = 0; p < size; p++)
-                            {
-                                for (uint8 c = 0; c < 3; c++)
-                                {
-                                    uint delta = pixels[p][c] - block_colors[selectors[p]][c];
-                                    error += delta * delta;
-                                }
-                            }
-                            tile_error[cColor][t] = error;
+                            tile_error[cColor][t] = get_tile_error(size, pixels, block_colors, selectors);
                         }
                         for (uint a = 0; a < m_num_alpha_blocks; a++)
                         {
@@ -531,19 +665,22 @@ namespace crnlib
                         }
                     }
 
-                    for (uint tile_index = 0, s = best_encoding + 1; s; s >>= 1, tile_index++)
+                    for (uint tile_index = 0, first_pixel = tile_offset << 4, s = best_encoding + 1; s; s >>= 1, tile_index++)
                     {
                         tile_details& tile = m_tiles[tile_offset | tile_index];
                         uint t = tiles[best_encoding][tile_index];
-                        tile.pixels.append(tilePixels + offsets[t], 16 << (t >> 2));
+                        tile.first_pixel = first_pixel;
+                        tile.num_pixels = 16 << (t >> 2);
+                        memcpy(&m_tile_pixels[first_pixel], tilePixels + offsets[t], tile.num_pixels * sizeof(color_quad_u8));
+                        first_pixel += tile.num_pixels;
                         tile.weight = weight;
                         if (m_has_color_blocks)
                         {
-                            tile.color_endpoint = palettize_color(tile.pixels.get_ptr(), tile.pixels.size());
+                            tile.color_endpoint = palettize_color(tilePixels + offsets[t], tile.num_pixels);
                         }
                         for (uint a = 0; a < m_num_alpha_blocks; a++)
                         {
-                            tile.alpha_endpoints[a] = palettize_alpha(tile.pixels.get_ptr(), tile.pixels.size(), m_params.m_alpha_component_indices[a]);
+                            tile.alpha_endpoints[a] = palettize_alpha(tilePixels + offsets[t], tile.num_pixels, m_params.m_alpha_component_indices[a]);
                         }
                     }
 
@@ -562,7 +699,7 @@ namespace crnlib
 
     void dxt_hc::determine_tiles_task_etc(uint64 data, void*)
     {
-        uint num_tasks = m_pTask_pool->get_num_threads() + 1;
+        uint num_tasks = m_params.m_num_helper_threads + 1;
         uint offsets[5] = { 0, 8, 16, 24, 16 };
         uint8 tiles[3][2] = { { 4 }, { 2, 3 }, { 0, 1 } };
         uint8 tile_map[3][2] = { { 0, 0 }, { 0, 1 }, { 0, 1 } };
@@ -633,13 +770,16 @@ namespace crnlib
                 }
 
                 vec2F alpha_endpoints = m_num_alpha_blocks ? palettize_alpha(tilePixels, 16, 3) : vec2F(cClear);
-                for (uint tile_index = 0, s = best_encoding + 1; s; s >>= 1, tile_index++)
+                for (uint tile_index = 0, first_pixel = b << 3, s = best_encoding + 1; s; s >>= 1, tile_index++)
                 {
                     tile_details& tile = m_tiles[b | tile_index];
                     uint t = tiles[best_encoding][tile_index];
-                    tile.pixels.append(tilePixels + offsets[t], 8 << (t >> 2));
+                    tile.first_pixel = first_pixel;
+                    tile.num_pixels = 8 << (t >> 2);
+                    memcpy(&m_tile_pixels[first_pixel], tilePixels + offsets[t], tile.num_pixels * sizeof(color_quad_u8));
+                    first_pixel += tile.num_pixels;
                     tile.weight = weight;
-                    tile.color_endpoint = palettize_color(tile.pixels.get_ptr(), tile.pixels.size());
+                    tile.color_endpoint = palettize_color(tilePixels + offsets[t], tile.num_pixels);
                     if (m_num_alpha_blocks)
                     {
                         tile.alpha_endpoints[0] = alpha_endpoints;
@@ -662,7 +802,7 @@ namespace crnlib
 
     void dxt_hc::determine_color_endpoint_codebook_task(uint64 data, void*)
     {
-        const uint num_tasks = m_pTask_pool->get_num_threads() + 1;
+        const uint num_tasks = m_params.m_num_helper_threads + 1;
         dxt1_endpoint_optimizer optimizer;
         dxt_endpoint_refiner refiner;
         crnlib::vector<uint8> selectors;
@@ -670,15 +810,15 @@ namespace crnlib
         for (uint cluster_index = (uint)data; cluster_index < m_color_clusters.size(); cluster_index += num_tasks)
         {
             color_cluster& cluster = m_color_clusters[cluster_index];
-            if (cluster.pixels.empty())
+            if (!cluster.num_pixels)
             {
                 continue;
             }
 
             dxt1_endpoint_optimizer::params params;
             params.m_block_index = cluster_index;
-            params.m_pPixels = cluster.pixels.get_ptr();
-            params.m_num_pixels = cluster.pixels.size();
+            params.m_pPixels = m_color_cluster_pixels.get_ptr() + cluster.first_pixel;
+            params.m_num_pixels = cluster.num_pixels;
             params.m_pixels_have_alpha = false;
             params.m_use_alpha_blocks = false;
             params.m_perceptual = m_params.m_perceptual;
@@ -711,8 +851,8 @@ namespace crnlib
                 encoding_weight[i] = math::lerp(1.15f, 1.0f, i / 7.0f);
             }
 
-            crnlib::vector<uint>& blocks = cluster.blocks[cColor];
-            for (uint i = 0; i < blocks.size(); i++)
+            const uint* blocks = m_color_cluster_blocks.get_ptr() + cluster.first_block;
+            for (uint i = 0; i < cluster.num_blocks; i++)
             {
                 uint b = blocks[i];
                 uint weight = (uint)(math::clamp<uint>(endpoint_weight * m_block_weights[b], 1, 2048) * encoding_weight[m_block_encodings[b]]);
@@ -740,8 +880,8 @@ namespace crnlib
             dxt_endpoint_refiner::results refinerResults;
             refinerParams.m_perceptual = m_params.m_perceptual;
             refinerParams.m_pSelectors = selectors.get_ptr();
-            refinerParams.m_pPixels = cluster.pixels.get_ptr();
-            refinerParams.m_num_pixels = cluster.pixels.size();
+            refinerParams.m_pPixels = m_color_cluster_pixels.get_ptr() + cluster.first_pixel;
+            refinerParams.m_num_pixels = cluster.num_pixels;
             refinerParams.m_dxt1_selectors = true;
             refinerParams.m_error_to_beat = results.m_error;
             refinerParams.m_block_index = cluster_index;
@@ -755,24 +895,24 @@ namespace crnlib
 
     void dxt_hc::determine_color_endpoint_codebook_task_etc(uint64 data, void*)
     {
-        uint num_tasks = m_pTask_pool->get_num_threads() + 1;
+        uint num_tasks = m_params.m_num_helper_threads + 1;
         uint8 delta[8][2] = { { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } };
         int scan[] = { -1, 0, 1 };
         int refine[] = { -3, -2, 2, 3 };
         for (uint iCluster = m_color_clusters.size() * data / num_tasks, iEnd = m_color_clusters.size() * (data + 1) / num_tasks; iCluster < iEnd; iCluster++)
         {
             color_cluster& cluster = m_color_clusters[iCluster];
-            if (cluster.pixels.size())
+            if (cluster.num_pixels)
             {
                 etc1_optimizer optimizer;
                 etc1_optimizer::params params;
                 params.m_use_color4 = false;
                 params.m_constrain_against_base_color5 = false;
                 etc1_optimizer::results results;
-                crnlib::vector<uint8> selectors(cluster.pixels.size());
-                params.m_pSrc_pixels = cluster.pixels.get_ptr();
+                crnlib::vector<uint8> selectors(cluster.num_pixels);
+                params.m_pSrc_pixels = m_color_cluster_pixels.get_ptr() + cluster.first_pixel;
                 results.m_pSelectors = selectors.get_ptr();
-                results.m_n = params.m_num_src_pixels = cluster.pixels.size();
+                results.m_n = params.m_num_src_pixels = cluster.num_pixels;
                 optimizer.init(params, results);
                 params.m_pScan_deltas = scan;
                 params.m_scan_delta_size = sizeof(scan) / sizeof(*scan);
@@ -804,9 +944,9 @@ namespace crnlib
                 }
                 float endpoint_weight = powf(math::minimum((cluster.color_values[3].get_luma() - cluster.color_values[0].get_luma()) / 100.0f, 1.0f), 2.7f);
 
-                crnlib::vector<uint>& blocks = cluster.blocks[cColor];
+                const uint* blocks = m_color_cluster_blocks.get_ptr() + cluster.first_block;
                 uint blockSize = m_has_subblocks ? 8 : 16;
-                for (uint i = 0; i < blocks.size(); i++)
+                for (uint i = 0; i < cluster.num_blocks; i++)
                 {
                     uint b = blocks[i];
                     color_quad_u8* pixels = m_has_subblocks ? ((color_quad_u8(*)[8])m_blocks)[b] : m_blocks[b];
@@ -836,151 +976,151 @@ namespace crnlib
     void dxt_hc::determine_color_endpoint_clusters_task(uint64 data, void* pData_ptr)
     {
         tree_clusterizer<vec6F>* vq = (tree_clusterizer<vec6F>*)pData_ptr;
-        const crnlib::vector<vec6F>& codebook = vq->get_codebook();
-        uint num_tasks = m_pTask_pool->get_num_threads() + 1;
+        uint num_tasks = m_params.m_num_helper_threads + 1;
         for (uint t = m_tiles.size() * data / num_tasks, tEnd = m_tiles.size() * (data + 1) / num_tasks; t < tEnd; t++)
         {
-            if (m_tiles[t].pixels.size())
+            if (m_tiles[t].num_pixels)
             {
                 const vec6F& v = m_tiles[t].color_endpoint;
-                float node_dist = codebook[vq->get_node_index(v)].squared_distance(v);
-                float best_dist = math::cNearlyInfinite;
-                uint best_index = 0;
-                for (uint i = 0; i < codebook.size(); i++)
-                {
-                    const vec6F& c = codebook[i];
-                    float dist = 0;
-                    float d0 = c[0] - v[0];
-                    dist += d0 * d0;
-                    float d1 = c[1] - v[1];
-                    dist += d1 * d1;
-                    if (dist > node_dist)
-                    {
-                        continue;
-                    }
-                    float d2 = c[2] - v[2];
-                    dist += d2 * d2;
-                    float d3 = c[3] - v[3];
-                    dist += d3 * d3;
-                    if (dist > node_dist)
-                    {
-                        continue;
-                    }
-                    float d4 = c[4] - v[4];
-                    dist += d4 * d4;
-                    float d5 = c[5] - v[5];
-                    dist += d5 * d5;
-                    if (dist < best_dist)
-                    {
-                        best_dist = dist;
-                        best_index = i;
-                        if (best_dist == 0.0f)
-                        {
-                            break;
-                        }
-                    }
-                }
-                m_tiles[t].cluster_indices[cColor] = best_index;
+                m_tiles[t].cluster_indices[cColor] = vq->find_nearest(v, vq->get_node_index(m_color_endpoint_vector_indices[t]));
             }
         }
     }
 
     void dxt_hc::determine_color_endpoints()
     {
-        uint num_tasks = m_pTask_pool->get_num_threads() + 1;
-        crnlib::vector<std::pair<vec6F, uint>> endpoints;
-        for (uint t = 0; t < m_tiles.size(); t++)
+        uint num_tasks = m_params.m_num_helper_threads + 1;
+        crnlib::vector<vec6F>& vectors = m_color_endpoint_vectors;
+        crnlib::vector<uint>& weights = m_color_endpoint_weights;
+        if (vectors.empty())
         {
-            if (m_tiles[t].pixels.size())
+            // The tile index is kept below the weight, so that each tile can be mapped to its merged vector.
+            crnlib::vector<std::pair<vec6F, uint64>> endpoints;
+            for (uint t = 0; t < m_tiles.size(); t++)
             {
-                endpoints.push_back(std::make_pair(m_tiles[t].color_endpoint, (uint)(m_tiles[t].pixels.size() * m_tiles[t].weight)));
+                if (m_tiles[t].num_pixels)
+                {
+                    endpoints.push_back(std::make_pair(m_tiles[t].color_endpoint, (uint64)(uint)(m_tiles[t].num_pixels * m_tiles[t].weight) << 32 | t));
+                }
             }
-        }
 
-        struct Node
-        {
-            std::pair<vec6F, uint>*p, *pEnd;
-            Node(std::pair<vec6F, uint>* begin, std::pair<vec6F, uint>* end) :
-                p(begin), pEnd(end)
+            struct Node
+            {
+                std::pair<vec6F, uint64>*p, *pEnd;
+                Node(std::pair<vec6F, uint64>* begin, std::pair<vec6F, uint64>* end) :
+                    p(begin), pEnd(end)
+                {
+                }
+                bool operator<(const Node& other) const
+                {
+                    return *p > *other.p;
+                }
+                static void sort_task(uint64 data, void* ptr)
+                {
+                    std::sort(((Node*)ptr)->p, ((Node*)ptr)->pEnd);
+                }
+            };
+
+            crnlib::vector<Node> nodes;
+            Node node(0, endpoints.get_ptr());
+            for (uint i = 0; i < num_tasks; i++)
             {
+                node.p = node.pEnd;
+                node.pEnd = endpoints.get_ptr() + endpoints.size() * (i + 1) / num_tasks;
+                if (node.p != node.pEnd)
+                {
+                    nodes.push_back(node);
+                }
             }
-            bool operator<(const Node& other) const
+
+            for (uint i = 0; i < nodes.size(); i++)
             {
-                return *p > *other.p;
+                m_pTask_pool->queue_task(&Node::sort_task, i, &nodes[i]);
             }
-            static void sort_task(uint64 data, void* ptr)
+            m_pTask_pool->join();
+
+            std::priority_queue<Node> queue;
+            for (uint i = 0; i < nodes.size(); i++)
             {
-                std::sort(((Node*)ptr)->p, ((Node*)ptr)->pEnd);
+                queue.push(nodes[i]);
             }
-        };
 
-        crnlib::vector<Node> nodes;
-        Node node(0, endpoints.get_ptr());
-        for (uint i = 0; i < num_tasks; i++)
-        {
-            node.p = node.pEnd;
-            node.pEnd = endpoints.get_ptr() + endpoints.size() * (i + 1) / num_tasks;
-            if (node.p != node.pEnd)
+            vectors.reserve(endpoints.size());
+            weights.reserve(endpoints.size());
+            m_color_endpoint_vector_indices.resize(m_tiles.size());
+            while (queue.size())
             {
-                nodes.push_back(node);
+                Node node = queue.top();
+                std::pair<vec6F, uint64>* endpoint = node.p++;
+                queue.pop();
+                if(node.p != node.pEnd)
+                {
+                    queue.push(node);
+                }
+                uint weight = (uint)(endpoint->second >> 32);
+                if (!vectors.size() || endpoint->first != vectors.back())
+                {
+                    vectors.push_back(endpoint->first);
+                    weights.push_back(weight);
+                }
+                else if (weights.back() > UINT_MAX - weight)
+                {
+                    weights.back() = UINT_MAX;
+                }
+                else
+                {
+                    weights.back() += weight;
+                }
+                m_color_endpoint_vector_indices[(uint)endpoint->second] = vectors.size() - 1;
             }
         }
 
-        for (uint i = 0; i < nodes.size(); i++)
-        {
-            m_pTask_pool->queue_task(&Node::sort_task, i, &nodes[i]);
-        }
-        m_pTask_pool->join();
+        tree_clusterizer<vec6F> vq;
+        vq.generate_codebook(vectors.get_ptr(), weights.get_ptr(), vectors.size(), math::minimum<uint>(m_num_tiles, m_params.m_color_endpoint_codebook_size), true, m_pTask_pool, m_params.m_num_helper_threads + 1);
+        vq.generate_search_tree();
+        m_color_clusters.resize(vq.get_codebook_size());
 
-        std::priority_queue<Node> queue;
-        for (uint i = 0; i < nodes.size(); i++)
+        for (uint i = 0; i <= m_params.m_num_helper_threads; i++)
         {
-            queue.push(nodes[i]);
+            m_pTask_pool->queue_object_task(this, &dxt_hc::determine_color_endpoint_clusters_task, i, &vq);
         }
+        m_pTask_pool->join();
 
-        crnlib::vector<vec6F> vectors;
-        crnlib::vector<uint> weights;
-        vectors.reserve(endpoints.size());
-        weights.reserve(endpoints.size());
-        while (queue.size())
+        // Lay the pixels and the blocks out cluster by cluster, in tile and block order.
+        uint total_pixels = 0;
+        for (uint t = 0; t < m_num_blocks; t++)
         {
-            Node node = queue.top();
-            std::pair<vec6F, uint>* endpoint = node.p++;
-            queue.pop();
-            if(node.p != node.pEnd)
-            {
-                queue.push(node);
-            }
-            if (!vectors.size() || endpoint->first != vectors.back())
-            {
-                vectors.push_back(endpoint->first);
-                weights.push_back(endpoint->second);
-            }
-            else if (weights.back() > UINT_MAX - endpoint->second)
-            {
-                weights.back() = UINT_MAX;
-            }
-            else
+            if (m_tiles[t].num_pixels)
             {
-                weights.back() += endpoint->second;
+                m_color_clusters[m_tiles[t].cluster_indices[cColor]].num_pixels += m_tiles[t].num_pixels;
+                total_pixels += m_tiles[t].num_pixels;
             }
         }
-
-        tree_clusterizer<vec6F> vq;
-        vq.generate_codebook(vectors.get_ptr(), weights.get_ptr(), vectors.size(), math::minimum<uint>(m_num_tiles, m_params.m_color_endpoint_codebook_size), true, m_pTask_pool);
-        m_color_clusters.resize(vq.get_codebook_size());
-
-        for (uint i = 0; i <= m_pTask_pool->get_num_threads(); i++)
+        for (uint b = 0; b < m_num_blocks; b++)
         {
-            m_pTask_pool->queue_object_task(this, &dxt_hc::determine_color_endpoint_clusters_task, i, &vq);
+            m_color_clusters[m_tiles[m_tile_indices[b]].cluster_indices[cColor]].num_blocks++;
         }
-        m_pTask_pool->join();
+        for (uint i = 0, first_pixel = 0, first_block = 0; i < m_color_clusters.size(); i++)
+        {
+            color_cluster& cluster = m_color_clusters[i];
+            cluster.first_pixel = first_pixel;
+            first_pixel += cluster.num_pixels;
+            cluster.num_pixels = 0;
+            cluster.first_block = first_block;
+            first_block += cluster.num_blocks;
+            cluster.num_blocks = 0;
+        }
+        m_color_cluster_pixels.resize(total_pixels);
+        m_color_cluster_blocks.resize(m_num_blocks);
 
         for (uint t = 0; t < m_num_blocks; t++)
         {
-            if (m_tiles[t].pixels.size())
+            const tile_details& tile = m_tiles[t];
+            if (tile.num_pixels)
             {
-                m_color_clusters[m_tiles[t].cluster_indices[cColor]].pixels.append(m_tiles[t].pixels);
+                color_cluster& cluster = m_color_clusters[tile.cluster_indices[cColor]];
+                memcpy(m_color_cluster_pixels.get_ptr() + cluster.first_pixel + cluster.num_pixels, m_tile_pixels.get_ptr() + tile.first_pixel, tile.num_pixels * sizeof(color_quad_u8));
+                cluster.num_pixels += tile.num_pixels;
             }
         }
 
@@ -988,7 +1128,8 @@ namespace crnlib
         {
             uint cluster_index = m_tiles[m_tile_indices[b]].cluster_indices[cColor];
             m_endpoint_indices[b].component[cColor] = cluster_index;
-            m_color_clusters[cluster_index].blocks[cColor].push_back(b);
+            color_cluster& cluster = m_color_clusters[cluster_index];
+            m_color_cluster_blocks[cluster.first_block + cluster.num_blocks++] = b;
             if (m_has_subblocks && m_endpoint_indices[b].reference && cluster_index == m_endpoint_indices[b - 1].component[cColor])
             {
                 if (m_endpoint_indices[b].reference >> 1)
@@ -1004,7 +1145,7 @@ namespace crnlib
             }
         }
 
-        for (uint i = 0; i <= m_pTask_pool->get_num_threads(); i++)
+        for (uint i = 0; i <= m_params.m_num_helper_threads; i++)
         {
             m_pTask_pool->queue_object_task(this, m_has_etc_color_blocks ? &dxt_hc::determine_color_endpoint_codebook_task_etc : &dxt_hc::determine_color_endpoint_codebook_task, i, nullptr);
         }
@@ -1013,7 +1154,7 @@ namespace crnlib
 
     void dxt_hc::determine_alpha_endpoint_codebook_task(uint64 data, void*)
     {
-        const uint num_tasks = m_pTask_pool->get_num_threads() + 1;
+        const uint num_tasks = m_params.m_num_helper_threads + 1;
         dxt5_endpoint_optimizer optimizer;
         dxt_endpoint_refiner refiner;
         crnlib::vector<uint8> selectors;
@@ -1021,14 +1162,14 @@ namespace crnlib
         for (uint cluster_index = (uint)data; cluster_index < m_alpha_clusters.size(); cluster_index += num_tasks)
         {
             alpha_cluster& cluster = m_alpha_clusters[cluster_index];
-            if (cluster.pixels.empty())
+            if (!cluster.num_pixels)
             {
                 continue;
             }
 
             dxt5_endpoint_optimizer::params params;
-            params.m_pPixels = cluster.pixels.get_ptr();
-            params.m_num_pixels = cluster.pixels.size();
+            params.m_pPixels = m_alpha_cluster_pixels.get_ptr() + cluster.first_pixel;
+            params.m_num_pixels = cluster.num_pixels;
             params.m_comp_index = 0;
             params.m_quality = cCRNDXTQualityUber;
             params.m_use_both_block_types = false;
@@ -1074,8 +1215,8 @@ namespace crnlib
             for (uint a = 0; a < m_num_alpha_blocks; a++)
             {
                 uint component_index = m_params.m_alpha_component_indices[a];
-                crnlib::vector<uint>& blocks = cluster.blocks[cAlpha0 + a];
-                for (uint i = 0; i < blocks.size(); i++)
+                const uint* blocks = m_alpha_cluster_blocks.get_ptr() + cluster.first_block[a];
+                for (uint i = 0; i < cluster.num_blocks[a]; i++)
                 {
                     uint b = blocks[i];
                     uint weight = encoding_weight[m_block_encodings[b]];
@@ -1106,8 +1247,8 @@ namespace crnlib
             dxt_endpoint_refiner::results refinerResults;
             refinerParams.m_perceptual = m_params.m_perceptual;
             refinerParams.m_pSelectors = selectors.get_ptr();
-            refinerParams.m_pPixels = cluster.pixels.get_ptr();
-            refinerParams.m_num_pixels = cluster.pixels.size();
+            refinerParams.m_pPixels = m_alpha_cluster_pixels.get_ptr() + cluster.first_pixel;
+            refinerParams.m_num_pixels = cluster.num_pixels;
             refinerParams.m_dxt1_selectors = false;
             refinerParams.m_error_to_beat = results.m_error;
             refinerParams.m_block_index = cluster_index;
@@ -1132,31 +1273,15 @@ namespace crnlib
     void dxt_hc::determine_alpha_endpoint_clusters_task(uint64 data, void* pData_ptr)
     {
         tree_clusterizer<vec2F>* vq = (tree_clusterizer<vec2F>*)pData_ptr;
-        const crnlib::vector<vec2F>& codebook = vq->get_codebook();
-        uint num_tasks = m_pTask_pool->get_num_threads() + 1;
+        uint num_tasks = m_params.m_num_helper_threads + 1;
         for (uint t = m_tiles.size() * data / num_tasks, tEnd = m_tiles.size() * (data + 1) / num_tasks; t < tEnd; t++)
         {
-            if (m_tiles[t].pixels.size())
+            if (m_tiles[t].num_pixels)
             {
                 for (uint a = 0; a < m_num_alpha_blocks; a++)
                 {
                     const vec2F& v = m_tiles[t].alpha_endpoints[a];
-                    float best_dist = math::cNearlyInfinite;
-                    uint best_index = 0;
-                    for (uint i = 0; i < codebook.size(); i++)
-                    {
-                        float dist = (codebook[i][0] - v[0]) * (codebook[i][0] - v[0]) + (codebook[i][1] - v[1]) * (codebook[i][1] - v[1]);
-                        if (dist < best_dist)
-                        {
-                            best_dist = dist;
-                            best_index = i;
-                            if (best_dist == 0.0f)
-                            {
-                                break;
-                            }
-                        }
-                    }
-                    m_tiles[t].cluster_indices[cAlpha0 + a] = best_index;
+                    m_tiles[t].cluster_indices[cAlpha0 + a] = vq->find_nearest(v);
                 }
             }
         }
@@ -1164,111 +1289,160 @@ namespace crnlib
 
     void dxt_hc::determine_alpha_endpoints()
     {
-        uint num_tasks = m_pTask_pool->get_num_threads() + 1;
-        crnlib::vector<std::pair<vec2F, uint>> endpoints;
-        for (uint a = 0; a < m_num_alpha_blocks; a++)
+        uint num_tasks = m_params.m_num_helper_threads + 1;
+        crnlib::vector<vec2F>& vectors = m_alpha_endpoint_vectors;
+        crnlib::vector<uint>& weights = m_alpha_endpoint_weights;
+        if (vectors.empty())
         {
-            for (uint t = 0; t < m_tiles.size(); t++)
+            crnlib::vector<std::pair<vec2F, uint>> endpoints;
+            for (uint a = 0; a < m_num_alpha_blocks; a++)
             {
-                if (m_tiles[t].pixels.size())
+                for (uint t = 0; t < m_tiles.size(); t++)
                 {
-                    endpoints.push_back(std::make_pair(m_tiles[t].alpha_endpoints[a], m_tiles[t].pixels.size()));
+                    if (m_tiles[t].num_pixels)
+                    {
+                        endpoints.push_back(std::make_pair(m_tiles[t].alpha_endpoints[a], m_tiles[t].num_pixels));
+                    }
                 }
             }
-        }
 
-        struct Node
-        {
-            std::pair<vec2F, uint>*p, *pEnd;
-            Node(std::pair<vec2F, uint>* begin, std::pair<vec2F, uint>* end) :
-                p(begin), pEnd(end)
+            struct Node
+            {
+                std::pair<vec2F, uint>*p, *pEnd;
+                Node(std::pair<vec2F, uint>* begin, std::pair<vec2F, uint>* end) :
+                    p(begin), pEnd(end)
+                {
+                }
+                bool operator<(const Node& other) const
+                {
+                    return *p > *other.p;
+                }
+                static void sort_task(uint64 data, void* ptr)
+                {
+                    std::sort(((Node*)ptr)->p, ((Node*)ptr)->pEnd);
+                }
+            };
+
+            crnlib::vector<Node> nodes;
+            Node node(0, endpoints.get_ptr());
+            for (uint i = 0; i < num_tasks; i++)
             {
+                node.p = node.pEnd;
+                node.pEnd = endpoints.get_ptr() + endpoints.size() * (i + 1) / num_tasks;
+                if (node.p != node.pEnd)
+                {
+                    nodes.push_back(node);
+                }
             }
-            bool operator<(const Node& other) const
+
+            for (uint i = 0; i < nodes.size(); i++)
             {
-                return *p > *other.p;
+                m_pTask_pool->queue_task(&Node::sort_task, i, &nodes[i]);
             }
-            static void sort_task(uint64 data, void* ptr)
+            m_pTask_pool->join();
+
+            std::priority_queue<Node> queue;
+            for (uint i = 0; i < nodes.size(); i++)
             {
-                std::sort(((Node*)ptr)->p, ((Node*)ptr)->pEnd);
+                queue.push(nodes[i]);
             }
-        };
 
-        crnlib::vector<Node> nodes;
-        Node node(0, endpoints.get_ptr());
-        for (uint i = 0; i < num_tasks; i++)
-        {
-            node.p = node.pEnd;
-            node.pEnd = endpoints.get_ptr() + endpoints.size() * (i + 1) / num_tasks;
-            if (node.p != node.pEnd)
+            vectors.reserve(endpoints.size());
+            weights.reserve(endpoints.size());
+            while (queue.size())
             {
-                nodes.push_back(node);
+                Node node = queue.top();
+                std::pair<vec2F, uint>* endpoint = node.p++;
+                queue.pop();
+                if (node.p != node.pEnd)
+                {
+                    queue.push(node);
+                }
+                if (!vectors.size() || endpoint->first != vectors.back())
+                {
+                    vectors.push_back(endpoint->first);
+                    weights.push_back(endpoint->second);
+                }
+                else if (weights.back() > UINT_MAX - endpoint->second)
+                {
+                    weights.back() = UINT_MAX;
+                }
+                else
+                {
+                    weights.back() += endpoint->second;
+                }
             }
         }
 
-        for (uint i = 0; i < nodes.size(); i++)
-        {
-            m_pTask_pool->queue_task(&Node::sort_task, i, &nodes[i]);
-        }
-        m_pTask_pool->join();
+        tree_clusterizer<vec2F> vq;
+        vq.generate_codebook(vectors.get_ptr(), weights.get_ptr(), vectors.size(), math::minimum<uint>(m_num_tiles, m_params.m_alpha_endpoint_codebook_size), false, m_pTask_pool, m_params.m_num_helper_threads + 1);
+        vq.generate_search_tree();
+        m_alpha_clusters.resize(vq.get_codebook_size());
 
-        std::priority_queue<Node> queue;
-        for (uint i = 0; i < nodes.size(); i++)
+        for (uint i = 0; i < num_tasks; i++)
         {
-            queue.push(nodes[i]);
+            m_pTask_pool->queue_object_task(this, &dxt_hc::determine_alpha_endpoint_clusters_task, i, &vq);
         }
+        m_pTask_pool->join();
 
-        crnlib::vector<vec2F> vectors;
-        crnlib::vector<uint> weights;
-        vectors.reserve(endpoints.size());
-        weights.reserve(endpoints.size());
-        while (queue.size())
+        // Lay the pixels and the blocks out cluster by cluster, in component, tile and block order.
+        uint total_pixels = 0, total_blocks = 0;
+        for (uint a = 0; a < m_num_alpha_blocks; a++)
         {
-            Node node = queue.top();
-            std::pair<vec2F, uint>* endpoint = node.p++;
-            queue.pop();
-            if (node.p != node.pEnd)
-            {
-                queue.push(node);
-            }
-            if (!vectors.size() || endpoint->first != vectors.back())
-            {
-                vectors.push_back(endpoint->first);
-                weights.push_back(endpoint->second);
-            }
-            else if (weights.back() > UINT_MAX - endpoint->second)
+            for (uint t = 0; t < m_num_blocks; t++)
             {
-                weights.back() = UINT_MAX;
+                if (m_tiles[t].num_pixels)
+                {
+                    m_alpha_clusters[m_tiles[t].cluster_indices[cAlpha0 + a]].num_pixels += m_tiles[t].num_pixels;
+                    total_pixels += m_tiles[t].num_pixels;
+                }
             }
-            else
+        }
+        for (uint b = 0; b < m_num_blocks; b++)
+        {
+            for (uint a = 0; a < m_num_alpha_blocks; a++)
             {
-                weights.back() += endpoint->second;
+                uint cluster_index = m_tiles[m_tile_indices[b]].cluster_indices[cAlpha0 + a];
+                m_endpoint_indices[b].component[cAlpha0 + a] = cluster_index;
+                if (!(m_has_subblocks && b & 1))
+                {
+                    m_alpha_clusters[cluster_index].num_blocks[a]++;
+                    total_blocks++;
+                }
             }
         }
-
-        tree_clusterizer<vec2F> vq;
-        vq.generate_codebook(vectors.get_ptr(), weights.get_ptr(), vectors.size(), math::minimum<uint>(m_num_tiles, m_params.m_alpha_endpoint_codebook_size), false, m_pTask_pool);
-        m_alpha_clusters.resize(vq.get_codebook_size());
-
-        for (uint i = 0; i < num_tasks; i++)
+        for (uint i = 0, first_pixel = 0, first_block = 0; i < m_alpha_clusters.size(); i++)
         {
-            m_pTask_pool->queue_object_task(this, &dxt_hc::determine_alpha_endpoint_clusters_task, i, &vq);
+            alpha_cluster& cluster = m_alpha_clusters[i];
+            cluster.first_pixel = first_pixel;
+            first_pixel += cluster.num_pixels;
+            cluster.num_pixels = 0;
+            for (uint a = 0; a < m_num_alpha_blocks; a++)
+            {
+                cluster.first_block[a] = first_block;
+                first_block += cluster.num_blocks[a];
+                cluster.num_blocks[a] = 0;
+            }
         }
-        m_pTask_pool->join();
+        m_alpha_cluster_pixels.resize(total_pixels);
+        m_alpha_cluster_blocks.resize(total_blocks);
 
         for (uint a = 0; a < m_num_alpha_blocks; a++)
         {
             uint component_index = m_params.m_alpha_component_indices[a];
             for (uint t = 0; t < m_num_blocks; t++)
             {
-                crnlib::vector<color_quad_u8>& source = m_tiles[t].pixels;
-                if (source.size())
+                const tile_details& tile = m_tiles[t];
+                if (tile.num_pixels)
                 {
-                    crnlib::vector<color_quad_u8>& destination = m_alpha_clusters[m_tiles[t].cluster_indices[cAlpha0 + a]].pixels;
-                    for (uint p = 0; p < source.size(); p++)
+                    alpha_cluster& cluster = m_alpha_clusters[tile.cluster_indices[cAlpha0 + a]];
+                    const color_quad_u8* pSource = m_tile_pixels.get_ptr() + tile.first_pixel;
+                    color_quad_u8* pDestination = m_alpha_cluster_pixels.get_ptr() + cluster.first_pixel + cluster.num_pixels;
+                    for (uint p = 0; p < tile.num_pixels; p++)
                     {
-                        destination.push_back(color_quad_u8(source[p][component_index]));
+                        pDestination[p] = color_quad_u8(pSource[p][component_index]);
                     }
+                    cluster.num_pixels += tile.num_pixels;
                 }
             }
         }
@@ -1277,11 +1451,10 @@ namespace crnlib
         {
             for (uint a = 0; a < m_num_alpha_blocks; a++)
             {
-                uint cluster_index = m_tiles[m_tile_indices[b]].cluster_indices[cAlpha0 + a];
-                m_endpoint_indices[b].component[cAlpha0 + a] = cluster_index;
                 if (!(m_has_subblocks && b & 1))
                 {
-                    m_alpha_clusters[cluster_index].blocks[cAlpha0 + a].push_back(b);
+                    alpha_cluster& cluster = m_alpha_clusters[m_endpoint_indices[b].component[cAlpha0 + a]];
+                    m_alpha_cluster_blocks[cluster.first_block[a] + cluster.num_blocks[a]++] = b;
                 }
             }
         }
@@ -1305,11 +1478,13 @@ namespace crnlib
 
     void dxt_hc::create_color_selector_codebook_task(uint64 data, void* pData_ptr)
     {
-        crnlib::vector<color_selector_details>& selector_details = *static_cast<crnlib::vector<color_selector_details>*>(pData_ptr);
-        uint num_tasks = m_pTask_pool->get_num_threads() + 1;
+        crnlib::vector<crnlib::vector<color_selector_details>>& task_details = *static_cast<crnlib::vector<crnlib::vector<color_selector_details>>*>(pData_ptr);
+        crnlib::vector<color_selector_details>& selector_details = task_details[(uint)data];
+        uint num_tasks = task_details.size();
         uint E2[16][4];
         uint E4[8][16];
         uint E8[4][256];
+        uint best_index = 0;
         for (uint n = m_has_subblocks ? m_num_blocks >> 1 : m_num_blocks, b = n * data / num_tasks, bEnd = n * (data + 1) / num_tasks; b < bEnd; b++)
         {
             color_cluster& cluster = m_color_clusters[m_endpoint_indices[b].color];
@@ -1328,24 +1503,19 @@ namespace crnlib
                     E4[p][s] = E2[p << 1][s & 3] + E2[p << 1 | 1][s >> 2];
                 }
             }
+            uint min_errors[4] = { 0, 0, 0, 0 };
             for (uint p = 0; p < 4; p++)
             {
                 for (uint s = 0; s < 256; s++)
                 {
                     E8[p][s] = E4[p << 1][s & 15] + E4[p << 1 | 1][s >> 4];
                 }
-            }
-            uint best_index = 0;
-            for (uint best_error = cUINT32_MAX, s = 0; s < m_color_selectors.size(); s++)
-            {
-                uint32 selector = m_color_selectors[s];
-                uint error = E8[0][selector & 255] + E8[1][selector >> 8 & 255] + E8[2][selector >> 16 & 255] + E8[3][selector >> 24 & 255];
-                if (error < best_error)
+                for (uint q = p << 2; q < (p + 1) << 2; q++)
                 {
-                    best_error = error;
-                    best_index = s;
+                    min_errors[p] += math::minimum(math::minimum(E2[q][0], E2[q][1]), math::minimum(E2[q][2], E2[q][3]));
                 }
             }
+            best_index = m_color_selector_index.find_nearest(E8, min_errors, best_index);
             uint(&total_errors)[16][4] = selector_details[best_index].error;
             for (uint p = 0; p < 16; p++)
             {
@@ -1378,7 +1548,7 @@ namespace crnlib
 
     void dxt_hc::create_color_selector_codebook()
     {
-        uint num_tasks = m_pTask_pool->get_num_threads() + 1;
+        uint num_tasks = m_params.m_num_helper_threads + 1;
         crnlib::vector<uint64> selectors(m_has_subblocks ? m_num_blocks >> 1 : m_num_blocks);
         for (uint i = 0, b = 0, step = m_has_subblocks ? 2 : 1; b < m_num_blocks; b += step)
         {
@@ -1452,7 +1622,7 @@ namespace crnlib
         }
 
         tree_clusterizer<vec16F> selector_vq;
-        selector_vq.generate_codebook(vectors.get_ptr(), weights.get_ptr(), vectors.size(), m_params.m_color_selector_codebook_size, false, m_pTask_pool);
+        selector_vq.generate_codebook(vectors.get_ptr(), weights.get_ptr(), vectors.size(), m_params.m_color_selector_codebook_size, false, m_pTask_pool, m_params.m_num_helper_threads + 1);
         m_color_selectors.resize(selector_vq.get_codebook_size());
         m_color_selectors_used.resize(selector_vq.get_codebook_size());
         for (uint i = 0; i < selector_vq.get_codebook_size(); i++)
@@ -1464,34 +1634,47 @@ namespace crnlib
                 m_color_selectors[i] |= (uint)(v[j] * 4.0f) << sh;
             }
         }
+        m_color_selector_index.init(m_color_selectors);
 
-        crnlib::vector<crnlib::vector<color_selector_details>> selector_details(num_tasks);
-        for (uint t = 0; t < num_tasks; t++)
+        // Every task accumulates the errors of the whole codebook, so the number of tasks is limited to the number of blocks per
+        // codebook entry. The selector assignment is exact, so the result doesn't depend on the partitioning.
+        uint num_selector_tasks = math::clamp<uint>(selectors.size() / math::maximum<uint>(m_color_selectors.size(), 1), 1, num_tasks);
+        crnlib::vector<crnlib::vector<color_selector_details>> selector_details(num_selector_tasks);
+        for (uint t = 0; t < num_selector_tasks; t++)
         {
             selector_details[t].resize(m_color_selectors.size());
-            m_pTask_pool->queue_object_task(this, &dxt_hc::create_color_selector_codebook_task, t, &selector_details[t]);
+            m_pTask_pool->queue_object_task(this, &dxt_hc::create_color_selector_codebook_task, t, &selector_details);
         }
         m_pTask_pool->join();
 
-        for (uint t = 1; t < num_tasks; t++)
+        for (uint t = 0; t < num_tasks; t++)
         {
-            for (uint i = 0; i < m_color_selectors.size(); i++)
+            m_pTask_pool->queue_object_task(this, &dxt_hc::merge_color_selector_details_task, t, &selector_details);
+        }
+        m_pTask_pool->join();
+    }
+
+    void dxt_hc::merge_color_selector_details_task(uint64 data, void* pData_ptr)
+    {
+        crnlib::vector<crnlib::vector<color_selector_details>>& selector_details = *static_cast<crnlib::vector<crnlib::vector<color_selector_details>>*>(pData_ptr);
+        uint num_tasks = m_params.m_num_helper_threads + 1;
+        for (uint i = m_color_selectors.size() * data / num_tasks, iEnd = m_color_selectors.size() * (data + 1) / num_tasks; i < iEnd; i++)
+        {
+            uint(&errors)[16][4] = selector_details[0][i].error;
+            bool used = selector_details[0][i].used;
+            for (uint t = 1; t < selector_details.size(); t++)
             {
                 for (uint8 p = 0; p < 16; p++)
                 {
                     for (uint8 s = 0; s < 4; s++)
                     {
-                        selector_details[0][i].error[p][s] += selector_details[t][i].error[p][s];
+                        errors[p][s] += selector_details[t][i].error[p][s];
                     }
                 }
-                selector_details[0][i].used = selector_details[0][i].used || selector_details[t][i].used;
+                used = used || selector_details[t][i].used;
             }
-        }
 
-        for (uint i = 0; i < m_color_selectors.size(); i++)
-        {
-            m_color_selectors_used[i] = selector_details[0][i].used;
-            uint(&errors)[16][4] = selector_details[0][i].error;
+            m_color_selectors_used[i] = used;
             m_color_selectors[i] = 0;
             for (uint sh = 0, p = 0; p < 16; p++, sh += 2)
             {
@@ -1515,10 +1698,12 @@ namespace crnlib
 
     void dxt_hc::create_alpha_selector_codebook_task(uint64 data, void* pData_ptr)
     {
-        crnlib::vector<alpha_selector_details>& selector_details = *static_cast<crnlib::vector<alpha_selector_details>*>(pData_ptr);
-        uint num_tasks = m_pTask_pool->get_num_threads() + 1;
+        crnlib::vector<crnlib::vector<alpha_selector_details>>& task_details = *static_cast<crnlib::vector<crnlib::vector<alpha_selector_details>>*>(pData_ptr);
+        crnlib::vector<alpha_selector_details>& selector_details = task_details[(uint)data];
+        uint num_tasks = task_details.size();
         uint E3[16][8];
         uint E6[8][64];
+        uint best_indices[2] = { 0, 0 };
         for (uint n = m_has_subblocks ? m_num_blocks >> 1 : m_num_blocks, b = n * data / num_tasks, bEnd = n * (data + 1) / num_tasks; b < bEnd; b++)
         {
             for (uint c = cAlpha0; c < cAlpha0 + m_num_alpha_blocks; c++)
@@ -1534,31 +1719,25 @@ namespace crnlib
                         E3[p][s] = delta * delta;
                     }
                 }
+                uint min_errors[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
                 for (uint p = 0; p < 8; p++)
                 {
                     for (uint s = 0; s < 64; s++)
                     {
                         E6[p][s] = E3[p << 1][s & 7] + E3[p << 1 | 1][s >> 3];
                     }
-                }
-                uint best_index = 0;
-                for (uint best_error = cUINT32_MAX, s = 0; s < m_alpha_selectors.size(); s++)
-                {
-                    uint64 selector = m_alpha_selectors[s];
-                    uint error = E6[0][selector & 63];
-                    error += E6[1][selector >> 6 & 63];
-                    error += E6[2][selector >> 12 & 63];
-                    error += E6[3][selector >> 18 & 63];
-                    error += E6[4][selector >> 24 & 63];
-                    error += E6[5][selector >> 30 & 63];
-                    error += E6[6][selector >> 36 & 63];
-                    error += E6[7][selector >> 42 & 63];
-                    if (error < best_error)
+                    for (uint q = p << 1; q < (p + 1) << 1; q++)
                     {
-                        best_error = error;
-                        best_index = s;
+                        uint min_error = E3[q][0];
+                        for (uint s = 1; s < 8; s++)
+                        {
+                            min_error = math::minimum(min_error, E3[q][s]);
+                        }
+                        min_errors[p] += min_error;
                     }
                 }
+                uint& best_index = best_indices[c - cAlpha0];
+                best_index = m_alpha_selector_index.find_nearest(E6, min_errors, best_index);
                 if (cluster.refined_alpha)
                 {
                     block_values = cluster.refined_alpha_values;
@@ -1587,7 +1766,7 @@ namespace crnlib
 
     void dxt_hc::create_alpha_selector_codebook()
     {
-        uint num_tasks = m_pTask_pool->get_num_threads() + 1;
+        uint num_tasks = m_params.m_num_helper_threads + 1;
         crnlib::vector<uint64> selectors(m_num_alpha_blocks * (m_has_subblocks ? m_num_blocks >> 1 : m_num_blocks));
         for (uint i = 0, c = cAlpha0; c < cAlpha0 + m_num_alpha_blocks; c++)
         {
@@ -1664,7 +1843,7 @@ namespace crnlib
         }
 
         tree_clusterizer<vec16F> selector_vq;
-        selector_vq.generate_codebook(vectors.get_ptr(), weights.get_ptr(), vectors.size(), m_params.m_alpha_selector_codebook_size, false, m_pTask_pool);
+        selector_vq.generate_codebook(vectors.get_ptr(), weights.get_ptr(), vectors.size(), m_params.m_alpha_selector_codebook_size, false, m_pTask_pool, m_params.m_num_helper_threads + 1);
         m_alpha_selectors.resize(selector_vq.get_codebook_size());
         m_alpha_selectors_used.resize(selector_vq.get_codebook_size());
         for (uint i = 0; i < selector_vq.get_codebook_size(); i++)
@@ -1676,34 +1855,45 @@ namespace crnlib
                 m_alpha_selectors[i] |= (uint64)(v[j] * 8.0f) << sh;
             }
         }
+        m_alpha_selector_index.init(m_alpha_selectors);
 
-        crnlib::vector<crnlib::vector<alpha_selector_details>> selector_details(num_tasks);
-        for (uint t = 0; t < num_tasks; t++)
+        uint num_selector_tasks = math::clamp<uint>(selectors.size() / math::maximum<uint>(m_alpha_selectors.size(), 1), 1, num_tasks);
+        crnlib::vector<crnlib::vector<alpha_selector_details>> selector_details(num_selector_tasks);
+        for (uint t = 0; t < num_selector_tasks; t++)
         {
             selector_details[t].resize(m_alpha_selectors.size());
-            m_pTask_pool->queue_object_task(this, &dxt_hc::create_alpha_selector_codebook_task, t, &selector_details[t]);
+            m_pTask_pool->queue_object_task(this, &dxt_hc::create_alpha_selector_codebook_task, t, &selector_details);
         }
         m_pTask_pool->join();
 
-        for (uint t = 1; t < num_tasks; t++)
+        for (uint t = 0; t < num_tasks; t++)
         {
-            for (uint i = 0; i < m_alpha_selectors.size(); i++)
+            m_pTask_pool->queue_object_task(this, &dxt_hc::merge_alpha_selector_details_task, t, &selector_details);
+        }
+        m_pTask_pool->join();
+    }
+
+    void dxt_hc::merge_alpha_selector_details_task(uint64 data, void* pData_ptr)
+    {
+        crnlib::vector<crnlib::vector<alpha_selector_details>>& selector_details = *static_cast<crnlib::vector<crnlib::vector<alpha_selector_details>>*>(pData_ptr);
+        uint num_tasks = m_params.m_num_helper_threads + 1;
+        for (uint i = m_alpha_selectors.size() * data / num_tasks, iEnd = m_alpha_selectors.size() * (data + 1) / num_tasks; i < iEnd; i++)
+        {
+            uint(&errors)[16][8] = selector_details[0][i].error;
+            bool used = selector_details[0][i].used;
+            for (uint t = 1; t < selector_details.size(); t++)
             {
                 for (uint8 p = 0; p < 16; p++)
                 {
                     for (uint8 s = 0; s < 8; s++)
                     {
-                        selector_details[0][i].error[p][s] += selector_details[t][i].error[p][s];
+                        errors[p][s] += selector_details[t][i].error[p][s];
                     }
                 }
-                selector_details[0][i].used = selector_details[0][i].used || selector_details[t][i].used;
+                used = used || selector_details[t][i].used;
             }
-        }
 
-        for (uint i = 0; i < m_alpha_selectors.size(); i++)
-        {
-            m_alpha_selectors_used[i] = selector_details[0][i].used;
-            uint(&errors)[16][8] = selector_details[0][i].error;
+            m_alpha_selectors_used[i] = used;
             m_alpha_selectors[i] = 0;
             for (uint sh = 0, p = 0; p < 16; p++, sh += 3)
             {
@@ -40,6 +40,118 @@ namespace crnlib
 {
     const uint cTotalCompressionPhases = 25;
 
+    // Exact nearest codeword search over a selector codebook. A codeword is made of cNumDigits digits of cDigitBits bits
+    // (the selectors of 4 pixels for DXT1, 2 pixels for DXT5A), and its error is the sum of the errors of its digits, which
+    // are looked up in E[digit][value]. Codewords are grouped by their first two digits, and a group is skipped when the
+    // error of these digits plus the smallest possible error of the remaining digits is already above the best error found.
+    // Returns the same codeword as an exhaustive search, including the lowest index on ties.
+    template <uint cDigitBits, uint cNumDigits>
+    class selector_search_index
+    {
+    public:
+        enum
+        {
+            cDigitValues = 1U << cDigitBits,
+            cDigitMask = cDigitValues - 1U
+        };
+
+        template <typename T>
+        void init(const crnlib::vector<T>& codewords)
+        {
+            m_codewords.resize(codewords.size());
+            crnlib::vector<uint64> keys(codewords.size());
+            for (uint i = 0; i < codewords.size(); i++)
+            {
+                m_codewords[i] = codewords[i];
+                uint64 digits = (m_codewords[i] & cDigitMask) << cDigitBits | (m_codewords[i] >> cDigitBits & cDigitMask);
+                keys[i] = digits << 32 | i;
+            }
+            std::sort(keys.begin(), keys.end());
+
+            m_sorted_codewords.resize(keys.size());
+            m_sorted_indices.resize(keys.size());
+            m_groups[0].resize(0);
+            m_groups[1].resize(0);
+            for (uint i = 0; i < keys.size(); i++)
+            {
+                uint index = (uint)keys[i];
+                uint digits = (uint)(keys[i] >> 32);
+                m_sorted_codewords[i] = m_codewords[index] >> (2 * cDigitBits);
+                m_sorted_indices[i] = index;
+                if (!i || digits != (uint)(keys[i - 1] >> 32))
+                {
+                    if (!i || digits >> cDigitBits != (uint)(keys[i - 1] >> 32) >> cDigitBits)
+                    {
+                        group g = { digits >> cDigitBits, m_groups[1].size(), m_groups[1].size() };
+                        m_groups[0].push_back(g);
+                    }
+                    group g = { digits & cDigitMask, i, i };
+                    m_groups[1].push_back(g);
+                    m_groups[0].back().end++;
+                }
+                m_groups[1].back().end++;
+            }
+        }
+
+        // min_errors[d] is the smallest error in E[d]. hint is the index of a codeword likely to be close, such as the result for the previous block.
+        uint find_nearest(const uint (*E)[cDigitValues], const uint* min_errors, uint hint) const
+        {
+            uint rest[cNumDigits + 1];
+            rest[cNumDigits] = 0;
+            for (uint d = cNumDigits - 1; d >= 1; d--)
+                rest[d] = rest[d + 1] + min_errors[d];
+
+            uint best_index = hint;
+            uint best_error = 0;
+            uint64 hint_codeword = m_codewords[hint];
+            for (uint d = 0; d < cNumDigits; d++, hint_codeword >>= cDigitBits)
+                best_error += E[d][hint_codeword & cDigitMask];
+
+            for (uint i = 0; i < m_groups[0].size(); i++)
+            {
+                const group& g0 = m_groups[0][i];
+                uint error0 = E[0][g0.digit];
+                if (error0 + rest[1] > best_error)
+                    continue;
+                for (uint j = g0.begin; j < g0.end; j++)
+                {
+                    const group& g1 = m_groups[1][j];
+                    uint error1 = error0 + E[1][g1.digit];
+                    if (error1 + rest[2] > best_error)
+                        continue;
+                    for (uint k = g1.begin; k < g1.end; k++)
+                    {
+                        uint error = error1;
+                        uint64 codeword = m_sorted_codewords[k];
+                        for (uint d = 2; d < cNumDigits; d++, codeword >>= cDigitBits)
+                            error += E[d][codeword & cDigitMask];
+                        if (error < best_error || (error == best_error && m_sorted_indices[k] < best_index))
+                        {
+                            best_error = error;
+                            best_index = m_sorted_indices[k];
+                        }
+                    }
+                }
+            }
+            return best_index;
+        }
+
+    private:
+        struct group
+        {
+            uint digit;
+            uint begin;
+            uint end;
+        };
+
+        crnlib::vector<uint64> m_codewords;
+        // The codewords sorted by their first two digits, shifted down past them, and their indices in m_codewords.
+        crnlib::vector<uint64> m_sorted_codewords;
+        crnlib::vector<uint> m_sorted_indices;
+        // m_groups[0] are the ranges of m_groups[1] sharing the first digit, m_groups[1] the ranges of m_sorted_codewords sharing the first two digits.
+        crnlib::vector<group> m_groups[2];
+    };
+
     class dxt_hc
     {
     public:
@@ -83,15 +195,24 @@ namespace crnlib
             }
         };
 
+        // The pixels of a tile are num_pixels entries of m_tile_pixels, starting at first_pixel.
         struct tile_details
         {
-            crnlib::vector<color_quad_u8> pixels;
+            tile_details() :
+                first_pixel(0),
+                num_pixels(0)
+            {
+            }
+
+            uint first_pixel;
+            uint num_pixels;
             float weight;
             vec<6, float> color_endpoint;
             vec<2, float> alpha_endpoints[2];
             uint16 cluster_indices[3];
         };
         crnlib::vector<tile_details> m_tiles;
+        crnlib::vector<color_quad_u8> m_tile_pixels;
         uint m_num_tiles;
         float m_color_derating[cCRNMaxLevels][8];
         float m_alpha_derating[8];
@@ -109,6 +230,8 @@ namespace crnlib
         crnlib::vector<uint> m_tile_indices;
         crnlib::vector<endpoint_indices_details> m_endpoint_indices;
         crnlib::vector<selector_indices_details> m_selector_indices;
+        selector_search_index<8, 4> m_color_selector_index;
+        selector_search_index<6, 8> m_alpha_selector_index;
 
         struct params
         {
@@ -119,6 +242,7 @@ namespace crnlib
                 m_format(cDXT1),
                 m_perceptual(true),
                 m_hierarchical(true),
+                m_slice_height(0),
                 m_color_endpoint_codebook_size(3072),
                 m_color_selector_codebook_size(3072),
                 m_alpha_endpoint_codebook_size(3072),
@@ -126,6 +250,8 @@ namespace crnlib
                 m_adaptive_tile_color_psnr_derating(2.0f),
                 m_adaptive_tile_alpha_psnr_derating(2.0f),
                 m_adaptive_tile_color_alpha_weighting_ratio(3.0f),
+                m_pTask_pool(nullptr),
+                m_num_helper_threads(0),
                 m_debugging(false),
                 m_pProgress_func(0),
                 m_pProgress_func_data(0)
@@ -156,6 +282,10 @@ namespace crnlib
             bool m_perceptual;
             bool m_hierarchical;
 
+            // Block rows per independently decodable slice of each face, or 0 if the levels aren't sliced.
+            // Endpoint references never cross a slice boundary.
+            uint m_slice_height;
+
             uint m_color_endpoint_codebook_size;
             uint m_color_selector_codebook_size;
             uint m_alpha_endpoint_codebook_size;
@@ -167,12 +297,19 @@ namespace crnlib
             uint m_alpha_component_indices[2];
 
             task_pool* m_pTask_pool;
+            // The work is split into m_num_helper_threads + 1 tasks, whatever the size of m_pTask_pool, so the output doesn't depend on it.
+            uint m_num_helper_threads;
             bool m_debugging;
             crn_progress_callback_func m_pProgress_func;
             void* m_pProgress_func_data;
         };
 
+        // Releases everything, including the tile analysis cached by compress().
         void clear();
+
+        // The tile analysis of the blocks and the per-tile endpoint vectors don't depend on the codebook sizes,
+        // so they are kept after a successful call and reused if compress() is called again on the same blocks
+        // with the same tile parameters (as during a bitrate search). Call clear() if the block contents change.
         bool compress(
             color_quad_u8 (*blocks)[16],
             crnlib::vector<endpoint_indices_details>& endpoint_indices,
@@ -199,32 +336,48 @@ namespace crnlib
             cNumComps = 3
         };
 
+        // The pixels and blocks of the clusters are stored contiguously, cluster by cluster, in m_color_cluster_pixels and m_color_cluster_blocks.
         struct color_cluster
         {
             color_cluster() :
+                first_pixel(0),
+                num_pixels(0),
+                first_block(0),
+                num_blocks(0),
                 first_endpoint(0),
                 second_endpoint(0)
             {
             }
 
-            crnlib::vector<uint> blocks[3];
-            crnlib::vector<color_quad_u8> pixels;
+            uint first_pixel;
+            uint num_pixels;
+            uint first_block;
+            uint num_blocks;
             uint first_endpoint;
             uint second_endpoint;
             color_quad_u8 color_values[4];
         };
         crnlib::vector<color_cluster> m_color_clusters;
+        crnlib::vector<color_quad_u8> m_color_cluster_pixels;
+        crnlib::vector<uint> m_color_cluster_blocks;
 
+        // Same for m_alpha_cluster_pixels and m_alpha_cluster_blocks. The blocks are kept separately for each alpha component.
         struct alpha_cluster
         {
             alpha_cluster() :
+                first_pixel(0),
+                num_pixels(0),
                 first_endpoint(0),
                 second_endpoint(0)
             {
+                utils::zero_object(first_block);
+                utils::zero_object(num_blocks);
             }
 
-            crnlib::vector<uint> blocks[3];
-            crnlib::vector<color_quad_u8> pixels;
+            uint first_pixel;
+            uint num_pixels;
+            uint first_block[2];
+            uint num_blocks[2];
             uint first_endpoint;
             uint second_endpoint;
             uint alpha_values[8];
@@ -232,6 +385,18 @@ namespace crnlib
             uint refined_alpha_values[8];
         };
         crnlib::vector<alpha_cluster> m_alpha_clusters;
+        crnlib::vector<color_quad_u8> m_alpha_cluster_pixels;
+        crnlib::vector<uint> m_alpha_cluster_blocks;
+
+        bool m_tiles_valid;
+        crnlib::vector<color_quad_u8> m_tile_blocks;
+        crnlib::vector<endpoint_indices_details> m_tile_endpoint_indices;
+        crnlib::vector<vec<6, float>> m_color_endpoint_vectors;
+        crnlib::vector<uint> m_color_endpoint_weights;
+        // Index of the tile's endpoint in m_color_endpoint_vectors.
+        crnlib::vector<uint> m_color_endpoint_vector_indices;
+        crnlib::vector<vec<2, float>> m_alpha_endpoint_vectors;
+        crnlib::vector<uint> m_alpha_endpoint_weights;
 
         crn_thread_id_t m_main_thread_id;
         bool m_canceled;
@@ -240,6 +405,10 @@ namespace crnlib
         int m_prev_phase_index;
         int m_prev_percentage_complete;
 
+        void clear_pass();
+        bool can_reuse_tiles(color_quad_u8 (*blocks)[16], const params& p) const;
+        void determine_tiles();
+
         vec<6, float> palettize_color(color_quad_u8* pixels, uint pixels_count);
         vec<2, float> palettize_alpha(color_quad_u8* pixels, uint pixels_count, uint comp_index);
         void determine_tiles_task(uint64 data, void* pData_ptr);
@@ -255,9 +424,11 @@ namespace crnlib
         void determine_alpha_endpoints();
 
         void create_color_selector_codebook_task(uint64 data, void* pData_ptr);
+        void merge_color_selector_details_task(uint64 data, void* pData_ptr);
         void create_color_selector_codebook();
 
         void create_alpha_selector_codebook_task(uint64 data, void* pData_ptr);
+        void merge_alpha_selector_details_task(uint64 data, void* pData_ptr);
         void create_alpha_selector_codebook();
 
         bool update_progress(uint phase_index, uint subphase_index, uint subphase_total);
@@ -30,6 +30,7 @@
 #include "crn_dxt_fast.h"
 #include "crn_console.h"
 #include "crn_threading.h"
+#include "crn_timer.h"
 
 #if CRNLIB_SUPPORT_ATI_COMPRESS
 #ifdef _DLL
@@ -271,81 +272,118 @@ namespace crnlib
         return true;
     }
 
+    // The blocks are compressed in tiles of whole block rows, which the tasks take in order until none are left.
     struct init_task_params
     {
+        enum
+        {
+            cMinBlocksPerTile = 128
+        };
+
+        struct task_stats
+        {
+            uint m_num_blocks;
+            uint m_num_tiles;
+            double m_time;
+        };
+
         dxt_format m_fmt;
         const image_u8* m_pImg;
         const dxt_image::pack_params* m_pParams;
         crn_thread_id_t m_main_thread;
+        uint m_rows_per_tile;
+        uint m_num_tiles;
+        volatile atomic32_t m_next_tile;
+        volatile atomic32_t m_num_blocks_done;
         atomic32_t m_canceled;
+        crnlib::vector<task_stats> m_task_stats;
     };
 
     void dxt_image::init_task(uint64 data, void* pData_ptr)
     {
-        const uint thread_index = static_cast<uint>(data);
+        const uint task_index = static_cast<uint>(data);
         init_task_params* pInit_params = static_cast<init_task_params*>(pData_ptr);
 
         const image_u8& img = *pInit_params->m_pImg;
         const pack_params& p = *pInit_params->m_pParams;
         const bool is_main_thread = (crn_get_current_thread_id() == pInit_params->m_main_thread);
 
-        uint block_index = 0;
+        timer t;
+        t.start();
+
+        uint num_blocks = 0;
+        uint num_tiles = 0;
 
         set_block_pixels_context optimizer_context;
         int prev_progress_percentage = -1;
 
-        for (uint block_y = 0; block_y < m_blocks_y; block_y++)
+        for (;;)
         {
-            const uint pixel_ofs_y = block_y * cDXTBlockSize;
+            const uint tile_index = atomic_increment32(&pInit_params->m_next_tile) - 1;
+            if (tile_index >= pInit_params->m_num_tiles)
+            {
+                break;
+            }
 
-            for (uint block_x = 0; block_x < m_blocks_x; block_x++, block_index++)
+            // Each tile starts from the same optimizer state, so the output doesn't depend on which thread compresses it.
+            optimizer_context.clear_cache();
+            num_tiles++;
+
+            const uint first_row = tile_index * pInit_params->m_rows_per_tile;
+            const uint end_row = math::minimum(first_row + pInit_params->m_rows_per_tile, m_blocks_y);
+            for (uint block_y = first_row; block_y < end_row; block_y++)
             {
-                if (pInit_params->m_canceled)
-                {
-                    return;
-                }
+                const uint pixel_ofs_y = block_y * cDXTBlockSize;
 
-                if (p.m_pProgress_callback && is_main_thread && ((block_index & 63) == 63))
+                for (uint block_x = 0; block_x < m_blocks_x; block_x++)
                 {
-                    const uint progress_percentage = p.m_progress_start + ((block_index * p.m_progress_range + get_total_blocks() / 2) / get_total_blocks());
-                    if ((int)progress_percentage != prev_progress_percentage)
+                    if (pInit_params->m_canceled)
                     {
-                        prev_progress_percentage = progress_percentage;
-                        if (!(p.m_pProgress_callback)(progress_percentage, p.m_pProgress_callback_user_data_ptr))
-                        {
-                            atomic_exchange32(&pInit_params->m_canceled, CRNLIB_TRUE);
-                            return;
-                        }
+                        return;
                     }
-                }
 
-                if (p.m_num_helper_threads)
-                {
-                    if ((block_index % (p.m_num_helper_threads + 1)) != thread_index)
+                    color_quad_u8 pixels[cDXTBlockSize * cDXTBlockSize];
+
+                    const uint pixel_ofs_x = block_x * cDXTBlockSize;
+
+                    for (uint y = 0; y < cDXTBlockSize; y++)
                     {
-                        continue;
+                        const uint iy = math::minimum(pixel_ofs_y + y, img.get_height() - 1);
+
+                        for (uint x = 0; x < cDXTBlockSize; x++)
+                        {
+                            const uint ix = math::minimum(pixel_ofs_x + x, img.get_width() - 1);
+
+                            pixels[x + y * cDXTBlockSize] = img(ix, iy);
+                        }
                     }
-                }
 
-                color_quad_u8 pixels[cDXTBlockSize * cDXTBlockSize];
+                    set_block_pixels(block_x, block_y, pixels, p, optimizer_context);
+                }
 
-                const uint pixel_ofs_x = block_x * cDXTBlockSize;
+                num_blocks += m_blocks_x;
+                const uint num_blocks_done = atomic_add32(&pInit_params->m_num_blocks_done, m_blocks_x);
 
-                for (uint y = 0; y < cDXTBlockSize; y++)
+                if (p.m_pProgress_callback && is_main_thread)
                 {
-                    const uint iy = math::minimum(pixel_ofs_y + y, img.get_height() - 1);
-
-                    for (uint x = 0; x < cDXTBlockSize; x++)
+                    const uint progress_percentage = p.m_progress_start + ((num_blocks_done * p.m_progress_range + get_total_blocks() / 2) / get_total_blocks());
+                    if ((int)progress_percentage != prev_progress_percentage)
                     {
-                        const uint ix = math::minimum(pixel_ofs_x + x, img.get_width() - 1);
-
-                        pixels[x + y * cDXTBlockSize] = img(ix, iy);
+                        prev_progress_percentage = progress_percentage;
+                        if (!(p.m_pProgress_callback)(progress_percentage, p.m_pProgress_callback_user_data_ptr))
+                        {
+                            atomic_exchange32(&pInit_params->m_canceled, CRNLIB_TRUE);
+                            return;
+                        }
                     }
                 }
-
-                set_block_pixels(block_x, block_y, pixels, p, optimizer_context);
             }
         }
+
+        init_task_params::task_stats& stats = pInit_params->m_task_stats[task_index];
+        stats.m_num_blocks = num_blocks;
+        stats.m_num_tiles = num_tiles;
+        stats.m_time = t.get_elapsed_secs();
     }
 
 #if CRNLIB_SUPPORT_ATI_COMPRESS
@@ -458,37 +496,63 @@ namespace crnlib
         }
 #endif
 
-        task_pool* pPool = p.m_pTask_pool;
-
-        task_pool tmp_pool;
-        if (!pPool)
+        scoped_task_pool pool;
+        if (!pool.init(p.m_pTask_pool, p.m_num_helper_threads))
         {
-            if (!tmp_pool.init(p.m_num_helper_threads))
-            {
-                return false;
-            }
-            pPool = &tmp_pool;
+            return false;
         }
+        task_pool* pPool = pool.get();
 
         init_task_params init_params;
         init_params.m_fmt = fmt;
         init_params.m_pImg = &img;
         init_params.m_pParams = &p;
         init_params.m_main_thread = crn_get_current_thread_id();
+        // Tiles of at least cMinBlocksPerTile blocks, independent of the number of threads.
+        init_params.m_rows_per_tile = math::maximum<uint>(1U, (init_task_params::cMinBlocksPerTile + m_blocks_x - 1) / m_blocks_x);
+        init_params.m_num_tiles = (m_blocks_y + init_params.m_rows_per_tile - 1) / init_params.m_rows_per_tile;
+        init_params.m_next_tile = 0;
+        init_params.m_num_blocks_done = 0;
         init_params.m_canceled = false;
 
-        for (uint i = 0; i <= p.m_num_helper_threads; i++)
+        const uint num_tasks = math::minimum(pPool->get_num_threads() + 1, init_params.m_num_tiles);
+        init_params.m_task_stats.resize(num_tasks);
+        for (uint i = 0; i < num_tasks; i++)
         {
-            pPool->queue_object_task(this, &dxt_image::init_task, i, &init_params);
+            utils::zero_object(init_params.m_task_stats[i]);
         }
 
-        pPool->join();
+        timer t;
+        t.start();
+
+        if (num_tasks < 2)
+        {
+            init_task(0, &init_params);
+        }
+        else
+        {
+            pPool->queue_multiple_object_tasks(this, &dxt_image::init_task, 0, num_tasks, &init_params);
+            pPool->join();
+        }
 
         if (init_params.m_canceled)
         {
             return false;
         }
 
+        if (p.m_debugging)
+        {
+            const double total_time = t.get_elapsed_secs();
+            console::debug("DXT pack: %ux%u, %u tiles of %u block rows, %u tasks, %3.3fs, %.0f blocks/s", m_width, m_height, init_params.m_num_tiles,
+                init_params.m_rows_per_tile, num_tasks, total_time, total_time > 0.0f ? get_total_blocks() / total_time : 0.0f);
+            for (uint i = 0; i < num_tasks; i++)
+            {
+                const init_task_params::task_stats& stats = init_params.m_task_stats[i];
+                console::debug("  Task %u: %u blocks in %u tiles, %3.3fs, %.0f blocks/s", i, stats.m_num_blocks, stats.m_num_tiles, stats.m_time,
+                    stats.m_time > 0.0f ? stats.m_num_blocks / stats.m_time : 0.0f);
+            }
+        }
+
         return true;
     }
 
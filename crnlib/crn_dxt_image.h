@@ -186,6 +186,7 @@ namespace crnlib
                 m_progress_start = 0;
                 m_progress_range = 100;
                 m_use_transparent_indices_for_black = false;
+                m_debugging = false;
                 m_pTask_pool = nullptr;
             }
 
@@ -200,6 +201,7 @@ namespace crnlib
                 m_endpoint_caching = (params.m_flags & cCRNCompFlagDisableEndpointCaching) == 0;
                 m_grayscale_sampling = (params.m_flags & cCRNCompFlagGrayscaleSampling) != 0;
                 m_compressor = params.m_dxt_compressor_type;
+                m_debugging = (params.m_flags & cCRNCompFlagDebugging) != 0;
             }
 
             uint m_dxt1a_alpha_threshold;
@@ -216,6 +218,7 @@ namespace crnlib
             bool m_use_both_block_types;
             bool m_endpoint_caching;
             bool m_use_transparent_indices_for_black;
+            bool m_debugging;
 
             typedef bool (*progress_callback_func)(uint percentage_complete, void* pUser_data_ptr);
             progress_callback_func m_pProgress_callback;
@@ -278,6 +281,12 @@ namespace crnlib
 
         struct set_block_pixels_context
         {
+            // Forgets the previous blocks, so the next block is compressed exactly as it would be with a new context.
+            void clear_cache()
+            {
+                m_dxt1_optimizer.clear_prev_results();
+            }
+
             dxt1_endpoint_optimizer m_dxt1_optimizer;
             dxt5_endpoint_optimizer m_dxt5_optimizer;
             pack_etc1_block_context m_etc1_optimizer;
@@ -26,6 +26,10 @@
 #include "crn_radix_sort.h"
 #include "crn_ryg_dxt.hpp"
 
+#if CRNLIB_X86_SIMD
+#include <immintrin.h>
+#endif
+
 namespace crnlib
 {
     const int g_etc1_inten_tables[cETC1IntenModifierValues][cETC1SelectorValues] = {
@@ -974,6 +978,7 @@ namespace crnlib
         m_selectors.resize(n);
         m_best_selectors.resize(n);
         m_temp_selectors.resize(n);
+        m_inten_table_selectors.resize(n * cETC1IntenModifierValues);
         m_trial_solution.m_selectors.resize(n);
         m_best_solution.m_selectors.resize(n);
 
@@ -1022,6 +1027,174 @@ namespace crnlib
         m_best_solution.m_error = cUINT64_MAX;
     }
 
+#if CRNLIB_X86_SIMD
+    // The SIMD kernels below compute the error and selectors of all eight intensity tables for one base color.
+    // They pick the lowest selector on ties like the scalar loop in evaluate_solution(), and dropping its early out
+    // never changes which table wins, so the results are identical. The 32-bit lane sums are flushed every
+    // cETC1SIMDChunkPixels pixels to stay clear of overflow on large clusters.
+    static const uint cETC1SIMDChunkPixels = 4096;
+
+    static void etc1_get_inten_table_colors(const color_quad_u8& base_color, uint inten_table, color_quad_u8* pColors)
+    {
+        const int* pInten_table = g_etc1_inten_tables[inten_table];
+        for (uint s = 0; s < 4; s++)
+        {
+            const int yd = pInten_table[s];
+            pColors[s].set(base_color.r + yd, base_color.g + yd, base_color.b + yd, 0);
+        }
+    }
+
+    static inline uint etc1_find_best_selector(const color_quad_u8& src_pixel, const color_quad_u8* pColors, uint8& selector)
+    {
+        uint best_error = color::elucidian_distance(src_pixel, pColors[0], false);
+        selector = 0;
+        for (uint s = 1; s < 4; s++)
+        {
+            const uint error = color::elucidian_distance(src_pixel, pColors[s], false);
+            if (error < best_error)
+            {
+                best_error = error;
+                selector = static_cast<uint8>(s);
+            }
+        }
+        return best_error;
+    }
+
+    CRNLIB_TARGET_SSE41 static inline __m128i etc1_pixel_errors_sse41(__m128i lo, __m128i hi, __m128i color)
+    {
+        const __m128i dlo = _mm_sub_epi16(lo, color);
+        const __m128i dhi = _mm_sub_epi16(hi, color);
+        return _mm_hadd_epi32(_mm_madd_epi16(dlo, dlo), _mm_madd_epi16(dhi, dhi));
+    }
+
+    CRNLIB_TARGET_SSE41 static void etc1_evaluate_inten_tables_sse41(uint n, const color_quad_u8* pSrc_pixels, const color_quad_u8& base_color, uint64* pErrors, uint8* pSelectors)
+    {
+        const __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i zero = _mm_setzero_si128();
+        const uint n4 = n & ~3U;
+
+        for (uint inten_table = 0; inten_table < cETC1IntenModifierValues; inten_table++, pSelectors += n)
+        {
+            color_quad_u8 block_colors[4];
+            etc1_get_inten_table_colors(base_color, inten_table, block_colors);
+            __m128i colors[4];
+            for (uint s = 0; s < 4; s++)
+            {
+                const color_quad_u8& c = block_colors[s];
+                colors[s] = _mm_setr_epi16(c.r, c.g, c.b, 0, c.r, c.g, c.b, 0);
+            }
+
+            uint64 total_error = 0;
+            for (uint i = 0; i < n4;)
+            {
+                const uint chunk_end = math::minimum(n4, i + cETC1SIMDChunkPixels);
+                __m128i sum = zero;
+                for (; i < chunk_end; i += 4)
+                {
+                    const __m128i px = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc_pixels + i)), rgb_mask);
+                    const __m128i lo = _mm_unpacklo_epi8(px, zero);
+                    const __m128i hi = _mm_unpackhi_epi8(px, zero);
+
+                    __m128i best = etc1_pixel_errors_sse41(lo, hi, colors[0]);
+                    __m128i sel = zero;
+                    for (int s = 1; s < 4; s++)
+                    {
+                        const __m128i error = etc1_pixel_errors_sse41(lo, hi, colors[s]);
+                        const __m128i better = _mm_cmplt_epi32(error, best);
+                        best = _mm_min_epi32(best, error);
+                        sel = _mm_blendv_epi8(sel, _mm_set1_epi32(s), better);
+                    }
+                    sum = _mm_add_epi32(sum, best);
+
+                    const int packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(sel, sel), zero));
+                    memcpy(pSelectors + i, &packed, 4);
+                }
+                sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+                sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+                total_error += static_cast<uint>(_mm_cvtsi128_si32(sum));
+            }
+            for (uint i = n4; i < n; i++)
+            {
+                total_error += etc1_find_best_selector(pSrc_pixels[i], block_colors, pSelectors[i]);
+            }
+            pErrors[inten_table] = total_error;
+        }
+    }
+
+    CRNLIB_TARGET_AVX2 static inline __m256i etc1_pixel_errors_avx2(__m256i lo, __m256i hi, __m256i color)
+    {
+        const __m256i dlo = _mm256_sub_epi16(lo, color);
+        const __m256i dhi = _mm256_sub_epi16(hi, color);
+        return _mm256_hadd_epi32(_mm256_madd_epi16(dlo, dlo), _mm256_madd_epi16(dhi, dhi));
+    }
+
+    // Same as the SSE4.1 kernel, but evaluates two intensity tables at once, one per 128-bit lane.
+    CRNLIB_TARGET_AVX2 static void etc1_evaluate_inten_tables_avx2(uint n, const color_quad_u8* pSrc_pixels, const color_quad_u8& base_color, uint64* pErrors, uint8* pSelectors)
+    {
+        const __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+        const __m256i zero = _mm256_setzero_si256();
+        const uint n4 = n & ~3U;
+
+        for (uint inten_table = 0; inten_table < cETC1IntenModifierValues; inten_table += 2, pSelectors += n * 2)
+        {
+            color_quad_u8 block_colors[2][4];
+            etc1_get_inten_table_colors(base_color, inten_table, block_colors[0]);
+            etc1_get_inten_table_colors(base_color, inten_table + 1, block_colors[1]);
+            __m256i colors[4];
+            for (uint s = 0; s < 4; s++)
+            {
+                const color_quad_u8& c0 = block_colors[0][s];
+                const color_quad_u8& c1 = block_colors[1][s];
+                colors[s] = _mm256_setr_epi16(c0.r, c0.g, c0.b, 0, c0.r, c0.g, c0.b, 0, c1.r, c1.g, c1.b, 0, c1.r, c1.g, c1.b, 0);
+            }
+
+            uint8* pSelectors0 = pSelectors;
+            uint8* pSelectors1 = pSelectors + n;
+            uint64 total_error[2] = { 0, 0 };
+            for (uint i = 0; i < n4;)
+            {
+                const uint chunk_end = math::minimum(n4, i + cETC1SIMDChunkPixels);
+                __m256i sum = zero;
+                for (; i < chunk_end; i += 4)
+                {
+                    const __m128i px128 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc_pixels + i)), rgb_mask);
+                    const __m256i px = _mm256_broadcastsi128_si256(px128);
+                    const __m256i lo = _mm256_unpacklo_epi8(px, zero);
+                    const __m256i hi = _mm256_unpackhi_epi8(px, zero);
+
+                    __m256i best = etc1_pixel_errors_avx2(lo, hi, colors[0]);
+                    __m256i sel = zero;
+                    for (int s = 1; s < 4; s++)
+                    {
+                        const __m256i error = etc1_pixel_errors_avx2(lo, hi, colors[s]);
+                        const __m256i better = _mm256_cmpgt_epi32(best, error);
+                        best = _mm256_min_epi32(best, error);
+                        sel = _mm256_blendv_epi8(sel, _mm256_set1_epi32(s), better);
+                    }
+                    sum = _mm256_add_epi32(sum, best);
+
+                    const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(sel, sel), zero);
+                    const int packed0 = _mm256_cvtsi256_si32(packed);
+                    const int packed1 = _mm256_extract_epi32(packed, 4);
+                    memcpy(pSelectors0 + i, &packed0, 4);
+                    memcpy(pSelectors1 + i, &packed1, 4);
+                }
+                sum = _mm256_add_epi32(sum, _mm256_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+                sum = _mm256_add_epi32(sum, _mm256_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+                total_error[0] += static_cast<uint>(_mm256_cvtsi256_si32(sum));
+                total_error[1] += static_cast<uint>(_mm256_extract_epi32(sum, 4));
+            }
+            for (uint i = n4; i < n; i++)
+            {
+                total_error[0] += etc1_find_best_selector(pSrc_pixels[i], block_colors[0], pSelectors0[i]);
+                total_error[1] += etc1_find_best_selector(pSrc_pixels[i], block_colors[1], pSelectors1[i]);
+            }
+            pErrors[inten_table] = total_error[0];
+            pErrors[inten_table + 1] = total_error[1];
+        }
+    }
+#endif
+
     bool etc1_optimizer::evaluate_solution(const etc1_solution_coordinates& coords, potential_solution& trial_solution, potential_solution* pBest_solution)
     {
         trial_solution.m_valid = false;
@@ -1045,6 +1218,38 @@ namespace crnlib
 
         trial_solution.m_error = cUINT64_MAX;
 
+#if CRNLIB_X86_SIMD
+        if (crnlib_cpu_has_sse41())
+        {
+            uint64 errors[cETC1IntenModifierValues];
+            uint8* pSelectors = m_inten_table_selectors.get_ptr();
+            if (crnlib_cpu_has_avx2())
+            {
+                etc1_evaluate_inten_tables_avx2(n, m_pParams->m_pSrc_pixels, base_color, errors, pSelectors);
+            }
+            else
+            {
+                etc1_evaluate_inten_tables_sse41(n, m_pParams->m_pSrc_pixels, base_color, errors, pSelectors);
+            }
+
+            uint best_inten_table = 0;
+            for (uint inten_table = 1; inten_table < cETC1IntenModifierValues; inten_table++)
+            {
+                if (errors[inten_table] < errors[best_inten_table])
+                {
+                    best_inten_table = inten_table;
+                }
+            }
+            trial_solution.m_error = errors[best_inten_table];
+            trial_solution.m_coords.m_inten_table = best_inten_table;
+            if (n)
+            {
+                memcpy(trial_solution.m_selectors.get_ptr(), pSelectors + best_inten_table * n, n);
+            }
+            trial_solution.m_valid = true;
+        }
+        else
+#endif
         for (uint inten_table = 0; inten_table < cETC1IntenModifierValues; inten_table++)
         {
             const int* pInten_table = g_etc1_inten_tables[inten_table];
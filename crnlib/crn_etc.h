@@ -625,6 +625,7 @@ namespace crnlib
         potential_solution m_best_solution;
         potential_solution m_trial_solution;
         crnlib::vector<uint8> m_temp_selectors;
+        crnlib::vector<uint8> m_inten_table_selectors;
 
         bool evaluate_solution(const etc1_solution_coordinates& coords, potential_solution& trial_solution, potential_solution* pBest_solution);
         bool evaluate_solution_fast(const etc1_solution_coordinates& coords, potential_solution& trial_solution, potential_solution* pBest_solution);
@@ -39,6 +39,11 @@
 #include <libgen.h>
 #endif
 
+#if !CRNLIB_USE_WIN32_API && defined(__GNUC__)
+#include <unistd.h>
+#include <utime.h>
+#endif
+
 namespace crnlib
 {
 #if CRNLIB_USE_WIN32_API
@@ -144,7 +149,77 @@ namespace crnlib
 
         return true;
     }
+
+    bool file_utils::get_file_time(const char* pFilename, uint64& file_time)
+    {
+        file_time = 0;
+
+        WIN32_FILE_ATTRIBUTE_DATA attr;
+        if (0 == GetFileAttributesExA(pFilename, GetFileExInfoStandard, &attr))
+        {
+            return false;
+        }
+
+        // FILETIME counts 100ns intervals.
+        file_time = (static_cast<uint64>(attr.ftLastWriteTime.dwLowDateTime) | (static_cast<uint64>(attr.ftLastWriteTime.dwHighDateTime) << 32U)) / 10000000U;
+        return true;
+    }
+
+    bool file_utils::touch_file(const char* pFilename)
+    {
+        HANDLE hFile = CreateFileA(pFilename, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        SYSTEMTIME system_time;
+        FILETIME file_time;
+        GetSystemTime(&system_time);
+        SystemTimeToFileTime(&system_time, &file_time);
+        const bool success = SetFileTime(hFile, nullptr, nullptr, &file_time) != 0;
+
+        CloseHandle(hFile);
+        return success;
+    }
+
+    bool file_utils::rename_file(const char* pSrcFilename, const char* pDstFilename)
+    {
+        return MoveFileExA(pSrcFilename, pDstFilename, MOVEFILE_REPLACE_EXISTING) != 0;
+    }
+
+    bool file_utils::link_file(const char* pSrcFilename, const char* pDstFilename)
+    {
+        return CreateHardLinkA(pDstFilename, pSrcFilename, nullptr) != 0;
+    }
+
+    bool file_utils::delete_file(const char* pFilename)
+    {
+        return DeleteFileA(pFilename) != 0;
+    }
+
+    bool file_utils::create_temp_file(const char* pDir, dynamic_string& filename)
+    {
+        char buf[MAX_PATH];
+        if (!GetTempFileNameA(pDir, "crn", 0, buf))
+        {
+            return false;
+        }
+        filename = buf;
+        return true;
+    }
 #elif defined(__GNUC__)
+    static mode_t get_file_creation_mask()
+    {
+        // umask() can only be read by setting it, so do it once during static initialization, before any other
+        // thread can be creating files.
+        mode_t mask = umask(0);
+        umask(mask);
+        return mask;
+    }
+
+    static const mode_t g_file_creation_mask = get_file_creation_mask();
+
     bool file_utils::is_read_only(const char* pFilename)
     {
         pFilename;
@@ -212,6 +287,65 @@ namespace crnlib
         file_size = stat_buf.st_size;
         return true;
     }
+
+    bool file_utils::get_file_time(const char* pFilename, uint64& file_time)
+    {
+        file_time = 0;
+        struct stat stat_buf;
+        if (stat(pFilename, &stat_buf))
+        {
+            return false;
+        }
+        file_time = static_cast<uint64>(stat_buf.st_mtime);
+        return true;
+    }
+
+    bool file_utils::touch_file(const char* pFilename)
+    {
+        return utime(pFilename, nullptr) == 0;
+    }
+
+    bool file_utils::rename_file(const char* pSrcFilename, const char* pDstFilename)
+    {
+        return rename(pSrcFilename, pDstFilename) == 0;
+    }
+
+    bool file_utils::link_file(const char* pSrcFilename, const char* pDstFilename)
+    {
+        return link(pSrcFilename, pDstFilename) == 0;
+    }
+
+    bool file_utils::delete_file(const char* pFilename)
+    {
+        return unlink(pFilename) == 0;
+    }
+
+    bool file_utils::create_temp_file(const char* pDir, dynamic_string& filename)
+    {
+        dynamic_string name_template;
+        combine_path(name_template, pDir, "crnXXXXXX");
+
+        crnlib::vector<char> buf(name_template.get_len() + 1);
+        memcpy(buf.get_ptr(), name_template.get_ptr(), buf.size());
+
+        int fd = mkstemp(buf.get_ptr());
+        if (fd < 0)
+        {
+            return false;
+        }
+        // mkstemp() creates the file as 0600; give it the mode any other new file would get, so it can be renamed
+        // into a shared location.
+        if (fchmod(fd, 0666 & ~g_file_creation_mask))
+        {
+            close(fd);
+            unlink(buf.get_ptr());
+            return false;
+        }
+        close(fd);
+
+        filename = buf.get_ptr();
+        return true;
+    }
 #else
     bool file_utils::is_read_only(const char* pFilename)
     {
@@ -260,6 +394,42 @@ namespace crnlib
         fclose(pFile);
         return true;
     }
+
+    bool file_utils::get_file_time(const char* pFilename, uint64& file_time)
+    {
+        pFilename;
+        file_time = 0;
+        return false;
+    }
+
+    bool file_utils::touch_file(const char* pFilename)
+    {
+        pFilename;
+        return false;
+    }
+
+    bool file_utils::rename_file(const char* pSrcFilename, const char* pDstFilename)
+    {
+        return rename(pSrcFilename, pDstFilename) == 0;
+    }
+
+    bool file_utils::link_file(const char* pSrcFilename, const char* pDstFilename)
+    {
+        pSrcFilename, pDstFilename;
+        return false;
+    }
+
+    bool file_utils::delete_file(const char* pFilename)
+    {
+        return remove(pFilename) == 0;
+    }
+
+    bool file_utils::create_temp_file(const char* pDir, dynamic_string& filename)
+    {
+        pDir;
+        filename.clear();
+        return false;
+    }
 #endif
 
     bool file_utils::get_file_size(const char* pFilename, uint32& file_size)
@@ -395,8 +565,10 @@ namespace crnlib
         if (pExt)
         {
             pExt->set(pBaseName);
-            get_extension(*pExt);
-            *pExt = "." + *pExt;
+            if (get_extension(*pExt))
+            {
+                *pExt = "." + *pExt;
+            }
         }
 #endif  // #ifdef WIN32
 
@@ -514,7 +686,7 @@ namespace crnlib
         }
 
         int dot = filename.find_right('.');
-        if (dot < sep)
+        if ((dot < 0) || (dot < sep))
         {
             filename.clear();
             return false;
@@ -537,7 +709,7 @@ namespace crnlib
         }
 
         int dot = filename.find_right('.');
-        if (dot < sep)
+        if ((dot < 0) || (dot < sep))
         {
             return false;
         }
@@ -37,6 +37,15 @@ namespace crnlib
         static bool does_dir_exist(const char* pDir);
         static bool get_file_size(const char* pFilename, uint64& file_size);
         static bool get_file_size(const char* pFilename, uint32& file_size);
+        // Last modification time in seconds, only meaningful for comparisons on the same system.
+        static bool get_file_time(const char* pFilename, uint64& file_time);
+        static bool touch_file(const char* pFilename);
+        // Replaces pDstFilename if it exists; atomic on the same volume.
+        static bool rename_file(const char* pSrcFilename, const char* pDstFilename);
+        static bool link_file(const char* pSrcFilename, const char* pDstFilename);
+        static bool delete_file(const char* pFilename);
+        // Creates a new, uniquely named empty file in pDir, with the permissions of a regular new file.
+        static bool create_temp_file(const char* pDir, dynamic_string& filename);
 
         static bool is_path_separator(char c);
         static bool is_path_or_drive_separator(char c);
@@ -93,4 +93,112 @@ namespace crnlib
 
         return hash;
     }
+
+    // MurmurHash3_x64_128 by Austin Appleby, placed in the public domain.
+    static inline uint64 rotl64(uint64 x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static inline uint64 fmix64(uint64 k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    static inline uint64 read_le64(const uint8* p)
+    {
+        uint64 v = 0;
+        for (int i = 7; i >= 0; i--)
+        {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+
+    void murmur3_hash128(const void* p, size_t len, uint32 seed, uint64 hash[2])
+    {
+        const uint8* data = static_cast<const uint8*>(p);
+        const size_t num_blocks = len / 16;
+        const uint64 c1 = 0x87c37b91114253d5ULL;
+        const uint64 c2 = 0x4cf5ad432745937fULL;
+
+        uint64 h1 = seed;
+        uint64 h2 = seed;
+
+        for (size_t i = 0; i < num_blocks; i++)
+        {
+            uint64 k1 = read_le64(data + i * 16);
+            uint64 k2 = read_le64(data + i * 16 + 8);
+
+            k1 *= c1;
+            k1 = rotl64(k1, 31);
+            k1 *= c2;
+            h1 ^= k1;
+
+            h1 = rotl64(h1, 27);
+            h1 += h2;
+            h1 = h1 * 5 + 0x52dce729;
+
+            k2 *= c2;
+            k2 = rotl64(k2, 33);
+            k2 *= c1;
+            h2 ^= k2;
+
+            h2 = rotl64(h2, 31);
+            h2 += h1;
+            h2 = h2 * 5 + 0x38495ab5;
+        }
+
+        const uint8* tail = data + num_blocks * 16;
+        uint64 k1 = 0;
+        uint64 k2 = 0;
+        switch (len & 15)
+        {
+        case 15: k2 ^= static_cast<uint64>(tail[14]) << 48;
+        case 14: k2 ^= static_cast<uint64>(tail[13]) << 40;
+        case 13: k2 ^= static_cast<uint64>(tail[12]) << 32;
+        case 12: k2 ^= static_cast<uint64>(tail[11]) << 24;
+        case 11: k2 ^= static_cast<uint64>(tail[10]) << 16;
+        case 10: k2 ^= static_cast<uint64>(tail[9]) << 8;
+        case 9:
+            k2 ^= static_cast<uint64>(tail[8]);
+            k2 *= c2;
+            k2 = rotl64(k2, 33);
+            k2 *= c1;
+            h2 ^= k2;
+        case 8: k1 ^= static_cast<uint64>(tail[7]) << 56;
+        case 7: k1 ^= static_cast<uint64>(tail[6]) << 48;
+        case 6: k1 ^= static_cast<uint64>(tail[5]) << 40;
+        case 5: k1 ^= static_cast<uint64>(tail[4]) << 32;
+        case 4: k1 ^= static_cast<uint64>(tail[3]) << 24;
+        case 3: k1 ^= static_cast<uint64>(tail[2]) << 16;
+        case 2: k1 ^= static_cast<uint64>(tail[1]) << 8;
+        case 1:
+            k1 ^= static_cast<uint64>(tail[0]);
+            k1 *= c1;
+            k1 = rotl64(k1, 31);
+            k1 *= c2;
+            h1 ^= k1;
+        }
+
+        h1 ^= static_cast<uint64>(len);
+        h2 ^= static_cast<uint64>(len);
+
+        h1 += h2;
+        h2 += h1;
+
+        h1 = fmix64(h1);
+        h2 = fmix64(h2);
+
+        h1 += h2;
+        h2 += h1;
+
+        hash[0] = h1;
+        hash[1] = h2;
+    }
 } // namespace crnlib
@@ -29,6 +29,9 @@ namespace crnlib
 {
     CRN_EXPORT uint32 fast_hash(const void* p, int len);
 
+    // 128-bit hash (MurmurHash3_x64_128), for content addressing. Not cryptographic.
+    CRN_EXPORT void murmur3_hash128(const void* p, size_t len, uint32 seed, uint64 hash[2]);
+
     // 4-byte integer hash, full avalanche
     inline uint32 bitmix32c(uint32 a)
     {
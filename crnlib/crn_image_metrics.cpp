@@ -0,0 +1,687 @@
+/*
+ * Copyright (c) 2010-2016 Richard Geldreich, Jr. and Binomial LLC
+ * Copyright (c) 2020 FrozenStorm Interactive, Yoann Potinet
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation or credits
+ *    is required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "crn_core.h"
+#include "crn_image_metrics.h"
+#include "crn_threading.h"
+
+#if CRNLIB_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace crnlib
+{
+    enum
+    {
+        cSSIMRadius = 5,
+        cSSIMTaps = cSSIMRadius * 2 + 1,
+        cSSIMSums = 5,
+        cMinBandHeight = 32
+    };
+
+    static const float cSSIM_C1 = 6.5025f;  // (255*.01)^2
+    static const float cSSIM_C2 = 58.5225f; // (255*.03)^2
+    static const float cSSIMBias = 128.0f;
+
+#if CRNLIB_X86_SIMD
+    // Lumas of 4 pixels as 32-bit lanes. The green weight is split in two halves so every weight fits pmaddwd.
+    CRNLIB_TARGET_SSE2 static inline __m128i luma_sse2(__m128i p)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weights = _mm_setr_epi16(19595, 19235, 7471, 19235, 19595, 19235, 7471, 19235);
+
+        __m128i lo = _mm_unpacklo_epi8(p, zero);
+        __m128i hi = _mm_unpackhi_epi8(p, zero);
+        lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(1, 2, 1, 0)), _MM_SHUFFLE(1, 2, 1, 0));
+        hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(1, 2, 1, 0)), _MM_SHUFFLE(1, 2, 1, 0));
+        lo = _mm_madd_epi16(lo, weights);
+        hi = _mm_madd_epi16(hi, weights);
+        lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+        hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+
+        const __m128i l = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+        return _mm_srli_epi32(_mm_add_epi32(l, _mm_set1_epi32(32768)), 16);
+    }
+
+    CRNLIB_TARGET_SSE2 static uint accum_error_sse2(const color_quad_u8* pA, const color_quad_u8* pB, uint n, bool luma, uint64* pTotal, uint64* pTotal2, uint* pMax)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i max_d = zero;
+        __m128i max_l = zero;
+
+        uint x = 0;
+        while (x + 4 <= n)
+        {
+            // 128 steps keep the 16-bit sums and 32-bit squares from overflowing before they are widened.
+            const uint chunk_end = math::minimum(n & ~3U, x + 4U * 128U);
+            __m128i sum = zero, sum2 = zero, lsum = zero, lsum2 = zero;
+            for (; x < chunk_end; x += 4)
+            {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pA + x));
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pB + x));
+                const __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+                max_d = _mm_max_epu8(max_d, d);
+
+                const __m128i lo = _mm_unpacklo_epi8(d, zero);
+                const __m128i hi = _mm_unpackhi_epi8(d, zero);
+                sum = _mm_add_epi16(sum, _mm_add_epi16(lo, hi));
+
+                const __m128i lo2 = _mm_mullo_epi16(lo, lo);
+                const __m128i hi2 = _mm_mullo_epi16(hi, hi);
+                sum2 = _mm_add_epi32(sum2, _mm_add_epi32(_mm_unpacklo_epi16(lo2, zero), _mm_unpackhi_epi16(lo2, zero)));
+                sum2 = _mm_add_epi32(sum2, _mm_add_epi32(_mm_unpacklo_epi16(hi2, zero), _mm_unpackhi_epi16(hi2, zero)));
+
+                if (luma)
+                {
+                    __m128i l = _mm_sub_epi32(luma_sse2(a), luma_sse2(b));
+                    const __m128i sign = _mm_srai_epi32(l, 31);
+                    l = _mm_sub_epi32(_mm_xor_si128(l, sign), sign);
+                    max_l = _mm_max_epi16(max_l, l);
+                    lsum = _mm_add_epi32(lsum, l);
+                    lsum2 = _mm_add_epi32(lsum2, _mm_madd_epi16(l, l));
+                }
+            }
+
+            CRNLIB_ALIGNED(16) uint16 s16[8];
+            CRNLIB_ALIGNED(16) uint32 s32[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(s16), sum);
+            _mm_store_si128(reinterpret_cast<__m128i*>(s32), sum2);
+            for (uint c = 0; c < 4; c++)
+            {
+                pTotal[c] += s16[c] + s16[c + 4];
+                pTotal2[c] += s32[c];
+            }
+
+            if (luma)
+            {
+                _mm_store_si128(reinterpret_cast<__m128i*>(s32), lsum);
+                pTotal[4] += s32[0] + s32[1] + s32[2] + s32[3];
+                _mm_store_si128(reinterpret_cast<__m128i*>(s32), lsum2);
+                pTotal2[4] += s32[0] + s32[1] + s32[2] + s32[3];
+            }
+        }
+
+        CRNLIB_ALIGNED(16) uint8 m[16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(m), max_d);
+        for (uint i = 0; i < 16; i++)
+        {
+            pMax[i & 3] = math::maximum<uint>(pMax[i & 3], m[i]);
+        }
+
+        CRNLIB_ALIGNED(16) uint16 l16[8];
+        _mm_store_si128(reinterpret_cast<__m128i*>(l16), max_l);
+        for (uint i = 0; i < 8; i++)
+        {
+            pMax[4] = math::maximum<uint>(pMax[4], l16[i]);
+        }
+
+        return x;
+    }
+#endif
+
+    // Adds the absolute differences of n pixels, their squares and their maximum to the per channel totals. The luma
+    // totals are only updated if luma is true.
+    static void accum_error(const color_quad_u8* pA, const color_quad_u8* pB, uint n, bool luma, uint64* pTotal, uint64* pTotal2, uint* pMax)
+    {
+        uint x = 0;
+#if CRNLIB_X86_SIMD
+        if (crnlib_cpu_has_sse2())
+        {
+            x = accum_error_sse2(pA, pB, n, luma, pTotal, pTotal2, pMax);
+        }
+#endif
+
+        for (; x < n; x++)
+        {
+            const color_quad_u8& a = pA[x];
+            const color_quad_u8& b = pB[x];
+            for (uint c = 0; c < 4; c++)
+            {
+                const uint d = labs(a[c] - b[c]);
+                pTotal[c] += d;
+                pTotal2[c] += d * d;
+                pMax[c] = math::maximum(pMax[c], d);
+            }
+
+            if (luma)
+            {
+                const uint d = labs(a.get_luma() - b.get_luma());
+                pTotal[4] += d;
+                pTotal2[4] += d * d;
+                pMax[4] = math::maximum(pMax[4], d);
+            }
+        }
+    }
+
+    // The windowed sums are taken over samples minus cSSIMBias, which keeps the variances accurate in float.
+    static inline float ssim_value(float ma, float mb, float saa, float sbb, float sab)
+    {
+        const float va = saa - ma * ma;
+        const float vb = sbb - mb * mb;
+        const float cov = sab - ma * mb;
+        const float ua = ma + cSSIMBias;
+        const float ub = mb + cSSIMBias;
+        const float uab = ua * ub;
+        const float n = (uab + uab + cSSIM_C1) * (cov + cov + cSSIM_C2);
+        const float d = (ua * ua + ub * ub + cSSIM_C1) * (va + vb + cSSIM_C2);
+        return n / d;
+    }
+
+#if CRNLIB_X86_SIMD
+    CRNLIB_TARGET_SSE2 static uint unpack_channel_sse2(const color_quad_u8* pSrc, uint n, uint channel, float* pDst)
+    {
+        const __m128 bias = _mm_set1_ps(cSSIMBias);
+        const __m128i mask = _mm_set1_epi32(0xFF);
+
+        uint x = 0;
+        for (; x + 4 <= n; x += 4)
+        {
+            const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + x));
+            __m128i v;
+            if (channel == image_metrics::cLumaChannel)
+            {
+                v = luma_sse2(p);
+            }
+            else
+            {
+                v = _mm_and_si128(_mm_srl_epi32(p, _mm_cvtsi32_si128(channel * 8)), mask);
+            }
+            _mm_storeu_ps(pDst + x, _mm_sub_ps(_mm_cvtepi32_ps(v), bias));
+        }
+        return x;
+    }
+#endif
+
+    // Converts one channel of a row of pixels to floats, minus cSSIMBias.
+    static void unpack_channel(const color_quad_u8* pSrc, uint n, uint channel, float* pDst)
+    {
+        uint x = 0;
+#if CRNLIB_X86_SIMD
+        if (crnlib_cpu_has_sse2())
+        {
+            x = unpack_channel_sse2(pSrc, n, channel, pDst);
+        }
+#endif
+
+        for (; x < n; x++)
+        {
+            const int v = (channel == image_metrics::cLumaChannel) ? pSrc[x].get_luma() : pSrc[x][channel];
+            pDst[x] = static_cast<float>(v) - cSSIMBias;
+        }
+    }
+
+    // The SIMD kernels below perform the same float operations in the same order as the scalar loops, so every path
+    // produces identical results.
+
+#if CRNLIB_X86_SIMD
+    CRNLIB_TARGET_SSE2 static uint ssim_filter_v_sse2(const float* const* ppA, const float* const* ppB, const float* pWeights, uint n, float* const* ppDst)
+    {
+        uint x = 0;
+        for (; x + 4 <= n; x += 4)
+        {
+            __m128 ma = _mm_setzero_ps(), mb = _mm_setzero_ps();
+            __m128 saa = _mm_setzero_ps(), sbb = _mm_setzero_ps(), sab = _mm_setzero_ps();
+            for (uint k = 0; k < cSSIMTaps; k++)
+            {
+                const __m128 w = _mm_set1_ps(pWeights[k]);
+                const __m128 a = _mm_loadu_ps(ppA[k] + x);
+                const __m128 b = _mm_loadu_ps(ppB[k] + x);
+                const __m128 wa = _mm_mul_ps(w, a);
+                const __m128 wb = _mm_mul_ps(w, b);
+                ma = _mm_add_ps(ma, wa);
+                mb = _mm_add_ps(mb, wb);
+                saa = _mm_add_ps(saa, _mm_mul_ps(wa, a));
+                sbb = _mm_add_ps(sbb, _mm_mul_ps(wb, b));
+                sab = _mm_add_ps(sab, _mm_mul_ps(wa, b));
+            }
+            _mm_storeu_ps(ppDst[0] + x, ma);
+            _mm_storeu_ps(ppDst[1] + x, mb);
+            _mm_storeu_ps(ppDst[2] + x, saa);
+            _mm_storeu_ps(ppDst[3] + x, sbb);
+            _mm_storeu_ps(ppDst[4] + x, sab);
+        }
+        return x;
+    }
+
+    CRNLIB_TARGET_AVX2 static uint ssim_filter_v_avx2(const float* const* ppA, const float* const* ppB, const float* pWeights, uint n, float* const* ppDst)
+    {
+        uint x = 0;
+        for (; x + 8 <= n; x += 8)
+        {
+            __m256 ma = _mm256_setzero_ps(), mb = _mm256_setzero_ps();
+            __m256 saa = _mm256_setzero_ps(), sbb = _mm256_setzero_ps(), sab = _mm256_setzero_ps();
+            for (uint k = 0; k < cSSIMTaps; k++)
+            {
+                const __m256 w = _mm256_set1_ps(pWeights[k]);
+                const __m256 a = _mm256_loadu_ps(ppA[k] + x);
+                const __m256 b = _mm256_loadu_ps(ppB[k] + x);
+                const __m256 wa = _mm256_mul_ps(w, a);
+                const __m256 wb = _mm256_mul_ps(w, b);
+                ma = _mm256_add_ps(ma, wa);
+                mb = _mm256_add_ps(mb, wb);
+                saa = _mm256_add_ps(saa, _mm256_mul_ps(wa, a));
+                sbb = _mm256_add_ps(sbb, _mm256_mul_ps(wb, b));
+                sab = _mm256_add_ps(sab, _mm256_mul_ps(wa, b));
+            }
+            _mm256_storeu_ps(ppDst[0] + x, ma);
+            _mm256_storeu_ps(ppDst[1] + x, mb);
+            _mm256_storeu_ps(ppDst[2] + x, saa);
+            _mm256_storeu_ps(ppDst[3] + x, sbb);
+            _mm256_storeu_ps(ppDst[4] + x, sab);
+        }
+        return x;
+    }
+
+    CRNLIB_TARGET_SSE2 static uint ssim_filter_h_sse2(const float* const* ppSrc, const float* pWeights, uint n, float* pDst)
+    {
+        const __m128 c1 = _mm_set1_ps(cSSIM_C1);
+        const __m128 c2 = _mm_set1_ps(cSSIM_C2);
+        const __m128 bias = _mm_set1_ps(cSSIMBias);
+
+        uint x = 0;
+        for (; x + 4 <= n; x += 4)
+        {
+            __m128 s[cSSIMSums];
+            for (uint i = 0; i < cSSIMSums; i++)
+            {
+                __m128 t = _mm_setzero_ps();
+                for (uint k = 0; k < cSSIMTaps; k++)
+                {
+                    t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(pWeights[k]), _mm_loadu_ps(ppSrc[i] + x + k)));
+                }
+                s[i] = t;
+            }
+
+            const __m128 va = _mm_sub_ps(s[2], _mm_mul_ps(s[0], s[0]));
+            const __m128 vb = _mm_sub_ps(s[3], _mm_mul_ps(s[1], s[1]));
+            const __m128 cov = _mm_sub_ps(s[4], _mm_mul_ps(s[0], s[1]));
+            const __m128 ua = _mm_add_ps(s[0], bias);
+            const __m128 ub = _mm_add_ps(s[1], bias);
+            const __m128 uab = _mm_mul_ps(ua, ub);
+            const __m128 num = _mm_mul_ps(_mm_add_ps(_mm_add_ps(uab, uab), c1), _mm_add_ps(_mm_add_ps(cov, cov), c2));
+            const __m128 den = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ua, ua), _mm_mul_ps(ub, ub)), c1), _mm_add_ps(_mm_add_ps(va, vb), c2));
+            _mm_storeu_ps(pDst + x, _mm_div_ps(num, den));
+        }
+        return x;
+    }
+
+    CRNLIB_TARGET_AVX2 static uint ssim_filter_h_avx2(const float* const* ppSrc, const float* pWeights, uint n, float* pDst)
+    {
+        const __m256 c1 = _mm256_set1_ps(cSSIM_C1);
+        const __m256 c2 = _mm256_set1_ps(cSSIM_C2);
+        const __m256 bias = _mm256_set1_ps(cSSIMBias);
+
+        uint x = 0;
+        for (; x + 8 <= n; x += 8)
+        {
+            __m256 s[cSSIMSums];
+            for (uint i = 0; i < cSSIMSums; i++)
+            {
+                __m256 t = _mm256_setzero_ps();
+                for (uint k = 0; k < cSSIMTaps; k++)
+                {
+                    t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_set1_ps(pWeights[k]), _mm256_loadu_ps(ppSrc[i] + x + k)));
+                }
+                s[i] = t;
+            }
+
+            const __m256 va = _mm256_sub_ps(s[2], _mm256_mul_ps(s[0], s[0]));
+            const __m256 vb = _mm256_sub_ps(s[3], _mm256_mul_ps(s[1], s[1]));
+            const __m256 cov = _mm256_sub_ps(s[4], _mm256_mul_ps(s[0], s[1]));
+            const __m256 ua = _mm256_add_ps(s[0], bias);
+            const __m256 ub = _mm256_add_ps(s[1], bias);
+            const __m256 uab = _mm256_mul_ps(ua, ub);
+            const __m256 num = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(uab, uab), c1), _mm256_add_ps(_mm256_add_ps(cov, cov), c2));
+            const __m256 den = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ua, ua), _mm256_mul_ps(ub, ub)), c1), _mm256_add_ps(_mm256_add_ps(va, vb), c2));
+            _mm256_storeu_ps(pDst + x, _mm256_div_ps(num, den));
+        }
+        return x;
+    }
+#endif
+
+    // Vertical pass: weighted sums of a, b, a^2, b^2 and a*b over cSSIMTaps rows, for n columns.
+    static void ssim_filter_v(const float* const* ppA, const float* const* ppB, const float* pWeights, uint n, float* const* ppDst)
+    {
+        uint x = 0;
+#if CRNLIB_X86_SIMD
+        if (crnlib_cpu_has_avx2())
+        {
+            x = ssim_filter_v_avx2(ppA, ppB, pWeights, n, ppDst);
+        }
+        else if (crnlib_cpu_has_sse2())
+        {
+            x = ssim_filter_v_sse2(ppA, ppB, pWeights, n, ppDst);
+        }
+#endif
+
+        for (; x < n; x++)
+        {
+            float ma = 0.0f, mb = 0.0f, saa = 0.0f, sbb = 0.0f, sab = 0.0f;
+            for (uint k = 0; k < cSSIMTaps; k++)
+            {
+                const float a = ppA[k][x];
+                const float b = ppB[k][x];
+                const float wa = pWeights[k] * a;
+                const float wb = pWeights[k] * b;
+                ma += wa;
+                mb += wb;
+                saa += wa * a;
+                sbb += wb * b;
+                sab += wa * b;
+            }
+            ppDst[0][x] = ma;
+            ppDst[1][x] = mb;
+            ppDst[2][x] = saa;
+            ppDst[3][x] = sbb;
+            ppDst[4][x] = sab;
+        }
+    }
+
+    // Horizontal pass over the vertical sums, which are padded by cSSIMRadius samples on each side, followed by the
+    // SSIM of each of the n windows.
+    static void ssim_filter_h(const float* const* ppSrc, const float* pWeights, uint n, float* pDst)
+    {
+        uint x = 0;
+#if CRNLIB_X86_SIMD
+        if (crnlib_cpu_has_avx2())
+        {
+            x = ssim_filter_h_avx2(ppSrc, pWeights, n, pDst);
+        }
+        else if (crnlib_cpu_has_sse2())
+        {
+            x = ssim_filter_h_sse2(ppSrc, pWeights, n, pDst);
+        }
+#endif
+
+        for (; x < n; x++)
+        {
+            float s[cSSIMSums];
+            for (uint i = 0; i < cSSIMSums; i++)
+            {
+                float t = 0.0f;
+                for (uint k = 0; k < cSSIMTaps; k++)
+                {
+                    t += pWeights[k] * ppSrc[i][x + k];
+                }
+                s[i] = t;
+            }
+            pDst[x] = ssim_value(s[0], s[1], s[2], s[3], s[4]);
+        }
+    }
+
+    image_metrics::image_metrics()
+    {
+        clear();
+    }
+
+    void image_metrics::clear()
+    {
+        m_pA = nullptr;
+        m_pB = nullptr;
+        m_width = 0;
+        m_height = 0;
+        m_channel_mask = 0;
+        m_compute_ssim = false;
+        m_band_height = 0;
+        m_band_stats.clear();
+        m_row_ssim.clear();
+        utils::zero_object(m_weights);
+        utils::zero_object(m_stats);
+        utils::zero_object(m_ssim);
+    }
+
+    bool image_metrics::compute(const image_u8& a, const image_u8& b, uint channel_mask, bool compute_ssim, bool multithreaded)
+    {
+        clear();
+
+        m_width = math::minimum(a.get_width(), b.get_width());
+        m_height = math::minimum(a.get_height(), b.get_height());
+        if ((!m_width) || (!m_height))
+        {
+            return false;
+        }
+
+        m_pA = &a;
+        m_pB = &b;
+        m_channel_mask = channel_mask & cAllChannels;
+        m_compute_ssim = compute_ssim;
+
+        double weight_sum = 0.0f;
+        double weights[cSSIMTaps];
+        for (int k = 0; k < cSSIMTaps; k++)
+        {
+            weights[k] = exp(-math::square(k - cSSIMRadius) / (2.0 * 1.5 * 1.5));
+            weight_sum += weights[k];
+        }
+        for (uint k = 0; k < cSSIMTaps; k++)
+        {
+            m_weights[k] = static_cast<float>(weights[k] / weight_sum);
+        }
+
+        uint num_bands = 1;
+        if ((multithreaded) && (g_number_of_processors > 1))
+        {
+            num_bands = math::clamp<uint>(m_height / cMinBandHeight, 1U, g_number_of_processors * 4);
+        }
+        m_band_height = (m_height + num_bands - 1) / num_bands;
+        num_bands = (m_height + m_band_height - 1) / m_band_height;
+
+        m_band_stats.resize(num_bands * cNumChannels);
+        if (m_compute_ssim)
+        {
+            m_row_ssim.resize(m_height * cNumChannels);
+        }
+
+        if (num_bands < 2)
+        {
+            process_band(0, nullptr);
+        }
+        else
+        {
+            scoped_task_pool tp;
+            tp.init(nullptr, math::minimum<uint>(g_number_of_processors, num_bands) - 1);
+
+            tp->queue_multiple_object_tasks(this, &image_metrics::process_band, 0, num_bands);
+            tp->join();
+        }
+
+        for (uint c = 0; c < cNumChannels; c++)
+        {
+            if ((m_channel_mask & (1U << c)) == 0)
+            {
+                continue;
+            }
+
+            for (uint i = 0; i < num_bands; i++)
+            {
+                const channel_stats& s = m_band_stats[i * cNumChannels + c];
+                m_stats[c].m_total += s.m_total;
+                m_stats[c].m_total2 += s.m_total2;
+                m_stats[c].m_max = math::maximum(m_stats[c].m_max, s.m_max);
+            }
+
+            if (m_compute_ssim)
+            {
+                // Summed row by row in order, so the result doesn't depend on the number of bands.
+                double total = 0.0f;
+                for (uint y = 0; y < m_height; y++)
+                {
+                    total += m_row_ssim[y * cNumChannels + c];
+                }
+                m_ssim[c] = total / (static_cast<double>(m_width) * m_height);
+            }
+        }
+
+        m_pA = nullptr;
+        m_pB = nullptr;
+        m_band_stats.clear();
+        m_row_ssim.clear();
+
+        return true;
+    }
+
+    void image_metrics::process_band(uint64 data, void* pData_ptr)
+    {
+        (void)pData_ptr;
+
+        const uint width = m_width;
+        const uint y0 = static_cast<uint>(data) * m_band_height;
+        const uint y1 = math::minimum(y0 + m_band_height, m_height);
+        const bool luma = (m_channel_mask & (1U << cLumaChannel)) != 0;
+
+        uint64 total[cNumChannels], total2[cNumChannels];
+        uint max_err[cNumChannels];
+        utils::zero_object(total);
+        utils::zero_object(total2);
+        utils::zero_object(max_err);
+
+        if (m_compute_ssim)
+        {
+            uint channels[cNumChannels];
+            uint num_channels = 0;
+            for (uint c = 0; c < cNumChannels; c++)
+            {
+                if (m_channel_mask & (1U << c))
+                {
+                    channels[num_channels++] = c;
+                }
+            }
+
+            // The last cSSIMTaps rows of both images as floats: [slot][image][channel][x]
+            crnlib::vector<float> window(cSSIMTaps * 2 * cNumChannels * width);
+            // The vertical sums of one output row, padded on both sides for the horizontal pass.
+            const uint padded_width = width + cSSIMRadius * 2;
+            crnlib::vector<float> sums(cSSIMSums * padded_width);
+            crnlib::vector<float> row_ssim(width);
+
+            const int first_row = static_cast<int>(y0) - cSSIMRadius;
+            const int last_row = static_cast<int>(y1) + cSSIMRadius - 1;
+
+            for (int r = first_row; r <= last_row; r++)
+            {
+                const uint src_y = math::clamp<int>(r, 0, m_height - 1);
+                const color_quad_u8* pA = m_pA->get_scanline(src_y);
+                const color_quad_u8* pB = m_pB->get_scanline(src_y);
+
+                if ((r >= static_cast<int>(y0)) && (r < static_cast<int>(y1)))
+                {
+                    accum_error(pA, pB, width, luma, total, total2, max_err);
+                }
+
+                const uint slot = (r - first_row) % cSSIMTaps;
+                for (uint i = 0; i < num_channels; i++)
+                {
+                    const uint c = channels[i];
+                    unpack_channel(pA, width, c, &window[((slot * 2) * cNumChannels + c) * width]);
+                    unpack_channel(pB, width, c, &window[((slot * 2 + 1) * cNumChannels + c) * width]);
+                }
+
+                if ((r - first_row) < (cSSIMTaps - 1))
+                {
+                    continue;
+                }
+
+                const uint y = r - cSSIMRadius;
+                for (uint i = 0; i < num_channels; i++)
+                {
+                    const uint c = channels[i];
+
+                    const float* pRows_a[cSSIMTaps];
+                    const float* pRows_b[cSSIMTaps];
+                    for (uint k = 0; k < cSSIMTaps; k++)
+                    {
+                        const uint s = (y - y0 + k) % cSSIMTaps;
+                        pRows_a[k] = &window[((s * 2) * cNumChannels + c) * width];
+                        pRows_b[k] = &window[((s * 2 + 1) * cNumChannels + c) * width];
+                    }
+
+                    float* pSums[cSSIMSums];
+                    float* pSums_dst[cSSIMSums];
+                    for (uint j = 0; j < cSSIMSums; j++)
+                    {
+                        pSums[j] = &sums[j * padded_width];
+                        pSums_dst[j] = pSums[j] + cSSIMRadius;
+                    }
+
+                    ssim_filter_v(pRows_a, pRows_b, m_weights, width, pSums_dst);
+
+                    for (uint j = 0; j < cSSIMSums; j++)
+                    {
+                        for (uint k = 0; k < cSSIMRadius; k++)
+                        {
+                            pSums[j][k] = pSums_dst[j][0];
+                            pSums_dst[j][width + k] = pSums_dst[j][width - 1];
+                        }
+                    }
+
+                    ssim_filter_h(pSums, m_weights, width, row_ssim.get_ptr());
+
+                    double row_totals[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                    for (uint x = 0; x < width; x++)
+                    {
+                        row_totals[x & 3] += row_ssim[x];
+                    }
+                    m_row_ssim[y * cNumChannels + c] = (row_totals[0] + row_totals[1]) + (row_totals[2] + row_totals[3]);
+                }
+            }
+        }
+        else
+        {
+            for (uint y = y0; y < y1; y++)
+            {
+                accum_error(m_pA->get_scanline(y), m_pB->get_scanline(y), width, luma, total, total2, max_err);
+            }
+        }
+
+        channel_stats* pStats = &m_band_stats[static_cast<uint>(data) * cNumChannels];
+        for (uint c = 0; c < cNumChannels; c++)
+        {
+            pStats[c].m_total = total[c];
+            pStats[c].m_total2 = total2[c];
+            pStats[c].m_max = max_err[c];
+        }
+    }
+
+    void image_metrics::get_error_metrics(image_utils::error_metrics& em, uint first_channel, uint num_channels, bool average_component_error) const
+    {
+        CRNLIB_ASSERT((first_channel < 4U) && (first_channel + num_channels <= 4U));
+
+        uint64 total = 0, total2 = 0;
+        uint max_err = 0;
+        for (uint c = num_channels ? first_channel : (uint)cLumaChannel; c < (num_channels ? first_channel + num_channels : (uint)cNumChannels); c++)
+        {
+            total += m_stats[c].m_total;
+            total2 += m_stats[c].m_total2;
+            max_err = math::maximum(max_err, m_stats[c].m_max);
+        }
+
+        double total_values = m_width * m_height;
+        if (average_component_error)
+        {
+            total_values *= math::clamp<uint>(num_channels, 1, 4);
+        }
+
+        em.set_from_totals(max_err, total, total2, total_values);
+    }
+
+} // namespace crnlib
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2010-2016 Richard Geldreich, Jr. and Binomial LLC
+ * Copyright (c) 2020 FrozenStorm Interactive, Yoann Potinet
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation or credits
+ *    is required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#include "crn_image_utils.h"
+#include "crn_export.h"
+
+namespace crnlib
+{
+    // Compares two images in a single pass over both, gathering the error statistics behind image_utils::error_metrics
+    // and the mean SSIM of every requested channel. Channels 0-3 are R, G, B and A, channel 4 is color_quad_u8::get_luma().
+    class CRN_EXPORT image_metrics
+    {
+        CRNLIB_NO_COPY_OR_ASSIGNMENT_OP(image_metrics);
+
+    public:
+        enum
+        {
+            cLumaChannel = 4,
+            cNumChannels = 5,
+            cAllChannels = (1 << cNumChannels) - 1
+        };
+
+        image_metrics();
+
+        void clear();
+
+        // channel_mask has bit n set for each channel n to compare. The images are compared over their common area.
+        // SSIM uses an 11x11 Gaussian window (sigma 1.5) centered on every pixel, with clamped edges.
+        bool compute(const image_u8& a, const image_u8& b, uint channel_mask = cAllChannels, bool compute_ssim = true, bool multithreaded = true);
+
+        inline uint get_width() const
+        {
+            return m_width;
+        }
+        inline uint get_height() const
+        {
+            return m_height;
+        }
+
+        inline uint get_max_error(uint channel) const
+        {
+            CRNLIB_ASSERT(channel < cNumChannels);
+            return m_stats[channel].m_max;
+        }
+        inline uint64 get_total_error(uint channel) const
+        {
+            CRNLIB_ASSERT(channel < cNumChannels);
+            return m_stats[channel].m_total;
+        }
+        inline uint64 get_total_squared_error(uint channel) const
+        {
+            CRNLIB_ASSERT(channel < cNumChannels);
+            return m_stats[channel].m_total2;
+        }
+
+        // Mean SSIM over all pixels, or 0 if SSIM wasn't computed for the channel.
+        inline double get_ssim(uint channel) const
+        {
+            CRNLIB_ASSERT(channel < cNumChannels);
+            return m_ssim[channel];
+        }
+
+        // Same results as error_metrics::compute(a, b, first_channel, num_channels, average_component_error).
+        void get_error_metrics(image_utils::error_metrics& em, uint first_channel, uint num_channels, bool average_component_error = true) const;
+
+    private:
+        struct channel_stats
+        {
+            uint64 m_total;
+            uint64 m_total2;
+            uint m_max;
+        };
+
+        const image_u8* m_pA;
+        const image_u8* m_pB;
+        uint m_width;
+        uint m_height;
+        uint m_channel_mask;
+        bool m_compute_ssim;
+
+        uint m_band_height;
+        crnlib::vector<channel_stats> m_band_stats;
+        crnlib::vector<double> m_row_ssim;
+
+        float m_weights[11];
+
+        channel_stats m_stats[cNumChannels];
+        double m_ssim[cNumChannels];
+
+        void process_band(uint64 data, void* pData_ptr);
+    };
+
+} // namespace crnlib
@@ -37,11 +37,17 @@
 #include "crn_console.h"
 #include "crn_resampler.h"
 #include "crn_threaded_resampler.h"
+#include "crn_image_metrics.h"
 #include "crn_strutils.h"
 #include "crn_file_utils.h"
 #include "crn_threading.h"
 #include "crn_cfile_stream.h"
+#include "crn_mapped_file_stream.h"
 #include "crn_mipmapped_texture.h"
+
+#if CRNLIB_X86_SIMD
+#include <immintrin.h>
+#endif
 #include "crn_buffer_stream.h"
 
 //#define STBI_HEADER_FILE_ONLY
@@ -59,13 +65,15 @@ namespace crnlib
         bool read_from_stream_stb(data_stream_serializer& serializer, image_u8& img)
         {
             uint8_vec buf;
-            if (!serializer.read_entire_file(buf))
+            const uint8* pSrc_data;
+            uint src_size;
+            if (!serializer.read_entire_file(buf, pSrc_data, src_size))
             {
                 return false;
             }
 
             int x = 0, y = 0, n = 0;
-            unsigned char* pData = stbi_load_from_memory(buf.get_ptr(), buf.size_in_bytes(), &x, &y, &n, 4);
+            unsigned char* pData = stbi_load_from_memory(pSrc_data, src_size, &x, &y, &n, 4);
 
             if (!pData)
             {
@@ -119,13 +127,15 @@ namespace crnlib
         bool read_from_stream_jpgd(data_stream_serializer& serializer, image_u8& img)
         {
             uint8_vec buf;
-            if (!serializer.read_entire_file(buf))
+            const uint8* pSrc_data;
+            uint src_size;
+            if (!serializer.read_entire_file(buf, pSrc_data, src_size))
             {
                 return false;
             }
 
             int width = 0, height = 0, actual_comps = 0;
-            unsigned char* pSrc_img = jpgd::decompress_jpeg_image_from_memory(buf.get_ptr(), buf.size_in_bytes(), &width, &height, &actual_comps, 4);
+            unsigned char* pSrc_img = jpgd::decompress_jpeg_image_from_memory(pSrc_data, src_size, &width, &height, &actual_comps, 4);
             if (!pSrc_img)
             {
                 return false;
@@ -187,7 +197,7 @@ namespace crnlib
                 return false;
             }
 
-            cfile_stream file_stream;
+            mapped_file_stream file_stream;
             if (!file_stream.open(pFilename))
             {
                 return false;
@@ -475,6 +485,75 @@ namespace crnlib
             return score >= 0.0f;
         }
 
+#if CRNLIB_X86_SIMD
+        // Clamping before the truncation gives the same index as the scalar code, which clamps after it. Returns the
+        // number of samples converted.
+        CRNLIB_TARGET_SSE2 static uint resampled_to_u8_sse2(const float* pSrc, uint src_stride, uint n, uint8* pDst, const uint8* pLinear_to_srgb, int table_size)
+        {
+            const __m128 scale = _mm_set1_ps(pLinear_to_srgb ? (float)table_size : 255.0f);
+            const __m128 limit = _mm_set1_ps(pLinear_to_srgb ? (float)(table_size - 1) : 255.0f);
+            const __m128 half = _mm_set1_ps(.5f);
+            const __m128 zero = _mm_setzero_ps();
+
+            uint x = 0;
+            for (; x + 4 <= n; x += 4)
+            {
+                const float* p = pSrc + x * src_stride;
+                const __m128 v = (src_stride == 1) ? _mm_loadu_ps(p) : _mm_setr_ps(p[0], p[src_stride], p[src_stride * 2], p[src_stride * 3]);
+                const __m128 f = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(v, scale), half), zero), limit);
+
+                CRNLIB_ALIGNED(16) int idx[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(idx), _mm_cvttps_epi32(f));
+
+                uint8* q = pDst + x * 4;
+                if (pLinear_to_srgb)
+                {
+                    q[0] = pLinear_to_srgb[idx[0]];
+                    q[4] = pLinear_to_srgb[idx[1]];
+                    q[8] = pLinear_to_srgb[idx[2]];
+                    q[12] = pLinear_to_srgb[idx[3]];
+                }
+                else
+                {
+                    q[0] = (uint8)idx[0];
+                    q[4] = (uint8)idx[1];
+                    q[8] = (uint8)idx[2];
+                    q[12] = (uint8)idx[3];
+                }
+            }
+            return x;
+        }
+#endif
+
+        // Converts n resampled samples of one component back to 8 bits. The samples are src_stride floats apart, and the
+        // results go to every 4th byte of pDst. pLinear_to_srgb is null for linear components.
+        static void resampled_to_u8(const float* pSrc, uint src_stride, uint n, uint8* pDst, const uint8* pLinear_to_srgb, int table_size)
+        {
+            uint x = 0;
+
+#if CRNLIB_X86_SIMD
+            if (crnlib_cpu_has_sse2())
+            {
+                x = resampled_to_u8_sse2(pSrc, src_stride, n, pDst, pLinear_to_srgb, table_size);
+            }
+#endif
+
+            for (; x < n; x++)
+            {
+                const float v = pSrc[x * src_stride];
+                if (!pLinear_to_srgb)
+                {
+                    int c = (int)(255.0f * v + .5f);
+                    pDst[x * 4] = (uint8)math::clamp(c, 0, 255);
+                }
+                else
+                {
+                    int j = (int)(table_size * v + .5f);
+                    pDst[x * 4] = pLinear_to_srgb[math::clamp(j, 0, table_size - 1)];
+                }
+            }
+        }
+
         bool resample_single_thread(const image_u8& src, image_u8& dst, const resample_params& params)
         {
             const uint src_width = src.get_width();
@@ -513,12 +592,14 @@ namespace crnlib
             // Partial gamma correction looks better on mips. Set to 1.0 to disable gamma correction.
             const float source_gamma = params.m_source_gamma; //1.75f;
 
-            float srgb_to_linear[256];
-            if (params.m_srgb)
+            // 8-bit to float conversion table of each resampled component.
+            float comp_to_float[cMaxComponents][256];
+            for (uint c = 0; c < params.m_num_comps; c++)
             {
+                const bool linear = !params.m_srgb || (params.m_first_comp + c == 3);
                 for (int i = 0; i < 256; ++i)
                 {
-                    srgb_to_linear[i] = (float)pow(i * 1.0f / 255.0f, source_gamma);
+                    comp_to_float[c][i] = linear ? i * (1.0f / 255.0f) : (float)pow(i * 1.0f / 255.0f, source_gamma);
                 }
             }
 
@@ -567,24 +648,16 @@ namespace crnlib
             {
                 const color_quad_u8* pSrc = src.get_scanline(src_y);
 
-                for (uint x = 0; x < src_width; x++)
+                for (uint c = 0; c < params.m_num_comps; c++)
                 {
-                    for (uint c = 0; c < params.m_num_comps; c++)
-                    {
-                        const uint comp_index = params.m_first_comp + c;
-                        const uint8 v = (*pSrc)[comp_index];
+                    const float* pTable = comp_to_float[c];
+                    const uint8* pComps = reinterpret_cast<const uint8*>(pSrc) + params.m_first_comp + c;
+                    float* pSamples = &samples[c][0];
 
-                        if (!params.m_srgb || (comp_index == 3))
-                        {
-                            samples[c][x] = v * (1.0f / 255.0f);
-                        }
-                        else
-                        {
-                            samples[c][x] = srgb_to_linear[v];
-                        }
+                    for (uint x = 0; x < src_width; x++)
+                    {
+                        pSamples[x] = pTable[pComps[x * 4]];
                     }
-
-                    pSrc++;
                 }
 
                 for (uint c = 0; c < params.m_num_comps; c++)
@@ -614,39 +687,9 @@ namespace crnlib
 
                         const bool linear = !params.m_srgb || (comp_index == 3);
                         CRNLIB_ASSERT(dst_y < dst_height);
-                        color_quad_u8* pDst = dst.get_scanline(dst_y);
-
-                        for (uint x = 0; x < dst_width; x++)
-                        {
-                            if (linear)
-                            {
-                                int c = (int)(255.0f * pOutput_samples[x] + .5f);
-                                if (c < 0)
-                                {
-                                    c = 0;
-                                }
-                                else if (c > 255)
-                                {
-                                    c = 255;
-                                }
-                                (*pDst)[comp_index] = (unsigned char)c;
-                            }
-                            else
-                            {
-                                int j = (int)(linear_to_srgb_table_size * pOutput_samples[x] + .5f);
-                                if (j < 0)
-                                {
-                                    j = 0;
-                                }
-                                else if (j >= linear_to_srgb_table_size)
-                                {
-                                    j = linear_to_srgb_table_size - 1;
-                                }
-                                (*pDst)[comp_index] = linear_to_srgb[j];
-                            }
+                        uint8* pDst = &dst.get_scanline(dst_y)[0][comp_index];
 
-                            pDst++;
-                        }
+                        resampled_to_u8(pOutput_samples, 1, dst_width, pDst, linear ? nullptr : linear_to_srgb, linear_to_srgb_table_size);
                     }
                     if (c < params.m_num_comps)
                     {
@@ -702,12 +745,14 @@ namespace crnlib
             // Partial gamma correction looks better on mips. Set to 1.0 to disable gamma correction.
             const float source_gamma = params.m_source_gamma; //1.75f;
 
-            float srgb_to_linear[256];
-            if (params.m_srgb)
+            // 8-bit to float conversion table of each resampled component.
+            float comp_to_float[cMaxComponents][256];
+            for (uint c = 0; c < params.m_num_comps; c++)
             {
+                const bool linear = !params.m_srgb || (params.m_first_comp + c == 3);
                 for (int i = 0; i < 256; ++i)
                 {
-                    srgb_to_linear[i] = (float)pow(i * 1.0f / 255.0f, source_gamma);
+                    comp_to_float[c][i] = linear ? i * (1.0f / 255.0f) : (float)pow(i * 1.0f / 255.0f, source_gamma);
                 }
             }
 
@@ -734,10 +779,10 @@ namespace crnlib
                 }
             }
 
-            task_pool tp;
-            tp.init(g_number_of_processors - 1);
+            scoped_task_pool tp;
+            tp.init(params.m_pTask_pool, g_number_of_processors - 1);
 
-            threaded_resampler resampler(tp);
+            threaded_resampler resampler(*tp.get());
             threaded_resampler::params p;
             p.m_src_width = src_width;
             p.m_src_height = src_height;
@@ -792,17 +837,7 @@ namespace crnlib
                 {
                     for (uint c = 0; c < params.m_num_comps; c++)
                     {
-                        const uint comp_index = params.m_first_comp + c;
-                        const uint8 v = (*pSrc)[comp_index];
-
-                        if (!params.m_srgb || (comp_index == 3))
-                        {
-                            pDst[c] = v * (1.0f / 255.0f);
-                        }
-                        else
-                        {
-                            pDst[c] = srgb_to_linear[v];
-                        }
+                        pDst[c] = comp_to_float[c][(*pSrc)[params.m_first_comp + c]];
                     }
 
                     pSrc++;
@@ -829,44 +864,15 @@ namespace crnlib
 
                 for (uint x = 0; x < dst_width; x++)
                 {
-                    color_quad_u8 dst(0, 0, 0, 255);
-
-                    for (uint c = 0; c < params.m_num_comps; c++)
-                    {
-                        const uint comp_index = params.m_first_comp + c;
-                        const float v = pSrc[c];
-
-                        if ((!params.m_srgb) || (comp_index == 3))
-                        {
-                            int c = static_cast<int>(255.0f * v + .5f);
-                            if (c < 0)
-                            {
-                                c = 0;
-                            }
-                            else if (c > 255)
-                            {
-                                c = 255;
-                            }
-                            dst[comp_index] = (unsigned char)c;
-                        }
-                        else
-                        {
-                            int j = static_cast<int>(linear_to_srgb_table_size * v + .5f);
-                            if (j < 0)
-                            {
-                                j = 0;
-                            }
-                            else if (j >= linear_to_srgb_table_size)
-                            {
-                                j = linear_to_srgb_table_size - 1;
-                            }
-                            dst[comp_index] = linear_to_srgb[j];
-                        }
-                    }
+                    pDst[x].set(0, 0, 0, 255);
+                }
 
-                    *pDst++ = dst;
+                for (uint c = 0; c < params.m_num_comps; c++)
+                {
+                    const uint comp_index = params.m_first_comp + c;
+                    const bool linear = (!params.m_srgb) || (comp_index == 3);
 
-                    pSrc += resampler_comps;
+                    resampled_to_u8(pSrc + c, resampler_comps, dst_width, &pDst[0][comp_index], linear ? nullptr : linear_to_srgb, linear_to_srgb_table_size);
                 }
             }
 
@@ -917,7 +923,7 @@ namespace crnlib
         }
 
         // FIXME: Totally hack-ass computation.
-        // Perhaps port http://www.lomont.org/Software/Misc/SSIM/SSIM.html?
+        // compute_ssim() no longer uses this, see image_metrics.
         double compute_block_ssim(uint t, const uint8* pX, const uint8* pY)
         {
             double ave_x = 0.0f;
@@ -961,76 +967,38 @@ namespace crnlib
 
         double compute_ssim(const image_u8& a, const image_u8& b, int channel_index)
         {
-            const uint N = 6;
-            uint8 sx[N * N], sy[N * N];
-
-            double total_ssim = 0.0f;
-            uint total_blocks = 0;
-
-            //image_u8 yimg((a.get_width() + N - 1) / N, (a.get_height() + N - 1) / N);
-
-            for (uint y = 0; y < a.get_height(); y += N)
-            {
-                for (uint x = 0; x < a.get_width(); x += N)
-                {
-                    for (uint iy = 0; iy < N; iy++)
-                    {
-                        for (uint ix = 0; ix < N; ix++)
-                        {
-                            if (channel_index < 0)
-                            {
-                                sx[ix + iy * N] = (uint8)a.get_clamped(x + ix, y + iy).get_luma();
-                            }
-                            else
-                            {
-                                sx[ix + iy * N] = (uint8)a.get_clamped(x + ix, y + iy)[channel_index];
-                            }
-
-                            if (channel_index < 0)
-                            {
-                                sy[ix + iy * N] = (uint8)b.get_clamped(x + ix, y + iy).get_luma();
-                            }
-                            else
-                            {
-                                sy[ix + iy * N] = (uint8)b.get_clamped(x + ix, y + iy)[channel_index];
-                            }
-                        }
-                    }
-
-                    double ssim = compute_block_ssim(N * N, sx, sy);
-                    total_ssim += ssim;
-                    total_blocks++;
-
-                    //uint ssim_c = (uint)math::clamp<double>(ssim * 127.0f + 128.0f, 0, 255);
-                    //yimg(x / N, y / N).set(ssim_c, ssim_c, ssim_c, 255);
-                }
-            }
+            const uint channel = (channel_index < 0) ? (uint)image_metrics::cLumaChannel : (uint)channel_index;
 
-            if (!total_blocks)
+            image_metrics metrics;
+            if (!metrics.compute(a, b, 1U << channel, true))
             {
                 return 0.0f;
             }
 
-            //save_to_file_stb_or_miniz("ssim.tga", yimg, cWriteFlagGrayscale);
+            return metrics.get_ssim(channel);
+        }
 
-            return total_ssim / total_blocks;
+        static void print_ssim(const image_metrics& metrics, bool has_alpha)
+        {
+            console::printf("Luma SSIM: %f", metrics.get_ssim(image_metrics::cLumaChannel));
+            console::printf("   R SSIM: %f", metrics.get_ssim(0));
+            console::printf("   G SSIM: %f", metrics.get_ssim(1));
+            console::printf("   B SSIM: %f", metrics.get_ssim(2));
+            if (has_alpha)
+            {
+                console::printf("   A SSIM: %f", metrics.get_ssim(3));
+            }
         }
 
         void print_ssim(const image_u8& src_img, const image_u8& dst_img)
         {
-            (void)src_img;
-            (void)dst_img;
-            //double y_ssim = compute_ssim(src_img, dst_img, -1);
-            //console::printf("Luma MSSIM: %f, Scaled: %f", y_ssim, (y_ssim - .8f) / .2f);
+            const bool has_alpha = src_img.has_alpha() || dst_img.has_alpha();
 
-            //double r_ssim = compute_ssim(src_img, dst_img, 0);
-            //console::printf("   R MSSIM: %f", r_ssim);
-
-            //double g_ssim = compute_ssim(src_img, dst_img, 1);
-            //console::printf("   G MSSIM: %f", g_ssim);
-
-            //double b_ssim = compute_ssim(src_img, dst_img, 2);
-            //console::printf("   B MSSIM: %f", b_ssim);
+            image_metrics metrics;
+            if (metrics.compute(src_img, dst_img, has_alpha ? image_metrics::cAllChannels : (image_metrics::cAllChannels & ~8U), true))
+            {
+                print_ssim(metrics, has_alpha);
+            }
         }
 
         void error_metrics::print(const char* pName) const
@@ -1050,63 +1018,22 @@ namespace crnlib
             //if ( (!a.get_width()) || (!b.get_height()) || (a.get_width() != b.get_width()) || (a.get_height() != b.get_height()) )
             //   return false;
 
-            const uint width = math::minimum(a.get_width(), b.get_width());
-            const uint height = math::minimum(a.get_height(), b.get_height());
-
             CRNLIB_ASSERT((first_channel < 4U) && (first_channel + num_channels <= 4U));
 
-            // Histogram approach due to Charles Bloom.
-            double hist[256];
-            utils::zero_object(hist);
-
-            for (uint y = 0; y < height; y++)
-            {
-                for (uint x = 0; x < width; x++)
-                {
-                    const color_quad_u8& ca = a(x, y);
-                    const color_quad_u8& cb = b(x, y);
-
-                    if (!num_channels)
-                    {
-                        hist[labs(ca.get_luma() - cb.get_luma())]++;
-                    }
-                    else
-                    {
-                        for (uint c = 0; c < num_channels; c++)
-                        {
-                            hist[labs(ca[first_channel + c] - cb[first_channel + c])]++;
-                        }
-                    }
-                }
-            }
-
-            mMax = 0;
-            double sum = 0.0f, sum2 = 0.0f;
-            for (uint i = 0; i < 256; i++)
-            {
-                if (!hist[i])
-                {
-                    continue;
-                }
-
-                mMax = math::maximum(mMax, i);
+            image_metrics metrics;
+            metrics.compute(a, b, num_channels ? (((1U << num_channels) - 1U) << first_channel) : (1U << image_metrics::cLumaChannel), false);
+            metrics.get_error_metrics(*this, first_channel, num_channels, average_component_error);
 
-                double x = i * hist[i];
+            return true;
+        }
 
-                sum += x;
-                sum2 += i * x;
-            }
+        void error_metrics::set_from_totals(uint max_error, uint64 total_error, uint64 total_squared_error, double total_values)
+        {
+            mMax = max_error;
 
             // See http://bmrc.berkeley.edu/courseware/cs294/fall97/assignment/psnr.html
-            double total_values = width * height;
-
-            if (average_component_error)
-            {
-                total_values *= math::clamp<uint>(num_channels, 1, 4);
-            }
-
-            mMean = math::clamp<double>(sum / total_values, 0.0f, 255.0f);
-            mMeanSquared = math::clamp<double>(sum2 / total_values, 0.0f, 255.0f * 255.0f);
+            mMean = math::clamp<double>(static_cast<double>(total_error) / total_values, 0.0f, 255.0f);
+            mMeanSquared = math::clamp<double>(static_cast<double>(total_squared_error) / total_values, 0.0f, 255.0f * 255.0f);
 
             mRootMeanSquared = sqrt(mMeanSquared);
 
@@ -1118,45 +1045,54 @@ namespace crnlib
             {
                 mPeakSNR = math::clamp<double>(log10(255.0f / mRootMeanSquared) * 20.0f, 0.0f, 500.0f);
             }
-
-            return true;
         }
 
-        void print_image_metrics(const image_u8& src_img, const image_u8& dst_img)
+        void print_image_metrics(const image_u8& src_img, const image_u8& dst_img, bool with_ssim)
         {
             if ((!src_img.get_width()) || (!dst_img.get_height()) || (src_img.get_width() != dst_img.get_width()) || (src_img.get_height() != dst_img.get_height()))
             {
                 console::printf("print_image_metrics: Image resolutions don't match exactly (%ux%u) vs. (%ux%u)", src_img.get_width(), src_img.get_height(), dst_img.get_width(), dst_img.get_height());
             }
 
+            const bool has_rgb = src_img.has_rgb() || dst_img.has_rgb();
+            const bool has_alpha = src_img.has_alpha() || dst_img.has_alpha();
+
+            image_metrics metrics;
+            metrics.compute(src_img, dst_img, has_alpha ? image_metrics::cAllChannels : (image_metrics::cAllChannels & ~8U), with_ssim && has_rgb);
+
             image_utils::error_metrics error_metrics;
 
-            if (src_img.has_rgb() || dst_img.has_rgb())
+            if (has_rgb)
             {
-                error_metrics.compute(src_img, dst_img, 0, 3, false);
+                metrics.get_error_metrics(error_metrics, 0, 3, false);
                 error_metrics.print("RGB Total  ");
 
-                error_metrics.compute(src_img, dst_img, 0, 3, true);
+                metrics.get_error_metrics(error_metrics, 0, 3, true);
                 error_metrics.print("RGB Average");
 
-                error_metrics.compute(src_img, dst_img, 0, 0);
+                metrics.get_error_metrics(error_metrics, 0, 0);
                 error_metrics.print("Luma       ");
 
-                error_metrics.compute(src_img, dst_img, 0, 1);
+                metrics.get_error_metrics(error_metrics, 0, 1);
                 error_metrics.print("Red        ");
 
-                error_metrics.compute(src_img, dst_img, 1, 1);
+                metrics.get_error_metrics(error_metrics, 1, 1);
                 error_metrics.print("Green      ");
 
-                error_metrics.compute(src_img, dst_img, 2, 1);
+                metrics.get_error_metrics(error_metrics, 2, 1);
                 error_metrics.print("Blue       ");
             }
 
-            if (src_img.has_alpha() || dst_img.has_alpha())
+            if (has_alpha)
             {
-                error_metrics.compute(src_img, dst_img, 3, 1);
+                metrics.get_error_metrics(error_metrics, 3, 1);
                 error_metrics.print("Alpha      ");
             }
+
+            if (with_ssim && has_rgb)
+            {
+                print_ssim(metrics, has_alpha);
+            }
         }
 
         static uint8 regen_z(uint x, uint y)
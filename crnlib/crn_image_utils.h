@@ -30,6 +30,7 @@
 namespace crnlib
 {
     enum pixel_format;
+    class task_pool;
 
     namespace image_utils
     {
@@ -89,7 +90,8 @@ namespace crnlib
                 m_first_comp(0),
                 m_num_comps(4),
                 m_source_gamma(2.2f), // 1.75f
-                m_multithreaded(true)
+                m_multithreaded(true),
+                m_pTask_pool(nullptr)
             {
             }
 
@@ -103,6 +105,8 @@ namespace crnlib
             uint m_num_comps;
             float m_source_gamma;
             bool m_multithreaded;
+            // Pool to use when multithreaded, instead of the shared pool or a private one.
+            task_pool* m_pTask_pool;
         };
 
         CRN_EXPORT bool resample_single_thread(const image_u8& src, image_u8& dst, const resample_params& params);
@@ -125,6 +129,9 @@ namespace crnlib
             // If pHist != nullptr, it must point to a 256 entry array.
             bool compute(const image_u8& a, const image_u8& b, uint first_channel, uint num_channels, bool average_component_error = true);
 
+            // Fills in the metrics from the maximum, sum and sum of squares of total_values absolute errors.
+            void set_from_totals(uint max_error, uint64 total_error, uint64 total_squared_error, double total_values);
+
             uint mMax;
             double mMean;
             double mMeanSquared;
@@ -147,7 +154,7 @@ namespace crnlib
             }
         };
 
-        CRN_EXPORT void print_image_metrics(const image_u8& src_img, const image_u8& dst_img);
+        CRN_EXPORT void print_image_metrics(const image_u8& src_img, const image_u8& dst_img, bool with_ssim = false);
 
         CRN_EXPORT double compute_block_ssim(uint n, const uint8* pX, const uint8* pY);
         CRN_EXPORT double compute_ssim(const image_u8& a, const image_u8& b, int channel_index);
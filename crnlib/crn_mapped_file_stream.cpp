@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2010-2016 Richard Geldreich, Jr. and Binomial LLC
+ * Copyright (c) 2020 FrozenStorm Interactive, Yoann Potinet
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation or credits
+ *    is required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "crn_core.h"
+#include "crn_mapped_file_stream.h"
+
+#if CRNLIB_USE_WIN32_API
+#include "crn_winhdr.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace crnlib
+{
+    mapped_file_stream::mapped_file_stream() :
+        data_stream(),
+        m_pData(nullptr),
+        m_size(0),
+        m_ofs(0)
+    {
+    }
+
+    mapped_file_stream::mapped_file_stream(const char* pFilename) :
+        data_stream(),
+        m_pData(nullptr),
+        m_size(0),
+        m_ofs(0)
+    {
+        open(pFilename);
+    }
+
+    mapped_file_stream::~mapped_file_stream()
+    {
+        close();
+    }
+
+    bool mapped_file_stream::open(const char* pFilename)
+    {
+        CRNLIB_ASSERT(pFilename);
+
+        close();
+
+        if (!map(pFilename))
+        {
+            if (!m_file.open(pFilename))
+            {
+                set_error();
+                return false;
+            }
+        }
+
+        set_name(pFilename);
+        m_attribs = cDataStreamReadable | cDataStreamSeekable;
+        m_opened = true;
+        return true;
+    }
+
+    bool mapped_file_stream::close()
+    {
+        clear_error();
+
+        if (!m_opened)
+        {
+            return false;
+        }
+
+        unmap();
+        m_file.close();
+        m_opened = false;
+        return true;
+    }
+
+#if CRNLIB_USE_WIN32_API
+    bool mapped_file_stream::map(const char* pFilename)
+    {
+        HANDLE hFile = CreateFileA(pFilename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        const void* pData = nullptr;
+        if ((GetFileSizeEx(hFile, &size)) && (size.QuadPart > 0) && (static_cast<uint64>(size.QuadPart) <= static_cast<uint64>(static_cast<size_t>(-1))))
+        {
+            HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (hMapping)
+            {
+                pData = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+                // The view keeps the mapping alive.
+                CloseHandle(hMapping);
+            }
+        }
+        CloseHandle(hFile);
+
+        if (!pData)
+        {
+            return false;
+        }
+
+        m_pData = static_cast<const uint8*>(pData);
+        m_size = size.QuadPart;
+        m_ofs = 0;
+        return true;
+    }
+
+    void mapped_file_stream::unmap()
+    {
+        if (m_pData)
+        {
+            UnmapViewOfFile(m_pData);
+            m_pData = nullptr;
+        }
+        m_size = 0;
+        m_ofs = 0;
+    }
+#else
+    bool mapped_file_stream::map(const char* pFilename)
+    {
+        // Check the path before opening it: opening a FIFO here would consume the writer the fallback needs.
+        struct stat st;
+        if ((stat(pFilename, &st) != 0) || (!S_ISREG(st.st_mode)))
+        {
+            return false;
+        }
+
+        int fd = ::open(pFilename, O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        void* pData = MAP_FAILED;
+        if ((fstat(fd, &st) == 0) && (S_ISREG(st.st_mode)) && (st.st_size > 0) && (static_cast<uint64>(st.st_size) <= static_cast<uint64>(static_cast<size_t>(-1))))
+        {
+            pData = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        // The mapping keeps the file referenced.
+        ::close(fd);
+
+        if (pData == MAP_FAILED)
+        {
+            return false;
+        }
+
+#ifdef MADV_SEQUENTIAL
+        madvise(pData, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+#endif
+
+        m_pData = static_cast<const uint8*>(pData);
+        m_size = st.st_size;
+        m_ofs = 0;
+        return true;
+    }
+
+    void mapped_file_stream::unmap()
+    {
+        if (m_pData)
+        {
+            munmap(const_cast<uint8*>(m_pData), static_cast<size_t>(m_size));
+            m_pData = nullptr;
+        }
+        m_size = 0;
+        m_ofs = 0;
+    }
+#endif
+
+    uint mapped_file_stream::read(void* pBuf, uint len)
+    {
+        CRNLIB_ASSERT(pBuf && (len <= 0x7FFFFFFF));
+
+        if ((!m_opened) || (!len))
+        {
+            return 0;
+        }
+
+        if (!m_pData)
+        {
+            const uint n = m_file.read(pBuf, len);
+            if (m_file.get_error())
+            {
+                set_error();
+            }
+            return n;
+        }
+
+        CRNLIB_ASSERT(m_ofs <= m_size);
+        len = static_cast<uint>(math::minimum<uint64>(len, m_size - m_ofs));
+        memcpy(pBuf, m_pData + m_ofs, len);
+        m_ofs += len;
+        return len;
+    }
+
+    uint mapped_file_stream::write(const void*, uint)
+    {
+        return 0;
+    }
+
+    bool mapped_file_stream::flush()
+    {
+        return false;
+    }
+
+    uint64 mapped_file_stream::get_size()
+    {
+        if (!m_opened)
+        {
+            return 0;
+        }
+
+        return m_pData ? m_size : m_file.get_size();
+    }
+
+    uint64 mapped_file_stream::get_remaining()
+    {
+        if (!m_opened)
+        {
+            return 0;
+        }
+
+        return m_pData ? (m_size - m_ofs) : m_file.get_remaining();
+    }
+
+    uint64 mapped_file_stream::get_ofs()
+    {
+        if (!m_opened)
+        {
+            return 0;
+        }
+
+        return m_pData ? m_ofs : m_file.get_ofs();
+    }
+
+    bool mapped_file_stream::seek(int64 ofs, bool relative)
+    {
+        if (!m_opened)
+        {
+            return false;
+        }
+
+        if (!m_pData)
+        {
+            return m_file.seek(ofs, relative);
+        }
+
+        int64 new_ofs = relative ? (static_cast<int64>(m_ofs) + ofs) : ofs;
+        if ((new_ofs < 0) || (static_cast<uint64>(new_ofs) > m_size))
+        {
+            return false;
+        }
+
+        m_ofs = new_ofs;
+        post_seek();
+        return true;
+    }
+} // namespace crnlib
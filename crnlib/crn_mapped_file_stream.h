@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2010-2016 Richard Geldreich, Jr. and Binomial LLC
+ * Copyright (c) 2020 FrozenStorm Interactive, Yoann Potinet
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation or credits
+ *    is required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#include "crn_cfile_stream.h"
+
+namespace crnlib
+{
+    // Read-only file stream backed by a memory mapping of the whole file, so get_ptr() exposes the file's contents without a copy.
+    // Falls back to buffered reads through a cfile_stream if the file can't be mapped (empty files, pipes, address space limits),
+    // in which case get_ptr() returns nullptr.
+    class CRN_EXPORT mapped_file_stream : public data_stream
+    {
+    public:
+        mapped_file_stream();
+        mapped_file_stream(const char* pFilename);
+        virtual ~mapped_file_stream();
+
+        bool open(const char* pFilename);
+        virtual bool close();
+
+        bool is_mapped() const
+        {
+            return m_pData != nullptr;
+        }
+
+        virtual const void* get_ptr() const
+        {
+            return m_pData;
+        }
+
+        virtual uint read(void* pBuf, uint len);
+        virtual uint write(const void* pBuf, uint len);
+        virtual bool flush();
+
+        virtual uint64 get_size();
+        virtual uint64 get_remaining();
+        virtual uint64 get_ofs();
+        virtual bool seek(int64 ofs, bool relative);
+
+    private:
+        cfile_stream m_file;
+        const uint8* m_pData;
+        uint64 m_size, m_ofs;
+
+        bool map(const char* pFilename);
+        void unmap();
+    };
+} // namespace crnlib
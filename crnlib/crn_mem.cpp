@@ -24,12 +24,16 @@
 #include "crn_core.h"
 #include "crn_console.h"
 #include "crnlib.h"
+#include "crn_atomics.h"
 
 #if CRNLIB_USE_WIN32_API
 #include "crn_winhdr.h"
 #endif
 
+// Set to 1 (or configure with -DCRN_MEM_STATS=ON) to track the heap usage reported by crnlib_print_mem_stats().
+#ifndef CRNLIB_MEM_STATS
 #define CRNLIB_MEM_STATS 0
+#endif
 
 #if !CRNLIB_USE_WIN32_API
 #if defined(CRN_OS_LINUX)
@@ -45,17 +49,24 @@ typedef __darwin_uuid_t uuid_t;
 namespace crnlib
 {
 #if CRNLIB_MEM_STATS
-#if CRNLIB_64BIT_POINTERS
-    typedef LONGLONG mem_stat_t;
-#define CRNLIB_MEM_COMPARE_EXCHANGE InterlockedCompareExchange64
-#else
-    typedef LONG mem_stat_t;
-#define CRNLIB_MEM_COMPARE_EXCHANGE InterlockedCompareExchange
-#endif
+    typedef atomic64_t mem_stat_t;
+#define CRNLIB_MEM_COMPARE_EXCHANGE atomic_compare_exchange64
 
     static volatile mem_stat_t g_total_blocks;
     static volatile mem_stat_t g_total_allocated;
     static volatile mem_stat_t g_max_allocated;
+    // Number of malloc's and realloc's since startup, to measure the allocator traffic.
+    static volatile mem_stat_t g_total_allocations;
+
+    static void count_allocation()
+    {
+        for (;;)
+        {
+            mem_stat_t cur_total_allocations = g_total_allocations;
+            if (CRNLIB_MEM_COMPARE_EXCHANGE(&g_total_allocations, cur_total_allocations + 1, cur_total_allocations) == cur_total_allocations)
+                break;
+        }
+    }
 
     static mem_stat_t update_total_allocated(int block_delta, mem_stat_t byte_delta)
     {
@@ -207,6 +218,7 @@ namespace crnlib
 #if CRNLIB_MEM_STATS
         CRNLIB_ASSERT((*g_pMSize)(p_new, g_pUser_data) == actual_size);
         update_total_allocated(1, static_cast<mem_stat_t>(actual_size));
+        count_allocation();
 #endif
 
         return p_new;
@@ -259,6 +271,10 @@ namespace crnlib
             num_new_blocks = 1;
         }
         update_total_allocated(num_new_blocks, static_cast<mem_stat_t>(actual_size) - static_cast<mem_stat_t>(cur_size));
+        if (size)
+        {
+            count_allocation();
+        }
 #endif
 
         return p_new;
@@ -319,12 +335,12 @@ namespace crnlib
         if (console::is_initialized())
         {
             console::debug("crnlib_print_mem_stats:");
-            console::debug("Current blocks: %u, allocated: " CRNLIB_INT64_FORMAT_SPECIFIER ", max ever allocated: " CRNLIB_INT64_FORMAT_SPECIFIER, g_total_blocks, (int64)g_total_allocated, (int64)g_max_allocated);
+            console::debug("Current blocks: %u, allocated: " CRNLIB_INT64_FORMAT_SPECIFIER ", max ever allocated: " CRNLIB_INT64_FORMAT_SPECIFIER ", total allocations: " CRNLIB_INT64_FORMAT_SPECIFIER, (uint)g_total_blocks, (int64)g_total_allocated, (int64)g_max_allocated, (int64)g_total_allocations);
         }
         else
         {
             printf("crnlib_print_mem_stats:\n");
-            printf("Current blocks: %u, allocated: " CRNLIB_INT64_FORMAT_SPECIFIER ", max ever allocated: " CRNLIB_INT64_FORMAT_SPECIFIER "\n", g_total_blocks, (int64)g_total_allocated, (int64)g_max_allocated);
+            printf("Current blocks: %u, allocated: " CRNLIB_INT64_FORMAT_SPECIFIER ", max ever allocated: " CRNLIB_INT64_FORMAT_SPECIFIER ", total allocations: " CRNLIB_INT64_FORMAT_SPECIFIER "\n", (uint)g_total_blocks, (int64)g_total_allocated, (int64)g_max_allocated, (int64)g_total_allocations);
         }
 #endif
     }
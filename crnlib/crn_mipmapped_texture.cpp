@@ -24,6 +24,7 @@
 #include "crn_core.h"
 #include "crn_mipmapped_texture.h"
 #include "crn_cfile_stream.h"
+#include "crn_mapped_file_stream.h"
 #include "crn_image_utils.h"
 #include "crn_console.h"
 #include "crn_texture_comp.h"
@@ -1944,13 +1945,13 @@ bool mipmapped_texture::convert(pixel_format fmt, bool cook, const dxt_image::pa
     q1_params.m_perceptual = false;
   }
 
-  task_pool tp;
-  if (!tp.init(p.m_num_helper_threads))
+  scoped_task_pool tp;
+  if (!tp.init(p.m_pTask_pool, p.m_num_helper_threads))
     return false;
 
   mipmapped_texture packed_tex;
 
-  qdxt_state state(tp);
+  qdxt_state state(*tp.get());
   if (!src_tex.qdxt_pack_init(state, packed_tex, q1_params, q5_params, fmt, false))
     return false;
 
@@ -2111,6 +2112,7 @@ bool mipmapped_texture::resize(uint new_width, uint new_height, const resample_p
     rparams.m_wrapping = params.m_wrapping;
     rparams.m_pFilter = params.m_pFilter;
     rparams.m_multithreaded = params.m_multithreaded;
+    rparams.m_pTask_pool = params.m_pTask_pool;
 
     if (!image_utils::resample(*pImg, *pMip, rparams)) {
       crnlib_delete(pMip);
@@ -2137,6 +2139,104 @@ bool mipmapped_texture::resize(uint new_width, uint new_height, const resample_p
   return true;
 }
 
+// Resamples the levels of a mip chain on a task pool. Each (face, level) pair is an independent task resampled
+// from the face's top level, or in pyramid mode each face is a task that derives every level from the one above it.
+class mipmap_generator {
+ public:
+  mipmap_generator(const mipmapped_texture::generate_mipmap_params& params, face_vec& faces, const crnlib::vector<const image_u8*>& top_images)
+      : m_params(params),
+        m_faces(faces),
+        m_top_images(top_images),
+        m_inner_multithreaded(false),
+        m_failed(false) {
+  }
+
+  bool generate() {
+    const uint num_faces = m_faces.size();
+    const uint num_levels = m_faces[0].size();
+
+    for (uint f = 0; f < num_faces; f++)
+      m_faces[f][0]->assign(crnlib_new<image_u8>(*m_top_images[f]), PIXEL_FMT_INVALID, m_faces[f][0]->get_orientation_flags());
+
+    if (num_levels < 2)
+      return true;
+
+    const uint num_tasks = m_params.m_pyramid ? num_faces : num_faces * (num_levels - 1);
+
+    scoped_task_pool tp;
+    if ((!m_params.m_multithreaded) || (g_number_of_processors < 2) || (num_tasks < 2) ||
+        (!tp.init(m_params.m_pTask_pool, math::minimum<uint>(g_number_of_processors, num_tasks) - 1))) {
+      // Nothing to spread over a pool, or its threads couldn't be created, so let each resample use the threaded resampler instead.
+      m_inner_multithreaded = m_params.m_multithreaded;
+      for (uint i = 0; i < num_tasks; i++)
+        resample_task(i, nullptr);
+      return !m_failed;
+    }
+
+    tp->queue_multiple_object_tasks(this, &mipmap_generator::resample_task, 0, num_tasks);
+    tp->join();
+
+    return !m_failed;
+  }
+
+ private:
+  const mipmapped_texture::generate_mipmap_params& m_params;
+  face_vec& m_faces;
+  const crnlib::vector<const image_u8*>& m_top_images;
+  bool m_inner_multithreaded;
+  volatile bool m_failed;
+
+  bool resample_level(uint face_index, uint level_index, const image_u8& src) {
+    const image_u8& top = *m_top_images[face_index];
+
+    image_utils::resample_params rparams;
+    rparams.m_dst_width = math::maximum<uint>(1U, top.get_width() >> level_index);
+    rparams.m_dst_height = math::maximum<uint>(1U, top.get_height() >> level_index);
+    rparams.m_filter_scale = m_params.m_filter_scale;
+    rparams.m_first_comp = 0;
+    rparams.m_num_comps = top.is_component_valid(3) ? 4 : 3;
+    rparams.m_srgb = m_params.m_srgb;
+    rparams.m_wrapping = m_params.m_wrapping;
+    rparams.m_pFilter = m_params.m_pFilter;
+    rparams.m_multithreaded = m_inner_multithreaded;
+    rparams.m_pTask_pool = m_params.m_pTask_pool;
+
+    image_u8* pMip = crnlib_new<image_u8>();
+
+    if (!image_utils::resample(src, *pMip, rparams)) {
+      crnlib_delete(pMip);
+      return false;
+    }
+
+    if (m_params.m_renormalize)
+      image_utils::renorm_normal_map(*pMip);
+
+    pMip->set_comp_flags(top.get_comp_flags());
+
+    mip_level* pLevel = m_faces[face_index][level_index];
+    pLevel->assign(pMip, PIXEL_FMT_INVALID, m_faces[face_index][0]->get_orientation_flags());
+    return true;
+  }
+
+  void resample_task(uint64 data, void*) {
+    if (m_params.m_pyramid) {
+      const uint face_index = static_cast<uint>(data);
+      for (uint l = 1; l < m_faces[face_index].size(); l++) {
+        if ((m_failed) || (!resample_level(face_index, l, *m_faces[face_index][l - 1]->get_image()))) {
+          m_failed = true;
+          return;
+        }
+      }
+    } else {
+      const uint num_mips = m_faces[0].size() - 1;
+      const uint face_index = static_cast<uint>(data) / num_mips;
+      const uint level_index = 1 + static_cast<uint>(data) % num_mips;
+      if ((m_failed) || (!resample_level(face_index, level_index, *m_top_images[face_index])))
+        m_failed = true;
+    }
+  }
+};
+
 bool mipmapped_texture::generate_mipmaps(const generate_mipmap_params& params, bool force) {
   CRNLIB_ASSERT(is_valid());
   if (!is_valid())
@@ -2169,48 +2269,18 @@ bool mipmapped_texture::generate_mipmaps(const generate_mipmap_params& params, b
       faces[f][l] = crnlib_new<mip_level>();
   }
 
-  for (uint f = 0; f < faces.size(); f++) {
-    image_u8 tmp;
-    image_u8* pImg = get_level(f, 0)->get_unpacked_image(tmp, cUnpackFlagUncook);
-
-    for (uint l = 0; l < num_levels; l++) {
-      const uint mip_width = math::maximum<uint>(1U, get_width() >> l);
-      const uint mip_height = math::maximum<uint>(1U, get_height() >> l);
-
-      image_u8* pMip = crnlib_new<image_u8>();
-
-      if (!l)
-        *pMip = *pImg;
-      else {
-        image_utils::resample_params rparams;
-        rparams.m_dst_width = mip_width;
-        rparams.m_dst_height = mip_height;
-        rparams.m_filter_scale = params.m_filter_scale;
-        rparams.m_first_comp = 0;
-        rparams.m_num_comps = pImg->is_component_valid(3) ? 4 : 3;
-        rparams.m_srgb = params.m_srgb;
-        rparams.m_wrapping = params.m_wrapping;
-        rparams.m_pFilter = params.m_pFilter;
-        rparams.m_multithreaded = params.m_multithreaded;
-
-        if (!image_utils::resample(*pImg, *pMip, rparams)) {
-          crnlib_delete(pMip);
-
-          for (uint f = 0; f < faces.size(); f++)
-            for (uint l = 0; l < faces[f].size(); l++)
-              crnlib_delete(faces[f][l]);
-
-          return false;
-        }
-
-        if (params.m_renormalize)
-          image_utils::renorm_normal_map(*pMip);
+  crnlib::vector<image_u8> tmp_images(faces.size());
+  crnlib::vector<const image_u8*> top_images(faces.size());
+  for (uint f = 0; f < faces.size(); f++)
+    top_images[f] = get_level(f, 0)->get_unpacked_image(tmp_images[f], cUnpackFlagUncook);
 
-        pMip->set_comp_flags(pImg->get_comp_flags());
-      }
+  mipmap_generator generator(params, faces, top_images);
+  if (!generator.generate()) {
+    for (uint f = 0; f < faces.size(); f++)
+      for (uint l = 0; l < faces[f].size(); l++)
+        crnlib_delete(faces[f][l]);
 
-      faces[f][l]->assign(pMip, PIXEL_FMT_INVALID, get_level(f, 0)->get_orientation_flags());
-    }
+    return false;
   }
 
   assign(faces);
@@ -2602,7 +2672,7 @@ bool mipmapped_texture::read_from_file(const char* pFilename, texture_file_types
 
   bool success = false;
 
-  cfile_stream in_stream;
+  mapped_file_stream in_stream;
   if (in_stream.open(pFilename)) {
     data_stream_serializer serializer(in_stream);
     success = read_from_stream(serializer, file_format);
@@ -2821,11 +2891,13 @@ bool mipmapped_texture::read_crn_from_memory(const void* pData, uint data_size,
 
 bool mipmapped_texture::read_crn(data_stream_serializer& serializer) {
   crnlib::vector<uint8> crn_data;
-  if (!serializer.read_entire_file(crn_data)) {
+  const uint8* pData;
+  uint data_size;
+  if (!serializer.read_entire_file(crn_data, pData, data_size)) {
     set_last_error("Failed reading CRN file");
     return false;
   }
-  return read_crn_from_memory(crn_data.get_ptr(), crn_data.size(), serializer.get_name().get_ptr());
+  return read_crn_from_memory(pData, data_size, serializer.get_name().get_ptr());
 }
 
 bool mipmapped_texture::write_to_file(
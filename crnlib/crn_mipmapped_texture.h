@@ -249,7 +249,8 @@ class CRN_EXPORT mipmapped_texture {
           m_rtopmip(false),
           m_filter_scale(.9f),
           m_gamma(1.75f),  // or 2.2f
-          m_multithreaded(true) {
+          m_multithreaded(true),
+          m_pTask_pool(nullptr) {
     }
 
     const char* m_pFilter;
@@ -260,6 +261,7 @@ class CRN_EXPORT mipmapped_texture {
     float m_filter_scale;
     float m_gamma;
     bool m_multithreaded;
+    task_pool* m_pTask_pool;  // used when multithreaded instead of the shared pool or a private one
   };
 
   bool resize(uint new_width, uint new_height, const resample_params& params);
@@ -268,11 +270,13 @@ class CRN_EXPORT mipmapped_texture {
     generate_mipmap_params()
         : resample_params(),
           m_min_mip_size(1),
-          m_max_mips(0) {
+          m_max_mips(0),
+          m_pyramid(false) {
     }
 
     uint m_min_mip_size;
     uint m_max_mips;  // actually the max # of total levels
+    bool m_pyramid;   // derive each level from the previous one instead of the top level
   };
 
   bool generate_mipmaps(const generate_mipmap_params& params, bool force);
@@ -120,3 +120,125 @@ void crnlib_output_debug_string(const char* p)
     puts(p);
 }
 #endif  // CRNLIB_USE_WIN32_API
+
+#if CRNLIB_X86_SIMD
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void crnlib_cpuid(unsigned leaf, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, 0);
+    for (unsigned i = 0; i < 4; i++)
+    {
+        regs[i] = r[i];
+    }
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static crnlib::uint64 crnlib_xgetbv()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((crnlib::uint64)edx << 32) | eax;
+#endif
+}
+
+enum
+{
+    cCPUFeatureSSE41 = 1,
+    cCPUFeatureAVX2 = 2,
+    cCPUFeatureSSE2 = 4
+};
+
+static unsigned crnlib_detect_cpu_features()
+{
+    unsigned regs[4];
+    crnlib_cpuid(0, regs);
+    const unsigned max_leaf = regs[0];
+    if (!max_leaf)
+    {
+        return 0;
+    }
+
+    unsigned features = 0;
+    crnlib_cpuid(1, regs);
+    if (regs[3] & (1U << 26))
+    {
+        features |= cCPUFeatureSSE2;
+    }
+    if (regs[2] & (1U << 19))
+    {
+        features |= cCPUFeatureSSE41;
+    }
+
+    // AVX2 also needs the OS to save the YMM state (OSXSAVE + XCR0 bits 1 and 2).
+    const bool os_saves_ymm = (regs[2] & (1U << 27)) && (regs[2] & (1U << 28)) && ((crnlib_xgetbv() & 6) == 6);
+    if (os_saves_ymm && (max_leaf >= 7))
+    {
+        crnlib_cpuid(7, regs);
+        if (regs[1] & (1U << 5))
+        {
+            features |= cCPUFeatureAVX2;
+        }
+    }
+    return features;
+}
+
+static volatile unsigned g_cpu_feature_mask = ~0U;
+
+static unsigned crnlib_get_cpu_features()
+{
+    static const unsigned s_features = crnlib_detect_cpu_features();
+    return s_features & g_cpu_feature_mask;
+}
+
+void crnlib_set_max_simd_level(unsigned level)
+{
+    static const unsigned s_level_masks[] = { 0, cCPUFeatureSSE2, cCPUFeatureSSE2 | cCPUFeatureSSE41 };
+    g_cpu_feature_mask = level < CRNLIB_ARRAY_SIZE(s_level_masks) ? s_level_masks[level] : ~0U;
+}
+
+bool crnlib_cpu_has_sse2(void)
+{
+    return (crnlib_get_cpu_features() & cCPUFeatureSSE2) != 0;
+}
+
+bool crnlib_cpu_has_sse41(void)
+{
+    return (crnlib_get_cpu_features() & cCPUFeatureSSE41) != 0;
+}
+
+bool crnlib_cpu_has_avx2(void)
+{
+    return (crnlib_get_cpu_features() & cCPUFeatureAVX2) != 0;
+}
+#else
+bool crnlib_cpu_has_sse2(void)
+{
+    return false;
+}
+
+bool crnlib_cpu_has_sse41(void)
+{
+    return false;
+}
+
+bool crnlib_cpu_has_avx2(void)
+{
+    return false;
+}
+
+void crnlib_set_max_simd_level(unsigned)
+{
+}
+#endif  // CRNLIB_X86_SIMD
@@ -84,6 +84,28 @@ const bool c_crnlib_big_endian_platform = !c_crnlib_little_endian_platform;
 
 #define CRNLIB_GET_ALIGNMENT(v) ((!sizeof(v)) ? 1 : (__alignof(v) ? __alignof(v) : sizeof(uint32)))
 
+// x86 SIMD kernels are compiled per function and selected at runtime, so the baseline build flags are unchanged.
+#if (defined(__GNUC__) || defined(_MSC_VER)) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define CRNLIB_X86_SIMD 1
+#if defined(__GNUC__)
+#define CRNLIB_TARGET_SSE2 __attribute__((target("sse2")))
+#define CRNLIB_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define CRNLIB_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CRNLIB_TARGET_SSE2
+#define CRNLIB_TARGET_SSE41
+#define CRNLIB_TARGET_AVX2
+#endif
+#else
+#define CRNLIB_X86_SIMD 0
+#endif
+
+CRN_EXPORT bool crnlib_cpu_has_sse2(void);
+CRN_EXPORT bool crnlib_cpu_has_sse41(void);
+CRN_EXPORT bool crnlib_cpu_has_avx2(void);
+// Caps the instruction sets reported above (0 = none, 1 = SSE2, 2 = SSE4.1, 3 = AVX2), so the SIMD kernels can be compared with the scalar code.
+CRN_EXPORT void crnlib_set_max_simd_level(unsigned level);
+
 #ifndef _MSC_VER
 int sprintf_s(char* buffer, size_t sizeOfBuffer, const char* format, ...);
 int vsprintf_s(char* buffer, size_t sizeOfBuffer, const char* format, va_list args);
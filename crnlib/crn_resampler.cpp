@@ -4,6 +4,10 @@
 #include "crn_resampler.h"
 #include "crn_resample_filters.h"
 
+#if CRNLIB_X86_SIMD
+#include <immintrin.h>
+#endif
+
 namespace crnlib
 {
 #define resampler_assert CRNLIB_ASSERT
@@ -419,11 +423,323 @@ namespace crnlib
         return Pcontrib;
     }
 
+    bool Resampler::pack_clist(const Contrib_List* Pclist, int dst_x, Packed_Contribs* Ppacked)
+    {
+        Ppacked->by_sample = use_packed_by_sample(dst_x);
+        Ppacked->num_groups = Ppacked->by_sample ? dst_x : (dst_x + PACKED_LANES - 1) / PACKED_LANES;
+        Ppacked->Pcounts = (int*)crnlib_malloc(Ppacked->num_groups * sizeof(int));
+        Ppacked->Ppixels = nullptr;
+        Ppacked->Pweights = nullptr;
+        if (!Ppacked->Pcounts)
+        {
+            return false;
+        }
+
+        int total = 0;
+        for (int g = 0; g < Ppacked->num_groups; g++)
+        {
+            int n = 0;
+            if (Ppacked->by_sample)
+            {
+                n = (Pclist[g].n + PACKED_LANES - 1) / PACKED_LANES;
+            }
+            else
+            {
+                for (int i = g * PACKED_LANES; i < min(dst_x, (g + 1) * PACKED_LANES); i++)
+                {
+                    n = max(n, (int)Pclist[i].n);
+                }
+            }
+            Ppacked->Pcounts[g] = n;
+            total += n * PACKED_LANES;
+        }
+
+        Ppacked->Ppixels = (int*)crnlib_malloc(total * sizeof(int));
+        Ppacked->Pweights = (Resample_Real*)crnlib_malloc(total * sizeof(Resample_Real));
+        if ((!Ppacked->Ppixels) || (!Ppacked->Pweights))
+        {
+            free_packed_clist(Ppacked);
+            return false;
+        }
+
+        int* Ppixels = Ppacked->Ppixels;
+        Resample_Real* Pweights = Ppacked->Pweights;
+        for (int g = 0; g < Ppacked->num_groups; g++)
+        {
+            for (int j = 0; j < Ppacked->Pcounts[g]; j++)
+            {
+                for (int l = 0; l < PACKED_LANES; l++)
+                {
+                    const int i = Ppacked->by_sample ? g : g * PACKED_LANES + l;
+                    const int k = Ppacked->by_sample ? j * PACKED_LANES + l : j;
+                    const bool valid = (i < dst_x) && (k < Pclist[i].n);
+                    *Ppixels++ = valid ? Pclist[i].p[k].pixel : 0;
+                    *Pweights++ = valid ? Pclist[i].p[k].weight : 0.0f;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    void Resampler::free_packed_clist(Packed_Contribs* Ppacked)
+    {
+        crnlib_free(Ppacked->Pcounts);
+        crnlib_free(Ppacked->Ppixels);
+        crnlib_free(Ppacked->Pweights);
+        Ppacked->num_groups = 0;
+        Ppacked->Pcounts = nullptr;
+        Ppacked->Ppixels = nullptr;
+        Ppacked->Pweights = nullptr;
+    }
+
+    static void resample_x_by_sample(Resample_Real* Pdst, const Resample_Real* Psrc, const Resampler::Packed_Contribs& packed)
+    {
+        const int* Ppixels = packed.Ppixels;
+        const Resample_Real* Pweights = packed.Pweights;
+
+        for (int g = 0; g < packed.num_groups; g++)
+        {
+            Resample_Real totals[Resampler::PACKED_LANES] = {};
+
+            for (int j = packed.Pcounts[g]; j > 0; j--, Ppixels += Resampler::PACKED_LANES, Pweights += Resampler::PACKED_LANES)
+            {
+                for (int l = 0; l < Resampler::PACKED_LANES; l++)
+                {
+                    totals[l] += Psrc[Ppixels[l]] * Pweights[l];
+                }
+            }
+
+            *Pdst++ = Resampler::sum_packed_lanes(totals);
+        }
+    }
+
+#if CRNLIB_X86_SIMD
+    // Each lane accumulates its contributors in list order and the padding adds zeros, so the results match the scalar code.
+    CRNLIB_TARGET_SSE2 static void resample_x_sse2(Resample_Real* Pdst, const Resample_Real* Psrc, int dst_x, const Resampler::Packed_Contribs& packed)
+    {
+        const int* Ppixels = packed.Ppixels;
+        const Resample_Real* Pweights = packed.Pweights;
+
+        for (int g = 0; g < packed.num_groups; g++)
+        {
+            __m128 total0 = _mm_setzero_ps();
+            __m128 total1 = _mm_setzero_ps();
+
+            for (int j = packed.Pcounts[g]; j > 0; j--, Ppixels += Resampler::PACKED_LANES, Pweights += Resampler::PACKED_LANES)
+            {
+                const __m128 s0 = _mm_setr_ps(Psrc[Ppixels[0]], Psrc[Ppixels[1]], Psrc[Ppixels[2]], Psrc[Ppixels[3]]);
+                const __m128 s1 = _mm_setr_ps(Psrc[Ppixels[4]], Psrc[Ppixels[5]], Psrc[Ppixels[6]], Psrc[Ppixels[7]]);
+                total0 = _mm_add_ps(total0, _mm_mul_ps(s0, _mm_load_ps(Pweights)));
+                total1 = _mm_add_ps(total1, _mm_mul_ps(s1, _mm_load_ps(Pweights + 4)));
+            }
+
+            if (packed.by_sample)
+            {
+                // sum_packed_lanes() order: (t0 + t4) + (t2 + t6), then (t1 + t5) + (t3 + t7).
+                const __m128 s = _mm_add_ps(total0, total1);
+                const __m128 t = _mm_add_ps(s, _mm_movehl_ps(s, s));
+                *Pdst++ = _mm_cvtss_f32(_mm_add_ss(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1))));
+                continue;
+            }
+
+            const int n = dst_x - g * Resampler::PACKED_LANES;
+            if (n >= Resampler::PACKED_LANES)
+            {
+                _mm_storeu_ps(Pdst, total0);
+                _mm_storeu_ps(Pdst + 4, total1);
+            }
+            else
+            {
+                CRNLIB_ALIGNED(16) Resample_Real tmp[Resampler::PACKED_LANES];
+                _mm_store_ps(tmp, total0);
+                _mm_store_ps(tmp + 4, total1);
+                memcpy(Pdst, tmp, n * sizeof(Resample_Real));
+            }
+            Pdst += Resampler::PACKED_LANES;
+        }
+    }
+
+    CRNLIB_TARGET_AVX2 static void resample_x_avx2(Resample_Real* Pdst, const Resample_Real* Psrc, int dst_x, const Resampler::Packed_Contribs& packed)
+    {
+        const int* Ppixels = packed.Ppixels;
+        const Resample_Real* Pweights = packed.Pweights;
+
+        for (int g = 0; g < packed.num_groups; g++)
+        {
+            __m256 total = _mm256_setzero_ps();
+
+            for (int j = packed.Pcounts[g]; j > 0; j--, Ppixels += Resampler::PACKED_LANES, Pweights += Resampler::PACKED_LANES)
+            {
+                const __m256 s = _mm256_i32gather_ps(Psrc, _mm256_loadu_si256((const __m256i*)Ppixels), sizeof(Resample_Real));
+                total = _mm256_add_ps(total, _mm256_mul_ps(s, _mm256_loadu_ps(Pweights)));
+            }
+
+            if (packed.by_sample)
+            {
+                const __m128 s = _mm_add_ps(_mm256_castps256_ps128(total), _mm256_extractf128_ps(total, 1));
+                const __m128 t = _mm_add_ps(s, _mm_movehl_ps(s, s));
+                *Pdst++ = _mm_cvtss_f32(_mm_add_ss(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1))));
+                continue;
+            }
+
+            const int n = dst_x - g * Resampler::PACKED_LANES;
+            if (n >= Resampler::PACKED_LANES)
+            {
+                _mm256_storeu_ps(Pdst, total);
+            }
+            else
+            {
+                CRNLIB_ALIGNED(32) Resample_Real tmp[Resampler::PACKED_LANES];
+                _mm256_store_ps(tmp, total);
+                memcpy(Pdst, tmp, n * sizeof(Resample_Real));
+            }
+            Pdst += Resampler::PACKED_LANES;
+        }
+    }
+
+    CRNLIB_TARGET_SSE2 static void scale_span_sse2(Resample_Real* Ptmp, const Resample_Real* Psrc, Resample_Real weight, int dst_x, bool add)
+    {
+        const __m128 w = _mm_set1_ps(weight);
+        int i = 0;
+        if (add)
+        {
+            for (; i + 4 <= dst_x; i += 4)
+            {
+                _mm_storeu_ps(Ptmp + i, _mm_add_ps(_mm_loadu_ps(Ptmp + i), _mm_mul_ps(_mm_loadu_ps(Psrc + i), w)));
+            }
+            for (; i < dst_x; i++)
+            {
+                Ptmp[i] += Psrc[i] * weight;
+            }
+        }
+        else
+        {
+            for (; i + 4 <= dst_x; i += 4)
+            {
+                _mm_storeu_ps(Ptmp + i, _mm_mul_ps(_mm_loadu_ps(Psrc + i), w));
+            }
+            for (; i < dst_x; i++)
+            {
+                Ptmp[i] = Psrc[i] * weight;
+            }
+        }
+    }
+
+    CRNLIB_TARGET_AVX2 static void scale_span_avx2(Resample_Real* Ptmp, const Resample_Real* Psrc, Resample_Real weight, int dst_x, bool add)
+    {
+        const __m256 w = _mm256_set1_ps(weight);
+        int i = 0;
+        if (add)
+        {
+            for (; i + 8 <= dst_x; i += 8)
+            {
+                _mm256_storeu_ps(Ptmp + i, _mm256_add_ps(_mm256_loadu_ps(Ptmp + i), _mm256_mul_ps(_mm256_loadu_ps(Psrc + i), w)));
+            }
+            for (; i < dst_x; i++)
+            {
+                Ptmp[i] += Psrc[i] * weight;
+            }
+        }
+        else
+        {
+            for (; i + 8 <= dst_x; i += 8)
+            {
+                _mm256_storeu_ps(Ptmp + i, _mm256_mul_ps(_mm256_loadu_ps(Psrc + i), w));
+            }
+            for (; i < dst_x; i++)
+            {
+                Ptmp[i] = Psrc[i] * weight;
+            }
+        }
+    }
+
+    CRNLIB_TARGET_SSE2 static void clamp_span_sse2(Resample_Real* Pdst, int n, Resample_Real lo, Resample_Real hi)
+    {
+        const __m128 l = _mm_set1_ps(lo);
+        const __m128 h = _mm_set1_ps(hi);
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            _mm_storeu_ps(Pdst + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(Pdst + i), l), h));
+        }
+        for (; i < n; i++)
+        {
+            Pdst[i] = (Pdst[i] < lo) ? lo : ((Pdst[i] > hi) ? hi : Pdst[i]);
+        }
+    }
+#endif
+
+    void Resampler::scale_span(Sample* Pdst, const Sample* Psrc, Resample_Real weight, int n, bool add)
+    {
+#if CRNLIB_X86_SIMD
+        if (crnlib_cpu_has_avx2())
+        {
+            scale_span_avx2(Pdst, Psrc, weight, n, add);
+            return;
+        }
+        else if (crnlib_cpu_has_sse2())
+        {
+            scale_span_sse2(Pdst, Psrc, weight, n, add);
+            return;
+        }
+#endif
+
+        if (add)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                Pdst[i] += Psrc[i] * weight;
+            }
+        }
+        else
+        {
+            for (int i = 0; i < n; i++)
+            {
+                Pdst[i] = Psrc[i] * weight;
+            }
+        }
+    }
+
+    void Resampler::clamp_span(Sample* Pdst, int n, Resample_Real lo, Resample_Real hi)
+    {
+#if CRNLIB_X86_SIMD
+        if (crnlib_cpu_has_sse2())
+        {
+            clamp_span_sse2(Pdst, n, lo, hi);
+            return;
+        }
+#endif
+
+        for (int i = 0; i < n; i++)
+        {
+            Pdst[i] = (Pdst[i] < lo) ? lo : ((Pdst[i] > hi) ? hi : Pdst[i]);
+        }
+    }
+
     void Resampler::resample_x(Sample* Pdst, const Sample* Psrc)
     {
         resampler_assert(Pdst);
         resampler_assert(Psrc);
 
+        if (m_packed_x.Pcounts)
+        {
+#if CRNLIB_X86_SIMD
+            if (crnlib_cpu_has_avx2())
+            {
+                resample_x_avx2(Pdst, Psrc, m_resample_dst_x, m_packed_x);
+                return;
+            }
+            else if (crnlib_cpu_has_sse2())
+            {
+                resample_x_sse2(Pdst, Psrc, m_resample_dst_x, m_packed_x);
+                return;
+            }
+#endif
+            resample_x_by_sample(Pdst, Psrc, m_packed_x);
+            return;
+        }
+
         int i, j;
         Sample total;
         Contrib_List* Pclist = m_Pclist_x;
@@ -446,17 +762,12 @@ namespace crnlib
 
     void Resampler::scale_y_mov(Sample* Ptmp, const Sample* Psrc, Resample_Real weight, int dst_x)
     {
-        int i;
-
 #if CRNLIB_RESAMPLER_DEBUG_OPS
         total_ops += dst_x;
 #endif
 
         // Not += because temp buf wasn't cleared.
-        for (i = dst_x; i > 0; i--)
-        {
-            *Ptmp++ = *Psrc++ * weight;
-        }
+        scale_span(Ptmp, Psrc, weight, dst_x, false);
     }
 
     void Resampler::scale_y_add(Sample* Ptmp, const Sample* Psrc, Resample_Real weight, int dst_x)
@@ -465,20 +776,12 @@ namespace crnlib
         total_ops += dst_x;
 #endif
 
-        for (int i = dst_x; i > 0; i--)
-        {
-            (*Ptmp++) += *Psrc++ * weight;
-        }
+        scale_span(Ptmp, Psrc, weight, dst_x, true);
     }
 
     void Resampler::clamp(Sample* Pdst, int n)
     {
-        while (n > 0)
-        {
-            Sample x = *Pdst;
-            *Pdst++ = clamp_sample(x);
-            n--;
-        }
+        clamp_span(Pdst, n, m_lo, m_hi);
     }
 
     void Resampler::resample_y(Sample* Pdst)
@@ -498,15 +801,9 @@ namespace crnlib
          * buffer -- the contributor must always be found!
          */
 
-            for (j = 0; j < MAX_SCAN_BUF_SIZE; j++)
-            {
-                if (m_Pscan_buf->scan_buf_y[j] == Pclist->p[i].pixel)
-                {
-                    break;
-                }
-            }
+            j = m_Pscan_buf->src_y_slot[resampler_range_check(Pclist->p[i].pixel, m_resample_src_y)];
 
-            resampler_assert(j < MAX_SCAN_BUF_SIZE);
+            resampler_assert(m_Pscan_buf->scan_buf_y[j] == Pclist->p[i].pixel);
 
             Psrc = m_Pscan_buf->scan_buf_l[j];
 
@@ -591,6 +888,7 @@ namespace crnlib
 
         m_Psrc_y_flag[resampler_range_check(m_cur_src_y, m_resample_src_y)] = TRUE;
         m_Pscan_buf->scan_buf_y[i] = m_cur_src_y;
+        m_Pscan_buf->src_y_slot[m_cur_src_y] = i;
 
         /* Does this slot have any memory allocated to it? */
 
@@ -639,10 +937,11 @@ namespace crnlib
 
         /* Check to see if all the required
       * contributors are present, if not,
-      * return nullptr.
+      * return nullptr. The last contributors
+      * are the most likely to be missing.
       */
 
-        for (i = 0; i < m_Pclist_y[m_cur_dst_y].n; i++)
+        for (i = m_Pclist_y[m_cur_dst_y].n - 1; i >= 0; i--)
         {
             if (!m_Psrc_y_flag[resampler_range_check(m_Pclist_y[m_cur_dst_y].p[i].pixel, m_resample_src_y)])
             {
@@ -692,6 +991,8 @@ namespace crnlib
             m_Pclist_y = nullptr;
         }
 
+        free_packed_clist(&m_packed_x);
+
         crnlib_free(m_Psrc_y_count);
         m_Psrc_y_count = nullptr;
 
@@ -783,6 +1084,12 @@ namespace crnlib
         m_Pscan_buf = nullptr;
         m_status = STATUS_OKAY;
 
+        m_packed_x.num_groups = 0;
+        m_packed_x.by_sample = false;
+        m_packed_x.Pcounts = nullptr;
+        m_packed_x.Ppixels = nullptr;
+        m_packed_x.Pweights = nullptr;
+
         m_resample_src_x = src_x;
         m_resample_src_y = src_y;
         m_resample_dst_x = dst_x;
@@ -837,6 +1144,13 @@ namespace crnlib
             m_clist_x_forced = true;
         }
 
+        // Without SIMD only the by_sample layout is used, so that every build adds the contributions in the same order.
+        if (((crnlib_cpu_has_sse2()) || (use_packed_by_sample(m_resample_dst_x))) && (!pack_clist(m_Pclist_x, m_resample_dst_x, &m_packed_x)))
+        {
+            m_status = STATUS_OUT_OF_MEMORY;
+            return;
+        }
+
         if (!Pclist_y)
         {
             m_Pclist_y = make_clist(m_resample_src_y, m_resample_dst_y, m_boundary_op, func, support, filter_y_scale, src_y_ofs);
@@ -31,6 +31,36 @@ namespace crnlib
             Contrib* p;
         };
 
+        // Contributor lists repacked for the SIMD kernels, stored lane by lane and padded with zero weights.
+        // Normally each group holds PACKED_LANES destination samples, and each lane walks one sample's list in order,
+        // which gives the same sums as the scalar code. Narrower outputs (by_sample) leave most lanes idle that way, so
+        // each group holds a single sample whose contributors are dealt round robin to the lanes, and the partial sums
+        // are combined with sum_packed_lanes().
+        enum
+        {
+            PACKED_LANES = 8
+        };
+
+        struct Packed_Contribs
+        {
+            int num_groups;
+            bool by_sample;
+            int* Pcounts;
+            int* Ppixels;
+            Resample_Real* Pweights;
+        };
+
+        static bool use_packed_by_sample(int dst_x)
+        {
+            return dst_x < PACKED_LANES;
+        }
+
+        template <typename T>
+        static inline T sum_packed_lanes(const T* Pt)
+        {
+            return ((Pt[0] + Pt[4]) + (Pt[2] + Pt[6])) + ((Pt[1] + Pt[5]) + (Pt[3] + Pt[7]));
+        }
+
         enum Boundary_Op
         {
             BOUNDARY_WRAP = 0,
@@ -103,6 +133,14 @@ namespace crnlib
             Resample_Real filter_scale,
             Resample_Real src_ofs);
 
+        // false on out of memory.
+        static bool pack_clist(const Contrib_List* Pclist, int dst_x, Packed_Contribs* Ppacked);
+        static void free_packed_clist(Packed_Contribs* Ppacked);
+
+        // Pdst[i] = Psrc[i] * weight, or Pdst[i] += Psrc[i] * weight if add is true.
+        static void scale_span(Sample* Pdst, const Sample* Psrc, Resample_Real weight, int n, bool add);
+        static void clamp_span(Sample* Pdst, int n, Resample_Real lo, Resample_Real hi);
+
     private:
         Resampler();
         Resampler(const Resampler& o);
@@ -132,6 +170,8 @@ namespace crnlib
 
         bool m_delay_x_resample;
 
+        Packed_Contribs m_packed_x;
+
         int* m_Psrc_y_count;
         unsigned char* m_Psrc_y_flag;
 
@@ -145,6 +185,8 @@ namespace crnlib
         {
             int scan_buf_y[MAX_SCAN_BUF_SIZE];
             Sample* scan_buf_l[MAX_SCAN_BUF_SIZE];
+            // Slot holding each buffered source line, so resample_y() doesn't have to search for it.
+            int src_y_slot[CRNLIB_RESAMPLER_MAX_DIMENSION];
         };
 
         Scan_Buf* m_Pscan_buf;
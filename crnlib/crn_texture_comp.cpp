@@ -534,7 +534,8 @@ namespace crnlib
             res_params.m_filter_scale = 1.0f;
             res_params.m_gamma = mipmap_params.m_gamma;
             res_params.m_srgb = srgb;
-            res_params.m_multithreaded = (params.m_num_helper_threads > 0);
+            res_params.m_multithreaded = (params.m_num_helper_threads > 0) || (params.m_pTask_pool != nullptr);
+            res_params.m_pTask_pool = static_cast<task_pool*>(params.m_pTask_pool);
 
             if (!work_tex.resize(new_width, new_height, res_params))
             {
@@ -556,9 +557,11 @@ namespace crnlib
             gen_params.m_filter_scale = mipmap_params.m_blurriness;
             gen_params.m_gamma = mipmap_params.m_gamma;
             gen_params.m_srgb = srgb;
-            gen_params.m_multithreaded = params.m_num_helper_threads > 0;
+            gen_params.m_multithreaded = (params.m_num_helper_threads > 0) || (params.m_pTask_pool != nullptr);
+            gen_params.m_pTask_pool = static_cast<task_pool*>(params.m_pTask_pool);
             gen_params.m_max_mips = mipmap_params.m_max_levels;
             gen_params.m_min_mip_size = mipmap_params.m_min_mip_size;
+            gen_params.m_pyramid = mipmap_params.m_pyramid != 0;
 
             console::info("Generating mipmaps using filter \"%s\"", pFilter);
 
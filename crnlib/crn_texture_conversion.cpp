@@ -27,6 +27,7 @@
 #include "crn_file_utils.h"
 #include "crn_cfile_stream.h"
 #include "crn_image_utils.h"
+#include "crn_image_metrics.h"
 #include "crn_texture_comp.h"
 #include "crn_strutils.h"
 
@@ -180,12 +181,7 @@ namespace crnlib
                                 }
 
                                 console::info("Face %u Mipmap level %u statistics:", face, level);
-                                image_utils::print_image_metrics(*pA, *pB);
-
-                                if ((pA->has_rgb()) || (pB->has_rgb()))
-                                {
-                                    image_utils::print_ssim(*pA, *pB);
-                                }
+                                image_utils::print_image_metrics(*pA, *pB, true);
                             }
                         }
                     }
@@ -210,10 +206,14 @@ namespace crnlib
                                 pB = &grayscale_b;
                             }
 
+                            image_metrics metrics;
                             image_utils::error_metrics rgb_error;
                             image_utils::error_metrics luma_error;
-                            if (rgb_error.compute(*pA, *pB, 0, 3, false) && luma_error.compute(*pA, *pB, 0, 0, true))
+                            if (metrics.compute(*pA, *pB, image_metrics::cAllChannels, false))
                             {
+                                metrics.get_error_metrics(rgb_error, 0, 3, false);
+                                metrics.get_error_metrics(luma_error, 0, 0, true);
+
                                 bool bCSVStatsFileExists = file_utils::does_file_exist(pCSVStatsFile);
                                 FILE* pFile;
                                 crn_fopen(&pFile, pCSVStatsFile, "a");
@@ -455,6 +455,8 @@ namespace crnlib
             console::debug("               Compressor: %s", get_dxt_compressor_name(comp_params.m_dxt_compressor_type));
             console::debug(" Disable endpoint caching: %u", comp_params.get_flag(cCRNCompFlagDisableEndpointCaching));
             console::debug("       Grayscale sampling: %u", comp_params.get_flag(cCRNCompFlagGrayscaleSampling));
+            console::debug("            Sliced levels: %u", comp_params.get_flag(cCRNCompFlagSlicedLevels));
+            console::debug("    Smallest levels first: %u", comp_params.get_flag(cCRNCompFlagSmallestLevelsFirst));
             console::debug("       Max helper threads: %u", comp_params.m_num_helper_threads);
             console::debug("");
         }
@@ -471,6 +473,7 @@ namespace crnlib
             console::debug("          Tiled: %u", mipmap_params.m_tiled);
             console::debug("     Max Levels: %u", mipmap_params.m_max_levels);
             console::debug(" Min level size: %u", mipmap_params.m_min_mip_size);
+            console::debug("        Pyramid: %u", mipmap_params.m_pyramid);
             console::debug("       window: %u %u %u %u", mipmap_params.m_window_left, mipmap_params.m_window_top, mipmap_params.m_window_right, mipmap_params.m_window_bottom);
             console::debug("   scale mode: %s", crn_get_scale_mode_desc(mipmap_params.m_scale_mode));
             console::debug("        scale: %f %f", mipmap_params.m_scale_x, mipmap_params.m_scale_y);
@@ -553,7 +556,9 @@ namespace crnlib
                 }
 
                 pack_params.m_num_helper_threads = comp_params.m_num_helper_threads;
+                pack_params.m_pTask_pool = static_cast<task_pool*>(comp_params.m_pTask_pool);
                 pack_params.m_use_transparent_indices_for_black = comp_params.get_flag(cCRNCompFlagUseTransparentIndicesForBlack);
+                pack_params.m_debugging = comp_params.get_flag(cCRNCompFlagDebugging);
 
                 console::info("Converting texture format from %s to %s", pixel_format_helpers::get_pixel_format_string(work_tex.get_format()), pixel_format_helpers::get_pixel_format_string(dst_format));
 
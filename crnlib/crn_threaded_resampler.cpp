@@ -26,6 +26,10 @@
 #include "crn_resample_filters.h"
 #include "crn_threading.h"
 
+#if CRNLIB_X86_SIMD
+#include <immintrin.h>
+#endif
+
 namespace crnlib
 {
     threaded_resampler::threaded_resampler(task_pool& tp) :
@@ -35,6 +39,7 @@ namespace crnlib
         m_pY_contribs(nullptr),
         m_bytes_per_pixel(0)
     {
+        utils::zero_object(m_packed_x);
     }
 
     threaded_resampler::~threaded_resampler()
@@ -61,116 +66,234 @@ namespace crnlib
             crnlib_free(m_pY_contribs);
             m_pY_contribs = nullptr;
         }
+
+        Resampler::free_packed_clist(&m_packed_x);
     }
 
-    void threaded_resampler::resample_x_task(uint64 data, void*)
+    // The kernels below add up the contributions in the same order as Resampler::resample_x(), so the threaded and
+    // single threaded resamplers give identical results.
+    static void resample_x_y_f32(vec4F* pDst, const float* pSrc, uint dst_width, const Resampler::Packed_Contribs& packed)
     {
-        const uint thread_index = (uint)data;
+        const int* pPixels = packed.Ppixels;
+        const float* pWeights = packed.Pweights;
 
-        for (uint src_y = 0; src_y < m_pParams->m_src_height; src_y++)
+        for (int g = 0; g < packed.num_groups; g++)
         {
-            if (m_pTask_pool->get_num_threads())
+            const uint num_lanes = packed.by_sample ? 1 : math::minimum<uint>(Resampler::PACKED_LANES, dst_width - g * Resampler::PACKED_LANES);
+            const int n = packed.Pcounts[g];
+
+            if (packed.by_sample)
             {
-                if ((src_y % (m_pTask_pool->get_num_threads() + 1)) != thread_index)
+                float totals[Resampler::PACKED_LANES] = {};
+                for (int j = 0; j < n; j++)
                 {
-                    continue;
+                    for (uint l = 0; l < Resampler::PACKED_LANES; l++)
+                    {
+                        totals[l] += pSrc[pPixels[j * Resampler::PACKED_LANES + l]] * pWeights[j * Resampler::PACKED_LANES + l];
+                    }
+                }
+                *pDst++ = vec4F(Resampler::sum_packed_lanes(totals), 0.0f, 0.0f, 0.0f);
+            }
+            else
+            {
+                for (uint l = 0; l < num_lanes; l++)
+                {
+                    float s = 0.0f;
+                    for (int j = 0; j < n; j++)
+                    {
+                        s += pSrc[pPixels[j * Resampler::PACKED_LANES + l]] * pWeights[j * Resampler::PACKED_LANES + l];
+                    }
+                    *pDst++ = vec4F(s, 0.0f, 0.0f, 0.0f);
                 }
             }
 
-            const Resampler::Contrib_List* pContribs = m_pX_contribs;
-            const Resampler::Contrib_List* pContribs_end = m_pX_contribs + m_pParams->m_dst_width;
+            pPixels += n * Resampler::PACKED_LANES;
+            pWeights += n * Resampler::PACKED_LANES;
+        }
+    }
 
-            switch (m_pParams->m_fmt)
+    static void resample_x_rgba(vec4F* pDst, const vec4F* pSrc, uint dst_width, const Resampler::Packed_Contribs& packed)
+    {
+        const int* pPixels = packed.Ppixels;
+        const float* pWeights = packed.Pweights;
+
+        for (int g = 0; g < packed.num_groups; g++)
+        {
+            const uint num_lanes = packed.by_sample ? 1 : math::minimum<uint>(Resampler::PACKED_LANES, dst_width - g * Resampler::PACKED_LANES);
+            const int n = packed.Pcounts[g];
+
+            if (packed.by_sample)
             {
-            case cPF_Y_F32:
+                vec4F totals[Resampler::PACKED_LANES];
+                for (uint l = 0; l < Resampler::PACKED_LANES; l++)
+                {
+                    totals[l].clear();
+                }
+                for (int j = 0; j < n; j++)
+                {
+                    for (uint l = 0; l < Resampler::PACKED_LANES; l++)
+                    {
+                        totals[l] += pSrc[pPixels[j * Resampler::PACKED_LANES + l]] * pWeights[j * Resampler::PACKED_LANES + l];
+                    }
+                }
+                *pDst++ = Resampler::sum_packed_lanes(totals);
+            }
+            else
             {
-                const float* pSrc = reinterpret_cast<const float*>(static_cast<const uint8*>(m_pParams->m_pSrc_pixels) + m_pParams->m_src_pitch * src_y);
-                vec4F* pDst = m_tmp_img.get_ptr() + m_pParams->m_dst_width * src_y;
-
-                do
+                for (uint l = 0; l < num_lanes; l++)
                 {
-                    const Resampler::Contrib* p = pContribs->p;
-                    const Resampler::Contrib* p_end = pContribs->p + pContribs->n;
-
                     vec4F s(0.0f);
-
-                    while (p != p_end)
+                    for (int j = 0; j < n; j++)
                     {
-                        const uint src_pixel = p->pixel;
-                        const float src_weight = p->weight;
+                        s += pSrc[pPixels[j * Resampler::PACKED_LANES + l]] * pWeights[j * Resampler::PACKED_LANES + l];
+                    }
+                    *pDst++ = s;
+                }
+            }
 
-                        s[0] += pSrc[src_pixel] * src_weight;
+            pPixels += n * Resampler::PACKED_LANES;
+            pWeights += n * Resampler::PACKED_LANES;
+        }
+    }
 
-                        p++;
-                    }
+#if CRNLIB_X86_SIMD
+    CRNLIB_TARGET_SSE2 static void resample_x_rgba_sse2(vec4F* pDst, const vec4F* pSrc, uint dst_width, const Resampler::Packed_Contribs& packed)
+    {
+        const float* pSrc_floats = reinterpret_cast<const float*>(pSrc);
+        float* pDst_floats = reinterpret_cast<float*>(pDst);
+        const int* pPixels = packed.Ppixels;
+        const float* pWeights = packed.Pweights;
 
-                    *pDst++ = s;
-                    pContribs++;
-                } while (pContribs != pContribs_end);
+        for (int g = 0; g < packed.num_groups; g++)
+        {
+            const uint num_lanes = packed.by_sample ? 1 : math::minimum<uint>(Resampler::PACKED_LANES, dst_width - g * Resampler::PACKED_LANES);
+            const int n = packed.Pcounts[g];
 
-                break;
+            if (packed.by_sample)
+            {
+                __m128 totals[Resampler::PACKED_LANES];
+                for (uint l = 0; l < Resampler::PACKED_LANES; l++)
+                {
+                    totals[l] = _mm_setzero_ps();
+                }
+                for (int j = 0; j < n; j++)
+                {
+                    for (uint l = 0; l < Resampler::PACKED_LANES; l++)
+                    {
+                        const __m128 src = _mm_loadu_ps(pSrc_floats + 4 * pPixels[j * Resampler::PACKED_LANES + l]);
+                        totals[l] = _mm_add_ps(totals[l], _mm_mul_ps(src, _mm_set1_ps(pWeights[j * Resampler::PACKED_LANES + l])));
+                    }
+                }
+                const __m128 s = _mm_add_ps(_mm_add_ps(totals[0], totals[4]), _mm_add_ps(totals[2], totals[6]));
+                const __m128 t = _mm_add_ps(_mm_add_ps(totals[1], totals[5]), _mm_add_ps(totals[3], totals[7]));
+                _mm_storeu_ps(pDst_floats, _mm_add_ps(s, t));
+                pDst_floats += 4;
             }
-            case cPF_RGBX_F32:
+            else
             {
-                const vec4F* pSrc = reinterpret_cast<const vec4F*>(static_cast<const uint8*>(m_pParams->m_pSrc_pixels) + m_pParams->m_src_pitch * src_y);
-                vec4F* pDst = m_tmp_img.get_ptr() + m_pParams->m_dst_width * src_y;
-
-                do
+                for (uint l = 0; l < num_lanes; l++)
                 {
-                    const Resampler::Contrib* p = pContribs->p;
-                    const Resampler::Contrib* p_end = pContribs->p + pContribs->n;
-
-                    vec4F s(0.0f);
-
-                    while (p != p_end)
+                    __m128 s = _mm_setzero_ps();
+                    for (int j = 0; j < n; j++)
                     {
-                        const float src_weight = p->weight;
+                        const __m128 src = _mm_loadu_ps(pSrc_floats + 4 * pPixels[j * Resampler::PACKED_LANES + l]);
+                        s = _mm_add_ps(s, _mm_mul_ps(src, _mm_set1_ps(pWeights[j * Resampler::PACKED_LANES + l])));
+                    }
+                    _mm_storeu_ps(pDst_floats, s);
+                    pDst_floats += 4;
+                }
+            }
 
-                        const vec4F& src_pixel = pSrc[p->pixel];
+            pPixels += n * Resampler::PACKED_LANES;
+            pWeights += n * Resampler::PACKED_LANES;
+        }
+    }
 
-                        s[0] += src_pixel[0] * src_weight;
-                        s[1] += src_pixel[1] * src_weight;
-                        s[2] += src_pixel[2] * src_weight;
+    // Two destination pixels per register, one in each 128-bit half.
+    CRNLIB_TARGET_AVX2 static void resample_x_rgba_avx2(vec4F* pDst, const vec4F* pSrc, uint dst_width, const Resampler::Packed_Contribs& packed)
+    {
+        if (packed.by_sample)
+        {
+            resample_x_rgba_sse2(pDst, pSrc, dst_width, packed);
+            return;
+        }
 
-                        p++;
-                    }
+        const float* pSrc_floats = reinterpret_cast<const float*>(pSrc);
+        float* pDst_floats = reinterpret_cast<float*>(pDst);
+        const int* pPixels = packed.Ppixels;
+        const float* pWeights = packed.Pweights;
 
-                    *pDst++ = s;
-                    pContribs++;
-                } while (pContribs != pContribs_end);
+        for (int g = 0; g < packed.num_groups; g++)
+        {
+            const uint num_lanes = math::minimum<uint>(Resampler::PACKED_LANES, dst_width - g * Resampler::PACKED_LANES);
+            const int n = packed.Pcounts[g];
 
-                break;
-            }
-            case cPF_RGBA_F32:
+            for (uint l = 0; l < num_lanes; l += 2)
             {
-                const vec4F* pSrc = reinterpret_cast<const vec4F*>(static_cast<const uint8*>(m_pParams->m_pSrc_pixels) + m_pParams->m_src_pitch * src_y);
-                vec4F* pDst = m_tmp_img.get_ptr() + m_pParams->m_dst_width * src_y;
-
-                do
+                __m256 s = _mm256_setzero_ps();
+                for (int j = 0; j < n; j++)
                 {
-                    Resampler::Contrib* p = pContribs->p;
-                    Resampler::Contrib* p_end = pContribs->p + pContribs->n;
-
-                    vec4F s(0.0f);
+                    const int* pP = pPixels + j * Resampler::PACKED_LANES + l;
+                    const float* pW = pWeights + j * Resampler::PACKED_LANES + l;
+                    const __m256 src = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pSrc_floats + 4 * pP[0])), _mm_loadu_ps(pSrc_floats + 4 * pP[1]), 1);
+                    const __m256 w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(pW[0])), _mm_set1_ps(pW[1]), 1);
+                    s = _mm256_add_ps(s, _mm256_mul_ps(src, w));
+                }
 
-                    while (p != p_end)
-                    {
-                        const float src_weight = p->weight;
+                _mm_storeu_ps(pDst_floats, _mm256_castps256_ps128(s));
+                if (l + 1 < num_lanes)
+                {
+                    _mm_storeu_ps(pDst_floats + 4, _mm256_extractf128_ps(s, 1));
+                }
+                pDst_floats += 4 * math::minimum<uint>(2, num_lanes - l);
+            }
 
-                        const vec4F& src_pixel = pSrc[p->pixel];
+            pPixels += n * Resampler::PACKED_LANES;
+            pWeights += n * Resampler::PACKED_LANES;
+        }
+    }
+#endif
 
-                        s[0] += src_pixel[0] * src_weight;
-                        s[1] += src_pixel[1] * src_weight;
-                        s[2] += src_pixel[2] * src_weight;
-                        s[3] += src_pixel[3] * src_weight;
+    void threaded_resampler::resample_x_task(uint64 data, void*)
+    {
+        const uint thread_index = (uint)data;
 
-                        p++;
-                    }
+        for (uint src_y = 0; src_y < m_pParams->m_src_height; src_y++)
+        {
+            if (m_pTask_pool->get_num_threads())
+            {
+                if ((src_y % (m_pTask_pool->get_num_threads() + 1)) != thread_index)
+                {
+                    continue;
+                }
+            }
 
-                    *pDst++ = s;
-                    pContribs++;
-                } while (pContribs != pContribs_end);
+            const void* pSrc = static_cast<const uint8*>(m_pParams->m_pSrc_pixels) + m_pParams->m_src_pitch * src_y;
+            vec4F* pDst = m_tmp_img.get_ptr() + m_pParams->m_dst_width * src_y;
 
+            switch (m_pParams->m_fmt)
+            {
+            case cPF_Y_F32:
+            {
+                resample_x_y_f32(pDst, static_cast<const float*>(pSrc), m_pParams->m_dst_width, m_packed_x);
+                break;
+            }
+            case cPF_RGBX_F32:
+            case cPF_RGBA_F32:
+            {
+#if CRNLIB_X86_SIMD
+                if (crnlib_cpu_has_avx2())
+                {
+                    resample_x_rgba_avx2(pDst, static_cast<const vec4F*>(pSrc), m_pParams->m_dst_width, m_packed_x);
+                    break;
+                }
+                else if (crnlib_cpu_has_sse2())
+                {
+                    resample_x_rgba_sse2(pDst, static_cast<const vec4F*>(pSrc), m_pParams->m_dst_width, m_packed_x);
+                    break;
+                }
+#endif
+                resample_x_rgba(pDst, static_cast<const vec4F*>(pSrc), m_pParams->m_dst_width, m_packed_x);
                 break;
             }
             default:
@@ -210,27 +333,12 @@ namespace crnlib
                     const vec4F* p = m_tmp_img.get_ptr() + m_pParams->m_dst_width * contribs.p[src_y_iter].pixel;
                     const float weight = contribs.p[src_y_iter].weight;
 
-                    if (!src_y_iter)
-                    {
-                        for (uint i = 0; i < m_pParams->m_dst_width; i++)
-                        {
-                            tmp[i] = p[i] * weight;
-                        }
-                    }
-                    else
-                    {
-                        for (uint i = 0; i < m_pParams->m_dst_width; i++)
-                        {
-                            tmp[i] += p[i] * weight;
-                        }
-                    }
+                    Resampler::scale_span(reinterpret_cast<float*>(tmp.get_ptr()), reinterpret_cast<const float*>(p), weight, m_pParams->m_dst_width * 4, src_y_iter != 0);
                 }
 
                 pSrc = tmp.get_ptr();
             }
 
-            const vec4F* pSrc_end = pSrc + m_pParams->m_dst_width;
-
             const float l = m_pParams->m_sample_low;
             const float h = m_pParams->m_sample_high;
 
@@ -240,46 +348,28 @@ namespace crnlib
             {
                 float* pDst = reinterpret_cast<float*>(static_cast<uint8*>(m_pParams->m_pDst_pixels) + m_pParams->m_dst_pitch * dst_y);
 
-                do
+                for (uint x = 0; x < m_pParams->m_dst_width; x++)
                 {
-                    *pDst++ = math::clamp((*pSrc)[0], l, h);
-
-                    pSrc++;
-                } while (pSrc != pSrc_end);
+                    pDst[x] = math::clamp(pSrc[x][0], l, h);
+                }
 
                 break;
             }
             case cPF_RGBX_F32:
-            {
-                vec4F* pDst = reinterpret_cast<vec4F*>(static_cast<uint8*>(m_pParams->m_pDst_pixels) + m_pParams->m_dst_pitch * dst_y);
-
-                do
-                {
-                    (*pDst)[0] = math::clamp((*pSrc)[0], l, h);
-                    (*pDst)[1] = math::clamp((*pSrc)[1], l, h);
-                    (*pDst)[2] = math::clamp((*pSrc)[2], l, h);
-                    (*pDst)[3] = h;
-
-                    pSrc++;
-                    pDst++;
-                } while (pSrc != pSrc_end);
-
-                break;
-            }
             case cPF_RGBA_F32:
             {
                 vec4F* pDst = reinterpret_cast<vec4F*>(static_cast<uint8*>(m_pParams->m_pDst_pixels) + m_pParams->m_dst_pitch * dst_y);
 
-                do
-                {
-                    (*pDst)[0] = math::clamp((*pSrc)[0], l, h);
-                    (*pDst)[1] = math::clamp((*pSrc)[1], l, h);
-                    (*pDst)[2] = math::clamp((*pSrc)[2], l, h);
-                    (*pDst)[3] = math::clamp((*pSrc)[3], l, h);
+                memcpy(pDst, pSrc, m_pParams->m_dst_width * sizeof(vec4F));
+                Resampler::clamp_span(reinterpret_cast<float*>(pDst), m_pParams->m_dst_width * 4, l, h);
 
-                    pSrc++;
-                    pDst++;
-                } while (pSrc != pSrc_end);
+                if (m_pParams->m_fmt == cPF_RGBX_F32)
+                {
+                    for (uint x = 0; x < m_pParams->m_dst_width; x++)
+                    {
+                        pDst[x][3] = h;
+                    }
+                }
 
                 break;
             }
@@ -335,6 +425,11 @@ namespace crnlib
             return false;
         }
 
+        if (!Resampler::pack_clist(m_pX_contribs, m_pParams->m_dst_width, &m_packed_x))
+        {
+            return false;
+        }
+
         if (!m_tmp_img.try_resize(m_pParams->m_dst_width * m_pParams->m_src_height))
         {
             return false;
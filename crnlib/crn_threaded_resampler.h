@@ -97,6 +97,7 @@ namespace crnlib
 
         Resampler::Contrib_List* m_pX_contribs;
         Resampler::Contrib_List* m_pY_contribs;
+        Resampler::Packed_Contribs m_packed_x;
         uint m_bytes_per_pixel;
 
         crnlib::vector<vec4F> m_tmp_img;
@@ -21,6 +21,8 @@
  * 3. This notice may not be removed or altered from any source distribution.
  */
 
+#pragma once
+
 #if CRNLIB_USE_WIN32_API
 #include "crn_threading_win32.h"
 #elif CRNLIB_USE_PTHREADS_API
@@ -28,3 +30,71 @@
 #else
 #include "crn_threading_null.h"
 #endif
+
+namespace crnlib
+{
+    // The process-wide pool started by the public crn_shared_pool_init(num_helper_threads), or nullptr.
+    CRN_EXPORT task_pool* crn_get_shared_task_pool();
+
+    // The pool a multithreaded operation queues its tasks on: the caller's pool if one is given, else the shared pool, else a private pool
+    // with the requested number of helper threads. The shared pool is only used when helper threads are requested. The private pool is
+    // kept across init() calls asking for the same number of threads.
+    class scoped_task_pool
+    {
+        CRNLIB_NO_COPY_OR_ASSIGNMENT_OP(scoped_task_pool);
+
+    public:
+        inline scoped_task_pool():
+            m_pPool(nullptr)
+        {
+        }
+
+        inline bool init(task_pool* pPool, uint num_helper_threads)
+        {
+            if ((!pPool) && (num_helper_threads))
+            {
+                pPool = crn_get_shared_task_pool();
+            }
+
+            if (pPool)
+            {
+                m_local_pool.deinit();
+                m_pPool = pPool;
+                return true;
+            }
+
+            if ((m_pPool != &m_local_pool) || (m_local_pool.get_num_threads() != num_helper_threads))
+            {
+                m_pPool = nullptr;
+                if (!m_local_pool.init(num_helper_threads))
+                {
+                    return false;
+                }
+            }
+
+            m_pPool = &m_local_pool;
+            return true;
+        }
+
+        inline void deinit()
+        {
+            m_local_pool.deinit();
+            m_pPool = nullptr;
+        }
+
+        inline task_pool* get() const
+        {
+            return m_pPool;
+        }
+
+        inline task_pool* operator->() const
+        {
+            CRNLIB_ASSERT(m_pPool);
+            return m_pPool;
+        }
+
+    private:
+        task_pool m_local_pool;
+        task_pool* m_pPool;
+    };
+} // namespace crnlib
@@ -23,6 +23,7 @@
 
 #include "crn_core.h"
 #include "crn_threading_pthreads.h"
+#include "crn_console.h"
 #include "crn_timer.h"
 
 #if CRNLIB_USE_PTHREADS_API
@@ -32,9 +33,6 @@
 #include <process.h>
 #else
 #include <unistd.h>
-#if defined(CRN_OS_DARWIN)
-#include "crn_darwin_pthreads.h"
-#endif
 #endif
 
 namespace crnlib
@@ -52,6 +50,12 @@ namespace crnlib
 #endif
     }
 
+    uint crn_get_max_helper_threads()
+    {
+        // use all CPU's
+        return g_number_of_processors - 1;
+    }
+
     crn_thread_id_t crn_get_current_thread_id()
     {
 #if defined(CRN_OS_BSD4) || defined(CRN_OS_DARWIN)
@@ -133,103 +137,137 @@ namespace crnlib
         count;
     }
 
-    semaphore::semaphore(long initialCount, long maximumCount, const char* pName)
+    semaphore::semaphore(long initialCount, long maximumCount, const char* pName):
+        m_count(initialCount),
+        m_max_count(maximumCount),
+        m_num_waiters(0)
     {
-        maximumCount, pName;
-        CRNLIB_ASSERT(maximumCount >= initialCount);
+        (void)pName;
+        CRNLIB_ASSERT((initialCount >= 0) && (maximumCount >= 1) && (maximumCount >= initialCount));
 
-        auto sem = sem_open("semaphore", O_CREAT, 0777, initialCount);
-        if (!sem)
+        if (pthread_mutex_init(&m_mutex, nullptr))
+        {
+            CRNLIB_FAIL("semaphore: pthread_mutex_init() failed");
+        }
+
+        // Timed waits are measured on the monotonic clock where it's available, so they aren't affected by changes to the system time.
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+#if defined(CRN_OS_LINUX)
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+        int status = pthread_cond_init(&m_cond, &attr);
+        pthread_condattr_destroy(&attr);
+        if (status)
         {
-            CRNLIB_FAIL("semaphore: sem_init() failed");
+            CRNLIB_FAIL("semaphore: pthread_cond_init() failed");
         }
-        m_sem = sem;
     }
 
     semaphore::~semaphore()
     {
-        sem_close(m_sem);
+        pthread_cond_destroy(&m_cond);
+        pthread_mutex_destroy(&m_mutex);
     }
 
-    void semaphore::release(long releaseCount)
+    bool semaphore::release(long releaseCount, long* pPreviousCount)
     {
         CRNLIB_ASSERT(releaseCount >= 1);
 
-        int status = 0;
-#ifdef WIN32
-        if (1 == releaseCount)
-        {
-            status = sem_post(m_sem);
-        }
-        else
-        {
-            status = sem_post_multiple(m_sem, releaseCount);
-        }
-#else
-        while (releaseCount > 0)
-        {
-            status = sem_post(m_sem);
-            if (status)
-            {
-                break;
-            }
-            releaseCount--;
-        }
-#endif
+        pthread_mutex_lock(&m_mutex);
 
-        if (status)
+        if (pPreviousCount)
         {
-            CRNLIB_FAIL("semaphore: sem_post() or sem_post_multiple() failed");
+            *pPreviousCount = m_count;
         }
+
+        const long count = math::minimum(math::maximum(releaseCount, 0L), m_max_count - m_count);
+        add_count(count);
+
+        pthread_mutex_unlock(&m_mutex);
+        return count == releaseCount;
     }
 
-    void semaphore::try_release(long releaseCount)
+    bool semaphore::try_release(long releaseCount, long* pPreviousCount)
     {
         CRNLIB_ASSERT(releaseCount >= 1);
 
-#ifdef WIN32
-        if (1 == releaseCount)
+        pthread_mutex_lock(&m_mutex);
+
+        if (pPreviousCount)
         {
-            sem_post(m_sem);
+            *pPreviousCount = m_count;
         }
-        else
+
+        const bool released = (releaseCount >= 1) && (releaseCount <= m_max_count - m_count);
+        if (released)
         {
-            sem_post_multiple(m_sem, releaseCount);
+            add_count(releaseCount);
         }
-#else
-        while (releaseCount > 0)
+
+        pthread_mutex_unlock(&m_mutex);
+        return released;
+    }
+
+    // Called with m_mutex locked.
+    void semaphore::add_count(long count)
+    {
+        m_count += count;
+
+        // Wake no more waiters than there are counts to take.
+        for (long i = math::minimum(count, m_num_waiters); i > 0; i--)
         {
-            sem_post(m_sem);
-            releaseCount--;
+            pthread_cond_signal(&m_cond);
         }
-#endif
     }
 
     bool semaphore::wait(uint32 milliseconds)
     {
-        int status;
-        if (milliseconds == cUINT32_MAX)
-        {
-            status = sem_wait(m_sem);
-        }
-        else
-        {
-            struct timespec interval;
-            interval.tv_sec = milliseconds / 1000;
-            interval.tv_nsec = (milliseconds % 1000) * 1000000L;
-            status = sem_timedwait(m_sem, &interval);
-        }
+        pthread_mutex_lock(&m_mutex);
 
-        if (status)
+        if ((!m_count) && (milliseconds))
         {
-            if (errno != ETIMEDOUT)
+            struct timespec deadline;
+            if (milliseconds != cUINT32_MAX)
+            {
+#if defined(CRN_OS_LINUX)
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+#else
+                clock_gettime(CLOCK_REALTIME, &deadline);
+#endif
+                deadline.tv_sec += milliseconds / 1000;
+                deadline.tv_nsec += (milliseconds % 1000) * 1000000L;
+                if (deadline.tv_nsec >= 1000000000L)
+                {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000L;
+                }
+            }
+
+            m_num_waiters++;
+            while (!m_count)
             {
-                CRNLIB_FAIL("semaphore: sem_wait() or sem_timedwait() failed");
+                int status = (milliseconds == cUINT32_MAX) ? pthread_cond_wait(&m_cond, &m_mutex) : pthread_cond_timedwait(&m_cond, &m_mutex, &deadline);
+                if (status == ETIMEDOUT)
+                {
+                    break;
+                }
+                else if (status)
+                {
+                    CRNLIB_FAIL("semaphore: pthread_cond_wait() or pthread_cond_timedwait() failed");
+                }
             }
-            return false;
+            m_num_waiters--;
         }
 
-        return true;
+        const bool acquired = m_count > 0;
+        if (acquired)
+        {
+            m_count--;
+        }
+
+        pthread_mutex_unlock(&m_mutex);
+        return acquired;
     }
 
 #if defined(CRN_OS_LINUX)
@@ -314,26 +352,81 @@ namespace crnlib
     }
 #endif
 
+    void task_pool::task_deque::clear()
+    {
+        scoped_spinlock lock(m_lock);
+        m_tasks.clear();
+        m_front = 0;
+    }
+
+    void task_pool::task_deque::push_back(const task& tsk)
+    {
+        scoped_spinlock lock(m_lock);
+        if (m_front == m_tasks.size())
+        {
+            m_tasks.resize(0);
+            m_front = 0;
+        }
+        m_tasks.push_back(tsk);
+    }
+
+    bool task_pool::task_deque::pop_back(task& tsk)
+    {
+        scoped_spinlock lock(m_lock);
+        if (m_front == m_tasks.size())
+        {
+            return false;
+        }
+        tsk = m_tasks.back();
+        m_tasks.pop_back();
+        return true;
+    }
+
+    bool task_pool::task_deque::pop_front(task& tsk)
+    {
+        scoped_spinlock lock(m_lock);
+        if (m_front == m_tasks.size())
+        {
+            return false;
+        }
+        tsk = m_tasks[m_front++];
+        return true;
+    }
+
+    static thread_local const void* g_pThread_context;
+
     task_pool::task_pool():
         m_num_threads(0),
-        m_tasks_available(0, 32767),
-        m_all_tasks_completed(0, 1),
+        m_num_started_threads(0),
+        m_num_queued_tasks(0),
+        m_num_sleeping_threads(0),
+        m_num_waiting_joiners(0),
         m_total_submitted_tasks(0),
         m_total_completed_tasks(0),
         m_exit_flag(false)
     {
-        utils::zero_object(m_threads);
+        m_deques.resize(1);
+        m_external_group.m_num_pending = 0;
+        pthread_mutex_init(&m_mutex, nullptr);
+        pthread_cond_init(&m_tasks_available, nullptr);
+        pthread_cond_init(&m_group_completed, nullptr);
     }
 
     task_pool::task_pool(uint num_threads):
         m_num_threads(0),
-        m_tasks_available(0, 32767),
-        m_all_tasks_completed(0, 1),
+        m_num_started_threads(0),
+        m_num_queued_tasks(0),
+        m_num_sleeping_threads(0),
+        m_num_waiting_joiners(0),
         m_total_submitted_tasks(0),
         m_total_completed_tasks(0),
         m_exit_flag(false)
     {
-        utils::zero_object(m_threads);
+        m_deques.resize(1);
+        m_external_group.m_num_pending = 0;
+        pthread_mutex_init(&m_mutex, nullptr);
+        pthread_cond_init(&m_tasks_available, nullptr);
+        pthread_cond_init(&m_group_completed, nullptr);
 
         bool status = init(num_threads);
         CRNLIB_VERIFY(status);
@@ -342,17 +435,21 @@ namespace crnlib
     task_pool::~task_pool()
     {
         deinit();
+        pthread_cond_destroy(&m_group_completed);
+        pthread_cond_destroy(&m_tasks_available);
+        pthread_mutex_destroy(&m_mutex);
     }
 
     bool task_pool::init(uint num_threads)
     {
-        CRNLIB_ASSERT(num_threads <= cMaxThreads);
-        num_threads = math::minimum<uint>(num_threads, cMaxThreads);
-
         deinit();
 
         bool succeeded = true;
 
+        // The deques must not move once the threads are running.
+        m_deques.resize(num_threads + 1);
+        m_threads.resize(num_threads);
+
         m_num_threads = 0;
         while (m_num_threads < num_threads)
         {
@@ -377,13 +474,14 @@ namespace crnlib
 
     void task_pool::deinit()
     {
+        join_all();
+
         if (m_num_threads)
         {
-            join();
-
+            pthread_mutex_lock(&m_mutex);
             atomic_exchange32(&m_exit_flag, true);
-
-            m_tasks_available.release(m_num_threads);
+            pthread_cond_broadcast(&m_tasks_available);
+            pthread_mutex_unlock(&m_mutex);
 
             for (uint i = 0; i < m_num_threads; i++)
             {
@@ -391,15 +489,78 @@ namespace crnlib
             }
 
             m_num_threads = 0;
+            m_num_started_threads = 0;
 
             atomic_exchange32(&m_exit_flag, false);
         }
 
-        m_task_stack.clear();
+        m_threads.clear();
+        m_deques.resize(1);
+        m_deques[0].clear();
+        m_num_queued_tasks = 0;
         m_total_submitted_tasks = 0;
         m_total_completed_tasks = 0;
     }
 
+    const task_pool::thread_context* task_pool::get_thread_context() const
+    {
+        for (const thread_context* pContext = static_cast<const thread_context*>(g_pThread_context); pContext; pContext = pContext->m_pPrev)
+        {
+            if (pContext->m_pPool == this)
+            {
+                return pContext;
+            }
+        }
+        return nullptr;
+    }
+
+    // Each thread outside the pool counts its tasks in a group of its own, so concurrent callers sharing the pool don't join each other's tasks.
+    // The group is bound to one pool at a time: until its tasks complete, the thread's tasks for any other pool go to that pool's shared group.
+    task_pool::task_group& task_pool::get_external_group()
+    {
+        static thread_local const task_pool* s_pPool;
+        static thread_local task_group s_group;
+
+        if (s_pPool != this)
+        {
+            if (s_group.m_num_pending)
+            {
+                return m_external_group;
+            }
+            s_pPool = this;
+        }
+        return s_group;
+    }
+
+    void task_pool::push_task(task& tsk)
+    {
+        const thread_context* pContext = get_thread_context();
+        uint deque_index = pContext ? pContext->m_deque_index : m_num_threads;
+        tsk.m_pGroup = pContext ? pContext->m_pGroup : &get_external_group();
+        tsk.m_pConsole_capture = console::get_thread_capture();
+
+        atomic_increment32(&tsk.m_pGroup->m_num_pending);
+        atomic_increment32(&m_total_submitted_tasks);
+        m_deques[deque_index].push_back(tsk);
+
+        // Either a sleeping thread or waiting joiner sees the new task count before waiting, or it is counted here.
+        // Joiners are woken too, so a thread waiting for its subtasks helps execute the new task.
+        atomic_increment32(&m_num_queued_tasks);
+        if (m_num_sleeping_threads || m_num_waiting_joiners)
+        {
+            pthread_mutex_lock(&m_mutex);
+            if (m_num_sleeping_threads)
+            {
+                pthread_cond_signal(&m_tasks_available);
+            }
+            if (m_num_waiting_joiners)
+            {
+                pthread_cond_broadcast(&m_group_completed);
+            }
+            pthread_mutex_unlock(&m_mutex);
+        }
+    }
+
     bool task_pool::queue_task(task_callback_func pFunc, uint64 data, void* pData_ptr)
     {
         CRNLIB_ASSERT(pFunc);
@@ -410,14 +571,7 @@ namespace crnlib
         tsk.m_pData_ptr = pData_ptr;
         tsk.m_flags = 0;
 
-        atomic_increment32(&m_total_submitted_tasks);
-        if (!m_task_stack.try_push(tsk))
-        {
-            atomic_increment32(&m_total_completed_tasks);
-            return false;
-        }
-
-        m_tasks_available.release(1);
+        push_task(tsk);
 
         return true;
     }
@@ -433,20 +587,47 @@ namespace crnlib
         tsk.m_pData_ptr = pData_ptr;
         tsk.m_flags = cTaskFlagObject;
 
-        atomic_increment32(&m_total_submitted_tasks);
-        if (!m_task_stack.try_push(tsk))
+        push_task(tsk);
+
+        return true;
+    }
+
+    // Takes the newest task of the given deque, or else the oldest task of the external deque or of another worker's deque.
+    bool task_pool::pop_task(uint deque_index, task& tsk)
+    {
+        if (!m_num_queued_tasks)
         {
-            atomic_increment32(&m_total_completed_tasks);
             return false;
         }
 
-        m_tasks_available.release(1);
+        bool found = m_deques[deque_index].pop_back(tsk);
+        for (uint i = 1; !found && i <= m_num_threads; i++)
+        {
+            uint victim = deque_index + i;
+            found = m_deques[victim > m_num_threads ? victim - m_num_threads - 1 : victim].pop_front(tsk);
+        }
 
-        return true;
+        if (found)
+        {
+            atomic_decrement32(&m_num_queued_tasks);
+        }
+        return found;
     }
 
-    void task_pool::process_task(task& tsk)
+    void task_pool::process_task(task& tsk, uint deque_index)
     {
+        // Subtasks queued by this task are counted in its own group, and are joined before it completes.
+        task_group group;
+        group.m_num_pending = 0;
+        thread_context context = { this, &group, deque_index, static_cast<const thread_context*>(g_pThread_context) };
+        g_pThread_context = &context;
+
+        console_capture* pPrev_capture = console::get_thread_capture();
+        if (tsk.m_pConsole_capture != pPrev_capture)
+        {
+            console::set_thread_capture(tsk.m_pConsole_capture);
+        }
+
         if (tsk.m_flags & cTaskFlagObject)
         {
             tsk.m_pObj->execute_task(tsk.m_data, tsk.m_pData_ptr);
@@ -456,54 +637,111 @@ namespace crnlib
             tsk.m_callback(tsk.m_data, tsk.m_pData_ptr);
         }
 
-        if (atomic_increment32(&m_total_completed_tasks) == m_total_submitted_tasks)
+        join_group(group, deque_index);
+        g_pThread_context = context.m_pPrev;
+
+        if (tsk.m_pConsole_capture != pPrev_capture)
+        {
+            console::set_thread_capture(pPrev_capture);
+        }
+
+        atomic_increment32(&m_total_completed_tasks);
+        if (!atomic_decrement32(&tsk.m_pGroup->m_num_pending))
         {
-            // Try to signal the semaphore (the max count is 1 so this may actually fail).
-            m_all_tasks_completed.try_release();
+            pthread_mutex_lock(&m_mutex);
+            pthread_cond_broadcast(&m_group_completed);
+            pthread_mutex_unlock(&m_mutex);
+        }
+    }
+
+    void task_pool::join_group(task_group& group, uint deque_index)
+    {
+        while (group.m_num_pending)
+        {
+            task tsk;
+            if (pop_task(deque_index, tsk))
+            {
+                process_task(tsk, deque_index);
+                continue;
+            }
+
+            // The remaining tasks of the group are running on other threads.
+            pthread_mutex_lock(&m_mutex);
+            atomic_increment32(&m_num_waiting_joiners);
+            while (group.m_num_pending && !m_num_queued_tasks)
+            {
+                pthread_cond_wait(&m_group_completed, &m_mutex);
+            }
+            atomic_decrement32(&m_num_waiting_joiners);
+            pthread_mutex_unlock(&m_mutex);
         }
     }
 
     void task_pool::join()
     {
-        // Try to steal any outstanding tasks. This could cause one or more worker threads to wake up and immediately go back to sleep, which is wasteful but should be harmless.
-        task tsk;
-        while (m_task_stack.pop(tsk))
+        const thread_context* pContext = get_thread_context();
+        if (pContext)
         {
-            process_task(tsk);
+            join_group(*pContext->m_pGroup, pContext->m_deque_index);
         }
+        else
+        {
+            join_group(get_external_group(), m_num_threads);
+            join_group(m_external_group, m_num_threads);
+        }
+    }
 
-        // At this point the task stack is empty.
-        // Now wait for all concurrent tasks to complete. The m_all_tasks_completed semaphore has a max count of 1, so it's possible it could have saturated to 1 as the tasks
-        // where issued and asynchronously completed, so this loop may iterate a few times.
-        const int total_submitted_tasks = atomic_add32(&m_total_submitted_tasks, 0);
-        while (m_total_completed_tasks != total_submitted_tasks)
+    // Waits for the tasks queued by every thread.
+    void task_pool::join_all()
+    {
+        while (get_num_outstanding_tasks())
         {
-            // If the previous (m_total_completed_tasks != total_submitted_tasks) check failed the semaphore MUST be eventually signalled once the last task completes.
-            // So I think this can actually be an INFINITE delay, but it shouldn't really matter if it's 1ms.
-            m_all_tasks_completed.wait(1);
+            task tsk;
+            if (pop_task(m_num_threads, tsk))
+            {
+                process_task(tsk, m_num_threads);
+                continue;
+            }
+
+            // The last task to complete always completes its group too.
+            pthread_mutex_lock(&m_mutex);
+            atomic_increment32(&m_num_waiting_joiners);
+            while (get_num_outstanding_tasks() && !m_num_queued_tasks)
+            {
+                pthread_cond_wait(&m_group_completed, &m_mutex);
+            }
+            atomic_decrement32(&m_num_waiting_joiners);
+            pthread_mutex_unlock(&m_mutex);
         }
     }
 
     void* task_pool::thread_func(void* pContext)
     {
         task_pool* pPool = static_cast<task_pool*>(pContext);
-        task tsk;
+
+        uint deque_index = atomic_increment32(&pPool->m_num_started_threads) - 1;
 
         for (;;)
         {
-            if (!pPool->m_tasks_available.wait())
+            task tsk;
+            if (pPool->pop_task(deque_index, tsk))
             {
-                break;
+                pPool->process_task(tsk, deque_index);
+                continue;
             }
 
-            if (pPool->m_exit_flag)
+            pthread_mutex_lock(&pPool->m_mutex);
+            atomic_increment32(&pPool->m_num_sleeping_threads);
+            while (!pPool->m_exit_flag && !pPool->m_num_queued_tasks)
             {
-                break;
+                pthread_cond_wait(&pPool->m_tasks_available, &pPool->m_mutex);
             }
+            atomic_decrement32(&pPool->m_num_sleeping_threads);
+            pthread_mutex_unlock(&pPool->m_mutex);
 
-            if (pPool->m_task_stack.pop(tsk))
+            if (pPool->m_exit_flag)
             {
-                pPool->process_task(tsk);
+                break;
             }
         }
 
@@ -38,13 +38,14 @@
 #endif
 
 #include <pthread.h>
-#include <semaphore.h>
 #include <unistd.h>
 
 #include "crn_export.h"
 
 namespace crnlib
 {
+    class console_capture;
+
     // g_number_of_processors defaults to 1. Will be higher on multicore machines.
     CRN_EXPORT extern uint g_number_of_processors;
 
@@ -96,6 +97,8 @@ namespace crnlib
         mutex& m_mutex;
     };
 
+    // Counting semaphore private to this object. release() clamps the count to the maximum and returns false if it had to, while
+    // try_release() has the Win32 semantics: releasing past the maximum count fails and leaves the count unchanged. pName is ignored.
     class CRN_EXPORT semaphore
     {
         CRNLIB_NO_COPY_OR_ASSIGNMENT_OP(semaphore);
@@ -103,12 +106,18 @@ namespace crnlib
         semaphore(long initialCount = 0, long maximumCount = 1, const char* pName = nullptr);
         ~semaphore();
 
-        void release(long releaseCount = 1);
-        void try_release(long releaseCount = 1);
+        bool release(long releaseCount = 1, long* pPreviousCount = nullptr);
+        bool try_release(long releaseCount = 1, long* pPreviousCount = nullptr);
         bool wait(uint32 milliseconds = cUINT32_MAX);
 
     private:
-        sem_t* m_sem;
+        pthread_mutex_t m_mutex;
+        pthread_cond_t m_cond;
+        long m_count;
+        long m_max_count;
+        long m_num_waiters;
+
+        void add_count(long count);
     };
 
     class CRN_EXPORT spinlock
@@ -150,58 +159,9 @@ namespace crnlib
         spinlock& m_lock;
     };
 
-    template <typename T, uint cMaxSize>
-    class tsstack
-    {
-    public:
-        inline tsstack():
-            m_top(0)
-        {
-        }
-
-        inline ~tsstack()
-        {
-        }
-
-        inline void clear()
-        {
-            m_spinlock.lock();
-            m_top = 0;
-            m_spinlock.unlock();
-        }
-
-        inline bool try_push(const T& obj)
-        {
-            bool result = false;
-            m_spinlock.lock();
-            if (m_top < (int)cMaxSize)
-            {
-                m_stack[m_top++] = obj;
-                result = true;
-            }
-            m_spinlock.unlock();
-            return result;
-        }
-
-        inline bool pop(T& obj)
-        {
-            bool result = false;
-            m_spinlock.lock();
-            if (m_top > 0)
-            {
-                obj = m_stack[--m_top];
-                result = true;
-            }
-            m_spinlock.unlock();
-            return result;
-        }
-
-    private:
-        spinlock m_spinlock;
-        T m_stack[cMaxSize];
-        int m_top;
-    };
-
+    // Work-stealing task pool. Each worker thread has its own deque of tasks: a worker pushes and pops the tasks it queues at the back,
+    // and idle threads steal from the front of the other deques. Tasks queued by threads outside the pool go to a shared deque.
+    // Tasks may queue subtasks and join() them; the joining thread executes queued tasks while it waits.
     class CRN_EXPORT task_pool
     {
     public:
@@ -209,8 +169,7 @@ namespace crnlib
         task_pool(uint num_threads);
         ~task_pool();
 
-        enum { cMaxThreads = 16 };
-
+        // The threads and their deques are allocated here, so the number of threads is only limited by the system.
         bool init(uint num_threads);
         void deinit();
 
@@ -244,15 +203,25 @@ namespace crnlib
         inline bool queue_multiple_object_tasks(S* pObject, T pObject_method, uint64 first_data, uint num_tasks,
                                                 void* pData_ptr = nullptr);
 
+        // Waits for the tasks queued by the calling task, or by the calling thread if it isn't running one of this pool's tasks.
+        // Queued tasks are executed by the calling thread in the meantime. Any number of threads may share the pool.
         void join();
 
     private:
+        // Counts the unfinished tasks queued from one task, or from the threads outside the pool.
+        struct task_group
+        {
+            volatile atomic32_t m_num_pending;
+        };
+
         struct task
         {
             inline task():
                 m_data(0),
                 m_pData_ptr(nullptr),
                 m_pObj(nullptr),
+                m_pGroup(nullptr),
+                m_pConsole_capture(nullptr),
                 m_flags(0)
             {
             }
@@ -266,30 +235,88 @@ namespace crnlib
                 executable_task* m_pObj;
             };
 
+            task_group* m_pGroup;
+            // The console capture of the thread that queued the task, so its output goes to the same place.
+            console_capture* m_pConsole_capture;
             uint m_flags;
         };
 
-        tsstack<task, cMaxThreads> m_task_stack;
+        class task_deque
+        {
+        public:
+            task_deque():
+                m_front(0)
+            {
+            }
+
+            // Copies get their own lock, so the deques can be kept in a vector. Only copied while the pool is idle.
+            task_deque(const task_deque& other):
+                m_tasks(other.m_tasks),
+                m_front(other.m_front)
+            {
+            }
+
+            task_deque& operator=(const task_deque& rhs)
+            {
+                m_tasks = rhs.m_tasks;
+                m_front = rhs.m_front;
+                return *this;
+            }
+
+            void clear();
+            void push_back(const task& tsk);
+            bool pop_back(task& tsk);
+            bool pop_front(task& tsk);
+
+        private:
+            spinlock m_lock;
+            crnlib::vector<task> m_tasks;
+            uint m_front;
+        };
+
+        // The pool and task group the current thread queues into, and its deque index. Kept in a per-thread list, innermost first.
+        struct thread_context
+        {
+            task_pool* m_pPool;
+            task_group* m_pGroup;
+            uint m_deque_index;
+            const thread_context* m_pPrev;
+        };
 
         uint m_num_threads;
-        pthread_t m_threads[cMaxThreads];
+        crnlib::vector<pthread_t> m_threads;
 
-        // Signalled whenever a task is queued up.
-        semaphore m_tasks_available;
+        // One deque per worker thread, followed by the deque of the threads outside the pool.
+        crnlib::vector<task_deque> m_deques;
+        // Used by the threads outside the pool whose own group is busy with the tasks of another pool.
+        task_group m_external_group;
 
-        // Signalled when all outstanding tasks are completed.
-        semaphore m_all_tasks_completed;
+        pthread_mutex_t m_mutex;
+        // Signalled when a task is queued and a worker thread is asleep.
+        pthread_cond_t m_tasks_available;
+        // Broadcast when the last pending task of a group completes, or when a task is queued and a joiner is waiting.
+        pthread_cond_t m_group_completed;
 
         enum task_flags
         {
             cTaskFlagObject = 1
         };
 
+        volatile atomic32_t m_num_started_threads;
+        volatile atomic32_t m_num_queued_tasks;
+        volatile atomic32_t m_num_sleeping_threads;
+        volatile atomic32_t m_num_waiting_joiners;
         volatile atomic32_t m_total_submitted_tasks;
         volatile atomic32_t m_total_completed_tasks;
         volatile atomic32_t m_exit_flag;
 
-        void process_task(task& tsk);
+        const thread_context* get_thread_context() const;
+        task_group& get_external_group();
+        void push_task(task& tsk);
+        bool pop_task(uint deque_index, task& tsk);
+        void process_task(task& tsk, uint deque_index);
+        void join_group(task_group& group, uint deque_index);
+        void join_all();
 
         static void* thread_func(void* pContext);
     };
@@ -380,41 +407,24 @@ namespace crnlib
             return true;
         }
 
-        bool status = true;
-
-        uint i;
-        for (i = 0; i < num_tasks; i++)
+        for (uint i = 0; i < num_tasks; i++)
         {
             task tsk;
 
             tsk.m_pObj = crnlib_new<object_task<S>>(pObject, pObject_method, cObjectTaskFlagDeleteAfterExecution);
             if (!tsk.m_pObj)
             {
-                status = false;
-                break;
+                return false;
             }
 
             tsk.m_data = first_data + i;
             tsk.m_pData_ptr = pData_ptr;
             tsk.m_flags = cTaskFlagObject;
 
-            atomic_increment32(&m_total_submitted_tasks);
-
-            if (!m_task_stack.try_push(tsk))
-            {
-                atomic_increment32(&m_total_completed_tasks);
-
-                status = false;
-                break;
-            }
-        }
-
-        if (i)
-        {
-            m_tasks_available.release(i);
+            push_task(tsk);
         }
 
-        return status;
+        return true;
     }
 } // namespace crnlib
 
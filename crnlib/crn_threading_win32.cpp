@@ -23,6 +23,7 @@
 
 #include "crn_core.h"
 #include "crn_threading_win32.h"
+#include "crn_console.h"
 #include "crn_winhdr.h"
 
 #include <process.h>
@@ -54,7 +55,7 @@ namespace crnlib
         if (g_number_of_processors > 1)
         {
             // use all CPU's
-            return CRNLIB_MIN((int)task_pool::cMaxThreads, (int)g_number_of_processors - 1);
+            return g_number_of_processors - 1;
         }
 
         return 0;
@@ -230,13 +231,27 @@ namespace crnlib
         }
     }
 
-    void semaphore::release(int32 releaseCount, int32* pPreviousCount)
+    bool semaphore::release(int32 releaseCount, int32* pPreviousCount)
     {
         CRNLIB_ASSUME(sizeof(LONG) == sizeof(int32));
-        if (0 == ReleaseSemaphore(m_handle, releaseCount, (LPLONG)pPreviousCount))
+        if (ReleaseSemaphore(m_handle, releaseCount, (LPLONG)pPreviousCount))
+        {
+            return true;
+        }
+        if (GetLastError() != ERROR_TOO_MANY_POSTS)
         {
             CRNLIB_FAIL("semaphore: ReleaseSemaphore() failed");
         }
+
+        // ReleaseSemaphore() releases all or nothing, so release one at a time up to the maximum.
+        for (int32 i = 0; i < releaseCount; i++)
+        {
+            if (!ReleaseSemaphore(m_handle, 1, i ? nullptr : (LPLONG)pPreviousCount))
+            {
+                break;
+            }
+        }
+        return false;
     }
 
     bool semaphore::try_release(int32 releaseCount, int32* pPreviousCount)
@@ -260,26 +275,23 @@ namespace crnlib
     task_pool::task_pool() :
         m_pTask_stack(crnlib_new<ts_task_stack_t>()),
         m_num_threads(0),
-        m_tasks_available(0, 32767),
+        m_tasks_available(0, cINT32_MAX),
         m_all_tasks_completed(0, 1),
         m_total_submitted_tasks(0),
         m_total_completed_tasks(0),
         m_exit_flag(false)
     {
-        utils::zero_object(m_threads);
     }
 
     task_pool::task_pool(uint num_threads) :
         m_pTask_stack(crnlib_new<ts_task_stack_t>()),
         m_num_threads(0),
-        m_tasks_available(0, 32767),
+        m_tasks_available(0, cINT32_MAX),
         m_all_tasks_completed(0, 1),
         m_total_submitted_tasks(0),
         m_total_completed_tasks(0),
         m_exit_flag(false)
     {
-        utils::zero_object(m_threads);
-
         bool status = init(num_threads);
         CRNLIB_VERIFY(status);
     }
@@ -292,13 +304,12 @@ namespace crnlib
 
     bool task_pool::init(uint num_threads)
     {
-        CRNLIB_ASSERT(num_threads <= cMaxThreads);
-        num_threads = math::minimum<uint>(num_threads, cMaxThreads);
-
         deinit();
 
         bool succeeded = true;
 
+        m_threads.resize(num_threads);
+
         m_num_threads = 0;
         while (m_num_threads < num_threads)
         {
@@ -327,7 +338,7 @@ namespace crnlib
     {
         if (m_num_threads)
         {
-            join();
+            join_all();
 
             // Set exit flag, then release all threads. Each should wakeup and exit.
             atomic_exchange32(&m_exit_flag, true);
@@ -354,6 +365,7 @@ namespace crnlib
                 }
             }
 
+            m_threads.clear();
             m_num_threads = 0;
 
             atomic_exchange32(&m_exit_flag, false);
@@ -367,6 +379,57 @@ namespace crnlib
         m_total_completed_tasks = 0;
     }
 
+    static thread_local const void* g_pThread_context;
+
+    const task_pool::thread_context* task_pool::get_thread_context() const
+    {
+        for (const thread_context* pContext = static_cast<const thread_context*>(g_pThread_context); pContext; pContext = pContext->m_pPrev)
+        {
+            if (pContext->m_pPool == this)
+            {
+                return pContext;
+            }
+        }
+        return nullptr;
+    }
+
+    // Each thread outside the pool counts its tasks in a group of its own, so concurrent callers sharing the pool don't join each other's tasks.
+    // The group is bound to one pool at a time: until its tasks complete, the thread's tasks for any other pool go to that pool's shared group.
+    task_pool::task_group& task_pool::get_external_group()
+    {
+        static thread_local const task_pool* s_pPool;
+        static thread_local task_group s_group;
+
+        if (s_pPool != this)
+        {
+            if (s_group.m_num_pending)
+            {
+                return m_external_group;
+            }
+            s_pPool = this;
+        }
+        return s_group;
+    }
+
+    bool task_pool::push_task(task& tsk)
+    {
+        const thread_context* pContext = get_thread_context();
+        tsk.m_pGroup = pContext ? pContext->m_pGroup : &get_external_group();
+        tsk.m_pConsole_capture = console::get_thread_capture();
+
+        atomic_increment32(&tsk.m_pGroup->m_num_pending);
+        atomic_increment32(&m_total_submitted_tasks);
+
+        if (!m_pTask_stack->try_push(tsk))
+        {
+            atomic_decrement32(&tsk.m_pGroup->m_num_pending);
+            atomic_increment32(&m_total_completed_tasks);
+            return false;
+        }
+
+        return true;
+    }
+
     bool task_pool::queue_task(task_callback_func pFunc, uint64 data, void* pData_ptr)
     {
         CRNLIB_ASSERT(pFunc);
@@ -377,11 +440,8 @@ namespace crnlib
         tsk.m_pData_ptr = pData_ptr;
         tsk.m_flags = 0;
 
-        atomic_increment32(&m_total_submitted_tasks);
-
-        if (!m_pTask_stack->try_push(tsk))
+        if (!push_task(tsk))
         {
-            atomic_increment32(&m_total_completed_tasks);
             return false;
         }
 
@@ -401,11 +461,8 @@ namespace crnlib
         tsk.m_pData_ptr = pData_ptr;
         tsk.m_flags = cTaskFlagObject;
 
-        atomic_increment32(&m_total_submitted_tasks);
-
-        if (!m_pTask_stack->try_push(tsk))
+        if (!push_task(tsk))
         {
-            atomic_increment32(&m_total_completed_tasks);
             return false;
         }
 
@@ -416,6 +473,18 @@ namespace crnlib
 
     void task_pool::process_task(task& tsk)
     {
+        // Subtasks queued by this task are counted in its own group, and are joined before it completes.
+        task_group group;
+        thread_context context = { this, &group, static_cast<const thread_context*>(g_pThread_context) };
+        g_pThread_context = &context;
+
+        // Output of the task goes to the console capture of the thread that queued it.
+        console_capture* pPrev_capture = console::get_thread_capture();
+        if (tsk.m_pConsole_capture != pPrev_capture)
+        {
+            console::set_thread_capture(tsk.m_pConsole_capture);
+        }
+
         if (tsk.m_flags & cTaskFlagObject)
         {
             tsk.m_pObj->execute_task(tsk.m_data, tsk.m_pData_ptr);
@@ -425,31 +494,109 @@ namespace crnlib
             tsk.m_callback(tsk.m_data, tsk.m_pData_ptr);
         }
 
+        join_group(group);
+        g_pThread_context = context.m_pPrev;
+
+        if (tsk.m_pConsole_capture != pPrev_capture)
+        {
+            console::set_thread_capture(pPrev_capture);
+        }
+
+        task_group* pGroup = tsk.m_pGroup;
+
+        scoped_mutex lock(m_completion_mutex);
+        if ((!atomic_decrement32(&pGroup->m_num_pending)) && (pGroup->m_num_waiters))
+        {
+            pGroup->m_pCompleted->try_release(pGroup->m_num_waiters);
+        }
         if (atomic_increment32(&m_total_completed_tasks) == m_total_submitted_tasks)
         {
-            // Try to signal the semaphore (the max count is 1 so this may actually fail).
+            // The max count is 1, so this fails if join_all() hasn't taken an earlier signal yet.
             m_all_tasks_completed.try_release();
         }
     }
 
+    // Steals outstanding tasks, including other threads' tasks, until the group completes. This could cause one or more worker threads
+    // to wake up and immediately go back to sleep, which is wasteful but should be harmless.
+    void task_pool::join_group(task_group& group)
+    {
+        while (group.m_num_pending)
+        {
+            task tsk;
+            if (m_pTask_stack->pop(tsk))
+            {
+                process_task(tsk);
+                continue;
+            }
+
+            {
+                scoped_mutex lock(m_completion_mutex);
+                if (!group.m_num_pending)
+                {
+                    break;
+                }
+                if (!group.m_pCompleted)
+                {
+                    group.m_pCompleted = crnlib_new<semaphore>(0, cINT32_MAX);
+                }
+                group.m_num_waiters++;
+            }
+
+            // The remaining tasks of the group are running on other threads. Wake up when the group completes, or when a task is queued
+            // which this thread can then help with. A signal meant for a joiner that has already left only causes another iteration.
+            HANDLE handles[2] = { group.m_pCompleted->get_handle(), m_tasks_available.get_handle() };
+            if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_FAILED)
+            {
+                CRNLIB_FAIL("task_pool: WaitForMultipleObjects() failed");
+            }
+
+            scoped_mutex lock(m_completion_mutex);
+            group.m_num_waiters--;
+        }
+
+        // The thread that completed the group's last task may still be signalling it.
+        scoped_mutex lock(m_completion_mutex);
+    }
+
     void task_pool::join()
     {
-        // Try to steal any outstanding tasks. This could cause one or more worker threads to wake up and immediately go back to sleep, which is wasteful but should be harmless.
-        task tsk;
-        while (m_pTask_stack->pop(tsk))
+        const thread_context* pContext = get_thread_context();
+        if (pContext)
         {
-            process_task(tsk);
+            join_group(*pContext->m_pGroup);
         }
+        else
+        {
+            join_group(get_external_group());
+            join_group(m_external_group);
+        }
+    }
 
-        // At this point the task stack is empty.
-        // Now wait for all concurrent tasks to complete. The m_all_tasks_completed semaphore has a max count of 1, so it's possible it could have saturated to 1 as the tasks
-        // where issued and asynchronously completed, so this loop may iterate a few times.
-        const int total_submitted_tasks = atomic_add32(&m_total_submitted_tasks, 0);
-        while (m_total_completed_tasks != total_submitted_tasks)
+    // Waits for the tasks queued by every thread.
+    void task_pool::join_all()
+    {
+        for (;;)
         {
-            // If the previous (m_total_completed_tasks != total_submitted_tasks) check failed the semaphore MUST be eventually signalled once the last task completes.
-            // So I think this can actually be an INFINITE delay, but it shouldn't really matter if it's 1ms.
-            m_all_tasks_completed.wait(1);
+            task tsk;
+            if (m_pTask_stack->pop(tsk))
+            {
+                process_task(tsk);
+                continue;
+            }
+
+            {
+                scoped_mutex lock(m_completion_mutex);
+                if (!get_num_outstanding_tasks())
+                {
+                    break;
+                }
+            }
+
+            HANDLE handles[2] = { m_all_tasks_completed.get_handle(), m_tasks_available.get_handle() };
+            if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_FAILED)
+            {
+                CRNLIB_FAIL("task_pool: WaitForMultipleObjects() failed");
+            }
         }
     }
 
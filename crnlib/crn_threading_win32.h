@@ -32,6 +32,8 @@
 
 namespace crnlib
 {
+    class console_capture;
+
     // g_number_of_processors defaults to 1. Will be higher on multicore machines.
     CRN_EXPORT extern uint g_number_of_processors;
 
@@ -146,7 +148,8 @@ namespace crnlib
             return m_handle;
         }
 
-        void release(int32 releaseCount = 1, int32* pPreviousCount = nullptr);
+        // Clamps the count to the maximum, returning false if it had to. try_release() fails instead, leaving the count unchanged.
+        bool release(int32 releaseCount = 1, int32* pPreviousCount = nullptr);
         bool try_release(int32 releaseCount = 1, int32* pPreviousCount = nullptr);
 
         bool wait(uint32 milliseconds = cUINT32_MAX);
@@ -288,7 +291,7 @@ namespace crnlib
         }
     };
 
-    // Simple multithreaded task pool. This class assumes a single global thread will be issuing tasks and joining.
+    // Simple multithreaded task pool. Any number of threads may queue tasks and join, each waiting only for its own tasks.
     class CRN_EXPORT task_pool
     {
         CRNLIB_NO_COPY_OR_ASSIGNMENT_OP(task_pool);
@@ -298,10 +301,7 @@ namespace crnlib
         task_pool(uint num_threads);
         ~task_pool();
 
-        enum
-        {
-            cMaxThreads = 16
-        };
+        // The threads are allocated here, so their number is only limited by the system.
         bool init(uint num_threads);
         void deinit();
 
@@ -333,11 +333,33 @@ namespace crnlib
         template<typename S, typename T>
         inline bool queue_multiple_object_tasks(S* pObject, T pObject_method, uint64 first_data, uint num_tasks, void* pData_ptr = nullptr);
 
-        // Waits for all outstanding tasks (if any) to complete.
-        // The calling thread will steal any outstanding tasks from worker threads, if possible.
+        // Waits for the tasks queued by the calling task, or by the calling thread if it isn't running one of this pool's tasks.
+        // Queued tasks are executed by the calling thread in the meantime. Any number of threads may share the pool.
         void join();
 
     private:
+        // Counts the unfinished tasks queued from one task, or from the threads outside the pool.
+        struct task_group
+        {
+            inline task_group() :
+                m_num_pending(0),
+                m_pCompleted(nullptr),
+                m_num_waiters(0)
+            {
+            }
+
+            inline ~task_group()
+            {
+                crnlib_delete(m_pCompleted);
+            }
+
+            volatile atomic32_t m_num_pending;
+            // Created by the first joiner that has to wait, and released once per waiting joiner when m_num_pending drops to zero.
+            // Both members are guarded by m_completion_mutex.
+            semaphore* m_pCompleted;
+            uint m_num_waiters;
+        };
+
         struct task
         {
             //inline task() : m_data(0), m_pData_ptr(nullptr), m_pObj(nullptr), m_flags(0) { }
@@ -351,21 +373,39 @@ namespace crnlib
                 executable_task* m_pObj;
             };
 
+            task_group* m_pGroup;
+            // The console capture of the thread that queued the task, so its output goes to the same place.
+            console_capture* m_pConsole_capture;
             uint m_flags;
         };
 
+        // The pool and task group the current thread queues into. Kept in a per-thread list, innermost first.
+        struct thread_context
+        {
+            task_pool* m_pPool;
+            task_group* m_pGroup;
+            const thread_context* m_pPrev;
+        };
+
         typedef tsstack<task> ts_task_stack_t;
         ts_task_stack_t* m_pTask_stack;
 
         uint m_num_threads;
-        HANDLE m_threads[cMaxThreads];
+        crnlib::vector<HANDLE> m_threads;
 
         // Signalled whenever a task is queued up.
         semaphore m_tasks_available;
 
-        // Signalled when all outstanding tasks are completed.
+        // Signalled when the last outstanding task is completed.
         semaphore m_all_tasks_completed;
 
+        // Held while a task is counted as completed and while a joiner decides to wait, so no completion is missed and a group isn't
+        // destroyed while it is being signalled.
+        mutex m_completion_mutex;
+
+        // Used by the threads outside the pool whose own group is busy with the tasks of another pool.
+        task_group m_external_group;
+
         enum task_flags
         {
             cTaskFlagObject = 1
@@ -375,7 +415,12 @@ namespace crnlib
         volatile atomic32_t m_total_completed_tasks;
         volatile atomic32_t m_exit_flag;
 
+        const thread_context* get_thread_context() const;
+        task_group& get_external_group();
+        bool push_task(task& tsk);
         void process_task(task& tsk);
+        void join_group(task_group& group);
+        void join_all();
 
         static unsigned __stdcall thread_func(void* pContext);
     };
@@ -482,12 +527,8 @@ namespace crnlib
             tsk.m_pData_ptr = pData_ptr;
             tsk.m_flags = cTaskFlagObject;
 
-            atomic_increment32(&m_total_submitted_tasks);
-
-            if (!m_pTask_stack->try_push(tsk))
+            if (!push_task(tsk))
             {
-                atomic_increment32(&m_total_completed_tasks);
-
                 status = false;
                 break;
             }
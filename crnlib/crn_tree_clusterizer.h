@@ -86,7 +86,8 @@ namespace crnlib
             m_nodes[pParams->main_node].m_alternative = true;
         }
 
-        void generate_codebook(VectorType* vectors, uint* weights, uint size, uint max_splits, bool generate_node_index_map = false, task_pool* pTask_pool = 0)
+        // The work is split into num_tasks parts, which the codebook depends on, and run on pTask_pool whatever its size.
+        void generate_codebook(VectorType* vectors, uint* weights, uint size, uint max_splits, bool generate_node_index_map = false, task_pool* pTask_pool = 0, uint num_tasks = 1)
         {
             m_vectors = vectors;
             m_vectorsInfo.resize(size);
@@ -97,7 +98,16 @@ namespace crnlib
             m_vectorComparison.resize(size);
             m_nodes.resize(max_splits << 2);
             m_codebook.clear();
-            uint num_tasks = pTask_pool ? pTask_pool->get_num_threads() + 1 : 1;
+            m_node_indices.clear();
+            if (generate_node_index_map)
+            {
+                m_node_indices.resize(size);
+                m_node_indices.set_all(cUINT32_MAX);
+            }
+            if (!pTask_pool)
+            {
+                num_tasks = 1;
+            }
 
             vq_node root;
             root.m_begin = 0;
@@ -126,7 +136,7 @@ namespace crnlib
 
             if (num_tasks > 1)
             {
-                while (splits < max_splits && node_queue.size() != num_tasks && split_node(node_queue, end_node, pTask_pool))
+                while (splits < max_splits && node_queue.size() != num_tasks && split_node(node_queue, end_node, pTask_pool, num_tasks))
                 {
                     splits++;
                 }
@@ -146,7 +156,7 @@ namespace crnlib
                 }
             }
 
-            while (splits < max_splits && split_node(node_queue, end_node, pTask_pool))
+            while (splits < max_splits && split_node(node_queue, end_node, pTask_pool, num_tasks))
             {
                 splits++;
             }
@@ -162,17 +172,23 @@ namespace crnlib
                 m_codebook.push_back(node.m_centroid);
                 if (generate_node_index_map)
                 {
+                    // A vector can be in several nodes when alternative nodes are split further, the first one is kept.
                     for (uint j = node.m_begin; j < node.m_end; j++)
                     {
-                        m_node_index_map.insert(std::make_pair(m_vectors[m_vectorsInfo[j].index], node.m_codebook_index));
+                        uint& node_index = m_node_indices[m_vectorsInfo[j].index];
+                        if (node_index == cUINT32_MAX)
+                        {
+                            node_index = node.m_codebook_index;
+                        }
                     }
                 }
             }
         }
 
-        inline uint get_node_index(const VectorType& v)
+        // Codebook index of the node generate_codebook() put the given input vector in, when generate_node_index_map was set.
+        inline uint get_node_index(uint vector_index) const
         {
-            return m_node_index_map.find(v)->second;
+            return m_node_indices[vector_index];
         }
 
         inline uint get_codebook_size() const
@@ -191,13 +207,73 @@ namespace crnlib
             return m_codebook;
         }
 
+        // Builds the kd-tree over the codebook used by find_nearest(). Call after generate_codebook().
+        void generate_search_tree()
+        {
+            m_search_indices.resize(m_codebook.size());
+            for (uint i = 0; i < m_search_indices.size(); i++)
+            {
+                m_search_indices[i] = i;
+            }
+            m_search_nodes.resize(0);
+            if (m_codebook.size())
+            {
+                split_search_node(0, m_codebook.size());
+            }
+        }
+
+        // Returns the index of the codebook entry nearest to v. On ties the lowest index wins, so the result is the same as a linear scan
+        // keeping the first strictly closer entry. hint is the index of an entry likely to be close, which tightens the search early on.
+        uint find_nearest(const VectorType& v, uint hint = 0) const
+        {
+            uint best_index = hint;
+            float best_dist = m_codebook[hint].squared_distance(v);
+
+            struct
+            {
+                uint node;
+                float plane_dist;
+            } stack[64];
+            stack[0].node = 0;
+            stack[0].plane_dist = 0.0f;
+            for (uint stack_size = 1; stack_size;)
+            {
+                stack_size--;
+                // Entries on the far side of a split plane are at least as far from v as the plane, even with rounding.
+                if (stack[stack_size].plane_dist > best_dist)
+                {
+                    continue;
+                }
+                const search_node* pNode = &m_search_nodes[stack[stack_size].node];
+                while (pNode->m_left >= 0)
+                {
+                    float d = v[pNode->m_axis] - pNode->m_split;
+                    stack[stack_size].node = d < 0.0f ? pNode->m_right : pNode->m_left;
+                    stack[stack_size].plane_dist = d * d;
+                    stack_size++;
+                    pNode = &m_search_nodes[d < 0.0f ? pNode->m_left : pNode->m_right];
+                }
+                for (uint i = pNode->m_begin; i < pNode->m_end; i++)
+                {
+                    uint index = m_search_indices[i];
+                    float dist = m_codebook[index].squared_distance(v, best_dist);
+                    if (dist < best_dist || (dist == best_dist && index < best_index))
+                    {
+                        best_dist = dist;
+                        best_index = index;
+                    }
+                }
+            }
+            return best_index;
+        }
+
     private:
         VectorType* m_vectors;
         crnlib::vector<VectorType> m_weightedVectors;
         crnlib::vector<double> m_weightedDotProducts;
         crnlib::vector<VectorInfo> m_vectorsInfo, m_vectorsInfoLeft, m_vectorsInfoRight;
         crnlib::vector<bool> m_vectorComparison;
-        crnlib::hash_map<VectorType, uint> m_node_index_map;
+        crnlib::vector<uint> m_node_indices;
 
         struct vq_node
         {
@@ -237,6 +313,87 @@ namespace crnlib
 
         vector_vec_type m_codebook;
 
+        enum
+        {
+            cSearchLeafSize = 8
+        };
+
+        struct search_node
+        {
+            uint m_begin;
+            uint m_end;
+            int m_left;
+            int m_right;
+            uint m_axis;
+            float m_split;
+        };
+
+        struct search_axis_comparison
+        {
+            const VectorType* m_pCodebook;
+            uint m_axis;
+            bool operator()(uint a, uint b) const
+            {
+                return m_pCodebook[a][m_axis] < m_pCodebook[b][m_axis];
+            }
+        };
+
+        crnlib::vector<search_node> m_search_nodes;
+        crnlib::vector<uint> m_search_indices;
+
+        // Splits m_search_indices[begin, end) at the median of its widest axis, until the leaves are small enough.
+        int split_search_node(uint begin, uint end)
+        {
+            int node_index = m_search_nodes.size();
+            search_node node;
+            node.m_begin = begin;
+            node.m_end = end;
+            node.m_left = -1;
+            node.m_right = -1;
+            node.m_axis = 0;
+            node.m_split = 0.0f;
+            m_search_nodes.push_back(node);
+
+            if (end - begin <= cSearchLeafSize)
+            {
+                return node_index;
+            }
+
+            VectorType low(m_codebook[m_search_indices[begin]]), high(low);
+            for (uint i = begin + 1; i < end; i++)
+            {
+                const VectorType& v = m_codebook[m_search_indices[i]];
+                for (uint a = 0; a < VectorType::num_elements; a++)
+                {
+                    low[a] = math::minimum(low[a], v[a]);
+                    high[a] = math::maximum(high[a], v[a]);
+                }
+            }
+            uint axis = 0;
+            for (uint a = 1; a < VectorType::num_elements; a++)
+            {
+                if (high[a] - low[a] > high[axis] - low[axis])
+                {
+                    axis = a;
+                }
+            }
+            if (high[axis] == low[axis])
+            {
+                return node_index;
+            }
+
+            uint middle = (begin + end) >> 1;
+            search_axis_comparison comparison = { m_codebook.get_ptr(), axis };
+            std::nth_element(m_search_indices.get_ptr() + begin, m_search_indices.get_ptr() + middle, m_search_indices.get_ptr() + end, comparison);
+            m_search_nodes[node_index].m_axis = axis;
+            m_search_nodes[node_index].m_split = m_codebook[m_search_indices[middle]][axis];
+            int left = split_search_node(begin, middle);
+            int right = split_search_node(middle, end);
+            m_search_nodes[node_index].m_left = left;
+            m_search_nodes[node_index].m_right = right;
+            return node_index;
+        }
+
         struct distance_comparison_task_params
         {
             VectorType* left_child;
@@ -262,7 +419,7 @@ namespace crnlib
             }
         }
 
-        bool split_node(std::priority_queue<NodeInfo>& node_queue, uint& end_node, task_pool* pTask_pool = 0)
+        bool split_node(std::priority_queue<NodeInfo>& node_queue, uint& end_node, task_pool* pTask_pool = 0, uint max_tasks = 1)
         {
             if (node_queue.empty())
             {
@@ -301,7 +458,7 @@ namespace crnlib
             parent_node.m_processed = true;
 
             uint num_blocks = (parent_node.m_end - parent_node.m_begin) >> 9;
-            uint num_tasks = num_blocks > 1 && pTask_pool ? math::minimum(num_blocks, pTask_pool->get_num_threads() + 1) : 1;
+            uint num_tasks = num_blocks > 1 && pTask_pool ? math::minimum(num_blocks, max_tasks) : 1;
 
             VectorType furthest(0);
             double furthest_dist = -1.0f;
@@ -65,6 +65,13 @@ namespace crnlib
     };
 
     crnlib_global_initializer g_crnlib_initializer;
+
+    static task_pool* g_pShared_task_pool;
+
+    task_pool* crn_get_shared_task_pool()
+    {
+        return g_pShared_task_pool;
+    }
 }  // namespace crnlib
 
 using namespace crnlib;
@@ -212,6 +219,36 @@ void crn_free_block(void* pBlock)
     crnlib_free(pBlock);
 }
 
+bool crn_shared_pool_init(crn_uint32 num_helper_threads)
+{
+    crn_shared_pool_shutdown();
+
+    g_pShared_task_pool = static_cast<task_pool*>(crn_create_task_pool(num_helper_threads));
+    return g_pShared_task_pool != nullptr;
+}
+
+void crn_shared_pool_shutdown()
+{
+    crn_free_task_pool(g_pShared_task_pool);
+    g_pShared_task_pool = nullptr;
+}
+
+crn_task_pool_t crn_create_task_pool(crn_uint32 num_helper_threads)
+{
+    task_pool* pPool = crnlib_new<task_pool>();
+    if (!pPool->init(num_helper_threads))
+    {
+        crnlib_delete(pPool);
+        return nullptr;
+    }
+    return pPool;
+}
+
+void crn_free_task_pool(crn_task_pool_t pPool)
+{
+    crnlib_delete(static_cast<task_pool*>(pPool));
+}
+
 void* crn_compress(const crn_comp_params& comp_params, crn_uint32& compressed_size, crn_uint32* pActual_quality_level, float* pActual_bitrate)
 {
     compressed_size = 0;
@@ -387,11 +424,123 @@ namespace crnlib
             }
         }
 
+        bool compress_blocks(const crn_uint32* pPixels, uint width, uint height, uint row_pitch, void* pDst_blocks, uint dst_row_pitch)
+        {
+            if ((!m_image.is_valid()) || (!pPixels) || (!pDst_blocks) || (!width) || (!height) || (row_pitch < static_cast<uint64>(width) * sizeof(crn_uint32)))
+            {
+                return false;
+            }
+
+            compress_blocks_state state;
+            state.m_pPixels = reinterpret_cast<const uint8*>(pPixels);
+            state.m_width = width;
+            state.m_height = height;
+            state.m_row_pitch = row_pitch;
+            state.m_blocks_x = (width + cDXTBlockSize - 1) / cDXTBlockSize;
+            state.m_blocks_y = (height + cDXTBlockSize - 1) / cDXTBlockSize;
+            state.m_pDst_blocks = static_cast<uint8*>(pDst_blocks);
+            const uint64 row_size = static_cast<uint64>(state.m_blocks_x) * m_image.get_bytes_per_block();
+            if ((row_size > cUINT32_MAX) || (dst_row_pitch && (dst_row_pitch < row_size)))
+            {
+                return false;
+            }
+            state.m_dst_row_pitch = dst_row_pitch ? dst_row_pitch : static_cast<uint>(row_size);
+
+            // Each task starts with fresh optimizer state, so the output doesn't depend on how the tasks are spread over the threads.
+            state.m_rows_per_task = math::maximum<uint>(1U, (cMinBlocksPerTask + state.m_blocks_x - 1) / state.m_blocks_x);
+            const uint num_tasks = (state.m_blocks_y + state.m_rows_per_task - 1) / state.m_rows_per_task;
+
+            if (!m_task_pool.init(static_cast<task_pool*>(m_comp_params.m_pTask_pool), m_comp_params.m_num_helper_threads))
+            {
+                return false;
+            }
+
+            if ((num_tasks < 2) || (!m_task_pool->get_num_threads()))
+            {
+                for (uint i = 0; i < num_tasks; i++)
+                {
+                    compress_rows_task(i, &state);
+                }
+            }
+            else
+            {
+                m_task_pool->queue_multiple_object_tasks(this, &crn_block_compressor::compress_rows_task, 0, num_tasks, &state);
+                m_task_pool->join();
+            }
+
+            return !state.m_failed;
+        }
+
     private:
+        enum
+        {
+            cMinBlocksPerTask = 256
+        };
+
+        struct compress_blocks_state
+        {
+            compress_blocks_state():
+                m_failed(false)
+            {
+            }
+
+            const uint8* m_pPixels;
+            uint m_width;
+            uint m_height;
+            uint m_row_pitch;
+            uint m_blocks_x;
+            uint m_blocks_y;
+            uint8* m_pDst_blocks;
+            uint m_dst_row_pitch;
+            uint m_rows_per_task;
+            volatile bool m_failed;
+        };
+
         dxt_image m_image;
         crn_comp_params m_comp_params;
         dxt_image::pack_params m_pack_params;
         dxt_image::set_block_pixels_context m_set_block_pixels_context;
+        scoped_task_pool m_task_pool;
+
+        // Compresses a run of block rows into a one block high image, and copies each row out to the destination.
+        void compress_rows_task(uint64 data, void* pData_ptr)
+        {
+            compress_blocks_state& state = *static_cast<compress_blocks_state*>(pData_ptr);
+
+            dxt_image row_image;
+            if (!row_image.init(m_image.get_format(), state.m_blocks_x * cDXTBlockSize, cDXTBlockSize, false))
+            {
+                state.m_failed = true;
+                return;
+            }
+            const uint row_size = state.m_blocks_x * row_image.get_bytes_per_block();
+
+            dxt_image::set_block_pixels_context context;
+            color_quad_u8 pixels[cDXTBlockSize * cDXTBlockSize];
+
+            const uint first_row = static_cast<uint>(data) * state.m_rows_per_task;
+            const uint end_row = math::minimum(first_row + state.m_rows_per_task, state.m_blocks_y);
+            for (uint block_y = first_row; block_y < end_row; block_y++)
+            {
+                for (uint block_x = 0; block_x < state.m_blocks_x; block_x++)
+                {
+                    // Partial blocks at the right and bottom edges repeat the last column and row.
+                    for (uint y = 0; y < cDXTBlockSize; y++)
+                    {
+                        const uint iy = math::minimum(block_y * cDXTBlockSize + y, state.m_height - 1);
+                        const color_quad_u8* pSrc = reinterpret_cast<const color_quad_u8*>(state.m_pPixels + static_cast<size_t>(iy) * state.m_row_pitch);
+                        for (uint x = 0; x < cDXTBlockSize; x++)
+                        {
+                            pixels[x + y * cDXTBlockSize] = pSrc[math::minimum(block_x * cDXTBlockSize + x, state.m_width - 1)];
+                        }
+                    }
+
+                    row_image.set_block_pixels(block_x, 0, pixels, m_pack_params, context);
+                }
+
+                memcpy(state.m_pDst_blocks + static_cast<size_t>(block_y) * state.m_dst_row_pitch, row_image.get_element_ptr(), row_size);
+            }
+        }
     };
 }
 
@@ -412,6 +561,12 @@ void crn_compress_block(crn_block_compressor_context_t pContext, const crn_uint3
     pComp->compress_block(pPixels, pDst_block);
 }
 
+bool crn_compress_blocks(crn_block_compressor_context_t pContext, const crn_uint32* pPixels, crn_uint32 width, crn_uint32 height, crn_uint32 row_pitch, void* pDst_blocks, crn_uint32 dst_row_pitch)
+{
+    crn_block_compressor* pComp = static_cast<crn_block_compressor*>(pContext);
+    return pComp ? pComp->compress_blocks(pPixels, width, height, row_pitch, pDst_blocks, dst_row_pitch) : false;
+}
+
 void crn_free_block_compressor(crn_block_compressor_context_t pContext)
 {
     crnlib_delete(static_cast<crn_block_compressor*>(pContext));
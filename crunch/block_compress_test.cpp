@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2010-2016 Richard Geldreich, Jr. and Binomial LLC
+ * Copyright (c) 2020 FrozenStorm Interactive, Yoann Potinet
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation or credits
+ *    is required.
+ * 
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "crn_core.h"
+#include "block_compress_test.h"
+#include "crn_console.h"
+#include "crn_image_utils.h"
+#include "crn_strutils.h"
+#include "crn_timer.h"
+#include "crn_threading.h"
+
+using namespace crnlib;
+
+namespace crn
+{
+    bool block_compress_tester::test(const char* pCmd_line)
+    {
+        console::printf("Command line:\n\"%s\"", pCmd_line);
+
+        static const command_line_params::param_desc param_desc_array[] =
+        {
+            { "block_compress_test", 0, false },
+            { "in", 1, false },
+            { "format", 1, false },
+            { "dxtQuality", 1, false },
+            { "maxThreads", 1, false },
+            { "runs", 1, false },
+        };
+
+        command_line_params cmd_line_params;
+        if (!cmd_line_params.parse(pCmd_line, CRNLIB_ARRAY_SIZE(param_desc_array), param_desc_array, true))
+        {
+            return false;
+        }
+
+        dynamic_string filename;
+        if (!cmd_line_params.get_value_as_string("in", 0, filename))
+        {
+            console::error("Must specify an input file using the /in option!");
+            return false;
+        }
+
+        image_u8 img;
+        if (!image_utils::read_from_file(img, filename.get_ptr(), 0))
+        {
+            console::error("Failed loading image file: %s", filename.get_ptr());
+            return false;
+        }
+
+        crn_comp_params comp_params;
+        comp_params.m_dxt_quality = cCRNDXTQualityNormal;
+
+        dynamic_string format;
+        if (cmd_line_params.get_value_as_string("format", 0, format))
+        {
+            uint fmt = cCRNFmtDXT1;
+            while ((fmt < cCRNFmtTotal) && crn_stricmp(format.get_ptr(), crn_get_format_string(static_cast<crn_format>(fmt))))
+            {
+                fmt++;
+            }
+            if (fmt == cCRNFmtTotal)
+            {
+                console::error("Unknown format: %s", format.get_ptr());
+                return false;
+            }
+            comp_params.m_format = static_cast<crn_format>(fmt);
+        }
+
+        dynamic_string dxt_quality;
+        if (cmd_line_params.get_value_as_string("dxtQuality", 0, dxt_quality))
+        {
+            uint q = 0;
+            while ((q < cCRNDXTQualityTotal) && crn_stricmp(dxt_quality.get_ptr(), crn_get_dxt_quality_string(static_cast<crn_dxt_quality>(q))))
+            {
+                q++;
+            }
+            if (q == cCRNDXTQualityTotal)
+            {
+                console::error("Unknown DXT quality: %s", dxt_quality.get_ptr());
+                return false;
+            }
+            comp_params.m_dxt_quality = static_cast<crn_dxt_quality>(q);
+        }
+
+        uint max_threads = cmd_line_params.get_value_as_int("maxThreads", 0, g_number_of_processors, 1, cINT32_MAX);
+        uint num_runs = cmd_line_params.get_value_as_int("runs", 0, 1, 1, 100);
+
+        const uint width = img.get_width();
+        const uint height = img.get_height();
+        const uint blocks_x = (width + cDXTBlockSize - 1) / cDXTBlockSize;
+        const uint blocks_y = (height + cDXTBlockSize - 1) / cDXTBlockSize;
+        const uint num_blocks = blocks_x * blocks_y;
+        const uint bytes_per_block = crn_get_bytes_per_dxt_block(comp_params.m_format);
+        const crn_uint32* pPixels = reinterpret_cast<const crn_uint32*>(img.get_ptr());
+        const uint row_pitch = img.get_pitch() * sizeof(crn_uint32);
+
+        crnlib::vector<uint8> blocks(num_blocks * bytes_per_block);
+        crnlib::vector<uint8> reference_blocks;
+
+        console::printf("Image: %ux%u (%u blocks), format: %s, quality: %s, %u CPU's, best of %u run(s)", width, height, num_blocks,
+            crn_get_format_string(comp_params.m_format), crn_get_dxt_quality_string(comp_params.m_dxt_quality), g_number_of_processors, num_runs);
+
+        // One block per call, gathering the pixels of each block like an application would.
+        {
+            crn_block_compressor_context_t pContext = crn_create_block_compressor(comp_params);
+            if (!pContext)
+            {
+                console::error("Failed creating a block compressor for format %s!", crn_get_format_string(comp_params.m_format));
+                return false;
+            }
+
+            double best_time = 0.0f;
+            for (uint run = 0; run < num_runs; run++)
+            {
+                timer t;
+                t.start();
+                crn_uint32 pixels[cDXTBlockSize * cDXTBlockSize];
+                for (uint block_y = 0; block_y < blocks_y; block_y++)
+                {
+                    for (uint block_x = 0; block_x < blocks_x; block_x++)
+                    {
+                        for (uint y = 0; y < cDXTBlockSize; y++)
+                        {
+                            for (uint x = 0; x < cDXTBlockSize; x++)
+                            {
+                                const color_quad_u8& c = img.get_clamped(block_x * cDXTBlockSize + x, block_y * cDXTBlockSize + y);
+                                pixels[x + y * cDXTBlockSize] = *reinterpret_cast<const crn_uint32*>(&c);
+                            }
+                        }
+                        crn_compress_block(pContext, pixels, &blocks[(block_x + block_y * blocks_x) * bytes_per_block]);
+                    }
+                }
+                double time = t.get_elapsed_secs();
+                if ((!run) || (time < best_time))
+                {
+                    best_time = time;
+                }
+            }
+            crn_free_block_compressor(pContext);
+
+            console::printf("crn_compress_block:            %7.3fs %12.0f blocks/s", best_time, best_time > 0.0f ? num_blocks / best_time : 0.0f);
+        }
+
+        double single_thread_time = 0.0f;
+        for (uint num_threads = 1;; num_threads = math::minimum(num_threads * 2, max_threads))
+        {
+            comp_params.m_num_helper_threads = num_threads - 1;
+            crn_block_compressor_context_t pContext = crn_create_block_compressor(comp_params);
+            if (!pContext)
+            {
+                console::error("Failed creating a block compressor with %u thread(s)!", num_threads);
+                return false;
+            }
+
+            double best_time = 0.0f;
+            for (uint run = 0; run < num_runs; run++)
+            {
+                timer t;
+                t.start();
+                bool status = crn_compress_blocks(pContext, pPixels, width, height, row_pitch, blocks.get_ptr());
+                double time = t.get_elapsed_secs();
+                if (!status)
+                {
+                    console::error("crn_compress_blocks failed with %u thread(s)!", num_threads);
+                    crn_free_block_compressor(pContext);
+                    return false;
+                }
+                if ((!run) || (time < best_time))
+                {
+                    best_time = time;
+                }
+            }
+            crn_free_block_compressor(pContext);
+
+            if (num_threads == 1)
+            {
+                single_thread_time = best_time;
+                reference_blocks = blocks;
+            }
+
+            const double speedup = best_time > 0.0f ? single_thread_time / best_time : 1.0f;
+            console::printf("crn_compress_blocks, %3u threads: %7.3fs %12.0f blocks/s %7.2fx%s", num_threads, best_time, best_time > 0.0f ? num_blocks / best_time : 0.0f,
+                speedup, (blocks == reference_blocks) ? "" : " (output differs from 1 thread!)");
+
+            if (num_threads == max_threads)
+            {
+                break;
+            }
+        }
+
+        return true;
+    }
+} // namespace crn
@@ -34,12 +34,19 @@
 
 #include "crn_dxt.h"
 #include "crn_cfile_stream.h"
+#include "crn_mapped_file_stream.h"
 #include "crn_texture_conversion.h"
+#include "crn_threading.h"
 
 #include "crn_defs.h"
 
 #include "corpus_gen.h"
 #include "corpus_test.h"
+#include "thread_scaling_test.h"
+#include "block_compress_test.h"
+#include "dxt1_simd_test.h"
+#include "semaphore_stress_test.h"
+#include "output_cache.h"
 
 using namespace crn;
 using namespace crnlib;
@@ -56,13 +63,32 @@ class crunch
     uint32 m_num_failed;
     uint32 m_num_succeeded;
     uint32 m_num_skipped;
+    uint32 m_num_cache_hits;
+
+    // Files that were read and converted, as opposed to -info, -compare and cache hits. Only these are counted in the throughput.
+    uint32 m_num_converted;
+    uint64 m_total_input_bytes;
+    uint64 m_total_texels;
+
+    uint32 m_num_jobs;
 
 public:
     crunch():
         m_num_processed(0),
         m_num_failed(0),
         m_num_succeeded(0),
-        m_num_skipped(0)
+        m_num_skipped(0),
+        m_num_cache_hits(0),
+        m_num_converted(0),
+        m_total_input_bytes(0),
+        m_total_texels(0),
+        m_num_jobs(1),
+        m_pFiles(nullptr),
+        m_pJobs(nullptr),
+        m_pJob_completed(nullptr),
+        m_pHelper_pool(nullptr),
+        m_next_job_index(0),
+        m_abort_jobs(false)
     {
     }
 
@@ -78,6 +104,36 @@ public:
         cCSBadParam,
     };
 
+    struct file_job
+    {
+        file_job():
+            m_status(cCSFailed),
+            m_processed(false),
+            m_cache_hit(false),
+            m_input_bytes(0),
+            m_total_texels(0),
+            m_completed(0)
+        {
+        }
+
+        convert_status m_status;
+
+        // False if the file was skipped before being read (-nooverwrite, -timestamp).
+        bool m_processed;
+
+        // True if the output file was taken from the -cache directory.
+        bool m_cache_hit;
+
+        // Set once the source file of a conversion has been read.
+        uint64 m_input_bytes;
+        uint64 m_total_texels;
+
+        // Console output of the job, replayed in file order when running concurrently.
+        console_capture m_output;
+
+        volatile atomic32_t m_completed;
+    };
+
     inline uint32 get_num_processed() const
     {
         return m_num_processed;
@@ -118,13 +174,20 @@ public:
         console::printf("-forcewrite - Overwrite read-only files");
         console::printf("-recreate - Recreate directory structure");
         console::printf("-fileformat [dds,ktx,crn,tga,bmp,png] - Output file format, default=crn or dds");
+        console::printf("-cache dir - Reuse output files of previous runs with identical input and options");
+        console::printf("-cachesize # - Maximum size of the cache directory in MB, 0=unlimited, default=1024");
+        console::printf("-cachelink - Hard link output files to the cache instead of copying them. Warning: an");
+        console::printf("             output file then shares its data with the cache entry, so a tool that");
+        console::printf("             modifies it in place corrupts the cache. Delete or replace it instead.");
 
         console::message("\nModes:");
         console::printf("-compare - Compare input and output files (no output files are written).");
         console::printf("-info - Only display input file statistics (no output files are written).");
 
         console::message("\nMisc. options:");
-        console::printf("-helperThreads # - Set number of helper threads, 0-16, default=(# of CPU's)-1");
+        console::printf("-helperThreads # - Set number of helper threads, default=(# of CPU's)-1");
+        console::printf("-jobs # - Process up to # files concurrently, default=1");
+        console::printf("          The CPU's are shared between the jobs unless -helperThreads is used.");
         console::printf("-noprogress - Disable progress output");
         console::printf("-quiet - Disable all console output");
         console::printf("-ignoreerrors - Continue processing files after errors. Note: The default");
@@ -135,7 +198,7 @@ public:
         console::printf("-clamp <width> <height> - Crop image if larger than width/height");
         console::printf("-clampscale <width> <height> - Scale image if larger than width/height");
         console::printf("-nostats - Disable all output file statistics (faster)");
-        console::printf("-imagestats - Print various image qualilty statistics");
+        console::printf("-imagestats - Print image quality statistics (error, PSNR and SSIM)");
         console::printf("-mipstats - Print statistics for each mipmap, not just the top mip");
         console::printf("-lzmastats - Print size of output file compressed with LZMA codec");
         console::printf("-split - Write faces/mip levels to multiple separate output PNG files");
@@ -178,6 +241,7 @@ public:
         console::printf("-rtopmip - Renormalize on the top mip-level too, default=disabled");
         console::printf("-maxmips # - Limit number of generated texture mipmap levels, 1-16, default=16");
         console::printf("-minmipsize # - Smallest allowable mipmap resolution, default=1");
+        console::printf("-mipPyramid - Filter each mipmap from the previous level (faster, slightly blurrier), default=disabled");
 
         console::message("\nCompression options:");
         console::printf("-alphaThreshold # - Set DXT1A alpha threshold, 0-255, default=128");
@@ -185,6 +249,10 @@ public:
         console::printf(" prefer DXT1A over DXT5 for images with alpha channels (.DDS only).");
         console::printf("-uniformMetrics - Use uniform color metrics, default=use perceptual metrics");
         console::printf("-noAdaptiveBlocks - Disable adaptive block sizes (i.e. disable macroblocks).");
+        console::printf("-slicedLevels - Split .CRN levels into slices that can be transcoded in parallel.");
+        console::printf("                Files can't be read by decoders that predate this option.");
+        console::printf("-smallestLevelsFirst - Store .CRN levels smallest first, so streamed files");
+        console::printf("                show low mips early. Old decoders can't read these files.");
 #ifdef CRNLIB_SUPPORT_ATI_COMPRESS
         console::printf("-compressor [CRN,CRNF,RYG,ATI] - Set DXTn compressor, default=CRN");
 #else
@@ -215,6 +283,10 @@ public:
         m_num_failed = 0;
         m_num_succeeded = 0;
         m_num_skipped = 0;
+        m_num_cache_hits = 0;
+        m_num_converted = 0;
+        m_total_input_bytes = 0;
+        m_total_texels = 0;
 
         command_line_params::param_desc std_params[] =
         {
@@ -225,8 +297,12 @@ public:
             { "outsamedir", 0, false },
             { "deep", 0, false },
             { "fileformat", 1, false },
+            { "cache", 1, false },
+            { "cachesize", 1, false },
+            { "cachelink", 0, false },
 
             { "helperThreads", 1, false },
+            { "jobs", 1, false },
             { "noprogress", 0, false },
             { "quiet", 0, false },
             { "ignoreerrors", 0, false },
@@ -247,6 +323,7 @@ public:
             { "wrap", 0, false },
             { "renormalize", 0, false },
             { "rtopmip", 0, false },
+            { "mipPyramid", 0, false },
             { "noprogress", 0, false },
             { "paramdebug", 0, false },
             { "debug", 0, false },
@@ -258,6 +335,8 @@ public:
             { "alphaThreshold", 1, false },
             { "uniformMetrics", 0, false },
             { "noAdaptiveBlocks", 0, false },
+            { "slicedLevels", 0, false },
+            { "smallestLevelsFirst", 0, false },
             { "compressor", 1, false },
             { "dxtQuality", 1, false },
             { "noendpointcaching", 0, false },
@@ -377,6 +456,18 @@ public:
 private:
     command_line_params m_params;
 
+    // State shared by the process_files_task() jobs.
+    find_files::file_desc_vec* m_pFiles;
+    crnlib::vector<file_job>* m_pJobs;
+    // Released once per completed job.
+    semaphore* m_pJob_completed;
+    // The helper threads all the jobs share, unless -helperThreads is used.
+    task_pool* m_pHelper_pool;
+    volatile atomic32_t m_next_job_index;
+    volatile atomic32_t m_abort_jobs;
+
+    output_cache m_cache;
+
     bool convert()
     {
         find_files::file_desc_vec files;
@@ -420,10 +511,24 @@ private:
         std::sort(files.begin(), files.end());
         files.resize((uint32)(std::unique(files.begin(), files.end()) - files.begin()));
 
+        m_num_jobs = math::minimum<uint32>(m_params.get_value_as_int("jobs", 0, 1, 1, cINT32_MAX), files.size());
+
+        dynamic_string cache_dir;
+        if (m_params.get_value_as_string("cache", 0, cache_dir))
+        {
+            const uint64 max_cache_size = static_cast<uint64>(m_params.get_value_as_int("cachesize", 0, 1024, 0, cINT32_MAX)) * 1024U * 1024U;
+            if (!m_cache.init(cache_dir.get_ptr(), max_cache_size, m_params.get_value_as_bool("cachelink")))
+            {
+                console::error("Unable to use cache directory: \"%s\"", cache_dir.get_ptr());
+                return false;
+            }
+        }
+
         timer tm;
         tm.start();
 
-        if (!process_files(files))
+        bool status = (m_num_jobs > 1) ? process_files_concurrently(files) : process_files(files);
+        if (!status)
         {
             if (!m_params.get_value_as_bool("ignoreerrors"))
             {
@@ -431,14 +536,34 @@ private:
             }
         }
 
+        if (m_cache.is_enabled())
+        {
+            m_cache.trim();
+        }
+
         double total_time = tm.get_elapsed_secs();
 
         console::printf("Total time: %3.3fs", total_time);
 
+        if ((m_num_converted) && (total_time > 0.0f))
+        {
+            console::printf("Throughput: %3.3f files/s, %3.3f MB/s, %3.3f Mtexels/s over %u converted file(s) (%u job(s))",
+                m_num_converted / total_time,
+                (m_total_input_bytes / total_time) / (1024.0f * 1024.0f),
+                (m_total_texels / total_time) / 1000000.0f,
+                m_num_converted,
+                m_num_jobs);
+        }
+
         console::printf(
             ((m_num_skipped) || (m_num_failed)) ? cWarningConsoleMessage : cInfoConsoleMessage,
             "%u total file(s) successfully processed, %u file(s) skipped, %u file(s) failed.", m_num_succeeded, m_num_skipped, m_num_failed);
 
+        if (m_cache.is_enabled())
+        {
+            console::printf("%u file(s) taken from the cache.", m_num_cache_hits);
+        }
+
         return true;
     }
 
@@ -514,213 +639,350 @@ private:
 
     bool process_files(find_files::file_desc_vec& files)
     {
-        const bool compare_mode = m_params.get_value_as_bool("compare");
-        const bool info_mode = m_params.get_value_as_bool("info");
-
         for (uint32 file_index = 0; file_index < files.size(); file_index++)
         {
-            const find_files::file_desc& file_desc = files[file_index];
-            const dynamic_string& in_filename = file_desc.m_fullname;
+            file_job job;
+            job.m_status = process_file(files, file_index, job);
 
-            dynamic_string in_drive, in_path, in_fname, in_ext;
-            file_utils::split_path(in_filename.get_ptr(), &in_drive, &in_path, &in_fname, &in_ext);
+            if (!update_file_status(job))
+            {
+                return false;
+            }
+        }
 
-            texture_file_types::format out_file_type = texture_file_types::cFormatCRN;
-            dynamic_string fmt;
-            if (m_params.get_value_as_string("fileformat", 0, fmt))
+        return true;
+    }
+
+    // Runs m_num_jobs files at a time on a task pool. Each job captures its console output, which is replayed on
+    // the calling thread strictly in file order, so the console and log output match a serial run. Pool tasks print
+    // to the capture of the thread that queued them, so this includes the output of the compressors' helper threads.
+    bool process_files_concurrently(find_files::file_desc_vec& files)
+    {
+        crnlib::vector<file_job> jobs(files.size());
+
+        m_pFiles = &files;
+        m_pJobs = &jobs;
+        m_next_job_index = 0;
+        m_abort_jobs = false;
+
+        semaphore job_completed(0, files.size());
+        m_pJob_completed = &job_completed;
+
+        // The job threads run the helper tasks too while they wait for them, so only the remaining CPU's get a helper thread.
+        task_pool helper_pool;
+        if (!m_params.has_key("helperThreads"))
+        {
+            const uint32 num_helper_threads = (g_number_of_processors > m_num_jobs) ? (g_number_of_processors - m_num_jobs) : 0;
+            if (!helper_pool.init(num_helper_threads))
             {
-                if (fmt == "tga")
-                {
-                    out_file_type = texture_file_types::cFormatTGA;
-                }
-                else if (fmt == "bmp")
-                {
-                    out_file_type = texture_file_types::cFormatBMP;
-                }
-                else if (fmt == "dds")
-                {
-                    out_file_type = texture_file_types::cFormatDDS;
-                }
-                else if (fmt == "ktx")
-                {
-                    out_file_type = texture_file_types::cFormatKTX;
-                }
-                else if (fmt == "crn")
-                {
-                    out_file_type = texture_file_types::cFormatCRN;
-                }
-                else if (fmt == "png")
-                {
-                    out_file_type = texture_file_types::cFormatPNG;
-                }
-                else
-                {
-                    console::error("Unsupported output file type: %s", fmt.get_ptr());
-                    return false;
-                }
+                console::error("Failed creating %u helper threads!", num_helper_threads);
+                return false;
             }
+            m_pHelper_pool = &helper_pool;
+        }
 
-            // No explicit output format has been specified - try to determine something doable.
-            if (!m_params.has_key("fileformat"))
+        task_pool pool;
+        if (!pool.init(m_num_jobs))
+        {
+            console::error("Failed creating %u job threads!", m_num_jobs);
+            m_pHelper_pool = nullptr;
+            return false;
+        }
+
+        pool.queue_multiple_object_tasks(this, &crunch::process_files_task, 0, m_num_jobs);
+
+        bool status = true;
+
+        for (uint32 file_index = 0; file_index < files.size(); file_index++)
+        {
+            file_job& job = jobs[file_index];
+
+            // Each wait takes the release of some completed job, and this job's own release is still to come while it runs.
+            while (!atomic_add32(&job.m_completed, 0))
             {
-                if (m_params.has_key("split"))
-                {
-                    out_file_type = texture_file_types::cFormatPNG;
-                }
-                else
-                {
-                    texture_file_types::format input_file_type = texture_file_types::determine_file_format(in_filename.get_ptr());
-                    if (input_file_type == texture_file_types::cFormatCRN)
-                    {
-                        out_file_type = texture_file_types::cFormatDDS;
-                        cfile_stream in_stream;
-                        crnd::crn_header in_header;
-                        if (in_stream.open(in_filename.get_ptr()) && in_stream.read(&in_header, sizeof(in_header)) == sizeof(in_header) &&
-                            (in_header.m_format == cCRNFmtETC1 || in_header.m_format == cCRNFmtETC2 || in_header.m_format == cCRNFmtETC2A || in_header.m_format == cCRNFmtETC1S || in_header.m_format == cCRNFmtETC2AS))
-                        {
-                            out_file_type = texture_file_types::cFormatKTX;
-                        }
-                    }
-                    else if (input_file_type == texture_file_types::cFormatKTX)
-                    {
-                        // Default to converting KTX files to PNG
-                        out_file_type = texture_file_types::cFormatPNG;
-                    }
-                }
+                job_completed.wait();
+            }
+
+            job.m_output.replay();
+            job.m_output.clear();
+
+            if (!update_file_status(job))
+            {
+                atomic_exchange32(&m_abort_jobs, true);
+                status = false;
+                break;
             }
+        }
+
+        pool.join();
+
+        m_pFiles = nullptr;
+        m_pJobs = nullptr;
+        m_pJob_completed = nullptr;
+        m_pHelper_pool = nullptr;
+
+        return status;
+    }
+
+    void process_files_task(uint64, void*)
+    {
+        find_files::file_desc_vec& files = *m_pFiles;
+        crnlib::vector<file_job>& jobs = *m_pJobs;
 
-            dynamic_string out_filename;
-            if (m_params.get_value_as_bool("outsamedir"))
+        for (;;)
+        {
+            const uint32 file_index = atomic_increment32(&m_next_job_index) - 1;
+            if (file_index >= files.size())
             {
-                out_filename.format("%s%s%s.%s", in_drive.get_ptr(), in_path.get_ptr(), in_fname.get_ptr(), texture_file_types::get_extension(out_file_type));
+                break;
             }
-            else if (m_params.has_key("out"))
+
+            file_job& job = jobs[file_index];
+
+            if (!m_abort_jobs)
             {
-                out_filename = m_params.get_value_as_string_or_empty("out");
+                console::set_thread_capture(&job.m_output);
+                job.m_status = process_file(files, file_index, job);
+                console::set_thread_capture(nullptr);
+            }
 
-                if (files.size() > 1)
-                {
-                    dynamic_string out_drive, out_dir, out_name, out_ext;
-                    file_utils::split_path(out_filename.get_ptr(), &out_drive, &out_dir, &out_name, &out_ext);
+            atomic_exchange32(&job.m_completed, true);
+            m_pJob_completed->release();
+        }
+    }
 
-                    out_name.format("%s_%u", out_name.get_ptr(), file_index);
+    // Updates the counters after a file has been processed. Returns false if processing must stop.
+    bool update_file_status(const file_job& job)
+    {
+        if (!job.m_processed)
+        {
+            if (job.m_status == cCSSkipped)
+            {
+                m_num_skipped++;
+                return true;
+            }
+            return job.m_status != cCSBadParam;
+        }
 
-                    out_filename.format("%s%s%s%s", out_drive.get_ptr(), out_dir.get_ptr(), out_name.get_ptr(), out_ext.get_ptr());
-                }
+        m_num_processed++;
+        if (job.m_total_texels)
+        {
+            m_num_converted++;
+            m_total_input_bytes += job.m_input_bytes;
+            m_total_texels += job.m_total_texels;
+        }
 
-                if (!m_params.has_key("fileformat"))
+        switch (job.m_status)
+        {
+            case cCSSucceeded: {
+                console::info("");
+                m_num_succeeded++;
+                if (job.m_cache_hit)
                 {
-                    out_file_type = texture_file_types::determine_file_format(out_filename.get_ptr());
+                    m_num_cache_hits++;
                 }
+                break;
+            }
+            case cCSSkipped: {
+                console::info("Skipping file.\n");
+                m_num_skipped++;
+                break;
+            }
+            case cCSBadParam: {
+                return false;
+            }
+            default: {
+                if (!m_params.get_value_as_bool("ignoreerrors"))
+                    return false;
+
+                console::info("");
+
+                m_num_failed++;
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    convert_status process_file(find_files::file_desc_vec& files, uint32 file_index, file_job& job)
+    {
+        const bool compare_mode = m_params.get_value_as_bool("compare");
+        const bool info_mode = m_params.get_value_as_bool("info");
+
+        const find_files::file_desc& file_desc = files[file_index];
+        const dynamic_string& in_filename = file_desc.m_fullname;
+
+        dynamic_string in_drive, in_path, in_fname, in_ext;
+        file_utils::split_path(in_filename.get_ptr(), &in_drive, &in_path, &in_fname, &in_ext);
+
+        texture_file_types::format out_file_type = texture_file_types::cFormatCRN;
+        dynamic_string fmt;
+        if (m_params.get_value_as_string("fileformat", 0, fmt))
+        {
+            if (fmt == "tga")
+            {
+                out_file_type = texture_file_types::cFormatTGA;
+            }
+            else if (fmt == "bmp")
+            {
+                out_file_type = texture_file_types::cFormatBMP;
+            }
+            else if (fmt == "dds")
+            {
+                out_file_type = texture_file_types::cFormatDDS;
+            }
+            else if (fmt == "ktx")
+            {
+                out_file_type = texture_file_types::cFormatKTX;
+            }
+            else if (fmt == "crn")
+            {
+                out_file_type = texture_file_types::cFormatCRN;
+            }
+            else if (fmt == "png")
+            {
+                out_file_type = texture_file_types::cFormatPNG;
             }
             else
             {
-                dynamic_string out_dir(m_params.get_value_as_string_or_empty("outdir"));
-
-                if (m_params.get_value_as_bool("recreate") && file_desc.m_rel.get_len())
-                {
-                    file_utils::combine_path(out_dir, out_dir.get_ptr(), file_desc.m_rel.get_ptr());
-                }
+                console::error("Unsupported output file type: %s", fmt.get_ptr());
+                return cCSBadParam;
+            }
+        }
 
-                if (out_dir.get_len())
+        // No explicit output format has been specified - try to determine something doable.
+        if (!m_params.has_key("fileformat"))
+        {
+            if (m_params.has_key("split"))
+            {
+                out_file_type = texture_file_types::cFormatPNG;
+            }
+            else
+            {
+                texture_file_types::format input_file_type = texture_file_types::determine_file_format(in_filename.get_ptr());
+                if (input_file_type == texture_file_types::cFormatCRN)
                 {
-                    if (file_utils::is_path_separator(out_dir.back()))
-                    {
-                        out_filename.format("%s%s.%s", out_dir.get_ptr(), in_fname.get_ptr(), texture_file_types::get_extension(out_file_type));
-                    }
-                    else
+                    out_file_type = texture_file_types::cFormatDDS;
+                    cfile_stream in_stream;
+                    crnd::crn_header in_header;
+                    if (in_stream.open(in_filename.get_ptr()) && in_stream.read(&in_header, sizeof(in_header)) == sizeof(in_header) &&
+                        (in_header.m_format == cCRNFmtETC1 || in_header.m_format == cCRNFmtETC2 || in_header.m_format == cCRNFmtETC2A || in_header.m_format == cCRNFmtETC1S || in_header.m_format == cCRNFmtETC2AS))
                     {
-                        out_filename.format("%s\\%s.%s", out_dir.get_ptr(), in_fname.get_ptr(), texture_file_types::get_extension(out_file_type));
+                        out_file_type = texture_file_types::cFormatKTX;
                     }
                 }
-                else
-                {
-                    out_filename.format("%s.%s", in_fname.get_ptr(), texture_file_types::get_extension(out_file_type));
-                }
-
-                if (m_params.get_value_as_bool("recreate"))
+                else if (input_file_type == texture_file_types::cFormatKTX)
                 {
-                    if (file_utils::full_path(out_filename))
-                    {
-                        if ((!compare_mode) && (!info_mode))
-                        {
-                            dynamic_string out_drive, out_path;
-                            file_utils::split_path(out_filename.get_ptr(), &out_drive, &out_path, nullptr, nullptr);
-                            out_drive += out_path;
-                            file_utils::create_path(out_drive.get_ptr());
-                        }
-                    }
+                    // Default to converting KTX files to PNG
+                    out_file_type = texture_file_types::cFormatPNG;
                 }
             }
+        }
+
+        dynamic_string out_filename;
+        if (m_params.get_value_as_bool("outsamedir"))
+        {
+            out_filename.format("%s%s%s.%s", in_drive.get_ptr(), in_path.get_ptr(), in_fname.get_ptr(), texture_file_types::get_extension(out_file_type));
+        }
+        else if (m_params.has_key("out"))
+        {
+            out_filename = m_params.get_value_as_string_or_empty("out");
 
-            if ((!compare_mode) && (!info_mode))
+            if (files.size() > 1)
             {
-                if (file_utils::does_file_exist(out_filename.get_ptr()))
-                {
-                    if (m_params.get_value_as_bool("nooverwrite"))
-                    {
-                        console::warning("Skipping already existing file: %s\n", out_filename.get_ptr());
-                        m_num_skipped++;
-                        continue;
-                    }
+                dynamic_string out_drive, out_dir, out_name, out_ext;
+                file_utils::split_path(out_filename.get_ptr(), &out_drive, &out_dir, &out_name, &out_ext);
 
-                    if (m_params.get_value_as_bool("timestamp"))
-                    {
-                        if (file_utils::is_older_than(in_filename.get_ptr(), out_filename.get_ptr()))
-                        {
-                            console::warning("Skipping up to date file: %s\n", out_filename.get_ptr());
-                            m_num_skipped++;
-                            continue;
-                        }
-                    }
-                }
+                out_name.format("%s_%u", out_name.get_ptr(), file_index);
+
+                out_filename.format("%s%s%s%s", out_drive.get_ptr(), out_dir.get_ptr(), out_name.get_ptr(), out_ext.get_ptr());
             }
 
-            convert_status status = cCSFailed;
+            if (!m_params.has_key("fileformat"))
+            {
+                out_file_type = texture_file_types::determine_file_format(out_filename.get_ptr());
+            }
+        }
+        else
+        {
+            dynamic_string out_dir(m_params.get_value_as_string_or_empty("outdir"));
 
-            if (info_mode)
+            if (m_params.get_value_as_bool("recreate") && file_desc.m_rel.get_len())
             {
-                status = display_file_info(file_index, files.size(), in_filename.get_ptr());
+                file_utils::combine_path(out_dir, out_dir.get_ptr(), file_desc.m_rel.get_ptr());
             }
-            else if (compare_mode)
+
+            if (out_dir.get_len())
             {
-                status = compare_file(file_index, files.size(), in_filename.get_ptr(), out_filename.get_ptr(), out_file_type);
+                if (file_utils::is_path_separator(out_dir.back()))
+                {
+                    out_filename.format("%s%s.%s", out_dir.get_ptr(), in_fname.get_ptr(), texture_file_types::get_extension(out_file_type));
+                }
+                else
+                {
+                    out_filename.format("%s\\%s.%s", out_dir.get_ptr(), in_fname.get_ptr(), texture_file_types::get_extension(out_file_type));
+                }
             }
-            else if (read_only_file_check(out_filename.get_ptr()))
+            else
             {
-                status = convert_file(file_index, files.size(), in_filename.get_ptr(), out_filename.get_ptr(), out_file_type);
+                out_filename.format("%s.%s", in_fname.get_ptr(), texture_file_types::get_extension(out_file_type));
             }
 
-            m_num_processed++;
-
-            switch (status)
+            if (m_params.get_value_as_bool("recreate"))
             {
-                case cCSSucceeded: {
-                    console::info("");
-                    m_num_succeeded++;
-                    break;
-                }
-                case cCSSkipped: {
-                    console::info("Skipping file.\n");
-                    m_num_skipped++;
-                    break;
-                }
-                case cCSBadParam: {
-                    return false;
+                if (file_utils::full_path(out_filename))
+                {
+                    if ((!compare_mode) && (!info_mode))
+                    {
+                        dynamic_string out_drive, out_path;
+                        file_utils::split_path(out_filename.get_ptr(), &out_drive, &out_path, nullptr, nullptr);
+                        out_drive += out_path;
+                        file_utils::create_path(out_drive.get_ptr());
+                    }
                 }
-                default: {
-                    if (!m_params.get_value_as_bool("ignoreerrors"))
-                        return false;
+            }
+        }
 
-                    console::info("");
+        if ((!compare_mode) && (!info_mode))
+        {
+            if (file_utils::does_file_exist(out_filename.get_ptr()))
+            {
+                if (m_params.get_value_as_bool("nooverwrite"))
+                {
+                    console::warning("Skipping already existing file: %s\n", out_filename.get_ptr());
+                    return cCSSkipped;
+                }
 
-                    m_num_failed++;
-                    break;
+                if (m_params.get_value_as_bool("timestamp"))
+                {
+                    if (file_utils::is_older_than(in_filename.get_ptr(), out_filename.get_ptr()))
+                    {
+                        console::warning("Skipping up to date file: %s\n", out_filename.get_ptr());
+                        return cCSSkipped;
+                    }
                 }
             }
         }
 
-        return true;
+        job.m_processed = true;
+
+        convert_status status = cCSFailed;
+
+        if (info_mode)
+        {
+            status = display_file_info(file_index, files.size(), in_filename.get_ptr());
+        }
+        else if (compare_mode)
+        {
+            status = compare_file(file_index, files.size(), in_filename.get_ptr(), out_filename.get_ptr(), out_file_type);
+        }
+        else if (read_only_file_check(out_filename.get_ptr()))
+        {
+            status = convert_file(file_index, files.size(), in_filename.get_ptr(), out_filename.get_ptr(), out_file_type, job);
+        }
+
+        return status;
     }
 
     void print_texture_info(const char* pTex_desc, texture_conversion::convert_params& params, mipmapped_texture& tex)
@@ -873,6 +1135,7 @@ private:
 
         mip_params.m_max_levels = m_params.get_value_as_int("maxmips", 0, cCRNMaxLevels, 1, cCRNMaxLevels);
         mip_params.m_min_mip_size = m_params.get_value_as_int("minmipsize", 0, 1, 1, cCRNMaxLevelResolution);
+        mip_params.m_pyramid = m_params.get_value_as_bool("mipPyramid");
 
         return true;
     }
@@ -1013,14 +1276,19 @@ private:
 
         comp_params.set_flag(cCRNCompFlagPerceptual, !m_params.get_value_as_bool("uniformMetrics"));
         comp_params.set_flag(cCRNCompFlagHierarchical, !m_params.get_value_as_bool("noAdaptiveBlocks"));
+        comp_params.set_flag(cCRNCompFlagSlicedLevels, m_params.get_value_as_bool("slicedLevels"));
+        comp_params.set_flag(cCRNCompFlagSmallestLevelsFirst, m_params.get_value_as_bool("smallestLevelsFirst"));
 
         if (m_params.has_key("helperThreads"))
         {
-            comp_params.m_num_helper_threads = m_params.get_value_as_int("helperThreads", 0, cCRNMaxHelperThreads, 0, cCRNMaxHelperThreads);
+            comp_params.m_num_helper_threads = m_params.get_value_as_int("helperThreads", 0, g_number_of_processors - 1, 0, cINT32_MAX);
         }
-        else if (g_number_of_processors > 1)
+        else
         {
+            // The work is split by m_num_helper_threads, which the output depends on, so it mustn't change with -jobs. Concurrent jobs
+            // share the CPU's by running on one helper pool instead.
             comp_params.m_num_helper_threads = g_number_of_processors - 1;
+            comp_params.m_pTask_pool = m_pHelper_pool;
         }
 
         dynamic_string comp_name;
@@ -1099,8 +1367,17 @@ private:
             return cCSFailed;
         }
 
+        // Map the file once for both the texture reader and the statistics below.
+        mapped_file_stream src_stream;
+        if (!src_stream.open(pSrc_filename))
+        {
+            console::error("Failed loading source file: %s", pSrc_filename);
+            return cCSFailed;
+        }
+
         mipmapped_texture src_tex;
-        if (!src_tex.read_from_file(pSrc_filename, src_file_format))
+        data_stream_serializer src_serializer(src_stream);
+        if (!src_tex.read_from_stream(src_serializer, src_file_format))
         {
             if (src_tex.get_last_error().is_empty())
             {
@@ -1114,8 +1391,7 @@ private:
             return cCSFailed;
         }
 
-        uint64 input_file_size;
-        file_utils::get_file_size(pSrc_filename, input_file_size);
+        const uint64 input_file_size = src_stream.get_size();
 
         uint32 total_in_pixels = 0;
         for (uint32 i = 0; i < src_tex.get_num_levels(); i++)
@@ -1125,14 +1401,16 @@ private:
             total_in_pixels += width * height * src_tex.get_num_faces();
         }
 
-        vector<uint8> src_tex_bytes;
-        if (!cfile_stream::read_file_into_array(pSrc_filename, src_tex_bytes))
+        vector<uint8> src_tex_buf;
+        const uint8* pSrc_tex_bytes;
+        uint src_tex_size;
+        if ((!src_stream.seek(0, false)) || (!src_stream.read_remaining(src_tex_buf, pSrc_tex_bytes, src_tex_size)))
         {
             console::error("Failed loading source file: %s", pSrc_filename);
             return cCSFailed;
         }
 
-        if (!src_tex_bytes.size())
+        if (!src_tex_size)
         {
             console::warning("Source file is empty: %s", pSrc_filename);
             return cCSSkipped;
@@ -1143,7 +1421,7 @@ private:
         {
             lzma_codec lossless_codec;
             vector<uint8> cmp_tex_bytes;
-            if (lossless_codec.pack(src_tex_bytes.get_ptr(), src_tex_bytes.size(), cmp_tex_bytes))
+            if (lossless_codec.pack(pSrc_tex_bytes, src_tex_size, cmp_tex_bytes))
             {
                 compressed_size = cmp_tex_bytes.size();
             }
@@ -1165,14 +1443,14 @@ private:
                 compressed_size, compressed_size * 8.0f / total_in_pixels);
         }
 
-        double entropy = math::compute_entropy(src_tex_bytes.get_ptr(), src_tex_bytes.size());
-        console::info("Source file entropy: %3.6f bits per byte", entropy / src_tex_bytes.size());
+        double entropy = math::compute_entropy(pSrc_tex_bytes, src_tex_size);
+        console::info("Source file entropy: %3.6f bits per byte", entropy / src_tex_size);
 
         if (src_file_format == texture_file_types::cFormatCRN)
         {
             crnd::crn_texture_info tex_info;
             tex_info.m_struct_size = sizeof(crnd::crn_texture_info);
-            crn_bool success = crnd::crnd_get_texture_info(src_tex_bytes.get_ptr(), src_tex_bytes.size(), &tex_info);
+            crn_bool success = crnd::crnd_get_texture_info(pSrc_tex_bytes, src_tex_size, &tex_info);
             if (!success)
             {
                 console::error("Failed retrieving CRN texture info!");
@@ -1255,7 +1533,7 @@ private:
         return cCSSucceeded;
     }
 
-    convert_status convert_file(uint32 file_index, uint32 num_files, const char* pSrc_filename, const char* pDst_filename, texture_file_types::format out_file_type)
+    convert_status convert_file(uint32 file_index, uint32 num_files, const char* pSrc_filename, const char* pDst_filename, texture_file_types::format out_file_type, file_job& job)
     {
         timer tim;
 
@@ -1275,37 +1553,8 @@ private:
             return cCSFailed;
         }
 
-        mipmapped_texture src_tex;
-        tim.start();
-        if (!src_tex.read_from_file(pSrc_filename, src_file_format))
-        {
-            if (src_tex.get_last_error().is_empty())
-            {
-                console::error("Failed reading source file: \"%s\"", pSrc_filename);
-            }
-            else
-            {
-                console::error("%s", src_tex.get_last_error().get_ptr());
-            }
-
-            return cCSFailed;
-        }
-        double total_time = tim.get_elapsed_secs();
-        console::info("Texture successfully loaded in %3.3fs", total_time);
-
-        if (m_params.get_value_as_bool("converttoluma"))
-        {
-            src_tex.convert(image_utils::cConversion_Y_To_RGB);
-        }
-        if (m_params.get_value_as_bool("setalphatoluma"))
-        {
-            src_tex.convert(image_utils::cConversion_Y_To_A);
-        }
-
         texture_conversion::convert_params params;
 
-        params.m_texture_type = src_tex.determine_texture_type();
-        params.m_pInput_texture = &src_tex;
         params.m_dst_filename = pDst_filename;
         params.m_dst_file_type = out_file_type;
         params.m_lzma_stats = m_params.has_key("lzmastats");
@@ -1314,7 +1563,7 @@ private:
         params.m_y_flip = m_params.has_key("yflip");
         params.m_unflip = m_params.has_key("unflip");
 
-        if ((!m_params.get_value_as_bool("noprogress")) && (!m_params.get_value_as_bool("quiet")))
+        if ((!m_params.get_value_as_bool("noprogress")) && (!m_params.get_value_as_bool("quiet")) && (m_num_jobs <= 1))
         {
             params.m_pProgress_func = progress_callback_func;
         }
@@ -1369,6 +1618,62 @@ private:
             return cCSBadParam;
         }
 
+        const bool convert_to_luma = m_params.get_value_as_bool("converttoluma");
+        const bool set_alpha_to_luma = m_params.get_value_as_bool("setalphatoluma");
+
+        // Everything else that affects the output is derived from the source file's contents.
+        dynamic_string cache_key;
+        if ((m_cache.is_enabled()) && (!params.m_write_mipmaps_to_multiple_files) &&
+            (m_cache.compute_key(pSrc_filename, params, (convert_to_luma ? 1 : 0) | (set_alpha_to_luma ? 2 : 0), cache_key)))
+        {
+            if (m_cache.fetch(cache_key, out_file_type, pDst_filename))
+            {
+                job.m_cache_hit = true;
+
+                console::info("Output file \"%s\" taken from the cache", pDst_filename);
+                return cCSSucceeded;
+            }
+
+            // With -cachelink the previous output file may be a link to an entry, don't write through it.
+            if (m_cache.uses_hardlinks())
+            {
+                file_utils::delete_file(pDst_filename);
+            }
+        }
+
+        mipmapped_texture src_tex;
+        tim.start();
+        if (!src_tex.read_from_file(pSrc_filename, src_file_format))
+        {
+            if (src_tex.get_last_error().is_empty())
+            {
+                console::error("Failed reading source file: \"%s\"", pSrc_filename);
+            }
+            else
+            {
+                console::error("%s", src_tex.get_last_error().get_ptr());
+            }
+
+            return cCSFailed;
+        }
+        double total_time = tim.get_elapsed_secs();
+        console::info("Texture successfully loaded in %3.3fs", total_time);
+
+        file_utils::get_file_size(pSrc_filename, job.m_input_bytes);
+        job.m_total_texels = src_tex.get_total_pixels_in_all_faces_and_mips();
+
+        if (convert_to_luma)
+        {
+            src_tex.convert(image_utils::cConversion_Y_To_RGB);
+        }
+        if (set_alpha_to_luma)
+        {
+            src_tex.convert(image_utils::cConversion_Y_To_A);
+        }
+
+        params.m_texture_type = src_tex.determine_texture_type();
+        params.m_pInput_texture = &src_tex;
+
         print_texture_info("Source texture", params, src_tex);
 
         if (params.m_texture_type == cTextureTypeNormalMap)
@@ -1397,6 +1702,11 @@ private:
 
         console::info("Texture successfully processed in %3.3fs", total_time);
 
+        if ((!cache_key.is_empty()) && (!m_cache.store(cache_key, out_file_type, pDst_filename)))
+        {
+            console::warning("Failed adding output file \"%s\" to the cache", pDst_filename);
+        }
+
         if (!m_params.get_value_as_bool("nostats"))
         {
             print_stats(stats);
@@ -1475,6 +1785,26 @@ static int main_internal(int argc, char* argv[])
         corpus_tester tester;
         status = tester.test(cmd_line.get_ptr());
     }
+    else if (check_for_option(argc, argv, "thread_scaling_test"))
+    {
+        thread_scaling_tester tester;
+        status = tester.test(cmd_line.get_ptr());
+    }
+    else if (check_for_option(argc, argv, "block_compress_test"))
+    {
+        block_compress_tester tester;
+        status = tester.test(cmd_line.get_ptr());
+    }
+    else if (check_for_option(argc, argv, "dxt1_simd_test"))
+    {
+        dxt1_simd_tester tester;
+        status = tester.test(cmd_line.get_ptr());
+    }
+    else if (check_for_option(argc, argv, "semaphore_stress_test"))
+    {
+        semaphore_stress_tester tester;
+        status = tester.test(cmd_line.get_ptr());
+    }
     else
     {
         crunch converter;
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2010-2016 Richard Geldreich, Jr. and Binomial LLC
+ * Copyright (c) 2020 FrozenStorm Interactive, Yoann Potinet
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation or credits
+ *    is required.
+ * 
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "crn_core.h"
+#include "dxt1_simd_test.h"
+#include "crn_console.h"
+#include "crn_image_utils.h"
+#include "crn_strutils.h"
+#include "crn_timer.h"
+
+using namespace crnlib;
+
+namespace crn
+{
+    bool dxt1_simd_tester::test(const char* pCmd_line)
+    {
+        console::printf("Command line:\n\"%s\"", pCmd_line);
+
+        static const command_line_params::param_desc param_desc_array[] =
+        {
+            { "dxt1_simd_test", 0, false },
+            { "in", 1, false },
+            { "runs", 1, false },
+        };
+
+        command_line_params cmd_line_params;
+        if (!cmd_line_params.parse(pCmd_line, CRNLIB_ARRAY_SIZE(param_desc_array), param_desc_array, true))
+        {
+            return false;
+        }
+
+        dynamic_string filename;
+        if (!cmd_line_params.get_value_as_string("in", 0, filename))
+        {
+            console::error("Must specify an input file using the /in option!");
+            return false;
+        }
+
+        image_u8 img;
+        if (!image_utils::read_from_file(img, filename.get_ptr(), 0))
+        {
+            console::error("Failed loading image file: %s", filename.get_ptr());
+            return false;
+        }
+
+        uint num_runs = cmd_line_params.get_value_as_int("runs", 0, 1, 1, 100);
+
+        const uint width = img.get_width();
+        const uint height = img.get_height();
+        const uint num_blocks = ((width + cDXTBlockSize - 1) / cDXTBlockSize) * ((height + cDXTBlockSize - 1) / cDXTBlockSize);
+        const crn_uint32* pPixels = reinterpret_cast<const crn_uint32*>(img.get_ptr());
+        const uint row_pitch = img.get_pitch() * sizeof(crn_uint32);
+
+        enum
+        {
+            cNumSIMDLevels = 3
+        };
+        static const char* s_simd_level_names[cNumSIMDLevels] = { "scalar", "SSE4.1", "AVX2" };
+        static const uint s_simd_levels[cNumSIMDLevels] = { 0, 2, 3 };
+        const bool simd_level_supported[cNumSIMDLevels] = { true, crnlib_cpu_has_sse41(), crnlib_cpu_has_avx2() };
+
+        console::printf("Image: %ux%u (%u blocks), format: DXT1, single thread, best of %u run(s)", width, height, num_blocks, num_runs);
+        console::printf("Quality    Block types %14s %14s %14s   (blocks/s, speedup over scalar)", s_simd_level_names[0], s_simd_level_names[1], s_simd_level_names[2]);
+
+        crnlib::vector<uint8> blocks(num_blocks * crn_get_bytes_per_dxt_block(cCRNFmtDXT1));
+        crnlib::vector<uint8> reference_blocks;
+        bool status = true;
+
+        for (uint quality = 0; quality < cCRNDXTQualityTotal; quality++)
+        {
+            // With 3 color blocks allowed the optimizer evaluates trials with evaluate_solution_uber(), and at uber quality
+            // with 4 color blocks only it uses the evaluate_solution_hc_*() kernels.
+            for (uint both_block_types = 1;; both_block_types = 0)
+            {
+                crn_comp_params comp_params;
+                comp_params.m_format = cCRNFmtDXT1;
+                comp_params.m_dxt_quality = static_cast<crn_dxt_quality>(quality);
+                comp_params.set_flag(cCRNCompFlagUseBothBlockTypes, both_block_types != 0);
+
+                dynamic_string line(cVarArg, "%-10s %-11s", crn_get_dxt_quality_string(comp_params.m_dxt_quality), both_block_types ? "3 and 4" : "4");
+                double scalar_time = 0.0f;
+
+                for (uint simd_level = 0; simd_level < cNumSIMDLevels; simd_level++)
+                {
+                    if (!simd_level_supported[simd_level])
+                    {
+                        line += dynamic_string(cVarArg, " %14s", "n/a");
+                        continue;
+                    }
+
+                    crnlib_set_max_simd_level(s_simd_levels[simd_level]);
+                    crn_block_compressor_context_t pContext = crn_create_block_compressor(comp_params);
+                    if (!pContext)
+                    {
+                        console::error("Failed creating a block compressor!");
+                        crnlib_set_max_simd_level(cUINT32_MAX);
+                        return false;
+                    }
+
+                    double best_time = 0.0f;
+                    for (uint run = 0; run < num_runs; run++)
+                    {
+                        timer t;
+                        t.start();
+                        bool compressed = crn_compress_blocks(pContext, pPixels, width, height, row_pitch, blocks.get_ptr());
+                        double time = t.get_elapsed_secs();
+                        if (!compressed)
+                        {
+                            console::error("crn_compress_blocks failed!");
+                            crn_free_block_compressor(pContext);
+                            crnlib_set_max_simd_level(cUINT32_MAX);
+                            return false;
+                        }
+                        if ((!run) || (time < best_time))
+                        {
+                            best_time = time;
+                        }
+                    }
+                    crn_free_block_compressor(pContext);
+
+                    if (!simd_level)
+                    {
+                        scalar_time = best_time;
+                        reference_blocks = blocks;
+                        line += dynamic_string(cVarArg, " %14.0f", best_time > 0.0f ? num_blocks / best_time : 0.0f);
+                    }
+                    else if (blocks != reference_blocks)
+                    {
+                        line += dynamic_string(cVarArg, " %14s", "MISMATCH");
+                        status = false;
+                    }
+                    else
+                    {
+                        line += dynamic_string(cVarArg, " %7.0f %5.2fx", best_time > 0.0f ? num_blocks / best_time : 0.0f, best_time > 0.0f ? scalar_time / best_time : 1.0f);
+                    }
+                }
+
+                console::printf("%s", line.get_ptr());
+
+                if (!both_block_types)
+                {
+                    break;
+                }
+            }
+        }
+
+        crnlib_set_max_simd_level(cUINT32_MAX);
+
+        if (!status)
+        {
+            console::error("The SIMD kernels produced different blocks than the scalar code!");
+        }
+
+        return status;
+    }
+} // namespace crn
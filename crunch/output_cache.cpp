@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2010-2016 Richard Geldreich, Jr. and Binomial LLC
+ * Copyright (c) 2020 FrozenStorm Interactive, Yoann Potinet
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation or credits
+ *    is required.
+ * 
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#include "crn_core.h"
+#include "output_cache.h"
+#include "crn_cfile_stream.h"
+#include "crn_mapped_file_stream.h"
+#include "crn_file_utils.h"
+#include "crn_find_files.h"
+#include "crn_hash.h"
+
+using namespace crnlib;
+
+namespace crn
+{
+    // Bump whenever the key layout below changes.
+    const uint32 cOutputCacheKeyVersion = 1;
+
+    // Temporary files older than this (in seconds) were left behind by a crunch process that died during a store().
+    const uint64 cStaleTempFileAge = 24 * 60 * 60;
+
+    static void append_bytes(crnlib::vector<uint8>& buf, const void* p, uint32 size)
+    {
+        buf.append(static_cast<const uint8*>(p), size);
+    }
+
+    static void append_uint32(crnlib::vector<uint8>& buf, uint32 v)
+    {
+        append_bytes(buf, &v, sizeof(v));
+    }
+
+    static void append_float(crnlib::vector<uint8>& buf, float v)
+    {
+        append_bytes(buf, &v, sizeof(v));
+    }
+
+    static void append_string(crnlib::vector<uint8>& buf, const char* p)
+    {
+        uint32 len = static_cast<uint32>(strlen(p));
+        append_uint32(buf, len);
+        append_bytes(buf, p, len);
+    }
+
+    // Writes an exact copy of pSrc_filename to pDst_filename.
+    static bool copy_file(const char* pSrc_filename, const char* pDst_filename)
+    {
+        crnlib::vector<uint8> buf;
+        if ((!cfile_stream::read_file_into_array(pSrc_filename, buf)) || (buf.empty()))
+        {
+            return false;
+        }
+
+        cfile_stream out_stream(pDst_filename, cDataStreamWritable | cDataStreamSeekable);
+        if (!out_stream.is_opened())
+        {
+            return false;
+        }
+
+        bool status = out_stream.write_array(buf);
+        return out_stream.close() && status;
+    }
+
+    output_cache::output_cache():
+        m_max_size(0),
+        m_use_hardlinks(false)
+    {
+    }
+
+    bool output_cache::init(const char* pDir, uint64 max_size, bool use_hardlinks)
+    {
+        m_dir = pDir;
+        if ((m_dir.is_empty()) || (!file_utils::full_path(m_dir)))
+        {
+            m_dir.clear();
+            return false;
+        }
+
+        if ((!file_utils::does_dir_exist(m_dir.get_ptr())) && (!file_utils::create_path(m_dir)))
+        {
+            m_dir.clear();
+            return false;
+        }
+
+        m_max_size = max_size;
+        m_use_hardlinks = use_hardlinks;
+        return true;
+    }
+
+    bool output_cache::compute_key(const char* pSrc_filename, const texture_conversion::convert_params& params, uint32 extra_flags, dynamic_string& key) const
+    {
+        mapped_file_stream src_stream;
+        crnlib::vector<uint8> src_buf;
+        const uint8* pSrc_data;
+        uint src_size;
+        if ((!src_stream.open(pSrc_filename)) || (!src_stream.read_remaining(src_buf, pSrc_data, src_size)))
+        {
+            return false;
+        }
+
+        uint64 src_hash[2];
+        murmur3_hash128(pSrc_data, src_size, 0, src_hash);
+
+        // Everything that can change the output file's bytes. Pointers, the destination filename and options that
+        // only affect the console output are left out.
+        crnlib::vector<uint8> desc;
+        append_uint32(desc, cOutputCacheKeyVersion);
+        append_string(desc, crn_get_version());
+        append_bytes(desc, src_hash, sizeof(src_hash));
+        append_uint32(desc, texture_file_types::determine_file_format(pSrc_filename));
+        append_uint32(desc, extra_flags);
+
+        append_uint32(desc, params.m_dst_file_type);
+        append_uint32(desc, params.m_dst_format);
+        append_uint32(desc, params.m_y_flip);
+        append_uint32(desc, params.m_unflip);
+        append_uint32(desc, params.m_always_use_source_pixel_format);
+        append_uint32(desc, params.m_write_mipmaps_to_multiple_files);
+        append_uint32(desc, params.m_quick);
+
+        const crn_comp_params& comp_params = params.m_comp_params;
+        append_uint32(desc, comp_params.m_file_type);
+        append_uint32(desc, comp_params.m_faces);
+        append_uint32(desc, comp_params.m_width);
+        append_uint32(desc, comp_params.m_height);
+        append_uint32(desc, comp_params.m_levels);
+        append_uint32(desc, comp_params.m_format);
+        append_uint32(desc, comp_params.m_flags & ~cCRNCompFlagDebugging);
+        append_float(desc, comp_params.m_target_bitrate);
+        append_uint32(desc, comp_params.m_quality_level);
+        append_uint32(desc, comp_params.m_dxt1a_alpha_threshold);
+        append_uint32(desc, comp_params.m_dxt_quality);
+        append_uint32(desc, comp_params.m_dxt_compressor_type);
+        append_uint32(desc, comp_params.m_alpha_component);
+        append_float(desc, comp_params.m_crn_adaptive_tile_color_psnr_derating);
+        append_float(desc, comp_params.m_crn_adaptive_tile_alpha_psnr_derating);
+        append_uint32(desc, comp_params.m_crn_color_endpoint_palette_size);
+        append_uint32(desc, comp_params.m_crn_color_selector_palette_size);
+        append_uint32(desc, comp_params.m_crn_alpha_endpoint_palette_size);
+        append_uint32(desc, comp_params.m_crn_alpha_selector_palette_size);
+        // The clusterizers split their work by thread, so the output depends on the number of helper threads.
+        append_uint32(desc, comp_params.m_num_helper_threads);
+        append_uint32(desc, comp_params.m_userdata0);
+        append_uint32(desc, comp_params.m_userdata1);
+
+        const crn_mipmap_params& mip_params = params.m_mipmap_params;
+        append_uint32(desc, mip_params.m_mode);
+        append_uint32(desc, mip_params.m_filter);
+        append_uint32(desc, mip_params.m_gamma_filtering);
+        append_float(desc, mip_params.m_gamma);
+        append_float(desc, mip_params.m_blurriness);
+        append_uint32(desc, mip_params.m_max_levels);
+        append_uint32(desc, mip_params.m_min_mip_size);
+        append_uint32(desc, mip_params.m_renormalize);
+        append_uint32(desc, mip_params.m_rtopmip);
+        append_uint32(desc, mip_params.m_tiled);
+        append_uint32(desc, mip_params.m_scale_mode);
+        append_float(desc, mip_params.m_scale_x);
+        append_float(desc, mip_params.m_scale_y);
+        append_uint32(desc, mip_params.m_window_left);
+        append_uint32(desc, mip_params.m_window_top);
+        append_uint32(desc, mip_params.m_window_right);
+        append_uint32(desc, mip_params.m_window_bottom);
+        append_uint32(desc, mip_params.m_clamp_scale);
+        append_uint32(desc, mip_params.m_clamp_width);
+        append_uint32(desc, mip_params.m_clamp_height);
+        append_uint32(desc, mip_params.m_pyramid);
+
+        uint64 hash[2];
+        murmur3_hash128(desc.get_ptr(), desc.size(), 0, hash);
+
+        key.format("%08x%08x%08x%08x", static_cast<uint32>(hash[0] >> 32U), static_cast<uint32>(hash[0]), static_cast<uint32>(hash[1] >> 32U), static_cast<uint32>(hash[1]));
+        return true;
+    }
+
+    void output_cache::get_entry_dir(const dynamic_string& key, dynamic_string& dir) const
+    {
+        // Entries are spread over 256 subdirectories to keep directory sizes reasonable.
+        dynamic_string prefix(key);
+        prefix.left(2);
+        file_utils::combine_path(dir, m_dir.get_ptr(), prefix.get_ptr());
+    }
+
+    void output_cache::get_entry_filename(const dynamic_string& key, texture_file_types::format file_type, dynamic_string& filename) const
+    {
+        dynamic_string dir, name;
+        get_entry_dir(key, dir);
+        name.format("%s.%s", key.get_ptr(), texture_file_types::get_extension(file_type));
+        file_utils::combine_path(filename, dir.get_ptr(), name.get_ptr());
+    }
+
+    bool output_cache::fetch(const dynamic_string& key, texture_file_types::format file_type, const char* pDst_filename) const
+    {
+        dynamic_string entry_filename;
+        get_entry_filename(key, file_type, entry_filename);
+
+        if (!file_utils::does_file_exist(entry_filename.get_ptr()))
+        {
+            return false;
+        }
+
+        bool status = false;
+        if (m_use_hardlinks)
+        {
+            file_utils::delete_file(pDst_filename);
+            status = file_utils::link_file(entry_filename.get_ptr(), pDst_filename);
+        }
+
+        // Also covers links across volumes. Fails if the entry was evicted by another process in the meantime.
+        if (!status)
+        {
+            status = copy_file(entry_filename.get_ptr(), pDst_filename);
+        }
+
+        if (status)
+        {
+            file_utils::touch_file(entry_filename.get_ptr());
+        }
+
+        return status;
+    }
+
+    bool output_cache::store(const dynamic_string& key, texture_file_types::format file_type, const char* pSrc_filename) const
+    {
+        dynamic_string entry_dir, entry_filename;
+        get_entry_dir(key, entry_dir);
+        get_entry_filename(key, file_type, entry_filename);
+
+        if ((!file_utils::does_dir_exist(entry_dir.get_ptr())) && (!file_utils::create_path(entry_dir)))
+        {
+            return false;
+        }
+
+        // Always copy, so the entry can't be changed by a later write to the output file. Readers only ever see
+        // complete entries because the copy is renamed into place.
+        dynamic_string temp_filename;
+        if (!file_utils::create_temp_file(entry_dir.get_ptr(), temp_filename))
+        {
+            return false;
+        }
+
+        if ((!copy_file(pSrc_filename, temp_filename.get_ptr())) || (!file_utils::rename_file(temp_filename.get_ptr(), entry_filename.get_ptr())))
+        {
+            file_utils::delete_file(temp_filename.get_ptr());
+            return false;
+        }
+
+        return true;
+    }
+
+    struct cache_entry
+    {
+        uint64 m_time;
+        uint64 m_size;
+        dynamic_string m_filename;
+
+        bool operator<(const cache_entry& rhs) const
+        {
+            if (m_time != rhs.m_time)
+            {
+                return m_time < rhs.m_time;
+            }
+            return m_filename < rhs.m_filename;
+        }
+    };
+
+    void output_cache::trim() const
+    {
+        find_files file_finder;
+        if (!file_finder.find(m_dir.get_ptr(), "*", find_files::cFlagAllowFiles | find_files::cFlagRecursive))
+        {
+            return;
+        }
+
+        // Read the current time off a fresh file, so it uses the same clock as the entries.
+        uint64 now = 0;
+        dynamic_string now_filename;
+        if (file_utils::create_temp_file(m_dir.get_ptr(), now_filename))
+        {
+            file_utils::get_file_time(now_filename.get_ptr(), now);
+            file_utils::delete_file(now_filename.get_ptr());
+        }
+
+        const find_files::file_desc_vec& files = file_finder.get_files();
+
+        crnlib::vector<cache_entry> entries;
+        entries.reserve(files.size());
+
+        uint64 total_size = 0;
+        for (uint32 i = 0; i < files.size(); i++)
+        {
+            const dynamic_string& filename = files[i].m_fullname;
+
+            cache_entry entry;
+            if ((!file_utils::get_file_time(filename.get_ptr(), entry.m_time)) || (!file_utils::get_file_size(filename.get_ptr(), entry.m_size)))
+            {
+                continue;
+            }
+
+            // Keys are hex strings, so only temporary files start with "crn".
+            if (!_strnicmp(files[i].m_name.get_ptr(), "crn", 3))
+            {
+                if ((now) && (now > entry.m_time) && (now - entry.m_time > cStaleTempFileAge))
+                {
+                    file_utils::delete_file(filename.get_ptr());
+                }
+                continue;
+            }
+
+            entry.m_filename = filename;
+            entries.push_back(entry);
+            total_size += entry.m_size;
+        }
+
+        if ((!m_max_size) || (total_size <= m_max_size))
+        {
+            return;
+        }
+
+        std::sort(entries.begin(), entries.end());
+
+        for (uint32 i = 0; (i < entries.size()) && (total_size > m_max_size); i++)
+        {
+            // Another process may have evicted or refreshed the entry already, either way it no longer counts.
+            file_utils::delete_file(entries[i].m_filename.get_ptr());
+            total_size -= entries[i].m_size;
+        }
+    }
+} // namespace crn
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2010-2016 Richard Geldreich, Jr. and Binomial LLC
+ * Copyright (c) 2020 FrozenStorm Interactive, Yoann Potinet
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation or credits
+ *    is required.
+ * 
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+
+#pragma once
+
+#include "crn_texture_conversion.h"
+
+namespace crn
+{
+    // Content-addressed store of crunch output files, keyed on the input file's bytes, the effective conversion
+    // parameters and the crnlib version. The cache directory is its own index, so any number of crunch processes
+    // may share it: entries are published with an atomic rename and the least recently used ones are evicted by
+    // modification time.
+    class output_cache
+    {
+        CRNLIB_NO_COPY_OR_ASSIGNMENT_OP(output_cache);
+
+    public:
+        output_cache();
+
+        // max_size is in bytes, 0=unlimited.
+        // With use_hardlinks, fetch() links the output file to the entry, so writing to the output in place modifies the entry too.
+        bool init(const char* pDir, crnlib::uint64 max_size, bool use_hardlinks);
+
+        inline bool is_enabled() const
+        {
+            return !m_dir.is_empty();
+        }
+
+        inline bool uses_hardlinks() const
+        {
+            return m_use_hardlinks;
+        }
+
+        // Computes the cache key of converting pSrc_filename with params. extra_flags covers crunch options applied
+        // to the source texture before conversion.
+        bool compute_key(const char* pSrc_filename, const crnlib::texture_conversion::convert_params& params, crnlib::uint32 extra_flags, crnlib::dynamic_string& key) const;
+
+        // Writes the cached output for key to pDst_filename. Returns false on a miss.
+        bool fetch(const crnlib::dynamic_string& key, crnlib::texture_file_types::format file_type, const char* pDst_filename) const;
+
+        // Adds pSrc_filename to the cache under key, replacing any existing entry.
+        bool store(const crnlib::dynamic_string& key, crnlib::texture_file_types::format file_type, const char* pSrc_filename) const;
+
+        // Deletes the least recently used entries until the cache fits in its maximum size.
+        void trim() const;
+
+    private:
+        crnlib::dynamic_string m_dir;
+        crnlib::uint64 m_max_size;
+        bool m_use_hardlinks;
+
+        void get_entry_dir(const crnlib::dynamic_string& key, crnlib::dynamic_string& dir) const;
+        void get_entry_filename(const crnlib::dynamic_string& key, crnlib::texture_file_types::format file_type, crnlib::dynamic_string& filename) const;
+    };
+} // namespace crn
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2010-2016 Richard Geldreich, Jr. and Binomial LLC
+ * Copyright (c) 2020 FrozenStorm Interactive, Yoann Potinet
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation or credits
+ *    is required.
+ * 
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "crn_core.h"
+#include "semaphore_stress_test.h"
+#include "crn_console.h"
+#include "crn_threading.h"
+#include "crn_timer.h"
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace crnlib;
+
+namespace crn
+{
+    namespace
+    {
+        // The two semaphores of a ping-pong pair, and the step the token is at.
+        struct semaphore_pair
+        {
+            semaphore* m_pPing;
+            semaphore* m_pPong;
+            volatile atomic32_t m_step;
+            volatile atomic32_t m_num_out_of_order;
+        };
+
+        struct stress_params
+        {
+            semaphore_pair* m_pPairs;
+            uint m_num_round_trips;
+        };
+
+        enum
+        {
+            cHandoffTimeoutMS = 2000
+        };
+
+        // Task 2 * i pings pair i and task 2 * i + 1 pongs it. Each checks that the other side's step is visible when its wait returns.
+        void ping_pong_task(uint64 data, void* pData_ptr)
+        {
+            const stress_params& params = *static_cast<const stress_params*>(pData_ptr);
+            semaphore_pair& pair = params.m_pPairs[data >> 1];
+            const bool ping = !(data & 1);
+
+            for (uint i = 0; i < params.m_num_round_trips; i++)
+            {
+                if (ping)
+                {
+                    atomic_exchange32(&pair.m_step, 2 * i + 1);
+                    pair.m_pPing->release();
+                    if ((!pair.m_pPong->wait(cHandoffTimeoutMS)) || (pair.m_step != static_cast<atomic32_t>(2 * i + 2)))
+                    {
+                        atomic_increment32(&pair.m_num_out_of_order);
+                    }
+                }
+                else
+                {
+                    if ((!pair.m_pPing->wait(cHandoffTimeoutMS)) || (pair.m_step != static_cast<atomic32_t>(2 * i + 1)))
+                    {
+                        atomic_increment32(&pair.m_num_out_of_order);
+                    }
+                    atomic_exchange32(&pair.m_step, 2 * i + 2);
+                    pair.m_pPong->release();
+                }
+            }
+        }
+
+        // Runs num_pools pools of 2 * num_pairs threads at once, and returns the number of out of order handoffs, or -1 if the threads couldn't be created.
+        int run_pools(uint num_pools, uint num_pairs, uint num_round_trips)
+        {
+            crnlib::vector<task_pool*> pools(num_pools);
+            crnlib::vector<semaphore_pair> pairs(num_pools * num_pairs);
+            crnlib::vector<stress_params> params(num_pools);
+            bool threads_created = true;
+
+            for (uint i = 0; i < pairs.size(); i++)
+            {
+                pairs[i].m_pPing = crnlib_new<semaphore>(0, 1);
+                pairs[i].m_pPong = crnlib_new<semaphore>(0, 1);
+                pairs[i].m_step = 0;
+                pairs[i].m_num_out_of_order = 0;
+            }
+
+            // Every task blocks until its partner runs, so each one needs a thread of its own.
+            for (uint p = 0; p < num_pools; p++)
+            {
+                pools[p] = crnlib_new<task_pool>();
+                if ((!pools[p]->init(num_pairs * 2)) || (pools[p]->get_num_threads() < num_pairs * 2))
+                {
+                    threads_created = false;
+                    continue;
+                }
+
+                params[p].m_pPairs = &pairs[p * num_pairs];
+                params[p].m_num_round_trips = num_round_trips;
+                for (uint i = 0; i < num_pairs * 2; i++)
+                {
+                    pools[p]->queue_task(ping_pong_task, i, &params[p]);
+                }
+            }
+
+            int num_out_of_order = 0;
+            for (uint p = 0; p < num_pools; p++)
+            {
+                pools[p]->join();
+                crnlib_delete(pools[p]);
+            }
+            for (uint i = 0; i < pairs.size(); i++)
+            {
+                num_out_of_order += pairs[i].m_num_out_of_order;
+                crnlib_delete(pairs[i].m_pPing);
+                crnlib_delete(pairs[i].m_pPong);
+            }
+
+            return threads_created ? num_out_of_order : -1;
+        }
+    }
+
+    bool semaphore_stress_tester::test(const char* pCmd_line)
+    {
+        console::printf("Command line:\n\"%s\"", pCmd_line);
+
+        static const command_line_params::param_desc param_desc_array[] =
+        {
+            { "semaphore_stress_test", 0, false },
+            { "processes", 1, false },
+            { "pools", 1, false },
+            { "pairs", 1, false },
+            { "roundTrips", 1, false },
+        };
+
+        command_line_params cmd_line_params;
+        if (!cmd_line_params.parse(pCmd_line, CRNLIB_ARRAY_SIZE(param_desc_array), param_desc_array, true))
+        {
+            return false;
+        }
+
+        uint num_processes = cmd_line_params.get_value_as_int("processes", 0, 4, 1, 64);
+        const uint num_pools = cmd_line_params.get_value_as_int("pools", 0, 4, 1, 64);
+        const uint num_pairs = cmd_line_params.get_value_as_int("pairs", 0, 2, 1, 512);
+        const uint num_round_trips = cmd_line_params.get_value_as_int("roundTrips", 0, 2000, 1, 10000000);
+
+#ifdef _WIN32
+        if (num_processes > 1)
+        {
+            console::warning("Running a single process: -processes needs fork().");
+            num_processes = 1;
+        }
+#endif
+
+        bool status = true;
+
+        // A release of one semaphore must not be visible to another one, and a timed wait must wait.
+        {
+            semaphore a(0, 1), b(0, 1);
+            a.release();
+            const bool isolated = !b.wait(0) && a.wait(0);
+
+            timer t;
+            t.start();
+            const bool timed_out = !b.wait(50);
+            const double wait_time = t.get_elapsed_ms();
+
+            console::printf("Isolation: %s, wait(50) %s after %.0f ms", isolated ? "ok" : "FAILED", timed_out ? "timed out" : "returned", wait_time);
+            status = isolated && timed_out && (wait_time >= 40.0f);
+        }
+
+        // release() clamps the count to the maximum and returns false, try_release() fails and leaves the count unchanged.
+        {
+            semaphore s(1, 3);
+            const bool released = s.release(1) && !s.release(5) && !s.try_release(1);
+            uint count = 0;
+            while (s.wait(0))
+            {
+                count++;
+            }
+
+            console::printf("Release past the maximum: %s, count %u", released ? "ok" : "FAILED", count);
+            status = status && released && (count == 3);
+        }
+
+        console::printf("%u process(es) x %u pool(s) x %u pair(s) x %u round trip(s)", num_processes, num_pools, num_pairs, num_round_trips);
+
+        timer t;
+        t.start();
+
+#ifdef _WIN32
+        const int num_out_of_order = run_pools(num_pools, num_pairs, num_round_trips);
+        if (num_out_of_order < 0)
+        {
+            console::error("Failed creating the task pool threads!");
+            return false;
+        }
+        console::printf("Process 0: %d out of order", num_out_of_order);
+        status = status && !num_out_of_order;
+#else
+        // The output of the children goes through stdout only, so flush first to avoid duplicating buffered text.
+        fflush(stdout);
+        for (uint i = 0; i < num_processes; i++)
+        {
+            pid_t pid = fork();
+            if (pid < 0)
+            {
+                console::error("fork() failed!");
+                status = false;
+                num_processes = i;
+                break;
+            }
+            if (!pid)
+            {
+                timer process_time;
+                process_time.start();
+                const int num_out_of_order = run_pools(num_pools, num_pairs, num_round_trips);
+                printf("Process %u: %d out of order, %3.3fs\n", i, num_out_of_order, process_time.get_elapsed_secs());
+                fflush(stdout);
+                _exit(num_out_of_order ? EXIT_FAILURE : EXIT_SUCCESS);
+            }
+        }
+
+        uint num_failed = 0;
+        for (uint i = 0; i < num_processes; i++)
+        {
+            int process_status = 0;
+            if ((wait(&process_status) < 0) || !WIFEXITED(process_status) || (WEXITSTATUS(process_status) != EXIT_SUCCESS))
+            {
+                num_failed++;
+            }
+        }
+        if (num_failed)
+        {
+            console::error("%u process(es) saw out of order handoffs or failed to run!", num_failed);
+            status = false;
+        }
+#endif
+
+        console::printf("Total time: %3.3fs", t.get_elapsed_secs());
+
+        return status;
+    }
+} // namespace crn
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2010-2016 Richard Geldreich, Jr. and Binomial LLC
+ * Copyright (c) 2020 FrozenStorm Interactive, Yoann Potinet
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ * 
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ * 
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation or credits
+ *    is required.
+ * 
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#include "crn_core.h"
+#include "thread_scaling_test.h"
+#include "crn_console.h"
+#include "crn_image_utils.h"
+#include "crn_strutils.h"
+#include "crn_timer.h"
+#include "crn_threading.h"
+
+using namespace crnlib;
+
+namespace crn
+{
+    bool thread_scaling_tester::test(const char* pCmd_line)
+    {
+        console::printf("Command line:\n\"%s\"", pCmd_line);
+
+        static const command_line_params::param_desc param_desc_array[] =
+        {
+            { "thread_scaling_test", 0, false },
+            { "in", 1, false },
+            { "format", 1, false },
+            { "quality", 1, false },
+            { "maxThreads", 1, false },
+            { "runs", 1, false },
+            { "nomips", 0, false },
+        };
+
+        command_line_params cmd_line_params;
+        if (!cmd_line_params.parse(pCmd_line, CRNLIB_ARRAY_SIZE(param_desc_array), param_desc_array, true))
+        {
+            return false;
+        }
+
+        dynamic_string filename;
+        if (!cmd_line_params.get_value_as_string("in", 0, filename))
+        {
+            console::error("Must specify an input file using the /in option!");
+            return false;
+        }
+
+        image_u8 img;
+        if (!image_utils::read_from_file(img, filename.get_ptr(), 0))
+        {
+            console::error("Failed loading image file: %s", filename.get_ptr());
+            return false;
+        }
+        if ((img.get_width() > cCRNMaxLevelResolution) || (img.get_height() > cCRNMaxLevelResolution))
+        {
+            console::error("Image is too large: %ux%u", img.get_width(), img.get_height());
+            return false;
+        }
+
+        crn_comp_params comp_params;
+        comp_params.m_width = img.get_width();
+        comp_params.m_height = img.get_height();
+        comp_params.m_pImages[0][0] = reinterpret_cast<const crn_uint32*>(img.get_ptr());
+        comp_params.m_quality_level = cmd_line_params.get_value_as_int("quality", 0, cCRNMaxQualityLevel, cCRNMinQualityLevel, cCRNMaxQualityLevel);
+
+        dynamic_string format;
+        if (cmd_line_params.get_value_as_string("format", 0, format))
+        {
+            uint fmt = cCRNFmtDXT1;
+            while ((fmt < cCRNFmtTotal) && crn_stricmp(format.get_ptr(), crn_get_format_string(static_cast<crn_format>(fmt))))
+            {
+                fmt++;
+            }
+            if (fmt == cCRNFmtTotal)
+            {
+                console::error("Unknown format: %s", format.get_ptr());
+                return false;
+            }
+            comp_params.m_format = static_cast<crn_format>(fmt);
+        }
+
+        crn_mipmap_params mip_params;
+        if (cmd_line_params.get_value_as_bool("nomips"))
+        {
+            mip_params.m_mode = cCRNMipModeNoMips;
+        }
+
+        uint max_threads = cmd_line_params.get_value_as_int("maxThreads", 0, g_number_of_processors, 1, cINT32_MAX);
+        uint num_runs = cmd_line_params.get_value_as_int("runs", 0, 1, 1, 100);
+
+        crnlib::vector<uint> thread_counts;
+        crnlib::vector<double> times;
+        crnlib::vector<crn_uint32> sizes;
+        for (uint num_threads = 1;; num_threads = math::minimum(num_threads * 2, max_threads))
+        {
+            comp_params.m_num_helper_threads = num_threads - 1;
+
+            double best_time = 0.0f;
+            crn_uint32 compressed_size = 0;
+            for (uint run = 0; run < num_runs; run++)
+            {
+                timer t;
+                t.start();
+                void* pData = crn_compress(comp_params, mip_params, compressed_size);
+                double time = t.get_elapsed_secs();
+                if (!pData)
+                {
+                    console::error("Compression failed with %u thread(s)!", num_threads);
+                    return false;
+                }
+                crn_free_block(pData);
+
+                if ((!run) || (time < best_time))
+                {
+                    best_time = time;
+                }
+            }
+
+            thread_counts.push_back(num_threads);
+            times.push_back(best_time);
+            sizes.push_back(compressed_size);
+
+            if (num_threads == max_threads)
+            {
+                break;
+            }
+        }
+
+        console::printf("Image: %ux%u, format: %s, %u CPU's, best of %u run(s)", img.get_width(), img.get_height(), crn_get_format_string(comp_params.m_format), g_number_of_processors, num_runs);
+        console::printf("Threads     Time  Speedup  Efficiency    Size");
+        for (uint i = 0; i < thread_counts.size(); i++)
+        {
+            double speedup = times[i] > 0.0f ? times[0] / times[i] : 1.0f;
+            console::printf("%7u %7.3fs %7.2fx %10.1f%% %7u", thread_counts[i], times[i], speedup, speedup * 100.0f / thread_counts[i], sizes[i]);
+        }
+
+        return true;
+    }
+} // namespace crn
@@ -23,8 +23,14 @@
 
 #pragma once
 
-#include "crn_core.h"
+#include "crn_command_line_params.h"
 
-#include <semaphore.h>
-
-int sem_timedwait(sem_t* sem, const struct timespec* abs_timeout);
+namespace crn
+{
+    // Compresses one image with an increasing number of threads and prints the speedup over a single thread.
+    class thread_scaling_tester
+    {
+    public:
+        bool test(const char* pCmd_line);
+    };
+} // namespace crn
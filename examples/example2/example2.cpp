@@ -35,6 +35,9 @@
 #include <stdio.h>
 #include <math.h>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 // CRN transcoder library.
 #include "crn_decomp.h"
@@ -54,6 +57,7 @@ static int print_usage()
     printf("Usage: example2 [source_file] [options]\n");
     printf("\nOptions:\n");
     printf("-out filename - Force output filename.\n");
+    printf("-threads # - Transcode the slices of each level on # threads (files written with -slicedLevels).\n");
     return EXIT_FAILURE;
 }
 
@@ -68,6 +72,26 @@ static int error(const char* pMsg, ...)
     return EXIT_FAILURE;
 }
 
+// A minimal crnd_parallel_for_func: spawns up to num_threads threads which pull task indices until none are left.
+// A real engine would hand the tasks to its own job system instead.
+static bool parallel_for(crnd::crnd_task_func pTask, void* pTask_data, crn_uint32 num_tasks, void* pUser_data)
+{
+    crn_uint32 num_threads = std::min(*static_cast<crn_uint32*>(pUser_data), num_tasks);
+    std::atomic<crn_uint32> next_task(0);
+    auto worker = [&]() {
+        for (crn_uint32 i; (i = next_task++) < num_tasks;)
+            pTask(i, pTask_data);
+    };
+
+    std::vector<std::thread> threads;
+    for (crn_uint32 i = 1; i < num_threads; i++)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& t : threads)
+        t.join();
+    return true;
+}
+
 // Loads an entire file into an allocated memory block.
 static crn_uint8* read_file_into_buffer(const char* pFilename, crn_uint32& size)
 {
@@ -105,6 +129,7 @@ int main(int argc, char* argv[])
     // Parse command line options
     const char* pSrc_filename = argv[1];
     char out_filename[FILENAME_MAX] = { '\0' };
+    crn_uint32 num_threads = 1;
 
     for (int i = 2; i < argc; i++)
     {
@@ -118,6 +143,15 @@ int main(int argc, char* argv[])
 
             strcpy_s(out_filename, sizeof(out_filename), argv[i]);
         }
+        else if (!_stricmp(argv[i], "-threads"))
+        {
+            if (++i >= argc)
+                return error("Expected number of threads!");
+
+            num_threads = atoi(argv[i]);
+            if (num_threads < 1)
+                return error("Invalid number of threads!");
+        }
         else
             return error("Invalid option: %s\n", argv[i]);
     }
@@ -164,6 +198,9 @@ int main(int argc, char* argv[])
         return error("crnd_unpack_begin() failed!\n");
     }
 
+    if (num_threads > 1)
+        printf("Transcoding on %u threads, level 0 slices: %u\n", num_threads, crnd::crnd_get_level_slice_count(pContext, 0));
+
     // Now create the DDS file.
     char dst_filename[FILENAME_MAX];
     sprintf_s(dst_filename, sizeof(dst_filename), "%s%s%s.dds", drive_buf, dir_buf, fname_buf);
@@ -267,7 +304,12 @@ int main(int argc, char* argv[])
 
         // Now transcode the level to raw DXTn
         tm.start();
-        if (!crnd::crnd_unpack_level(pContext, pDecomp_images, total_face_size, row_pitch, level_index))
+        bool unpacked;
+        if (num_threads > 1)
+            unpacked = crnd::crnd_unpack_level_parallel(pContext, pDecomp_images, total_face_size, row_pitch, level_index, parallel_for, &num_threads);
+        else
+            unpacked = crnd::crnd_unpack_level(pContext, pDecomp_images, total_face_size, row_pitch, level_index);
+        if (!unpacked)
         {
             for (crn_uint32 f = 0; f < cCRNMaxFaces; f++)
                 for (crn_uint32 l = 0; l < cCRNMaxLevels; l++)
@@ -53,6 +53,14 @@
 
 #define CRND_RESTRICT __restrict
 
+// SSE2 is part of the x64 baseline, so it needs no runtime detection.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define CRND_SSE2 1
+#include <emmintrin.h>
+#else
+#define CRND_SSE2 0
+#endif
+
 #ifdef _MSC_VER
 #pragma warning(disable : 4127)  // warning C4127: conditional expression is constant
 #endif
@@ -1069,6 +1077,7 @@ namespace crnd
 namespace crnd
 {
     const crn_header* crnd_get_header(const void* pData, uint32 data_size);
+    uint32 crnd_get_level_end_ofs(const crn_header* pHeader, uint32 level_index, uint32 data_size);
 } // namespace crnd
 
 // File: checksum.h
@@ -1808,7 +1817,9 @@ namespace crnd
     {
         const uint32 cMaxExpectedCodeSize = 16;
         const uint32 cMaxSupportedSyms = 8192;
-        const uint32 cMaxTableBits = 11;
+        // Large palettes have many 12 and 13 bit codes, which would otherwise take the slow path in symbol_codec::decode().
+        // The bigger tables take ~15us longer to build, which only shows on files of a couple of KB.
+        const uint32 cMaxTableBits = 13;
 
         class decoder_tables
         {
@@ -1983,10 +1994,11 @@ namespace crnd
         const uint8* m_pDecode_buf_end;
         uint32 m_decode_buf_size;
 
-        typedef uint32 bit_buf_type;
+        typedef uint64 bit_buf_type;
 
-        enum { cBitBufSize = 32U };
+        enum { cBitBufSize = 64U };
 
+        // The bit buffer is MSB aligned: the next bit to decode is bit 63.
         bit_buf_type m_bit_buf;
 
         int m_bit_count;
@@ -1994,6 +2006,7 @@ namespace crnd
     private:
         void get_bits_init();
         uint32 get_bits(uint32 num_bits);
+        void refill();
     };
 } // namespace crnd
 
@@ -2660,7 +2673,10 @@ namespace crnd
             return NULL;
 
         const crn_header& file_header = *static_cast<const crn_header*>(pData);
-        if (file_header.m_sig != crn_header::cCRNSigValue)
+        if (file_header.m_sig != ((file_header.m_flags & cCRNHeaderFlagsExtended) ? crn_header::cCRNSigValueExtended : crn_header::cCRNSigValue))
+            return NULL;
+
+        if (file_header.m_flags & ~cCRNHeaderFlagsKnown)
             return NULL;
 
         if ((file_header.m_header_size < sizeof(crn_header)) || (data_size < file_header.m_data_size))
@@ -2669,6 +2685,22 @@ namespace crnd
         return &file_header;
     }
 
+    // Returns the offset just past the level's data: the start of the level stored after it, or data_size for the last stored level.
+    uint32 crnd_get_level_end_ofs(const crn_header* pHeader, uint32 level_index, uint32 data_size)
+    {
+        const uint32 cur_level_ofs = pHeader->m_level_ofs[level_index];
+
+        uint32 end_ofs = data_size;
+        for (uint32 i = 0; i < pHeader->m_levels; i++)
+        {
+            const uint32 level_ofs = pHeader->m_level_ofs[i];
+            if ((level_ofs > cur_level_ofs) && (level_ofs < end_ofs))
+                end_ofs = level_ofs;
+        }
+
+        return end_ofs;
+    }
+
     bool crnd_validate_file(const void* pData, uint32 data_size, crn_file_info* pFile_info)
     {
         if (pFile_info)
@@ -2715,15 +2747,7 @@ namespace crnd
             pFile_info->m_levels = pHeader->m_levels;
 
             for (uint32 i = 0; i < pHeader->m_levels; i++)
-            {
-                uint32 next_ofs = pHeader->m_data_size;
-
-                // assumes the levels are packed together sequentially
-                if ((i + 1) < pHeader->m_levels)
-                    next_ofs = pHeader->m_level_ofs[i + 1];
-
-                pFile_info->m_level_compressed_size[i] = next_ofs - pHeader->m_level_ofs[i];
-            }
+                pFile_info->m_level_compressed_size[i] = crnd_get_level_end_ofs(pHeader, i, pHeader->m_data_size) - pHeader->m_level_ofs[i];
 
             pFile_info->m_color_endpoint_palette_entries = pHeader->m_color_endpoints.m_num;
             pFile_info->m_color_selector_palette_entries = pHeader->m_color_selectors.m_num;;
@@ -2805,13 +2829,7 @@ namespace crnd
         uint32 cur_level_ofs = pHeader->m_level_ofs[level_index];
 
         if (pSize)
-        {
-            uint32 next_level_ofs = data_size;
-            if ((level_index + 1) < (pHeader->m_levels))
-                next_level_ofs = pHeader->m_level_ofs[level_index + 1];
-
-            *pSize = next_level_ofs - cur_level_ofs;
-        }
+            *pSize = crnd_get_level_end_ofs(pHeader, level_index, data_size) - cur_level_ofs;
 
         return static_cast<const uint8*>(pData) + cur_level_ofs;
     }
@@ -3183,39 +3201,48 @@ namespace crnd
         return result;
     }
 
-    uint32 symbol_codec::decode(const static_huffman_data_model& model)
+    // Tops the bit buffer up to at least 56 bits.
+    // While 8 or more bytes are left, this is a single big endian 64-bit load, which also copies some bits of the next byte
+    // below m_bit_count. Those are the same bits that the next refill will OR in, so they don't need to be masked.
+    // Past the end of the buffer the stream is padded with zeros, like get_bits() does.
+    inline void symbol_codec::refill()
     {
-        const prefix_coding::decoder_tables* pTables = model.m_pDecode_tables;
-
-        if (m_bit_count < 24)
+        const uint8* p = m_pDecode_buf_next;
+        if (m_pDecode_buf_end - p >= 8)
         {
-            if (m_bit_count < 16)
-            {
-                uint32 c0 = 0, c1 = 0;
-                const uint8* p = m_pDecode_buf_next;
-                if (p < m_pDecode_buf_end)
-                    c0 = *p++;
-                if (p < m_pDecode_buf_end)
-                    c1 = *p++;
-                m_pDecode_buf_next = p;
-                m_bit_count += 16;
-                uint32 c = (c0 << 8) | c1;
-                m_bit_buf |= (c << (32 - m_bit_count));
-            }
-            else
+            bit_buf_type c = ((bit_buf_type)p[0] << 56) | ((bit_buf_type)p[1] << 48) | ((bit_buf_type)p[2] << 40) | ((bit_buf_type)p[3] << 32) |
+                ((bit_buf_type)p[4] << 24) | ((bit_buf_type)p[5] << 16) | ((bit_buf_type)p[6] << 8) | (bit_buf_type)p[7];
+            m_bit_buf |= c >> m_bit_count;
+            m_pDecode_buf_next = p + ((63 - m_bit_count) >> 3);
+            m_bit_count |= 56;
+        }
+        else
+        {
+            while (m_bit_count <= 56)
             {
-                uint32 c = (m_pDecode_buf_next < m_pDecode_buf_end) ? *m_pDecode_buf_next++ : 0;
+                bit_buf_type c = (p < m_pDecode_buf_end) ? *p++ : 0;
                 m_bit_count += 8;
-                m_bit_buf |= (c << (32 - m_bit_count));
+                m_bit_buf |= (c << (cBitBufSize - m_bit_count));
             }
+            m_pDecode_buf_next = p;
         }
+    }
+
+    uint32 symbol_codec::decode(const static_huffman_data_model& model)
+    {
+        const prefix_coding::decoder_tables* pTables = model.m_pDecode_tables;
+
+        // Codes are at most 16 bits, and a refill leaves at least 56 bits in the buffer, so this only refills every few symbols.
+        if (m_bit_count < 16)
+            refill();
 
-        uint32 k = (m_bit_buf >> 16) + 1;
+        const uint32 code = static_cast<uint32>(m_bit_buf >> 48);
+        uint32 k = code + 1;
         uint32 sym, len;
 
         if (k <= pTables->m_table_max_code)
         {
-            uint32 t = pTables->m_lookup[m_bit_buf >> (32 - pTables->m_table_bits)];
+            uint32 t = pTables->m_lookup[code >> (16 - pTables->m_table_bits)];
 
             CRND_ASSERT(t != cUINT32_MAX);
             sym = t & cUINT16_MAX;
@@ -3234,7 +3261,7 @@ namespace crnd
                 len++;
             }
 
-            int val_ptr = pTables->m_val_ptrs[len - 1] + (m_bit_buf >> (32 - len));
+            int val_ptr = pTables->m_val_ptrs[len - 1] + (code >> (16 - len));
 
             if (((uint32)val_ptr >= model.m_total_syms))
             {
@@ -3265,6 +3292,19 @@ namespace crnd
     const uint8 g_dxt1_from_linear[cDXT1SelectorValues] = { 0U, 2U, 3U, 1U };
     const uint8 g_etc1_from_linear[cDXT1SelectorValues] = { 3U, 2U, 0U, 1U };
 
+    // ETC1 intensity modifiers indexed by (selector msb << 1 | lsb).
+    const int32 g_etc1_modifier_table[8][cDXT1SelectorValues] = {
+        { 2, 8, -2, -8 }, { 5, 17, -5, -17 }, { 9, 29, -9, -29 }, { 13, 42, -13, -42 },
+        { 18, 60, -18, -60 }, { 24, 80, -24, -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 }
+    };
+
+    const int32 g_etc2a_modifier_table[16][cDXT5SelectorValues] = {
+        { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 }, { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+        { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 }, { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+        { -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 }, { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+        { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 }, { -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 }
+    };
+
     const uint8 g_dxt5_to_linear[cDXT5SelectorValues] = { 0U, 7U, 1U, 2U, 3U, 4U, 5U, 6U };
     const uint8 g_dxt5_from_linear[cDXT5SelectorValues] = { 0U, 2U, 3U, 4U, 5U, 6U, 7U, 1U };
 
@@ -3502,7 +3542,8 @@ namespace crnd
             m_magic(cMagicValue),
             m_pData(NULL),
             m_data_size(0),
-            m_pHeader(NULL)
+            m_pHeader(NULL),
+            m_rgba_tables_valid(false)
         {
         }
 
@@ -3538,15 +3579,10 @@ namespace crnd
             void** pDst, uint32 dst_size_in_bytes, uint32 row_pitch_in_bytes,
             uint32 level_index)
         {
-            uint32 cur_level_ofs = m_pHeader->m_level_ofs[level_index];
-
-            uint32 next_level_ofs = m_data_size;
-            if ((level_index + 1) < (m_pHeader->m_levels))
-                next_level_ofs = m_pHeader->m_level_ofs[level_index + 1];
+            uint32 src_size_in_bytes;
+            const uint8* pSrc = get_level_data(level_index, src_size_in_bytes);
 
-            CRND_ASSERT(next_level_ofs > cur_level_ofs);
-
-            return unpack_level(m_pData + cur_level_ofs, next_level_ofs - cur_level_ofs, pDst, dst_size_in_bytes, row_pitch_in_bytes, level_index);
+            return unpack_level(pSrc, src_size_in_bytes, pDst, dst_size_in_bytes, row_pitch_in_bytes, level_index);
         }
 
         bool unpack_level(
@@ -3560,64 +3596,126 @@ namespace crnd
                     return false;
 #endif
 
+            uint32 blocks_x, blocks_y;
+            if (!get_level_layout(level_index, dst_size_in_bytes, row_pitch_in_bytes, blocks_x, blocks_y))
+                return false;
+
+            const uint32 num_slices = get_num_slices(pSrc, src_size_in_bytes, blocks_y);
+            if (!num_slices)
+                return false;
+
+            block_writer writer(*this, (uint8**)pDst, row_pitch_in_bytes);
+            for (uint32 slice_index = 0; slice_index < num_slices; slice_index++)
+            {
+                if (!unpack_slice(m_codec, m_block_buffer, pSrc, src_size_in_bytes, writer, blocks_x, blocks_y, slice_index))
+                    return false;
+            }
+
+            return true;
+        }
+
+        bool unpack_level_parallel(
+            void** pDst, uint32 dst_size_in_bytes, uint32 row_pitch_in_bytes,
+            uint32 level_index,
+            crnd_parallel_for_func pParallel_for, void* pUser_data)
+        {
+            if (level_index >= m_pHeader->m_levels)
+                return false;
+
+            uint32 src_size_in_bytes;
+            const uint8* pSrc = get_level_data(level_index, src_size_in_bytes);
+
+            uint32 blocks_x, blocks_y;
+            if (!get_level_layout(level_index, dst_size_in_bytes, row_pitch_in_bytes, blocks_x, blocks_y))
+                return false;
+
+            const uint32 num_slices = get_num_slices(pSrc, src_size_in_bytes, blocks_y);
+            if (num_slices < 2)
+                return unpack_level(pSrc, src_size_in_bytes, pDst, dst_size_in_bytes, row_pitch_in_bytes, level_index);
+
+            crnd::vector<uint8> slice_status;
+            if (!slice_status.resize(num_slices))
+                return false;
+
+            parallel_unpack_state state;
+            state.m_pUnpacker = this;
+            state.m_pSrc = pSrc;
+            state.m_src_size_in_bytes = src_size_in_bytes;
+            state.m_pDst = (uint8**)pDst;
+            state.m_row_pitch_in_bytes = row_pitch_in_bytes;
+            state.m_blocks_x = blocks_x;
+            state.m_blocks_y = blocks_y;
+            state.m_pSlice_status = &slice_status[0];
+
+            if (!pParallel_for(&unpack_slice_task, &state, num_slices, pUser_data))
+                return false;
+
+            for (uint32 slice_index = 0; slice_index < num_slices; slice_index++)
+            {
+                if (!slice_status[slice_index])
+                    return false;
+            }
+
+            return true;
+        }
+
+        bool unpack_level_rgba(void** pDst, uint32 dst_size_in_bytes, uint32 row_pitch_in_bytes, uint32 level_index)
+        {
+#ifdef CRND_BUILD_DEBUG
+            for (uint32 f = 0; f < m_pHeader->m_faces; f++)
+                if (!pDst[f])
+                    return false;
+#endif
+
+            if (level_index >= m_pHeader->m_levels)
+                return false;
+
             const uint32 width = math::maximum(m_pHeader->m_width >> level_index, 1U);
             const uint32 height = math::maximum(m_pHeader->m_height >> level_index, 1U);
-            const uint32 blocks_x = (width + 3U) >> 2U;
-            const uint32 blocks_y = (height + 3U) >> 2U;
-            const uint32 block_size = m_pHeader->m_format == cCRNFmtDXT1 || m_pHeader->m_format == cCRNFmtDXT5A || m_pHeader->m_format == cCRNFmtETC1 || m_pHeader->m_format == cCRNFmtETC2 || m_pHeader->m_format == cCRNFmtETC1S ? 8 : 16;
-
-            uint32 minimal_row_pitch = block_size * blocks_x;
             if (!row_pitch_in_bytes)
-                row_pitch_in_bytes = minimal_row_pitch;
-            else if ((row_pitch_in_bytes < minimal_row_pitch) || (row_pitch_in_bytes & 3))
+                row_pitch_in_bytes = width << 2;
+            else if ((row_pitch_in_bytes < (width << 2)) || (row_pitch_in_bytes & 3))
                 return false;
-            if (dst_size_in_bytes < row_pitch_in_bytes * blocks_y)
+            if (dst_size_in_bytes < row_pitch_in_bytes * (height - 1) + (width << 2))
                 return false;
 
-            if (!m_codec.start_decoding(static_cast<const crnd::uint8*>(pSrc), src_size_in_bytes))
+            if (!m_rgba_tables_valid)
+            {
+                if (!init_rgba_tables())
+                    return false;
+                m_rgba_tables_valid = true;
+            }
+
+            uint32 src_size_in_bytes;
+            const uint8* pSrc = get_level_data(level_index, src_size_in_bytes);
+            const uint32 blocks_x = (width + 3U) >> 2U;
+            const uint32 blocks_y = (height + 3U) >> 2U;
+
+            const uint32 num_slices = get_num_slices(pSrc, src_size_in_bytes, blocks_y);
+            if (!num_slices)
                 return false;
 
-            bool status = false;
-            switch (m_pHeader->m_format)
+            rgba_writer writer(*this, (uint8**)pDst, row_pitch_in_bytes, width, height);
+            for (uint32 slice_index = 0; slice_index < num_slices; slice_index++)
             {
-                case cCRNFmtDXT1:
-                case cCRNFmtETC1S:
-                    status = unpack_dxt1((uint8**)pDst, row_pitch_in_bytes, blocks_x, blocks_y);
-                    break;
-                case cCRNFmtDXT5:
-                case cCRNFmtDXT5_CCxY:
-                case cCRNFmtDXT5_xGBR:
-                case cCRNFmtDXT5_AGBR:
-                case cCRNFmtDXT5_xGxR:
-                case cCRNFmtETC2AS:
-                    status = unpack_dxt5((uint8**)pDst, row_pitch_in_bytes, blocks_x, blocks_y);
-                    break;
-                case cCRNFmtDXT5A:
-                    status = unpack_dxt5a((uint8**)pDst, row_pitch_in_bytes, blocks_x, blocks_y);
-                    break;
-                case cCRNFmtDXN_XY:
-                case cCRNFmtDXN_YX:
-                    status = unpack_dxn((uint8**)pDst, row_pitch_in_bytes, blocks_x, blocks_y);
-                    break;
-                case cCRNFmtETC1:
-                    status = unpack_etc1((uint8**)pDst, row_pitch_in_bytes, blocks_x, blocks_y);
-                    break;
-                case cCRNFmtETC2:
-                    status = unpack_etc1((uint8**)pDst, row_pitch_in_bytes, blocks_x, blocks_y);
-                    break;
-                case cCRNFmtETC2A:
-                    status = unpack_etc2a((uint8**)pDst, row_pitch_in_bytes, blocks_x, blocks_y);
-                    break;
-                default:
+                if (!unpack_slice(m_codec, m_block_buffer, pSrc, src_size_in_bytes, writer, blocks_x, blocks_y, slice_index))
                     return false;
             }
-            if (!status)
-                return false;
 
-            m_codec.stop_decoding();
             return true;
         }
 
+        uint32 get_level_slice_count(uint32 level_index) const
+        {
+            if (level_index >= m_pHeader->m_levels)
+                return 0;
+
+            uint32 src_size_in_bytes;
+            const uint8* pSrc = get_level_data(level_index, src_size_in_bytes);
+            const uint32 height = math::maximum(m_pHeader->m_height >> level_index, 1U);
+            return get_num_slices(pSrc, src_size_in_bytes, (height + 3U) >> 2U);
+        }
+
         inline const void* get_data() const
         {
             return m_pData;
@@ -3649,6 +3747,13 @@ namespace crnd
         crnd::vector<uint16> m_alpha_endpoints;
         crnd::vector<uint16> m_alpha_selectors;
 
+        // Palettes expanded for unpack_level_rgba(), built on its first call.
+        bool m_rgba_tables_valid;
+        crnd::vector<uint32> m_rgba_colors;
+        crnd::vector<uint8> m_rgba_color_selectors;
+        crnd::vector<uint8> m_rgba_alpha_values;
+        crnd::vector<uint8> m_rgba_alpha_selectors;
+
         struct block_buffer_element
         {
             uint16 endpoint_reference;
@@ -3659,6 +3764,169 @@ namespace crnd
 
         crnd::vector<block_buffer_element> m_block_buffer;
 
+        // Faces and block rows of a level covered by one symbol stream.
+        struct level_slice
+        {
+            uint32 first_face;
+            uint32 end_face;
+            uint32 first_row;
+            uint32 end_row;
+        };
+
+        struct parallel_unpack_state
+        {
+            const crn_unpacker* m_pUnpacker;
+            const uint8* m_pSrc;
+            uint32 m_src_size_in_bytes;
+            uint8** m_pDst;
+            uint32 m_row_pitch_in_bytes;
+            uint32 m_blocks_x;
+            uint32 m_blocks_y;
+            uint8* m_pSlice_status;
+        };
+
+        const uint8* get_level_data(uint32 level_index, uint32& size) const
+        {
+            uint32 cur_level_ofs = m_pHeader->m_level_ofs[level_index];
+            uint32 next_level_ofs = crnd_get_level_end_ofs(m_pHeader, level_index, m_data_size);
+
+            CRND_ASSERT(next_level_ofs > cur_level_ofs);
+
+            size = next_level_ofs - cur_level_ofs;
+            return m_pData + cur_level_ofs;
+        }
+
+        bool get_level_layout(uint32 level_index, uint32 dst_size_in_bytes, uint32& row_pitch_in_bytes, uint32& blocks_x, uint32& blocks_y) const
+        {
+            const uint32 width = math::maximum(m_pHeader->m_width >> level_index, 1U);
+            const uint32 height = math::maximum(m_pHeader->m_height >> level_index, 1U);
+            blocks_x = (width + 3U) >> 2U;
+            blocks_y = (height + 3U) >> 2U;
+            const uint32 block_size = m_pHeader->m_format == cCRNFmtDXT1 || m_pHeader->m_format == cCRNFmtDXT5A || m_pHeader->m_format == cCRNFmtETC1 || m_pHeader->m_format == cCRNFmtETC2 || m_pHeader->m_format == cCRNFmtETC1S ? 8 : 16;
+
+            uint32 minimal_row_pitch = block_size * blocks_x;
+            if (!row_pitch_in_bytes)
+                row_pitch_in_bytes = minimal_row_pitch;
+            else if ((row_pitch_in_bytes < minimal_row_pitch) || (row_pitch_in_bytes & 3))
+                return false;
+            if (dst_size_in_bytes < row_pitch_in_bytes * blocks_y)
+                return false;
+
+            return true;
+        }
+
+        // Returns the number of slices in the level's data, or 0 if its slice table is invalid.
+        uint32 get_num_slices(const void* pSrc, uint32 src_size_in_bytes, uint32 blocks_y) const
+        {
+            if (!(m_pHeader->m_flags & cCRNHeaderFlagSliced))
+                return 1;
+
+            if (src_size_in_bytes < sizeof(crn_level_slices))
+                return 0;
+
+            const crn_level_slices& slices = *static_cast<const crn_level_slices*>(pSrc);
+            const uint32 slice_height = slices.m_slice_height;
+            if ((!slice_height) || (slice_height & 1))
+                return 0;
+
+            const uint32 num_slices = m_pHeader->m_faces * ((((blocks_y + 1) & ~1) + slice_height - 1) / slice_height);
+            if ((slices.m_num_slices != num_slices) || (src_size_in_bytes < sizeof(crn_level_slices) + sizeof(slices.m_slice_ofs[0]) * (num_slices - 1)))
+                return 0;
+
+            return num_slices;
+        }
+
+        // Decodes one slice of a level using the given codec and block buffer, so different slices can be decoded concurrently.
+        // The level's slice table must have been validated by get_num_slices().
+        template <typename T>
+        bool unpack_slice(
+            symbol_codec& codec, crnd::vector<block_buffer_element>& block_buffer,
+            const void* pSrc, uint32 src_size_in_bytes,
+            T& writer, uint32 blocks_x, uint32 blocks_y,
+            uint32 slice_index) const
+        {
+            const uint8* pSlice_src = static_cast<const uint8*>(pSrc);
+            uint32 slice_size_in_bytes = src_size_in_bytes;
+            level_slice slice = { 0, m_pHeader->m_faces, 0, (blocks_y + 1) & ~1U };
+
+            if (m_pHeader->m_flags & cCRNHeaderFlagSliced)
+            {
+                const crn_level_slices& slices = *static_cast<const crn_level_slices*>(pSrc);
+                const uint32 slice_height = slices.m_slice_height;
+                const uint32 slices_per_face = slices.m_num_slices / m_pHeader->m_faces;
+
+                const uint32 slice_ofs = slices.m_slice_ofs[slice_index];
+                uint32 next_slice_ofs = src_size_in_bytes;
+                if ((slice_index + 1) < slices.m_num_slices)
+                    next_slice_ofs = slices.m_slice_ofs[slice_index + 1];
+                if ((slice_ofs >= next_slice_ofs) || (next_slice_ofs > src_size_in_bytes))
+                    return false;
+
+                pSlice_src += slice_ofs;
+                slice_size_in_bytes = next_slice_ofs - slice_ofs;
+
+                slice.first_face = slice_index / slices_per_face;
+                slice.end_face = slice.first_face + 1;
+                slice.first_row = slice_index % slices_per_face * slice_height;
+                slice.end_row = math::minimum(slice.first_row + slice_height, slice.end_row);
+            }
+
+            if (!codec.start_decoding(pSlice_src, slice_size_in_bytes))
+                return false;
+
+            bool status = false;
+            switch (m_pHeader->m_format)
+            {
+                case cCRNFmtDXT1:
+                case cCRNFmtETC1S:
+                    status = unpack_dxt1(codec, block_buffer, writer, blocks_x, blocks_y, slice);
+                    break;
+                case cCRNFmtDXT5:
+                case cCRNFmtDXT5_CCxY:
+                case cCRNFmtDXT5_xGBR:
+                case cCRNFmtDXT5_AGBR:
+                case cCRNFmtDXT5_xGxR:
+                case cCRNFmtETC2AS:
+                    status = unpack_dxt5(codec, block_buffer, writer, blocks_x, blocks_y, slice);
+                    break;
+                case cCRNFmtDXT5A:
+                    status = unpack_dxt5a(codec, block_buffer, writer, blocks_x, blocks_y, slice);
+                    break;
+                case cCRNFmtDXN_XY:
+                case cCRNFmtDXN_YX:
+                    status = unpack_dxn(codec, block_buffer, writer, blocks_x, blocks_y, slice);
+                    break;
+                case cCRNFmtETC1:
+                    status = unpack_etc1(codec, block_buffer, writer, blocks_x, blocks_y, slice);
+                    break;
+                case cCRNFmtETC2:
+                    status = unpack_etc1(codec, block_buffer, writer, blocks_x, blocks_y, slice);
+                    break;
+                case cCRNFmtETC2A:
+                    status = unpack_etc2a(codec, block_buffer, writer, blocks_x, blocks_y, slice);
+                    break;
+                default:
+                    return false;
+            }
+            if (!status)
+                return false;
+
+            codec.stop_decoding();
+            return true;
+        }
+
+        static void unpack_slice_task(uint32 slice_index, void* pTask_data)
+        {
+            const parallel_unpack_state& state = *static_cast<const parallel_unpack_state*>(pTask_data);
+
+            symbol_codec codec;
+            crnd::vector<block_buffer_element> block_buffer;
+            block_writer writer(*state.m_pUnpacker, state.m_pDst, state.m_row_pitch_in_bytes);
+            state.m_pSlice_status[slice_index] = state.m_pUnpacker->unpack_slice(
+                codec, block_buffer, state.m_pSrc, state.m_src_size_in_bytes,
+                writer, state.m_blocks_x, state.m_blocks_y, slice_index);
+        }
+
         bool init_tables()
         {
             if (!m_codec.start_decoding(m_pData + m_pHeader->m_tables_ofs, m_pHeader->m_tables_size))
@@ -3941,97 +4209,578 @@ namespace crnd
             x = (x & msk) | (v & ~msk);
         }
 
-        bool unpack_dxt1(uint8** pDst, uint32 output_pitch_in_bytes, uint32 output_width, uint32 output_height)
+        // Packs the first half of an ETC1 block for two subblock endpoints, using differential mode when they are close enough.
+        static inline uint32 get_etc1_block_endpoint(uint32 endpoint0, uint32 endpoint1, uint32 flip, uint32& diff)
         {
-            const uint32 num_color_endpoints = m_color_endpoints.size();
-            const uint32 width = (output_width + 1) & ~1;
-            const uint32 height = (output_height + 1) & ~1;
-            const int32 delta_pitch_in_dwords = (output_pitch_in_bytes >> 2) - (width << 1);
+            uint8 block_endpoint[4], e0[4], e1[4];
+            *(uint32*)&e0 = endpoint0;
+            *(uint32*)&e1 = endpoint1;
+            diff = 1;
+            for (uint c = 0; diff && c < 3; c++)
+                diff = e0[c] + 3 >= e1[c] && e1[c] + 4 >= e0[c] ? diff : 0;
+            for (uint c = 0; c < 3; c++)
+                block_endpoint[c] = diff ? e0[c] << 3 | ((e1[c] - e0[c]) & 7) : (e0[c] << 3 & 0xF0) | e1[c] >> 1;
+            block_endpoint[3] = e0[3] << 5 | e1[3] << 2 | diff << 1 | flip;
+            return *(uint32*)&block_endpoint;
+        }
 
-            if (m_block_buffer.size() < width)
-                m_block_buffer.resize(width);
+        // Writes the decoded blocks in their DXTn/ETC format.
+        class block_writer
+        {
+        public:
+            block_writer(const crn_unpacker& unpacker, uint8** pDst, uint32 row_pitch_in_bytes) :
+                m_unpacker(unpacker),
+                m_pDst(pDst),
+                m_row_pitch_in_bytes(row_pitch_in_bytes),
+                m_pRow(NULL)
+            {
+            }
 
-            uint32 color_endpoint_index = 0;
-            uint8 reference_group = 0;
+            inline void begin_row(uint32 face, uint32 block_y)
+            {
+                m_pRow = reinterpret_cast<uint32*>(m_pDst[face] + block_y * m_row_pitch_in_bytes);
+            }
 
-            for (uint32 f = 0; f < m_pHeader->m_faces; f++)
+            inline void write_dxt1(uint32 block_x, uint32 color_endpoint_index, uint32 color_selector_index)
             {
-                uint32* pData = (uint32*)pDst[f];
-                for (uint32 y = 0; y < height; y++, pData += delta_pitch_in_dwords)
-                {
-                    bool visible = y < output_height;
-                    for (uint32 x = 0; x < width; x++, pData += 2)
-                    {
-                        visible = visible && x < output_width;
-                        if (!(y & 1) && !(x & 1))
-                            reference_group = m_codec.decode(m_reference_encoding_dm);
-                        block_buffer_element& buffer = m_block_buffer[x];
-                        uint8 endpoint_reference;
-                        if (y & 1)
-                        {
-                            endpoint_reference = buffer.endpoint_reference;
-                        }
-                        else
-                        {
-                            endpoint_reference = reference_group & 3;
-                            reference_group >>= 2;
-                            buffer.endpoint_reference = reference_group & 3;
-                            reference_group >>= 2;
-                        }
-                        if (!endpoint_reference)
-                        {
-                            color_endpoint_index += m_codec.decode(m_endpoint_delta_dm[0]);
-                            if (color_endpoint_index >= num_color_endpoints)
-                                color_endpoint_index -= num_color_endpoints;
-                            buffer.color_endpoint_index = color_endpoint_index;
-                        }
-                        else if (endpoint_reference == 1)
-                        {
-                            buffer.color_endpoint_index = color_endpoint_index;
-                        }
+                uint32* pData = m_pRow + (block_x << 1);
+                pData[0] = m_unpacker.m_color_endpoints[color_endpoint_index];
+                pData[1] = m_unpacker.m_color_selectors[color_selector_index];
+            }
+
+            inline void write_dxt5(uint32 block_x, uint32 color_endpoint_index, uint32 color_selector_index, uint32 alpha0_endpoint_index, uint32 alpha0_selector_index)
+            {
+                uint32* pData = m_pRow + (block_x << 2);
+                const uint16* pAlpha0_selectors = &m_unpacker.m_alpha_selectors[alpha0_selector_index * 3];
+                pData[0] = m_unpacker.m_alpha_endpoints[alpha0_endpoint_index] | (pAlpha0_selectors[0] << 16);
+                pData[1] = pAlpha0_selectors[1] | (pAlpha0_selectors[2] << 16);
+                pData[2] = m_unpacker.m_color_endpoints[color_endpoint_index];
+                pData[3] = m_unpacker.m_color_selectors[color_selector_index];
+            }
+
+            inline void write_dxt5a(uint32 block_x, uint32 alpha0_endpoint_index, uint32 alpha0_selector_index)
+            {
+                uint32* pData = m_pRow + (block_x << 1);
+                const uint16* pAlpha0_selectors = &m_unpacker.m_alpha_selectors[alpha0_selector_index * 3];
+                pData[0] = m_unpacker.m_alpha_endpoints[alpha0_endpoint_index] | (pAlpha0_selectors[0] << 16);
+                pData[1] = pAlpha0_selectors[1] | (pAlpha0_selectors[2] << 16);
+            }
+
+            inline void write_dxn(uint32 block_x, uint32 alpha0_endpoint_index, uint32 alpha0_selector_index, uint32 alpha1_endpoint_index, uint32 alpha1_selector_index)
+            {
+                uint32* pData = m_pRow + (block_x << 2);
+                const uint16* pAlpha0_selectors = &m_unpacker.m_alpha_selectors[alpha0_selector_index * 3];
+                const uint16* pAlpha1_selectors = &m_unpacker.m_alpha_selectors[alpha1_selector_index * 3];
+                pData[0] = m_unpacker.m_alpha_endpoints[alpha0_endpoint_index] | (pAlpha0_selectors[0] << 16);
+                pData[1] = pAlpha0_selectors[1] | (pAlpha0_selectors[2] << 16);
+                pData[2] = m_unpacker.m_alpha_endpoints[alpha1_endpoint_index] | (pAlpha1_selectors[0] << 16);
+                pData[3] = pAlpha1_selectors[1] | (pAlpha1_selectors[2] << 16);
+            }
+
+            inline void write_etc1(uint32 block_x, uint32 color_endpoint0_index, uint32 color_endpoint1_index, uint32 color_selector_index, uint32 flip)
+            {
+                uint32* pData = m_pRow + (block_x << 1);
+                uint32 diff;
+                pData[0] = get_etc1_block_endpoint(m_unpacker.m_color_endpoints[color_endpoint0_index], m_unpacker.m_color_endpoints[color_endpoint1_index], flip, diff);
+                pData[1] = m_unpacker.m_color_selectors[color_selector_index << 1 | flip];
+            }
+
+            inline void write_etc2a(uint32 block_x, uint32 color_endpoint0_index, uint32 color_endpoint1_index, uint32 color_selector_index, uint32 alpha0_endpoint_index, uint32 alpha0_selector_index, uint32 flip)
+            {
+                uint32* pData = m_pRow + (block_x << 2);
+                uint32 diff;
+                const uint16* pAlpha0_selectors = &m_unpacker.m_alpha_selectors[alpha0_selector_index * 6 + (flip ? 3 : 0)];
+                pData[0] = m_unpacker.m_alpha_endpoints[alpha0_endpoint_index] | pAlpha0_selectors[0] << 16;
+                pData[1] = pAlpha0_selectors[1] | pAlpha0_selectors[2] << 16;
+                pData[2] = get_etc1_block_endpoint(m_unpacker.m_color_endpoints[color_endpoint0_index], m_unpacker.m_color_endpoints[color_endpoint1_index], flip, diff);
+                pData[3] = m_unpacker.m_color_selectors[color_selector_index << 1 | flip];
+            }
+
+        private:
+            const crn_unpacker& m_unpacker;
+            uint8** m_pDst;
+            uint32 m_row_pitch_in_bytes;
+            uint32* m_pRow;
+        };
+
+        // Writes the decoded blocks as 32bpp RGBA pixels, looking up every block's colors in the tables built by init_rgba_tables().
+        class rgba_writer
+        {
+        public:
+            rgba_writer(const crn_unpacker& unpacker, uint8** pDst, uint32 row_pitch_in_bytes, uint32 width, uint32 height) :
+                m_unpacker(unpacker),
+                m_pDst(pDst),
+                m_row_pitch_in_bytes(row_pitch_in_bytes),
+                m_width(width),
+                m_height(height),
+                m_pRow(NULL),
+                m_num_rows(0),
+                m_dxn_yx(unpacker.m_pHeader->m_format == cCRNFmtDXN_YX)
+            {
+            }
+
+            inline void begin_row(uint32 face, uint32 block_y)
+            {
+                const uint32 y = block_y << 2;
+                m_pRow = m_pDst[face] + y * m_row_pitch_in_bytes;
+                m_num_rows = y < m_height ? math::minimum(m_height - y, 4U) : 0;
+            }
+
+            inline void write_dxt1(uint32 block_x, uint32 color_endpoint_index, uint32 color_selector_index)
+            {
+#if CRND_SSE2
+                __m128i rows[4];
+                get_color_rows(rows, color_endpoint_index, color_selector_index);
+                store_rows(block_x, rows);
+#else
+                uint32 pixels[16];
+                get_colors(pixels, color_endpoint_index, color_selector_index);
+                store(block_x, pixels);
+#endif
+            }
+
+            inline void write_dxt5(uint32 block_x, uint32 color_endpoint_index, uint32 color_selector_index, uint32 alpha0_endpoint_index, uint32 alpha0_selector_index)
+            {
+                uint8 alpha[16];
+                get_alpha(alpha, alpha0_endpoint_index, &m_unpacker.m_rgba_alpha_selectors[alpha0_selector_index << 4]);
+#if CRND_SSE2
+                __m128i rows[4];
+                get_color_rows(rows, color_endpoint_index, color_selector_index);
+
+                // Move each alpha byte to the top byte of its pixel.
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha));
+                const __m128i a_lo = _mm_unpacklo_epi8(zero, a);
+                const __m128i a_hi = _mm_unpackhi_epi8(zero, a);
+                rows[0] = _mm_or_si128(_mm_and_si128(rows[0], rgb_mask), _mm_unpacklo_epi16(zero, a_lo));
+                rows[1] = _mm_or_si128(_mm_and_si128(rows[1], rgb_mask), _mm_unpackhi_epi16(zero, a_lo));
+                rows[2] = _mm_or_si128(_mm_and_si128(rows[2], rgb_mask), _mm_unpacklo_epi16(zero, a_hi));
+                rows[3] = _mm_or_si128(_mm_and_si128(rows[3], rgb_mask), _mm_unpackhi_epi16(zero, a_hi));
+                store_rows(block_x, rows);
+#else
+                uint32 pixels[16];
+                get_colors(pixels, color_endpoint_index, color_selector_index);
+                set_alpha(pixels, alpha);
+                store(block_x, pixels);
+#endif
+            }
+
+            inline void write_dxt5a(uint32 block_x, uint32 alpha0_endpoint_index, uint32 alpha0_selector_index)
+            {
+                uint8 alpha[16];
+                get_alpha(alpha, alpha0_endpoint_index, &m_unpacker.m_rgba_alpha_selectors[alpha0_selector_index << 4]);
+#if CRND_SSE2
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha));
+                const __m128i a_lo = _mm_unpacklo_epi8(zero, a);
+                const __m128i a_hi = _mm_unpackhi_epi8(zero, a);
+                __m128i rows[4];
+                rows[0] = _mm_unpacklo_epi16(zero, a_lo);
+                rows[1] = _mm_unpackhi_epi16(zero, a_lo);
+                rows[2] = _mm_unpacklo_epi16(zero, a_hi);
+                rows[3] = _mm_unpackhi_epi16(zero, a_hi);
+                store_rows(block_x, rows);
+#else
+                uint32 pixels[16];
+                memset(pixels, 0, sizeof(pixels));
+                set_alpha(pixels, alpha);
+                store(block_x, pixels);
+#endif
+            }
+
+            inline void write_dxn(uint32 block_x, uint32 alpha0_endpoint_index, uint32 alpha0_selector_index, uint32 alpha1_endpoint_index, uint32 alpha1_selector_index)
+            {
+                uint8 alpha[2][16];
+                get_alpha(alpha[0], alpha0_endpoint_index, &m_unpacker.m_rgba_alpha_selectors[alpha0_selector_index << 4]);
+                get_alpha(alpha[1], alpha1_endpoint_index, &m_unpacker.m_rgba_alpha_selectors[alpha1_selector_index << 4]);
+                const uint8* pX = alpha[m_dxn_yx ? 1 : 0];
+                const uint8* pY = alpha[m_dxn_yx ? 0 : 1];
+#if CRND_SSE2
+                // Interleave X and Y, then append B=0 and A=255 to every pixel.
+                const __m128i ba = _mm_set1_epi16(static_cast<short>(0xFF00));
+                const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pX));
+                const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pY));
+                const __m128i xy_lo = _mm_unpacklo_epi8(x, y);
+                const __m128i xy_hi = _mm_unpackhi_epi8(x, y);
+                __m128i rows[4];
+                rows[0] = _mm_unpacklo_epi16(xy_lo, ba);
+                rows[1] = _mm_unpackhi_epi16(xy_lo, ba);
+                rows[2] = _mm_unpacklo_epi16(xy_hi, ba);
+                rows[3] = _mm_unpackhi_epi16(xy_hi, ba);
+                store_rows(block_x, rows);
+#else
+                uint32 pixels[16];
+                uint8* pBytes = reinterpret_cast<uint8*>(pixels);
+                for (uint32 i = 0; i < 16; i++, pBytes += 4)
+                {
+                    pBytes[0] = pX[i];
+                    pBytes[1] = pY[i];
+                    pBytes[2] = 0;
+                    pBytes[3] = 255;
+                }
+                store(block_x, pixels);
+#endif
+            }
+
+            inline void write_etc1(uint32 block_x, uint32 color_endpoint0_index, uint32 color_endpoint1_index, uint32 color_selector_index, uint32 flip)
+            {
+                uint32 pixels[16];
+                get_etc1_colors(pixels, color_endpoint0_index, color_endpoint1_index, color_selector_index, flip);
+                store(block_x, pixels);
+            }
+
+            inline void write_etc2a(uint32 block_x, uint32 color_endpoint0_index, uint32 color_endpoint1_index, uint32 color_selector_index, uint32 alpha0_endpoint_index, uint32 alpha0_selector_index, uint32 flip)
+            {
+                uint32 pixels[16];
+                get_etc1_colors(pixels, color_endpoint0_index, color_endpoint1_index, color_selector_index, flip);
+                uint8 alpha[16];
+                get_alpha(alpha, alpha0_endpoint_index, &m_unpacker.m_rgba_alpha_selectors[(alpha0_selector_index << 1 | flip) << 4]);
+                set_alpha(pixels, alpha);
+                store(block_x, pixels);
+            }
+
+        private:
+            const crn_unpacker& m_unpacker;
+            uint8** m_pDst;
+            uint32 m_row_pitch_in_bytes;
+            uint32 m_width;
+            uint32 m_height;
+            uint8* m_pRow;
+            uint32 m_num_rows;
+            bool m_dxn_yx;
+
+            inline void get_colors(uint32* pPixels, uint32 color_endpoint_index, uint32 color_selector_index) const
+            {
+                const uint32* pColors = &m_unpacker.m_rgba_colors[color_endpoint_index << 2];
+                const uint8* pSelectors = &m_unpacker.m_rgba_color_selectors[color_selector_index << 4];
+                for (uint32 i = 0; i < 16; i++)
+                    pPixels[i] = pColors[pSelectors[i]];
+            }
+
+            inline void get_etc1_colors(uint32* pPixels, uint32 color_endpoint0_index, uint32 color_endpoint1_index, uint32 color_selector_index, uint32 flip) const
+            {
+                uint32 diff;
+                get_etc1_block_endpoint(m_unpacker.m_color_endpoints[color_endpoint0_index], m_unpacker.m_color_endpoints[color_endpoint1_index], flip, diff);
+
+                // The selector table holds subblock << 2 | selector, so gather from both subblocks' colors at once.
+                uint32 colors[8];
+                const uint32 mode_ofs = diff ? 0 : 4;
+                memcpy(colors, &m_unpacker.m_rgba_colors[(color_endpoint0_index << 3) + mode_ofs], sizeof(uint32) * 4);
+                memcpy(colors + 4, &m_unpacker.m_rgba_colors[(color_endpoint1_index << 3) + mode_ofs], sizeof(uint32) * 4);
+
+                const uint8* pSelectors = &m_unpacker.m_rgba_color_selectors[(color_selector_index << 1 | flip) << 4];
+                for (uint32 i = 0; i < 16; i++)
+                    pPixels[i] = colors[pSelectors[i]];
+            }
+
+            inline void get_alpha(uint8* pAlpha, uint32 alpha_endpoint_index, const uint8* pSelectors) const
+            {
+                const uint8* pValues = &m_unpacker.m_rgba_alpha_values[alpha_endpoint_index << 3];
+                for (uint32 i = 0; i < 16; i++)
+                    pAlpha[i] = pValues[pSelectors[i]];
+            }
+
+            static inline void set_alpha(uint32* pPixels, const uint8* pAlpha)
+            {
+                uint8* pBytes = reinterpret_cast<uint8*>(pPixels);
+                for (uint32 i = 0; i < 16; i++)
+                    pBytes[(i << 2) + 3] = pAlpha[i];
+            }
+
+            // Copies the visible part of a block to the destination.
+            inline void store(uint32 block_x, const uint32* pPixels)
+            {
+                const uint32 x = block_x << 2;
+                const uint32 num_cols = math::minimum(m_width - x, 4U);
+                uint8* pDst_row = m_pRow + (x << 2);
+                for (uint32 y = 0; y < m_num_rows; y++, pDst_row += m_row_pitch_in_bytes, pPixels += 4)
+                {
+                    uint32* pDst = reinterpret_cast<uint32*>(pDst_row);
+                    for (uint32 i = 0; i < num_cols; i++)
+                        pDst[i] = pPixels[i];
+                }
+            }
+
+#if CRND_SSE2
+            // Selects each pixel's color from the block's 4 colors, 4 pixels at a time.
+            static inline __m128i select_colors(__m128i selectors, __m128i c0, __m128i c1, __m128i c2, __m128i c3)
+            {
+                __m128i result = _mm_and_si128(_mm_cmpeq_epi32(selectors, _mm_setzero_si128()), c0);
+                result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(selectors, _mm_set1_epi32(1)), c1));
+                result = _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(selectors, _mm_set1_epi32(2)), c2));
+                return _mm_or_si128(result, _mm_and_si128(_mm_cmpeq_epi32(selectors, _mm_set1_epi32(3)), c3));
+            }
+
+            inline void get_color_rows(__m128i* pRows, uint32 color_endpoint_index, uint32 color_selector_index) const
+            {
+                const __m128i colors = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_unpacker.m_rgba_colors[color_endpoint_index << 2]));
+                const __m128i c0 = _mm_shuffle_epi32(colors, 0x00);
+                const __m128i c1 = _mm_shuffle_epi32(colors, 0x55);
+                const __m128i c2 = _mm_shuffle_epi32(colors, 0xAA);
+                const __m128i c3 = _mm_shuffle_epi32(colors, 0xFF);
+
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i selectors = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_unpacker.m_rgba_color_selectors[color_selector_index << 4]));
+                const __m128i s_lo = _mm_unpacklo_epi8(selectors, zero);
+                const __m128i s_hi = _mm_unpackhi_epi8(selectors, zero);
+                pRows[0] = select_colors(_mm_unpacklo_epi16(s_lo, zero), c0, c1, c2, c3);
+                pRows[1] = select_colors(_mm_unpackhi_epi16(s_lo, zero), c0, c1, c2, c3);
+                pRows[2] = select_colors(_mm_unpacklo_epi16(s_hi, zero), c0, c1, c2, c3);
+                pRows[3] = select_colors(_mm_unpackhi_epi16(s_hi, zero), c0, c1, c2, c3);
+            }
+
+            inline void store_rows(uint32 block_x, const __m128i* pRows)
+            {
+                const uint32 x = block_x << 2;
+                if ((m_num_rows == 4) && (x + 4 <= m_width))
+                {
+                    uint8* pDst = m_pRow + (x << 2);
+                    for (uint32 y = 0; y < 4; y++, pDst += m_row_pitch_in_bytes)
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst), pRows[y]);
+                }
+                else
+                {
+                    uint32 pixels[16];
+                    for (uint32 y = 0; y < 4; y++)
+                        _mm_storeu_si128(reinterpret_cast<__m128i*>(&pixels[y << 2]), pRows[y]);
+                    store(block_x, pixels);
+                }
+            }
+#endif
+        };
+
+        static inline uint8 clamp_color(int32 c)
+        {
+            return static_cast<uint8>(math::clamp<int32>(c, 0, 255));
+        }
+
+        static void get_etc1_subblock_colors(uint32* pColors, uint32 r, uint32 g, uint32 b, uint32 inten_table)
+        {
+            for (uint32 s = 0; s < 4; s++)
+            {
+                const int32 delta = g_etc1_modifier_table[inten_table][s];
+                color_quad_u8 c(clamp_color(r + delta), clamp_color(g + delta), clamp_color(b + delta), 255);
+                memcpy(&pColors[s], &c, sizeof(uint32));
+            }
+        }
+
+        // Expands the palettes into per-endpoint colors and per-selector raster order indices, so unpacking a block to RGBA is a table lookup per pixel.
+        bool init_rgba_tables()
+        {
+            const uint32 format = m_pHeader->m_format;
+            const bool has_subblocks = format == cCRNFmtETC1 || format == cCRNFmtETC2 || format == cCRNFmtETC2A;
+            const bool has_etc_color_blocks = has_subblocks || format == cCRNFmtETC1S || format == cCRNFmtETC2AS;
+            const bool has_etc_alpha_blocks = format == cCRNFmtETC2A || format == cCRNFmtETC2AS;
+
+            if (m_color_endpoints.size())
+            {
+                // ETC subblocks get their 555 (differential mode) colors followed by their 444 (individual mode) colors.
+                const uint32 colors_per_endpoint = has_subblocks ? 8 : 4;
+                if (!m_rgba_colors.resize(m_color_endpoints.size() * colors_per_endpoint))
+                    return false;
+
+                for (uint32 i = 0; i < m_color_endpoints.size(); i++)
+                {
+                    const uint32 endpoint = m_color_endpoints[i];
+                    uint32* pColors = &m_rgba_colors[i * colors_per_endpoint];
+                    if (has_subblocks)
+                    {
+                        uint8 e[4];
+                        *(uint32*)&e = endpoint;
+                        get_etc1_subblock_colors(pColors, e[0] << 3 | e[0] >> 2, e[1] << 3 | e[1] >> 2, e[2] << 3 | e[2] >> 2, e[3] & 7);
+                        get_etc1_subblock_colors(pColors + 4, (e[0] >> 1) * 0x11, (e[1] >> 1) * 0x11, (e[2] >> 1) * 0x11, e[3] & 7);
+                    }
+                    else if (has_etc_color_blocks)
+                    {
+                        // A differential mode block with a zero delta.
+                        uint8 e[4];
+                        *(uint32*)&e = endpoint;
+                        get_etc1_subblock_colors(pColors, e[0] | e[0] >> 5, e[1] | e[1] >> 5, e[2] | e[2] >> 5, e[3] >> 5);
+                    }
+                    else
+                    {
+                        color_quad_u8 colors[cDXT1SelectorValues];
+                        dxt1_block::get_block_colors(colors, static_cast<uint16>(endpoint & 0xFFFF), static_cast<uint16>(endpoint >> 16));
+                        memcpy(pColors, colors, sizeof(colors));
+                    }
+                }
+
+                const uint32 selectors_per_entry = has_subblocks ? 2 : 1;
+                const uint32 num_selectors = m_color_selectors.size() / selectors_per_entry;
+                if (!m_rgba_color_selectors.resize(m_color_selectors.size() << 4))
+                    return false;
+
+                for (uint32 i = 0; i < num_selectors; i++)
+                {
+                    for (uint32 flip = 0; flip < selectors_per_entry; flip++)
+                    {
+                        const uint32 selector = m_color_selectors[i * selectors_per_entry + flip];
+                        uint8* pDst = &m_rgba_color_selectors[(i * selectors_per_entry + flip) << 4];
+                        for (uint32 y = 0; y < 4; y++)
+                        {
+                            for (uint32 x = 0; x < 4; x++)
+                            {
+                                if (has_etc_color_blocks)
+                                {
+                                    // ETC selectors are stored as two bit planes in column major order.
+                                    const uint32 bit = x << 2 | y;
+                                    const uint32 lsb = selector >> ((3 - (bit >> 3)) << 3 | (bit & 7)) & 1;
+                                    const uint32 msb = selector >> ((1 - (bit >> 3)) << 3 | (bit & 7)) & 1;
+                                    const uint32 subblock = has_subblocks ? (flip ? y >> 1 : x >> 1) : 0;
+                                    pDst[y << 2 | x] = static_cast<uint8>(subblock << 2 | msb << 1 | lsb);
+                                }
+                                else
+                                {
+                                    pDst[y << 2 | x] = static_cast<uint8>(selector >> ((y << 2 | x) << 1) & 3);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (m_alpha_endpoints.size())
+            {
+                if (!m_rgba_alpha_values.resize(m_alpha_endpoints.size() << 3))
+                    return false;
+
+                for (uint32 i = 0; i < m_alpha_endpoints.size(); i++)
+                {
+                    const uint32 endpoint = m_alpha_endpoints[i];
+                    uint8* pValues = &m_rgba_alpha_values[i << 3];
+                    if (has_etc_alpha_blocks)
+                    {
+                        const int32* pModifiers = g_etc2a_modifier_table[endpoint >> 8 & 15];
+                        const int32 base = endpoint & 0xFF, multiplier = endpoint >> 12;
+                        for (uint32 s = 0; s < 8; s++)
+                            pValues[s] = clamp_color(base + pModifiers[s] * multiplier);
+                    }
+                    else
+                    {
+                        uint32 values[cDXT5SelectorValues];
+                        dxt5_block::get_block_values(values, endpoint & 0xFF, endpoint >> 8);
+                        for (uint32 s = 0; s < 8; s++)
+                            pValues[s] = static_cast<uint8>(values[s]);
+                    }
+                }
+
+                // ETC2A alpha selectors come in two orientations, like the color selectors.
+                const uint32 num_selectors = m_alpha_selectors.size() / 3;
+                if (!m_rgba_alpha_selectors.resize(num_selectors << 4))
+                    return false;
+
+                for (uint32 i = 0; i < num_selectors; i++)
+                {
+                    const uint16* pSelectors = &m_alpha_selectors[i * 3];
+                    uint8* pDst = &m_rgba_alpha_selectors[i << 4];
+                    if (has_etc_alpha_blocks)
+                    {
+                        // Big endian, 3 bits per pixel in column major order.
+                        const uint64 bits = (uint64)(pSelectors[0] & 0xFF) << 40 | (uint64)(pSelectors[0] >> 8) << 32 | (uint64)(pSelectors[1] & 0xFF) << 24 |
+                            (uint64)(pSelectors[1] >> 8) << 16 | (uint64)(pSelectors[2] & 0xFF) << 8 | (uint64)(pSelectors[2] >> 8);
+                        for (uint32 y = 0; y < 4; y++)
+                            for (uint32 x = 0; x < 4; x++)
+                                pDst[y << 2 | x] = static_cast<uint8>(bits >> (45 - 3 * (x << 2 | y)) & 7);
+                    }
+                    else
+                    {
+                        const uint64 bits = (uint64)pSelectors[0] | (uint64)pSelectors[1] << 16 | (uint64)pSelectors[2] << 32;
+                        for (uint32 j = 0; j < 16; j++)
+                            pDst[j] = static_cast<uint8>(bits >> (j * 3) & 7);
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        template <typename T>
+        bool unpack_dxt1(symbol_codec& codec, crnd::vector<block_buffer_element>& block_buffer, T& writer, uint32 output_width, uint32 output_height, const level_slice& slice) const
+        {
+            const uint32 num_color_endpoints = m_color_endpoints.size();
+            const uint32 width = (output_width + 1) & ~1;
+
+            if (block_buffer.size() < width)
+                block_buffer.resize(width);
+
+            uint32 color_endpoint_index = 0;
+            uint8 reference_group = 0;
+
+            for (uint32 f = slice.first_face; f < slice.end_face; f++)
+            {
+                for (uint32 y = slice.first_row; y < slice.end_row; y++)
+                {
+                    writer.begin_row(f, y);
+                    bool visible = y < output_height;
+                    for (uint32 x = 0; x < width; x++)
+                    {
+                        visible = visible && x < output_width;
+                        if (!(y & 1) && !(x & 1))
+                            reference_group = codec.decode(m_reference_encoding_dm);
+                        block_buffer_element& buffer = block_buffer[x];
+                        uint8 endpoint_reference;
+                        if (y & 1)
+                        {
+                            endpoint_reference = buffer.endpoint_reference;
+                        }
                         else
                         {
-                            color_endpoint_index = buffer.color_endpoint_index;
+                            endpoint_reference = reference_group & 3;
+                            reference_group >>= 2;
+                            buffer.endpoint_reference = reference_group & 3;
+                            reference_group >>= 2;
                         }
-                        uint32 color_selector_index = m_codec.decode(m_selector_delta_dm[0]);
-                        if (visible)
+                        if (!endpoint_reference)
                         {
-                            pData[0] = m_color_endpoints[color_endpoint_index];
-                            pData[1] = m_color_selectors[color_selector_index];
+                            color_endpoint_index += codec.decode(m_endpoint_delta_dm[0]);
+                            if (color_endpoint_index >= num_color_endpoints)
+                                color_endpoint_index -= num_color_endpoints;
+                            buffer.color_endpoint_index = color_endpoint_index;
+                        }
+                        else if (endpoint_reference == 1)
+                        {
+                            buffer.color_endpoint_index = color_endpoint_index;
                         }
+                        else
+                        {
+                            color_endpoint_index = buffer.color_endpoint_index;
+                        }
+                        uint32 color_selector_index = codec.decode(m_selector_delta_dm[0]);
+                        if (visible)
+                            writer.write_dxt1(x, color_endpoint_index, color_selector_index);
                     }
                 }
             }
             return true;
         }
 
-        bool unpack_dxt5(uint8** pDst, uint32 row_pitch_in_bytes, uint32 output_width, uint32 output_height)
+        template <typename T>
+        bool unpack_dxt5(symbol_codec& codec, crnd::vector<block_buffer_element>& block_buffer, T& writer, uint32 output_width, uint32 output_height, const level_slice& slice) const
         {
             const uint32 num_color_endpoints = m_color_endpoints.size();
             const uint32 num_alpha_endpoints = m_alpha_endpoints.size();
             const uint32 width = (output_width + 1) & ~1;
-            const uint32 height = (output_height + 1) & ~1;
-            const int32 delta_pitch_in_dwords = (row_pitch_in_bytes >> 2) - (width << 2);
 
-            if (m_block_buffer.size() < width)
-                m_block_buffer.resize(width);
+            if (block_buffer.size() < width)
+                block_buffer.resize(width);
 
             uint32 color_endpoint_index = 0;
             uint32 alpha0_endpoint_index = 0;
             uint8 reference_group = 0;
 
-            for (uint32 f = 0; f < m_pHeader->m_faces; f++)
+            for (uint32 f = slice.first_face; f < slice.end_face; f++)
             {
-                uint32* pData = (uint32*)pDst[f];
-                for (uint32 y = 0; y < height; y++, pData += delta_pitch_in_dwords)
+                for (uint32 y = slice.first_row; y < slice.end_row; y++)
                 {
+                    writer.begin_row(f, y);
                     bool visible = y < output_height;
-                    for (uint32 x = 0; x < width; x++, pData += 4)
+                    for (uint32 x = 0; x < width; x++)
                     {
                         visible = visible && x < output_width;
                         if (!(y & 1) && !(x & 1))
-                            reference_group = m_codec.decode(m_reference_encoding_dm);
-                        block_buffer_element& buffer = m_block_buffer[x];
+                            reference_group = codec.decode(m_reference_encoding_dm);
+                        block_buffer_element& buffer = block_buffer[x];
                         uint8 endpoint_reference;
                         if (y & 1)
                         {
@@ -4046,11 +4795,11 @@ namespace crnd
                         }
                         if (!endpoint_reference)
                         {
-                            color_endpoint_index += m_codec.decode(m_endpoint_delta_dm[0]);
+                            color_endpoint_index += codec.decode(m_endpoint_delta_dm[0]);
                             if (color_endpoint_index >= num_color_endpoints)
                                 color_endpoint_index -= num_color_endpoints;
                             buffer.color_endpoint_index = color_endpoint_index;
-                            alpha0_endpoint_index += m_codec.decode(m_endpoint_delta_dm[1]);
+                            alpha0_endpoint_index += codec.decode(m_endpoint_delta_dm[1]);
                             if (alpha0_endpoint_index >= num_alpha_endpoints)
                                 alpha0_endpoint_index -= num_alpha_endpoints;
                             buffer.alpha0_endpoint_index = alpha0_endpoint_index;
@@ -4065,48 +4814,41 @@ namespace crnd
                             color_endpoint_index = buffer.color_endpoint_index;
                             alpha0_endpoint_index = buffer.alpha0_endpoint_index;
                         }
-                        uint32 color_selector_index = m_codec.decode(m_selector_delta_dm[0]);
-                        uint32 alpha0_selector_index = m_codec.decode(m_selector_delta_dm[1]);
+                        uint32 color_selector_index = codec.decode(m_selector_delta_dm[0]);
+                        uint32 alpha0_selector_index = codec.decode(m_selector_delta_dm[1]);
                         if (visible)
-                        {
-                            const uint16* pAlpha0_selectors = &m_alpha_selectors[alpha0_selector_index * 3];
-                            pData[0] = m_alpha_endpoints[alpha0_endpoint_index] | (pAlpha0_selectors[0] << 16);
-                            pData[1] = pAlpha0_selectors[1] | (pAlpha0_selectors[2] << 16);
-                            pData[2] = m_color_endpoints[color_endpoint_index];
-                            pData[3] = m_color_selectors[color_selector_index];
-                        }
+                            writer.write_dxt5(x, color_endpoint_index, color_selector_index, alpha0_endpoint_index, alpha0_selector_index);
                     }
                 }
             }
             return true;
         }
 
-        bool unpack_dxn(uint8** pDst, uint32 row_pitch_in_bytes, uint32 output_width, uint32 output_height)
+        template <typename T>
+        bool unpack_dxn(symbol_codec& codec, crnd::vector<block_buffer_element>& block_buffer, T& writer, uint32 output_width, uint32 output_height, const level_slice& slice) const
         {
             const uint32 num_alpha_endpoints = m_alpha_endpoints.size();
             const uint32 width = (output_width + 1) & ~1;
-            const uint32 height = (output_height + 1) & ~1;
-            const int32 delta_pitch_in_dwords = (row_pitch_in_bytes >> 2) - (width << 2);
 
-            if (m_block_buffer.size() < width)
-                m_block_buffer.resize(width);
+            if (block_buffer.size() < width)
+                block_buffer.resize(width);
 
             uint32 alpha0_endpoint_index = 0;
             uint32 alpha1_endpoint_index = 0;
             uint8 reference_group = 0;
 
-            for (uint32 f = 0; f < m_pHeader->m_faces; f++)
+            for (uint32 f = slice.first_face; f < slice.end_face; f++)
             {
-                uint32* pData = (uint32*)pDst[f];
-                for (uint32 y = 0; y < height; y++, pData += delta_pitch_in_dwords)
+                for (uint32 y = slice.first_row; y < slice.end_row; y++)
                 {
+                    writer.begin_row(f, y);
                     bool visible = y < output_height;
-                    for (uint32 x = 0; x < width; x++, pData += 4)
+                    for (uint32 x = 0; x < width; x++)
                     {
                         visible = visible && x < output_width;
                         if (!(y & 1) && !(x & 1))
-                            reference_group = m_codec.decode(m_reference_encoding_dm);
-                        block_buffer_element& buffer = m_block_buffer[x];
+                            reference_group = codec.decode(m_reference_encoding_dm);
+                        block_buffer_element& buffer = block_buffer[x];
                         uint8 endpoint_reference;
                         if (y & 1)
                         {
@@ -4121,11 +4863,11 @@ namespace crnd
                         }
                         if (!endpoint_reference)
                         {
-                            alpha0_endpoint_index += m_codec.decode(m_endpoint_delta_dm[1]);
+                            alpha0_endpoint_index += codec.decode(m_endpoint_delta_dm[1]);
                             if (alpha0_endpoint_index >= num_alpha_endpoints)
                                 alpha0_endpoint_index -= num_alpha_endpoints;
                             buffer.alpha0_endpoint_index = alpha0_endpoint_index;
-                            alpha1_endpoint_index += m_codec.decode(m_endpoint_delta_dm[1]);
+                            alpha1_endpoint_index += codec.decode(m_endpoint_delta_dm[1]);
                             if (alpha1_endpoint_index >= num_alpha_endpoints)
                                 alpha1_endpoint_index -= num_alpha_endpoints;
                             buffer.alpha1_endpoint_index = alpha1_endpoint_index;
@@ -4140,48 +4882,40 @@ namespace crnd
                             alpha0_endpoint_index = buffer.alpha0_endpoint_index;
                             alpha1_endpoint_index = buffer.alpha1_endpoint_index;
                         }
-                        uint32 alpha0_selector_index = m_codec.decode(m_selector_delta_dm[1]);
-                        uint32 alpha1_selector_index = m_codec.decode(m_selector_delta_dm[1]);
+                        uint32 alpha0_selector_index = codec.decode(m_selector_delta_dm[1]);
+                        uint32 alpha1_selector_index = codec.decode(m_selector_delta_dm[1]);
                         if (visible)
-                        {
-                            const uint16* pAlpha0_selectors = &m_alpha_selectors[alpha0_selector_index * 3];
-                            const uint16* pAlpha1_selectors = &m_alpha_selectors[alpha1_selector_index * 3];
-                            pData[0] = m_alpha_endpoints[alpha0_endpoint_index] | (pAlpha0_selectors[0] << 16);
-                            pData[1] = pAlpha0_selectors[1] | (pAlpha0_selectors[2] << 16);
-                            pData[2] = m_alpha_endpoints[alpha1_endpoint_index] | (pAlpha1_selectors[0] << 16);
-                            pData[3] = pAlpha1_selectors[1] | (pAlpha1_selectors[2] << 16);
-                        }
+                            writer.write_dxn(x, alpha0_endpoint_index, alpha0_selector_index, alpha1_endpoint_index, alpha1_selector_index);
                     }
                 }
             }
             return true;
         }
 
-        bool unpack_dxt5a(uint8** pDst, uint32 row_pitch_in_bytes, uint32 output_width, uint32 output_height)
+        template <typename T>
+        bool unpack_dxt5a(symbol_codec& codec, crnd::vector<block_buffer_element>& block_buffer, T& writer, uint32 output_width, uint32 output_height, const level_slice& slice) const
         {
             const uint32 num_alpha_endpoints = m_alpha_endpoints.size();
             const uint32 width = (output_width + 1) & ~1;
-            const uint32 height = (output_height + 1) & ~1;
-            const int32 delta_pitch_in_dwords = (row_pitch_in_bytes >> 2) - (width << 1);
 
-            if (m_block_buffer.size() < width)
-                m_block_buffer.resize(width);
+            if (block_buffer.size() < width)
+                block_buffer.resize(width);
 
             uint32 alpha0_endpoint_index = 0;
             uint8 reference_group = 0;
 
-            for (uint32 f = 0; f < m_pHeader->m_faces; f++)
+            for (uint32 f = slice.first_face; f < slice.end_face; f++)
             {
-                uint32* pData = (uint32*)pDst[f];
-                for (uint32 y = 0; y < height; y++, pData += delta_pitch_in_dwords)
+                for (uint32 y = slice.first_row; y < slice.end_row; y++)
                 {
+                    writer.begin_row(f, y);
                     bool visible = y < output_height;
-                    for (uint32 x = 0; x < width; x++, pData += 2)
+                    for (uint32 x = 0; x < width; x++)
                     {
                         visible = visible && x < output_width;
                         if (!(y & 1) && !(x & 1))
-                            reference_group = m_codec.decode(m_reference_encoding_dm);
-                        block_buffer_element& buffer = m_block_buffer[x];
+                            reference_group = codec.decode(m_reference_encoding_dm);
+                        block_buffer_element& buffer = block_buffer[x];
                         uint8 endpoint_reference;
                         if (y & 1)
                         {
@@ -4196,7 +4930,7 @@ namespace crnd
                         }
                         if (!endpoint_reference)
                         {
-                            alpha0_endpoint_index += m_codec.decode(m_endpoint_delta_dm[1]);
+                            alpha0_endpoint_index += codec.decode(m_endpoint_delta_dm[1]);
                             if (alpha0_endpoint_index >= num_alpha_endpoints)
                                 alpha0_endpoint_index -= num_alpha_endpoints;
                             buffer.alpha0_endpoint_index = alpha0_endpoint_index;
@@ -4209,56 +4943,51 @@ namespace crnd
                         {
                             alpha0_endpoint_index = buffer.alpha0_endpoint_index;
                         }
-                        uint32 alpha0_selector_index = m_codec.decode(m_selector_delta_dm[1]);
+                        uint32 alpha0_selector_index = codec.decode(m_selector_delta_dm[1]);
                         if (visible)
-                        {
-                            const uint16* pAlpha0_selectors = &m_alpha_selectors[alpha0_selector_index * 3];
-                            pData[0] = m_alpha_endpoints[alpha0_endpoint_index] | (pAlpha0_selectors[0] << 16);
-                            pData[1] = pAlpha0_selectors[1] | (pAlpha0_selectors[2] << 16);
-                        }
+                            writer.write_dxt5a(x, alpha0_endpoint_index, alpha0_selector_index);
                     }
                 }
             }
             return true;
         }
 
-        bool unpack_etc1(uint8** pDst, uint32 output_pitch_in_bytes, uint32 output_width, uint32 output_height)
+        template <typename T>
+        bool unpack_etc1(symbol_codec& codec, crnd::vector<block_buffer_element>& block_buffer, T& writer, uint32 output_width, uint32 output_height, const level_slice& slice) const
         {
             const uint32 num_color_endpoints = m_color_endpoints.size();
             const uint32 width = (output_width + 1) & ~1;
-            const uint32 height = (output_height + 1) & ~1;
-            const int32 delta_pitch_in_dwords = (output_pitch_in_bytes >> 2) - (width << 1);
 
-            if (m_block_buffer.size() < width << 1)
-                m_block_buffer.resize(width << 1);
+            if (block_buffer.size() < width << 1)
+                block_buffer.resize(width << 1);
 
             uint32 color_endpoint_index = 0, diagonal_color_endpoint_index = 0;
             uint8 reference_group = 0;
 
-            for (uint32 f = 0; f < m_pHeader->m_faces; f++)
+            for (uint32 f = slice.first_face; f < slice.end_face; f++)
             {
-                uint32* pData = (uint32*)pDst[f];
-                for (uint32 y = 0; y < height; y++, pData += delta_pitch_in_dwords)
+                for (uint32 y = slice.first_row; y < slice.end_row; y++)
                 {
+                    writer.begin_row(f, y);
                     bool visible = y < output_height;
-                    for (uint32 x = 0; x < width; x++, pData += 2)
+                    for (uint32 x = 0; x < width; x++)
                     {
                         visible = visible && x < output_width;
-                        block_buffer_element& buffer = m_block_buffer[x << 1];
-                        uint8 endpoint_reference, block_endpoint[4], e0[4], e1[4];
+                        block_buffer_element& buffer = block_buffer[x << 1];
+                        uint8 endpoint_reference;
                         if (y & 1)
                         {
                             endpoint_reference = buffer.endpoint_reference;
                         }
                         else
                         {
-                            reference_group = m_codec.decode(m_reference_encoding_dm);
+                            reference_group = codec.decode(m_reference_encoding_dm);
                             endpoint_reference = (reference_group & 3) | (reference_group >> 2 & 12);
                             buffer.endpoint_reference = (reference_group >> 2 & 3) | (reference_group >> 4 & 12);
                         }
                         if (!(endpoint_reference & 3))
                         {
-                            color_endpoint_index += m_codec.decode(m_endpoint_delta_dm[0]);
+                            color_endpoint_index += codec.decode(m_endpoint_delta_dm[0]);
                             if (color_endpoint_index >= num_color_endpoints)
                                 color_endpoint_index -= num_color_endpoints;
                             buffer.color_endpoint_index = color_endpoint_index;
@@ -4276,75 +5005,64 @@ namespace crnd
                             color_endpoint_index = buffer.color_endpoint_index;
                         }
                         endpoint_reference >>= 2;
-                        *(uint32*)&e0 = m_color_endpoints[color_endpoint_index];
-                        uint32 selector_index = m_codec.decode(m_selector_delta_dm[0]);
+                        const uint32 color_endpoint0_index = color_endpoint_index;
+                        uint32 selector_index = codec.decode(m_selector_delta_dm[0]);
                         if (endpoint_reference)
                         {
-                            color_endpoint_index += m_codec.decode(m_endpoint_delta_dm[0]);
+                            color_endpoint_index += codec.decode(m_endpoint_delta_dm[0]);
                             if (color_endpoint_index >= num_color_endpoints)
                                 color_endpoint_index -= num_color_endpoints;
                         }
-                        diagonal_color_endpoint_index = m_block_buffer[x << 1 | 1].color_endpoint_index;
-                        m_block_buffer[x << 1 | 1].color_endpoint_index = color_endpoint_index;
-                        *(uint32*)&e1 = m_color_endpoints[color_endpoint_index];
+                        diagonal_color_endpoint_index = block_buffer[x << 1 | 1].color_endpoint_index;
+                        block_buffer[x << 1 | 1].color_endpoint_index = color_endpoint_index;
                         if (visible)
-                        {
-                            uint32 flip = endpoint_reference >> 1 ^ 1, diff = 1;
-                            for (uint c = 0; diff && c < 3; c++)
-                                diff = e0[c] + 3 >= e1[c] && e1[c] + 4 >= e0[c] ? diff : 0;
-                            for (uint c = 0; c < 3; c++)
-                                block_endpoint[c] = diff ? e0[c] << 3 | ((e1[c] - e0[c]) & 7) : (e0[c] << 3 & 0xF0) | e1[c] >> 1;
-                            block_endpoint[3] = e0[3] << 5 | e1[3] << 2 | diff << 1 | flip;
-                            pData[0] = *(uint32*)&block_endpoint;
-                            pData[1] = m_color_selectors[selector_index << 1 | flip];
-                        }
+                            writer.write_etc1(x, color_endpoint0_index, color_endpoint_index, selector_index, endpoint_reference >> 1 ^ 1);
                     }
                 }
             }
             return true;
         }
 
-        bool unpack_etc2a(uint8** pDst, uint32 output_pitch_in_bytes, uint32 output_width, uint32 output_height)
+        template <typename T>
+        bool unpack_etc2a(symbol_codec& codec, crnd::vector<block_buffer_element>& block_buffer, T& writer, uint32 output_width, uint32 output_height, const level_slice& slice) const
         {
             const uint32 num_color_endpoints = m_color_endpoints.size();
             const uint32 num_alpha_endpoints = m_alpha_endpoints.size();
             const uint32 width = (output_width + 1) & ~1;
-            const uint32 height = (output_height + 1) & ~1;
-            const int32 delta_pitch_in_dwords = (output_pitch_in_bytes >> 2) - (width << 2);
 
-            if (m_block_buffer.size() < width << 1)
-                m_block_buffer.resize(width << 1);
+            if (block_buffer.size() < width << 1)
+                block_buffer.resize(width << 1);
 
             uint32 color_endpoint_index = 0, diagonal_color_endpoint_index = 0, alpha0_endpoint_index = 0, diagonal_alpha0_endpoint_index = 0;
             uint8 reference_group = 0;
 
-            for (uint32 f = 0; f < m_pHeader->m_faces; f++)
+            for (uint32 f = slice.first_face; f < slice.end_face; f++)
             {
-                uint32* pData = (uint32*)pDst[f];
-                for (uint32 y = 0; y < height; y++, pData += delta_pitch_in_dwords)
+                for (uint32 y = slice.first_row; y < slice.end_row; y++)
                 {
+                    writer.begin_row(f, y);
                     bool visible = y < output_height;
-                    for (uint32 x = 0; x < width; x++, pData += 4)
+                    for (uint32 x = 0; x < width; x++)
                     {
                         visible = visible && x < output_width;
-                        block_buffer_element& buffer = m_block_buffer[x << 1];
-                        uint8 endpoint_reference, block_endpoint[4], e0[4], e1[4];
+                        block_buffer_element& buffer = block_buffer[x << 1];
+                        uint8 endpoint_reference;
                         if (y & 1)
                         {
                             endpoint_reference = buffer.endpoint_reference;
                         }
                         else
                         {
-                            reference_group = m_codec.decode(m_reference_encoding_dm);
+                            reference_group = codec.decode(m_reference_encoding_dm);
                             endpoint_reference = (reference_group & 3) | (reference_group >> 2 & 12);
                             buffer.endpoint_reference = (reference_group >> 2 & 3) | (reference_group >> 4 & 12);
                         }
                         if (!(endpoint_reference & 3))
                         {
-                            color_endpoint_index += m_codec.decode(m_endpoint_delta_dm[0]);
+                            color_endpoint_index += codec.decode(m_endpoint_delta_dm[0]);
                             if (color_endpoint_index >= num_color_endpoints)
                                 color_endpoint_index -= num_color_endpoints;
-                            alpha0_endpoint_index += m_codec.decode(m_endpoint_delta_dm[1]);
+                            alpha0_endpoint_index += codec.decode(m_endpoint_delta_dm[1]);
                             if (alpha0_endpoint_index >= num_alpha_endpoints)
                                 alpha0_endpoint_index -= num_alpha_endpoints;
                             buffer.color_endpoint_index = color_endpoint_index;
@@ -4366,34 +5084,21 @@ namespace crnd
                             alpha0_endpoint_index = buffer.alpha0_endpoint_index;
                         }
                         endpoint_reference >>= 2;
-                        *(uint32*)&e0 = m_color_endpoints[color_endpoint_index];
-                        uint32 color_selector_index = m_codec.decode(m_selector_delta_dm[0]);
-                        uint32 alpha0_selector_index = m_codec.decode(m_selector_delta_dm[1]);
+                        const uint32 color_endpoint0_index = color_endpoint_index;
+                        uint32 color_selector_index = codec.decode(m_selector_delta_dm[0]);
+                        uint32 alpha0_selector_index = codec.decode(m_selector_delta_dm[1]);
                         if (endpoint_reference)
                         {
-                            color_endpoint_index += m_codec.decode(m_endpoint_delta_dm[0]);
+                            color_endpoint_index += codec.decode(m_endpoint_delta_dm[0]);
                             if (color_endpoint_index >= num_color_endpoints)
                                 color_endpoint_index -= num_color_endpoints;
                         }
-                        *(uint32*)&e1 = m_color_endpoints[color_endpoint_index];
-                        diagonal_color_endpoint_index = m_block_buffer[x << 1 | 1].color_endpoint_index;
-                        diagonal_alpha0_endpoint_index = m_block_buffer[x << 1 | 1].alpha0_endpoint_index;
-                        m_block_buffer[x << 1 | 1].color_endpoint_index = color_endpoint_index;
-                        m_block_buffer[x << 1 | 1].alpha0_endpoint_index = alpha0_endpoint_index;
+                        diagonal_color_endpoint_index = block_buffer[x << 1 | 1].color_endpoint_index;
+                        diagonal_alpha0_endpoint_index = block_buffer[x << 1 | 1].alpha0_endpoint_index;
+                        block_buffer[x << 1 | 1].color_endpoint_index = color_endpoint_index;
+                        block_buffer[x << 1 | 1].alpha0_endpoint_index = alpha0_endpoint_index;
                         if (visible)
-                        {
-                            uint32 flip = endpoint_reference >> 1 ^ 1, diff = 1;
-                            for (uint c = 0; diff && c < 3; c++)
-                                diff = e0[c] + 3 >= e1[c] && e1[c] + 4 >= e0[c] ? diff : 0;
-                            for (uint c = 0; c < 3; c++)
-                                block_endpoint[c] = diff ? e0[c] << 3 | ((e1[c] - e0[c]) & 7) : (e0[c] << 3 & 0xF0) | e1[c] >> 1;
-                            block_endpoint[3] = e0[3] << 5 | e1[3] << 2 | diff << 1 | flip;
-                            const uint16* pAlpha0_selectors = &m_alpha_selectors[alpha0_selector_index * 6 + (flip ? 3 : 0)];
-                            pData[0] = m_alpha_endpoints[alpha0_endpoint_index] | pAlpha0_selectors[0] << 16;
-                            pData[1] = pAlpha0_selectors[1] | pAlpha0_selectors[2] << 16;
-                            pData[2] = *(uint32*)&block_endpoint;
-                            pData[3] = m_color_selectors[color_selector_index << 1 | flip];
-                        }
+                            writer.write_etc2a(x, color_endpoint0_index, color_endpoint_index, color_selector_index, alpha0_endpoint_index, alpha0_selector_index, endpoint_reference >> 1 ^ 1);
                     }
                 }
             }
@@ -4401,6 +5106,143 @@ namespace crnd
         }
     };
 
+    // Collects a .CRN file as it is received and creates its crn_unpacker once the tables and palettes are present.
+    class crn_stream_unpacker
+    {
+    public:
+        inline crn_stream_unpacker() :
+            m_magic(cMagicValue),
+            m_header_size(0),
+            m_received(0),
+            m_failed(false),
+            m_pUnpacker(NULL),
+            m_ready_levels(0)
+        {
+        }
+
+        inline ~crn_stream_unpacker()
+        {
+            crnd_delete(m_pUnpacker);
+            m_magic = 0;
+        }
+
+        inline bool is_valid() const
+        {
+            return m_magic == cMagicValue;
+        }
+
+        bool add_data(const uint8* pData, uint32 data_size, uint32& ready_levels)
+        {
+            ready_levels = 0;
+            if (m_failed)
+                return false;
+
+            m_failed = true;
+            while (data_size)
+            {
+                // Until the header has been validated, the buffer only grows as far as the part of the header needed next.
+                const uint32 buffer_size = m_header_size ? m_data.size() : (m_received < sizeof(crn_header) ? (uint32)sizeof(crn_header) : (uint32)get_header().m_header_size);
+                const uint32 n = math::minimum(data_size, buffer_size - m_received);
+                if (!n)
+                    return false;
+
+                if ((m_data.size() < buffer_size) && (!m_data.resize(buffer_size)))
+                    return false;
+
+                memcpy(&m_data[m_received], pData, n);
+                m_received += n;
+                pData += n;
+                data_size -= n;
+
+                if ((!m_header_size) && (m_received >= sizeof(crn_header)))
+                {
+                    if (get_header().m_header_size < sizeof(crn_header))
+                        return false;
+
+                    if (m_received == get_header().m_header_size)
+                    {
+                        if (!check_header())
+                            return false;
+
+                        m_header_size = m_received;
+                        if (!m_data.resize(get_header().m_data_size))
+                            return false;
+                    }
+                }
+            }
+
+            if (m_header_size && !m_pUnpacker && (m_received >= crnd_get_segmented_file_size(&m_data[0], m_data.size())))
+            {
+                m_pUnpacker = crnd_new<crn_unpacker>();
+                if ((!m_pUnpacker) || (!m_pUnpacker->init(&m_data[0], m_data.size())))
+                    return false;
+            }
+
+            if (m_pUnpacker)
+            {
+                const crn_header& header = get_header();
+                for (uint32 level_index = 0; level_index < header.m_levels; level_index++)
+                {
+                    if ((!(m_ready_levels & (1U << level_index))) && (m_received >= crnd_get_level_end_ofs(&header, level_index, m_data.size())))
+                        ready_levels |= 1U << level_index;
+                }
+                m_ready_levels |= ready_levels;
+            }
+
+            m_failed = false;
+            return true;
+        }
+
+        inline crn_unpacker* get_unpacker() const
+        {
+            return m_pUnpacker;
+        }
+
+        inline uint32 get_ready_levels() const
+        {
+            return m_ready_levels;
+        }
+
+    private:
+        enum { cMagicValue = 0x5EA1C0DE };
+
+        uint32 m_magic;
+
+        crnd::vector<uint8> m_data;
+        uint32 m_header_size;
+        uint32 m_received;
+        bool m_failed;
+
+        crn_unpacker* m_pUnpacker;
+        uint32 m_ready_levels;
+
+        inline const crn_header& get_header() const
+        {
+            return *reinterpret_cast<const crn_header*>(&m_data[0]);
+        }
+
+        // Validates the complete header before the buffer is grown to the file size it claims.
+        bool check_header() const
+        {
+            const crn_header& header = get_header();
+            if (header.m_sig != ((header.m_flags & cCRNHeaderFlagsExtended) ? crn_header::cCRNSigValueExtended : crn_header::cCRNSigValue))
+                return false;
+
+            if ((header.m_flags & ~cCRNHeaderFlagsKnown) || (header.m_flags & cCRNHeaderFlagSegmented))
+                return false;
+
+            const uint32 header_size = header.m_header_size;
+            if ((header.m_levels < 1) || (header.m_levels > cCRNMaxLevels) || (header_size < sizeof(crn_header) + sizeof(header.m_level_ofs[0]) * (header.m_levels - 1)))
+                return false;
+
+            const uint32 header_crc = crc16(&header.m_data_size, (uint32)(header_size - ((const uint8*)&header.m_data_size - (const uint8*)&header)));
+            if (header_crc != header.m_header_crc16)
+                return false;
+
+            return header.m_data_size >= header_size;
+        }
+    };
+
     crnd_unpack_context crnd_unpack_begin(const void* pData, uint32 data_size)
     {
         if ((!pData) || (data_size < cCRNHeaderMinSize))
@@ -4471,6 +5313,52 @@ namespace crnd
         return pUnpacker->unpack_level(pSrc, src_size_in_bytes, pDst, dst_size_in_bytes, row_pitch_in_bytes, level_index);
     }
 
+    bool crnd_unpack_level_parallel(
+        crnd_unpack_context pContext,
+        void** pDst, uint32 dst_size_in_bytes, uint32 row_pitch_in_bytes,
+        uint32 level_index,
+        crnd_parallel_for_func pParallel_for, void* pUser_data)
+    {
+        if ((!pContext) || (!pDst) || (dst_size_in_bytes < 8U) || (level_index >= cCRNMaxLevels) || (!pParallel_for))
+            return false;
+
+        crn_unpacker* pUnpacker = static_cast<crn_unpacker*>(pContext);
+
+        if (!pUnpacker->is_valid())
+            return false;
+
+        return pUnpacker->unpack_level_parallel(pDst, dst_size_in_bytes, row_pitch_in_bytes, level_index, pParallel_for, pUser_data);
+    }
+
+    bool crnd_unpack_level_rgba(
+        crnd_unpack_context pContext,
+        void** pDst, uint32 dst_size_in_bytes, uint32 row_pitch_in_bytes,
+        uint32 level_index)
+    {
+        if ((!pContext) || (!pDst) || (dst_size_in_bytes < 4U) || (level_index >= cCRNMaxLevels))
+            return false;
+
+        crn_unpacker* pUnpacker = static_cast<crn_unpacker*>(pContext);
+
+        if (!pUnpacker->is_valid())
+            return false;
+
+        return pUnpacker->unpack_level_rgba(pDst, dst_size_in_bytes, row_pitch_in_bytes, level_index);
+    }
+
+    uint32 crnd_get_level_slice_count(crnd_unpack_context pContext, uint32 level_index)
+    {
+        if ((!pContext) || (level_index >= cCRNMaxLevels))
+            return 0;
+
+        crn_unpacker* pUnpacker = static_cast<crn_unpacker*>(pContext);
+
+        if (!pUnpacker->is_valid())
+            return 0;
+
+        return pUnpacker->get_level_slice_count(level_index);
+    }
+
     bool crnd_unpack_end(crnd_unpack_context pContext)
     {
         if (!pContext)
@@ -4485,6 +5373,75 @@ namespace crnd
 
         return true;
     }
+
+    crnd_stream_context crnd_stream_begin()
+    {
+        return crnd_new<crn_stream_unpacker>();
+    }
+
+    bool crnd_stream_add_data(crnd_stream_context pContext, const void* pData, uint32 data_size, uint32* pReady_levels)
+    {
+        if (pReady_levels)
+            *pReady_levels = 0;
+
+        if ((!pContext) || ((!pData) && data_size))
+            return false;
+
+        crn_stream_unpacker* pStream = static_cast<crn_stream_unpacker*>(pContext);
+
+        if (!pStream->is_valid())
+            return false;
+
+        uint32 ready_levels;
+        if (!pStream->add_data(static_cast<const uint8*>(pData), data_size, ready_levels))
+            return false;
+
+        if (pReady_levels)
+            *pReady_levels = ready_levels;
+
+        return true;
+    }
+
+    crnd_unpack_context crnd_stream_get_unpack_context(crnd_stream_context pContext)
+    {
+        if (!pContext)
+            return NULL;
+
+        crn_stream_unpacker* pStream = static_cast<crn_stream_unpacker*>(pContext);
+
+        if (!pStream->is_valid())
+            return NULL;
+
+        return pStream->get_unpacker();
+    }
+
+    uint32 crnd_stream_get_ready_levels(crnd_stream_context pContext)
+    {
+        if (!pContext)
+            return 0;
+
+        crn_stream_unpacker* pStream = static_cast<crn_stream_unpacker*>(pContext);
+
+        if (!pStream->is_valid())
+            return 0;
+
+        return pStream->get_ready_levels();
+    }
+
+    bool crnd_stream_end(crnd_stream_context pContext)
+    {
+        if (!pContext)
+            return false;
+
+        crn_stream_unpacker* pStream = static_cast<crn_stream_unpacker*>(pContext);
+
+        if (!pStream->is_valid())
+            return false;
+
+        crnd_delete(pStream);
+
+        return true;
+    }
 } // namespace crnd
 
 #endif  // CRND_INCLUDE_CRND_H
@@ -199,11 +199,68 @@ namespace crnd
         void** ppDst, uint32 dst_size_in_bytes, uint32 row_pitch_in_bytes,
         uint32 level_index);
 
+    // Task callback used by crnd_unpack_level_parallel().
+    typedef void (*crnd_task_func)(uint32 task_index, void* pTask_data);
+
+    // Parallel for callback used by crnd_unpack_level_parallel(): must call pTask(i, pTask_data) exactly once for every i in [0, num_tasks),
+    // in any order and on any threads, and only return once all the calls have completed. Returning false makes the unpack fail.
+    typedef bool (*crnd_parallel_for_func)(crnd_task_func pTask, void* pTask_data, uint32 num_tasks, void* pUser_data);
+
+    // crnd_unpack_level_parallel() - Same as crnd_unpack_level(), but transcodes the level's slices concurrently using the caller's threads.
+    // Only levels written with cCRNCompFlagSlicedLevels have more than one slice, other levels are unpacked on the calling thread.
+    // pParallel_for - Called once with one task per slice. pUser_data is passed to it unchanged.
+    // Unlike crnd_unpack_level(), this function allocates a small amount of memory for each slice.
+    CRN_EXPORT bool crnd_unpack_level_parallel(
+        crnd_unpack_context pContext,
+        void** ppDst, uint32 dst_size_in_bytes, uint32 row_pitch_in_bytes,
+        uint32 level_index,
+        crnd_parallel_for_func pParallel_for, void* pUser_data);
+
+    // crnd_unpack_level_rgba() - Transcodes the specified mipmap level straight to 32bpp RGBA pixels (R in the lowest byte), without going through DXT/ETC blocks.
+    // ppDst - A pointer to an array of 1 or 6 destination buffer pointers, as in crnd_unpack_level().
+    // dst_size_in_bytes - Size of each destination buffer, at least row_pitch_in_bytes * (height - 1) + width * 4.
+    // row_pitch_in_bytes - The pitch in bytes from one row of pixels to the next, or 0 for width * 4. Must be a multiple of 4.
+    // Channels are written as stored: DXT5 swizzles such as DXT5_xGBR are not undone, DXN writes X/Y to R/G with B=0 and A=255, and DXT5A writes alpha with RGB=0.
+    // The first call on a context expands its palettes into lookup tables of up to 32 bytes per palette entry, which are freed by crnd_unpack_end().
+    CRN_EXPORT bool crnd_unpack_level_rgba(
+        crnd_unpack_context pContext,
+        void** ppDst, uint32 dst_size_in_bytes, uint32 row_pitch_in_bytes,
+        uint32 level_index);
+
+    // Returns the number of independently decodable slices in the specified mipmap level, or 0 if any of the input parameters are invalid.
+    CRN_EXPORT uint32 crnd_get_level_slice_count(crnd_unpack_context pContext, uint32 level_index);
+
     // crnd_unpack_end() - Frees the decompress tables and unpacked palettes associated with the specified unpack context.
     // Returns false if the context is NULL, or if it points to an invalid context.
     // This function frees all memory associated with the context.
     CRN_EXPORT bool crnd_unpack_end(crnd_unpack_context pContext);
 
+    // Streaming transcode context handle.
+    typedef void* crnd_stream_context;
+
+    // crnd_stream_begin() - Creates a context that transcodes a .CRN file while it is still being received.
+    // Feed it the file in order with crnd_stream_add_data(). The file's tables and palettes are decoded as soon as their bytes are present,
+    // and each mipmap level can be transcoded as soon as all of its bytes are (see cCRNCompFlagSmallestLevelsFirst).
+    // Segmented files aren't supported. Returns NULL if out of memory.
+    CRN_EXPORT crnd_stream_context crnd_stream_begin();
+
+    // crnd_stream_add_data() - Appends the next data_size bytes of the file.
+    // pReady_levels - Optional, receives a bitmask of the mipmap levels that became complete with this data.
+    // Returns false if the data is invalid, goes past the end of the file, or if out of memory. The context is unusable after that.
+    // The first call with the complete header allocates a buffer for the whole file.
+    CRN_EXPORT bool crnd_stream_add_data(crnd_stream_context pContext, const void* pData, uint32 data_size, uint32* pReady_levels);
+
+    // crnd_stream_get_unpack_context() - Returns NULL until the header, tables and palettes have been received, then an unpack context
+    // for the file which may be passed to crnd_unpack_level() and friends for the levels that are complete.
+    // The unpack context and its data are owned by the stream context: don't call crnd_unpack_end() on it.
+    CRN_EXPORT crnd_unpack_context crnd_stream_get_unpack_context(crnd_stream_context pContext);
+
+    // crnd_stream_get_ready_levels() - Returns a bitmask of the mipmap levels whose data has been completely received.
+    CRN_EXPORT uint32 crnd_stream_get_ready_levels(crnd_stream_context pContext);
+
+    // crnd_stream_end() - Frees the stream context, its received data and its unpack context.
+    CRN_EXPORT bool crnd_stream_end(crnd_stream_context pContext);
+
     // The following API's allow the user to create "segmented" CRN files. A segmented file contains multiple pieces:
     // - Base data: Header + compression tables
     // - Level data: Individual mipmap levels
@@ -295,14 +352,26 @@ namespace crnd
     enum crn_header_flags
     {
         // If set, the compressed mipmap level data is not located after the file's base data - it will be separately managed by the user instead.
-        cCRNHeaderFlagSegmented = 1
+        cCRNHeaderFlagSegmented = 1,
+
+        // If set, each mipmap level starts with a crn_level_slices table and is split into independently decodable slices.
+        cCRNHeaderFlagSliced = 2,
+
+        // If set, the mipmap levels are stored from smallest to largest, so a file that is streamed in can show its low mips first.
+        cCRNHeaderFlagSmallestLevelsFirst = 4,
+
+        // Files with any of these flags use the cCRNSigValueExtended signature, so decoders that predate the flags reject them.
+        cCRNHeaderFlagsExtended = cCRNHeaderFlagSliced | cCRNHeaderFlagSmallestLevelsFirst,
+
+        cCRNHeaderFlagsKnown = cCRNHeaderFlagSegmented | cCRNHeaderFlagSliced | cCRNHeaderFlagSmallestLevelsFirst
     };
 
     struct crn_header
     {
         enum
         {
-            cCRNSigValue = ('H' << 8) | 'x'
+            cCRNSigValue = ('H' << 8) | 'x',
+            cCRNSigValueExtended = ('H' << 8) | 's'
         };
 
         crn_packed_uint<2> m_sig;
@@ -340,6 +409,18 @@ namespace crnd
 
     const unsigned int cCRNHeaderMinSize = 62U;
 
+    // Located at the start of each level's data in files with cCRNHeaderFlagSliced set.
+    // Each face of the level is split into slices of m_slice_height block rows (the last slice of a face may be shorter),
+    // ordered by face then by row. Every slice is a separate symbol stream that starts with reset predictor state.
+    struct crn_level_slices
+    {
+        crn_packed_uint<2> m_slice_height;
+        crn_packed_uint<2> m_num_slices;
+
+        // m_slice_ofs[] is actually an array of offsets from the start of the level's data: m_slice_ofs[m_num_slices]
+        crn_packed_uint<4> m_slice_ofs[1];
+    };
+
 #pragma pack(pop)
 } // namespace crnd
 
@@ -121,7 +121,8 @@ enum crn_limits
     cCRNMaxFaces = 6,
     cCRNMaxLevels = 16,
 
-    cCRNMaxHelperThreads = 15,
+    // Height in 4x4 blocks of the independently decodable level slices written when cCRNCompFlagSlicedLevels is set.
+    cCRNSliceHeight = 64,
 
     cCRNMinQualityLevel = 0,
     cCRNMaxQualityLevel = 255
@@ -177,6 +178,16 @@ enum crn_comp_flags
     // Default: Not set.
     cCRNCompFlagGrayscaleSampling = 256,
 
+    // If enabled, each mipmap level of a .CRN file is split into slices of cCRNSliceHeight block rows which can be transcoded in parallel
+    // by crnd_unpack_level_parallel(). Slightly increases the file size. Decoders built before this flag existed can't read these files.
+    // Default: Not set.
+    cCRNCompFlagSlicedLevels = 512,
+
+    // If enabled, the mipmap levels of a .CRN file are stored from smallest to largest, so a streaming transcoder (crnd_stream_begin())
+    // can show the low mips before the rest of the file arrives. Decoders built before this flag existed can't read these files.
+    // Default: Not set.
+    cCRNCompFlagSmallestLevelsFirst = 1024,
+
     // If enabled, debug information will be output during compression.
     // Default: Not set.
     cCRNCompFlagDebugging = 0x80000000,
@@ -227,6 +238,9 @@ enum crn_dxt_compressor_type
 // subphase_index, total_subphases - progress within current phase
 typedef crn_bool (*crn_progress_callback_func)(crn_uint32 phase_index, crn_uint32 total_phases, crn_uint32 subphase_index, crn_uint32 total_subphases, void* pUser_data_ptr);
 
+// Pool of helper threads created by crn_create_task_pool(), see below.
+typedef void* crn_task_pool_t;
+
 // CRN/DDS compression parameters struct.
 struct crn_comp_params
 {
@@ -274,6 +288,7 @@ struct crn_comp_params
         m_userdata1 = 0;
         m_pProgress_func = NULL;
         m_pProgress_func_data = NULL;
+        m_pTask_pool = NULL;
     }
 
     inline bool operator==(const crn_comp_params& rhs) const
@@ -309,6 +324,7 @@ struct crn_comp_params
         CRNLIB_COMP(m_userdata1);
         CRNLIB_COMP(m_pProgress_func);
         CRNLIB_COMP(m_pProgress_func_data);
+        CRNLIB_COMP(m_pTask_pool);
 
         for (crn_uint32 f = 0; f < cCRNMaxFaces; f++)
             for (crn_uint32 l = 0; l < cCRNMaxLevels; l++)
@@ -334,7 +350,6 @@ struct crn_comp_params
             ((m_crn_alpha_endpoint_palette_size) && ((m_crn_alpha_endpoint_palette_size < cCRNMinPaletteSize) || (m_crn_alpha_endpoint_palette_size > cCRNMaxPaletteSize))) ||
             ((m_crn_alpha_selector_palette_size) && ((m_crn_alpha_selector_palette_size < cCRNMinPaletteSize) || (m_crn_alpha_selector_palette_size > cCRNMaxPaletteSize))) ||
             (m_alpha_component > 3) ||
-            (m_num_helper_threads > cCRNMaxHelperThreads) ||
             (m_dxt_quality > cCRNDXTQualityUber) ||
             (m_dxt_compressor_type >= cCRNTotalDXTCompressors))
         {
@@ -402,6 +417,8 @@ struct crn_comp_params
     crn_uint32 m_crn_alpha_selector_palette_size; // [cCRNMinPaletteSize,cCRNMaxPaletteSize]
 
     // Number of helper threads to create during compression. 0=no threading.
+    // If crn_shared_pool_init() started a shared pool, its threads are used instead of creating new ones, unless this is 0.
+    // The work is split into m_num_helper_threads + 1 parts whichever pool runs it, and the CRN output depends on this split.
     crn_uint32 m_num_helper_threads;
 
     // CRN userdata0 and userdata1 members, which are written directly to the header of the output file.
@@ -411,6 +428,10 @@ struct crn_comp_params
     // User provided progress callback.
     crn_progress_callback_func m_pProgress_func;
     void* m_pProgress_func_data;
+
+    // Optional pool of helper threads to run the compression on, instead of creating threads or using the shared pool.
+    // The work is still split by m_num_helper_threads, so the output doesn't depend on the size of the pool.
+    crn_task_pool_t m_pTask_pool;
 };
 
 // Mipmap generator's mode.
@@ -502,6 +523,8 @@ struct crn_mipmap_params
         m_clamp_scale = false;
         m_clamp_width = 0;
         m_clamp_height = 0;
+
+        m_pyramid = false;
     }
 
     inline bool check() const
@@ -538,6 +561,7 @@ struct crn_mipmap_params
         CRNLIB_COMP(m_clamp_scale);
         CRNLIB_COMP(m_clamp_width);
         CRNLIB_COMP(m_clamp_height);
+        CRNLIB_COMP(m_pyramid);
         return true;
 #undef CRNLIB_COMP
     }
@@ -571,8 +595,26 @@ struct crn_mipmap_params
     crn_bool m_clamp_scale;
     crn_uint32 m_clamp_width;
     crn_uint32 m_clamp_height;
+
+    // Filter each mip level from the previous one instead of from the top level. This is much cheaper on large
+    // textures, but the small levels are slightly blurrier since the filter is applied repeatedly.
+    crn_bool m_pyramid;
 };
 
+// -------- Helper threads.
+
+// By default each compression call creates m_num_helper_threads threads and joins them before returning, and a CRN bitrate search
+// does so for every trial. crn_shared_pool_init() starts a process-wide pool of num_helper_threads threads that all later calls share instead,
+// until crn_shared_pool_shutdown() stops it. Neither function may be called while other crnlib calls are running.
+// Returns false if the threads couldn't be created, in which case there is no shared pool.
+CRN_EXPORT bool crn_shared_pool_init(crn_uint32 num_helper_threads);
+CRN_EXPORT void crn_shared_pool_shutdown();
+
+// Creates a pool of num_helper_threads threads for crn_comp_params::m_pTask_pool, or returns NULL on failure.
+// Any number of compression calls may run on the same pool concurrently. The pool must outlive them.
+CRN_EXPORT crn_task_pool_t crn_create_task_pool(crn_uint32 num_helper_threads);
+CRN_EXPORT void crn_free_task_pool(crn_task_pool_t pPool);
+
 // -------- High-level helper function definitions for CDN/DDS compression.
 
 #ifndef CRNLIB_MIN_ALLOC_ALIGNMENT
@@ -669,7 +711,7 @@ CRN_EXPORT const char* crn_get_dxt_quality_string(crn_dxt_quality q);
 typedef void* crn_block_compressor_context_t;
 
 // Create a DXTn block compressor.
-// This function only supports the basic/nonswizzled "fundamental" formats: DXT1, DXT3, DXT5, DXT5A, DXN_XY and DXN_YX.
+// This function only supports the basic/nonswizzled "fundamental" formats: DXT1, DXT3, DXT5, DXT5A, DXN_XY, DXN_YX, ETC1, ETC2 and ETC2A.
 // Avoid calling this multiple times if you intend on compressing many blocks, because it allocates some memory.
 CRN_EXPORT crn_block_compressor_context_t crn_create_block_compressor(const crn_comp_params& params);
 
@@ -678,6 +720,14 @@ CRN_EXPORT crn_block_compressor_context_t crn_create_block_compressor(const crn_
 // pPixels should be an array of 16 crn_uint32's. Each crn_uint32 must be r,g,b,a (r is always first) in memory.
 CRN_EXPORT void crn_compress_block(crn_block_compressor_context_t pContext, const crn_uint32* pPixels, void* pDst_block);
 
+// Compresses a width x height surface of crn_uint32 pixels (r,g,b,a in memory) to an array of blocks in raster order.
+// row_pitch is the number of bytes between the pixel rows, dst_row_pitch the number of bytes between the block rows in pDst_blocks,
+// or 0 if they are tightly packed. Partial blocks at the right and bottom edges repeat the last column and row of pixels.
+// The blocks are spread over the threads selected by the crn_comp_params the context was created with, as in crn_compress().
+// The output doesn't depend on the number of threads. A context must not be used by several threads at once.
+// Returns false if the arguments are invalid.
+CRN_EXPORT bool crn_compress_blocks(crn_block_compressor_context_t pContext, const crn_uint32* pPixels, crn_uint32 width, crn_uint32 height, crn_uint32 row_pitch, void* pDst_blocks, crn_uint32 dst_row_pitch = 0);
+
 // Frees a DXTn block compressor.
 CRN_EXPORT void crn_free_block_compressor(crn_block_compressor_context_t pContext);
 